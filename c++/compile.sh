@@ -11,11 +11,16 @@ srcFiles="src/base/bit_map.cpp                          \
           src/cpu/flag.cpp                              \
           src/memory/memcache.cpp                       \
           src/memory/mempool.cpp                        \
+          src/common/deferred_logging.cpp               \
           src/common/errorcode.cpp                      \
           src/string/string_util.cpp                    \
           src/string/dmg_fp/dtoa.cpp                    \
-          src/string/dmg_fp/g_fmt.cpp"
+          src/string/dmg_fp/g_fmt.cpp                   \
+          src/sync/lock_profiler.cpp                    \
+          src/sync/snapshot.cpp                         \
+          src/thread/thread_pool.cpp"
 testFiles="src/base/test/bit_map_test.cpp               \
+           src/base/test/btree_map_test.cpp             \
            src/base/test/crc32c_test.cpp                \
            src/base/test/env_test.cpp                   \
            src/base/test/exponential_backoff_test.cpp   \
@@ -24,8 +29,12 @@ testFiles="src/base/test/bit_map_test.cpp               \
            src/base/test/intrusive_rbtree_test.cpp      \
            src/base/test/intrusive_map_test.cpp         \
            src/base/test/intrusive_hash_map_test.cpp    \
+           src/base/test/mapped_slot_vector_test.cpp    \
            src/base/test/skiplist_test.cpp              \
+           src/base/test/slot_vector_test.cpp           \
            src/base/test/status_test.cpp                \
+           src/base/test/timer_test.cpp                 \
+           src/common/test/deferred_logging_test.cpp    \
            src/common/test/errorcode_test.cpp           \
            src/cpu/test/cpu_test.cpp                    \
            src/cpu/test/flag_test.cpp                   \
@@ -33,14 +42,27 @@ testFiles="src/base/test/bit_map_test.cpp               \
            src/memory/test/memcache_test.cpp            \
            src/memory/test/objcache_test.cpp            \
            src/string/test/string_util_test.cpp         \
+           src/sync/test/atomic_test.cpp                \
            src/sync/test/cond_test.cpp                  \
+           src/sync/test/count_down_latch_test.cpp      \
+           src/sync/test/distributed_rwlock_test.cpp    \
+           src/sync/test/fair_lock_test.cpp             \
+           src/sync/test/future_test.cpp                \
+           src/sync/test/lock_profiler_test.cpp         \
+           src/sync/test/lock_stripes_test.cpp          \
            src/sync/test/micro_lock_test.cpp            \
+           src/sync/test/mpsc_queue_test.cpp            \
            src/sync/test/posix_lock_test.cpp            \
+           src/sync/test/ring_buffer_test.cpp           \
+           src/sync/test/seq_lock_test.cpp              \
+           src/sync/test/snapshot_test.cpp              \
+           src/sync/test/worker_rounds_test.cpp         \
+           src/thread/test/thread_pool_test.cpp         \
            test/unittest/main.cpp"
 allFiles="$srcFiles $testFiles"
 
 libDir="$workingDir/thirdparty/lib"
-libs="$libDir/libgtest.so $libDir/libgmock.so $libDir/libtcmalloc.a -lpthread"
+libs="$libDir/libgtest.so $libDir/libgmock.so $libDir/libprotobuf.so $libDir/libtcmalloc.a -lpthread"
 
 outputDir="build/"
 target="$outputDir/unittest"
@@ -52,6 +74,9 @@ if [ $MODE ] && [ $MODE == "release" ]; then
 else
     parameters=$parameters" -D__DEBUG__ -g"
 fi
+if [ $LOCK_PROFILING ] && [ $LOCK_PROFILING == "1" ]; then
+    parameters=$parameters" -DENABLE_LOCK_PROFILING=1"
+fi
 
 g++ -o $target $allFiles $parameters
 
@@ -0,0 +1,756 @@
+#ifndef _SRC_BASE_BTREE_MAP_H
+#define _SRC_BASE_BTREE_MAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+
+namespace detail {
+
+/**
+ * Search in the sorted keys of a B+-tree node.  LowerBound() returns the
+ * number of keys less than 'key', and UpperBound() the number of keys not
+ * greater than 'key'.  Specialized with SSE for integer keys below.
+ */
+template <typename K, typename Comparator>
+struct BTreeNodeSearch
+{
+    static uint32_t LowerBound(const K* keys, uint32_t n, const K& key,
+                               const Comparator& comparator)
+    {
+        return std::lower_bound(keys, keys + n, key, comparator) - keys;
+    }
+
+    static uint32_t UpperBound(const K* keys, uint32_t n, const K& key,
+                               const Comparator& comparator)
+    {
+        return std::upper_bound(keys, keys + n, key, comparator) - keys;
+    }
+};
+
+#ifdef __SSE4_2__
+
+// Compare 128 bits of keys with 'key' at a time.  As keys are sorted, the
+// first chunk which is not all less (or not greater) ends the search.
+template <typename K, bool IS_SIGNED, bool IS_UPPER>
+struct BTreeSimdSearch
+{
+    enum { LANES = 16 / sizeof(K), FULL_MASK = (1 << LANES) - 1 };
+
+    static __m128i bias(__m128i v)
+    {
+        // Flip the sign bit, so that signed comparisons order unsigned keys.
+        if (IS_SIGNED) return v;
+        return sizeof(K) == 4 ?
+            _mm_xor_si128(v, _mm_set1_epi32(INT32_MIN)) :
+            _mm_xor_si128(v, _mm_set1_epi64x(INT64_MIN));
+    }
+
+    // Bits of lanes whose key is before the bound
+    static int match(__m128i keys, __m128i key)
+    {
+        __m128i greater = sizeof(K) == 4 ?
+            (IS_UPPER ? _mm_cmpgt_epi32(keys, key) : _mm_cmpgt_epi32(key, keys)) :
+            (IS_UPPER ? _mm_cmpgt_epi64(keys, key) : _mm_cmpgt_epi64(key, keys));
+        int mask = sizeof(K) == 4 ?
+            _mm_movemask_ps(_mm_castsi128_ps(greater)) :
+            _mm_movemask_pd(_mm_castsi128_pd(greater));
+        return IS_UPPER ? (~mask & FULL_MASK) : mask;
+    }
+
+    static uint32_t Search(const K* keys, uint32_t n, K key)
+    {
+        __m128i target = bias(sizeof(K) == 4 ?
+                              _mm_set1_epi32(static_cast<int32_t>(key)) :
+                              _mm_set1_epi64x(static_cast<int64_t>(key)));
+        uint32_t i = 0;
+        for (; i + LANES <= n; i += LANES)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+            int mask = match(bias(chunk), target);
+            if (mask != FULL_MASK)
+            {
+                return i + __builtin_popcount(mask);
+            }
+        }
+        for (; i < n; ++i)
+        {
+            if (IS_UPPER ? key < keys[i] : !(keys[i] < key))
+            {
+                break;
+            }
+        }
+        return i;
+    }
+};
+
+#define BTREE_SIMD_NODE_SEARCH(type, isSigned)                                  \
+    template <>                                                                 \
+    struct BTreeNodeSearch<type, std::less<type> >                              \
+    {                                                                           \
+        static uint32_t LowerBound(const type* keys, uint32_t n, type key,      \
+                                   const std::less<type>&)                      \
+        {                                                                       \
+            return BTreeSimdSearch<type, isSigned, false>::Search(keys, n, key); \
+        }                                                                       \
+        static uint32_t UpperBound(const type* keys, uint32_t n, type key,      \
+                                   const std::less<type>&)                      \
+        {                                                                       \
+            return BTreeSimdSearch<type, isSigned, true>::Search(keys, n, key); \
+        }                                                                       \
+    }
+
+BTREE_SIMD_NODE_SEARCH(int32_t, true);
+BTREE_SIMD_NODE_SEARCH(uint32_t, false);
+BTREE_SIMD_NODE_SEARCH(int64_t, true);
+BTREE_SIMD_NODE_SEARCH(uint64_t, false);
+
+#undef BTREE_SIMD_NODE_SEARCH
+
+#endif  // __SSE4_2__
+
+}  // namespace detail
+
+/**
+ * A B+-tree map.
+ *
+ * Unlike IntrusiveMap, which spends one node with three pointers per object,
+ * BTreeMap packs many keys into a node of NODE_SIZE bytes, a few cache lines,
+ * so a lookup only touches log(n)/log(slots) nodes.  The keys and values of
+ * a node are kept in separate arrays, the in-node search scans the keys only,
+ * with SSE for 32-bit and 64-bit integer keys ordered by std::less.  Values
+ * are stored in leaves, which are linked for range iteration.
+ *
+ * K and V must be default-constructible and assignable.  Any insertion or
+ * removal invalidates all iterators.  Iterators expose key() and value()
+ * rather than a std::pair, as keys and values are stored apart.
+ *
+ * Usage:
+ *   BTreeMap<uint64_t, Record*> map;
+ *   map.insert(key, record);
+ *   for (BTreeMap<uint64_t, Record*>::iterator iter = map.lower_bound(lo);
+ *        iter != map.end() && iter.key() < hi; ++iter)
+ *   {
+ *       Process(iter.value());
+ *   }
+ */
+template <typename K,
+          typename V,
+          typename Comparator = std::less<K>,
+          size_t NODE_SIZE = 512>
+class BTreeMap
+{
+    struct Node;
+    struct InnerNode;
+    struct LeafNode;
+
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef size_t size_type;
+
+    enum
+    {
+        NODE_HEADER_SIZE = 8 + 2 * sizeof(void*),
+        INNER_SLOTS = MAX(4, (NODE_SIZE - NODE_HEADER_SIZE - sizeof(void*)) /
+                             (sizeof(K) + sizeof(void*))),
+        LEAF_SLOTS = MAX(4, (NODE_SIZE - NODE_HEADER_SIZE) / (sizeof(K) + sizeof(V))),
+        MAX_DEPTH = 32,
+    };
+
+    /** Iterator<V> is the iterator, Iterator<const V> the const_iterator. */
+    template <typename Value>
+    class Iterator
+    {
+    public:
+        Iterator() : mMap(NULL), mLeaf(NULL), mIndex(0) {}
+
+        /** An iterator converts to a const_iterator, not the other way. */
+        Iterator(const Iterator<typename std::remove_const<Value>::type>& other)
+            : mMap(other.mMap), mLeaf(other.mLeaf), mIndex(other.mIndex)
+        {
+        }
+
+        const K& key() const { return mLeaf->keys[mIndex]; }
+        Value& value() const { return mLeaf->values[mIndex]; }
+
+        template <typename Other>
+        bool operator==(const Iterator<Other>& other) const
+        {
+            return mLeaf == other.mLeaf && mIndex == other.mIndex;
+        }
+
+        template <typename Other>
+        bool operator!=(const Iterator<Other>& other) const { return !(*this == other); }
+
+        Iterator& operator++()
+        {
+            if (++mIndex >= mLeaf->count)
+            {
+                mLeaf = mLeaf->next;
+                mIndex = 0;
+            }
+            return *this;
+        }
+
+        Iterator operator++(int)
+        {
+            Iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+
+        Iterator& operator--()
+        {
+            if (mLeaf == NULL)
+            {
+                mLeaf = mMap->mLastLeaf;
+                mIndex = mLeaf->count;
+            }
+            else if (mIndex == 0)
+            {
+                mLeaf = mLeaf->prev;
+                mIndex = mLeaf->count;
+            }
+            --mIndex;
+            return *this;
+        }
+
+        Iterator operator--(int)
+        {
+            Iterator ret = *this;
+            --*this;
+            return ret;
+        }
+
+    private:
+        friend class BTreeMap;
+        template <typename> friend class Iterator;
+
+        Iterator(const BTreeMap* map, LeafNode* leaf, uint32_t index)
+            : mMap(map), mLeaf(leaf), mIndex(index)
+        {
+            // Normalize a position past the end of a leaf.
+            if (mLeaf != NULL && mIndex >= mLeaf->count)
+            {
+                mLeaf = mLeaf->next;
+                mIndex = 0;
+            }
+        }
+
+        const BTreeMap* mMap;
+        LeafNode* mLeaf;
+        uint32_t mIndex;
+    };
+
+    typedef Iterator<V> iterator;
+    typedef Iterator<const V> const_iterator;
+
+    explicit BTreeMap(const Comparator& comparator = Comparator())
+        : mRoot(NULL),
+          mFirstLeaf(NULL),
+          mLastLeaf(NULL),
+          mSize(0),
+          mComparator(comparator)
+    {
+    }
+
+    ~BTreeMap() { clear(); }
+
+    iterator begin() { return iterator(this, mFirstLeaf, 0); }
+    const_iterator begin() const { return const_iterator(this, mFirstLeaf, 0); }
+    iterator end() { return iterator(this, NULL, 0); }
+    const_iterator end() const { return const_iterator(this, NULL, 0); }
+
+    size_type size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+
+    iterator lower_bound(const K& key) { return lowerBound(key); }
+    const_iterator lower_bound(const K& key) const { return lowerBound(key); }
+
+    iterator upper_bound(const K& key) { return upperBound(key); }
+    const_iterator upper_bound(const K& key) const { return upperBound(key); }
+
+    iterator find(const K& key) { return findKey(key); }
+    const_iterator find(const K& key) const { return findKey(key); }
+
+    size_type count(const K& key) const { return find(key) != end(); }
+
+    /**
+     * Insert (key, value), return the iterator to the element with the key,
+     * and false if the key already exists, in which case the map is not
+     * changed.
+     */
+    std::pair<iterator, bool> insert(const K& key, const V& value);
+
+    /** Return the value of 'key', inserting a default one if not found. */
+    V& operator[](const K& key)
+    {
+        return insert(key, V()).first.value();
+    }
+
+    /** Remove 'key', return the number of removed elements. */
+    size_type erase(const K& key);
+
+    /** Remove the element, return the iterator following it. */
+    iterator erase(iterator iter)
+    {
+        K key = iter.key();
+        erase(key);
+        return lower_bound(key);
+    }
+
+    void clear()
+    {
+        if (mRoot != NULL)
+        {
+            freeNode(mRoot);
+        }
+        mRoot = NULL;
+        mFirstLeaf = NULL;
+        mLastLeaf = NULL;
+        mSize = 0;
+    }
+
+    /** Check the invariants of the tree, for debugging. */
+    void validate() const
+    {
+        size_type size = 0;
+        LeafNode* leaf = mFirstLeaf;
+        if (mRoot != NULL)
+        {
+            int leafDepth = -1;
+            validateNode(mRoot, NULL, NULL, 0, &leafDepth, &leaf, &size);
+        }
+        ASSERT(leaf == NULL);
+        ASSERT(size == mSize);
+    }
+
+private:
+    typedef detail::BTreeNodeSearch<K, Comparator> Search;
+
+    struct Node
+    {
+        uint32_t count;     // Number of keys
+        bool isLeaf;
+
+        explicit Node(bool leaf) : count(0), isLeaf(leaf) {}
+    };
+
+    // children[i] holds keys in [keys[i - 1], keys[i])
+    struct InnerNode : public Node
+    {
+        InnerNode() : Node(false) {}
+
+        K keys[INNER_SLOTS];
+        Node* children[INNER_SLOTS + 1];
+    };
+
+    struct LeafNode : public Node
+    {
+        LeafNode() : Node(true), prev(NULL), next(NULL) {}
+
+        LeafNode* prev;
+        LeafNode* next;
+        K keys[LEAF_SLOTS];
+        V values[LEAF_SLOTS];
+    };
+
+    // Position in an inner node along the path from the root.
+    struct PathEntry
+    {
+        InnerNode* node;
+        uint32_t index;     // Index of the child taken
+    };
+
+    static InnerNode* asInner(Node* node)
+    {
+        ASSERT_DEBUG(!node->isLeaf);
+        return static_cast<InnerNode*>(node);
+    }
+
+    static LeafNode* asLeaf(Node* node)
+    {
+        ASSERT_DEBUG(node->isLeaf);
+        return static_cast<LeafNode*>(node);
+    }
+
+    LeafNode* findLeaf(const K& key) const
+    {
+        Node* node = mRoot;
+        if (node == NULL) return NULL;
+        while (!node->isLeaf)
+        {
+            InnerNode* inner = asInner(node);
+            node = inner->children[Search::UpperBound(inner->keys, inner->count, key, mComparator)];
+        }
+        return asLeaf(node);
+    }
+
+    // The const and non-const lookups share these.
+    iterator lowerBound(const K& key) const
+    {
+        LeafNode* leaf = findLeaf(key);
+        if (leaf == NULL) return iterator(this, NULL, 0);
+        return iterator(this, leaf, Search::LowerBound(leaf->keys, leaf->count, key, mComparator));
+    }
+
+    iterator upperBound(const K& key) const
+    {
+        LeafNode* leaf = findLeaf(key);
+        if (leaf == NULL) return iterator(this, NULL, 0);
+        return iterator(this, leaf, Search::UpperBound(leaf->keys, leaf->count, key, mComparator));
+    }
+
+    iterator findKey(const K& key) const
+    {
+        iterator iter = lowerBound(key);
+        if (iter.mLeaf != NULL && !mComparator(key, iter.key()))
+        {
+            return iter;
+        }
+        return iterator(this, NULL, 0);
+    }
+
+    // Descend to the leaf of 'key', recording the path.
+    LeafNode* findLeaf(const K& key, PathEntry* path, uint32_t* depth) const
+    {
+        Node* node = mRoot;
+        *depth = 0;
+        while (!node->isLeaf)
+        {
+            InnerNode* inner = asInner(node);
+            uint32_t index = Search::UpperBound(inner->keys, inner->count, key, mComparator);
+            ASSERT(*depth < MAX_DEPTH);
+            path[*depth].node = inner;
+            path[*depth].index = index;
+            ++*depth;
+            node = inner->children[index];
+        }
+        return asLeaf(node);
+    }
+
+    // Insert (key, right) into 'inner' at 'index', splitting the node upwards
+    // along the path if it's full.
+    void insertInner(PathEntry* path, uint32_t depth, K key, Node* right);
+
+    // Fix the underflow of the node at 'depth' of the path, i.e. the child
+    // path[depth - 1].node->children[path[depth - 1].index].
+    void rebalance(PathEntry* path, uint32_t depth, Node* node);
+
+    void freeNode(Node* node)
+    {
+        if (node->isLeaf)
+        {
+            delete asLeaf(node);
+            return;
+        }
+        InnerNode* inner = asInner(node);
+        for (uint32_t i = 0; i <= inner->count; ++i)
+        {
+            freeNode(inner->children[i]);
+        }
+        delete inner;
+    }
+
+    void validateNode(Node* node, const K* lo, const K* hi, int depth,
+                      int* leafDepth, LeafNode** leaf, size_type* size) const
+    {
+        ASSERT(node == mRoot || node->count >= minKeys(node));
+        const K* keys = node->isLeaf ? asLeaf(node)->keys : asInner(node)->keys;
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            ASSERT(i == 0 || mComparator(keys[i - 1], keys[i]));
+            ASSERT(lo == NULL || !mComparator(keys[i], *lo));
+            ASSERT(hi == NULL || mComparator(keys[i], *hi));
+        }
+        if (node->isLeaf)
+        {
+            if (*leafDepth < 0) *leafDepth = depth;
+            ASSERT(*leafDepth == depth);
+            ASSERT(*leaf == node);
+            *leaf = (*leaf)->next;
+            *size += node->count;
+            return;
+        }
+        InnerNode* inner = asInner(node);
+        for (uint32_t i = 0; i <= inner->count; ++i)
+        {
+            validateNode(inner->children[i],
+                         i == 0 ? lo : &keys[i - 1],
+                         i == inner->count ? hi : &keys[i],
+                         depth + 1, leafDepth, leaf, size);
+        }
+    }
+
+    // Splitting a full inner node pushes one key up, leaving at least
+    // (INNER_SLOTS - 1) / 2 keys on both sides.
+    static uint32_t minKeys(const Node* node)
+    {
+        return node->isLeaf ? LEAF_SLOTS / 2 : (INNER_SLOTS - 1) / 2;
+    }
+
+    Node* mRoot;
+    LeafNode* mFirstLeaf;
+    LeafNode* mLastLeaf;
+    size_type mSize;
+    Comparator mComparator;
+
+    DISALLOW_COPY_AND_ASSIGN(BTreeMap);
+};
+
+template <typename K, typename V, typename Comparator, size_t NODE_SIZE>
+std::pair<typename BTreeMap<K, V, Comparator, NODE_SIZE>::iterator, bool>
+BTreeMap<K, V, Comparator, NODE_SIZE>::insert(const K& key, const V& value)
+{
+    if (UNLIKELY(mRoot == NULL))
+    {
+        LeafNode* leaf = new LeafNode;
+        mRoot = mFirstLeaf = mLastLeaf = leaf;
+    }
+    PathEntry path[MAX_DEPTH];
+    uint32_t depth = 0;
+    LeafNode* leaf = findLeaf(key, path, &depth);
+    uint32_t pos = Search::LowerBound(leaf->keys, leaf->count, key, mComparator);
+    if (pos < leaf->count && !mComparator(key, leaf->keys[pos]))
+    {
+        return std::make_pair(iterator(this, leaf, pos), false);
+    }
+
+    if (leaf->count == LEAF_SLOTS)
+    {
+        // Split the leaf, the upper half goes to a new right sibling.
+        LeafNode* right = new LeafNode;
+        uint32_t half = LEAF_SLOTS / 2;
+        std::copy(leaf->keys + half, leaf->keys + LEAF_SLOTS, right->keys);
+        std::copy(leaf->values + half, leaf->values + LEAF_SLOTS, right->values);
+        right->count = LEAF_SLOTS - half;
+        leaf->count = half;
+        right->next = leaf->next;
+        right->prev = leaf;
+        if (leaf->next != NULL)
+        {
+            leaf->next->prev = right;
+        }
+        else
+        {
+            mLastLeaf = right;
+        }
+        leaf->next = right;
+        insertInner(path, depth, right->keys[0], right);
+        if (pos > half)
+        {
+            leaf = right;
+            pos -= half;
+        }
+    }
+
+    std::copy_backward(leaf->keys + pos, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+    std::copy_backward(leaf->values + pos, leaf->values + leaf->count,
+                       leaf->values + leaf->count + 1);
+    leaf->keys[pos] = key;
+    leaf->values[pos] = value;
+    ++leaf->count;
+    ++mSize;
+    return std::make_pair(iterator(this, leaf, pos), true);
+}
+
+template <typename K, typename V, typename Comparator, size_t NODE_SIZE>
+void BTreeMap<K, V, Comparator, NODE_SIZE>::insertInner(
+        PathEntry* path, uint32_t depth, K key, Node* right)
+{
+    if (depth == 0)
+    {
+        // The root was split, grow the tree by one level.
+        InnerNode* root = new InnerNode;
+        root->keys[0] = key;
+        root->children[0] = mRoot;
+        root->children[1] = right;
+        root->count = 1;
+        mRoot = root;
+        return;
+    }
+    InnerNode* inner = path[depth - 1].node;
+    uint32_t index = path[depth - 1].index;
+    if (inner->count == INNER_SLOTS)
+    {
+        // Split the node and push up the middle key.
+        InnerNode* sibling = new InnerNode;
+        uint32_t mid = INNER_SLOTS / 2;
+        K midKey = inner->keys[mid];
+        std::copy(inner->keys + mid + 1, inner->keys + INNER_SLOTS, sibling->keys);
+        std::copy(inner->children + mid + 1, inner->children + INNER_SLOTS + 1,
+                  sibling->children);
+        sibling->count = INNER_SLOTS - mid - 1;
+        inner->count = mid;
+        insertInner(path, depth - 1, midKey, sibling);
+        if (index > mid)
+        {
+            inner = sibling;
+            index -= mid + 1;
+        }
+    }
+    std::copy_backward(inner->keys + index, inner->keys + inner->count,
+                       inner->keys + inner->count + 1);
+    std::copy_backward(inner->children + index + 1, inner->children + inner->count + 1,
+                       inner->children + inner->count + 2);
+    inner->keys[index] = key;
+    inner->children[index + 1] = right;
+    ++inner->count;
+}
+
+template <typename K, typename V, typename Comparator, size_t NODE_SIZE>
+typename BTreeMap<K, V, Comparator, NODE_SIZE>::size_type
+BTreeMap<K, V, Comparator, NODE_SIZE>::erase(const K& key)
+{
+    if (mRoot == NULL) return 0;
+    PathEntry path[MAX_DEPTH];
+    uint32_t depth = 0;
+    LeafNode* leaf = findLeaf(key, path, &depth);
+    uint32_t pos = Search::LowerBound(leaf->keys, leaf->count, key, mComparator);
+    if (pos == leaf->count || mComparator(key, leaf->keys[pos]))
+    {
+        return 0;
+    }
+    std::copy(leaf->keys + pos + 1, leaf->keys + leaf->count, leaf->keys + pos);
+    std::copy(leaf->values + pos + 1, leaf->values + leaf->count, leaf->values + pos);
+    --leaf->count;
+    --mSize;
+    // Separators equal to the key are left in inner nodes, they are still
+    // valid bounds.
+    rebalance(path, depth, leaf);
+    return 1;
+}
+
+template <typename K, typename V, typename Comparator, size_t NODE_SIZE>
+void BTreeMap<K, V, Comparator, NODE_SIZE>::rebalance(
+        PathEntry* path, uint32_t depth, Node* node)
+{
+    if (depth == 0)
+    {
+        // Shrink the root when it runs out of keys.
+        if (node->count > 0) return;
+        if (node->isLeaf)
+        {
+            delete asLeaf(node);
+            mRoot = mFirstLeaf = mLastLeaf = NULL;
+        }
+        else
+        {
+            mRoot = asInner(node)->children[0];
+            delete asInner(node);
+        }
+        return;
+    }
+    if (node->count >= minKeys(node)) return;
+
+    InnerNode* parent = path[depth - 1].node;
+    uint32_t index = path[depth - 1].index;
+    // Always work on a pair of adjacent children: left + right.
+    uint32_t sep = index > 0 ? index - 1 : index;
+    Node* left = parent->children[sep];
+    Node* right = parent->children[sep + 1];
+    Node* sibling = (left == node) ? right : left;
+
+    if (sibling->count > minKeys(sibling))
+    {
+        // Borrow one element from the sibling through the parent.
+        if (node->isLeaf)
+        {
+            LeafNode* l = asLeaf(left);
+            LeafNode* r = asLeaf(right);
+            if (sibling == left)
+            {
+                std::copy_backward(r->keys, r->keys + r->count, r->keys + r->count + 1);
+                std::copy_backward(r->values, r->values + r->count, r->values + r->count + 1);
+                r->keys[0] = l->keys[l->count - 1];
+                r->values[0] = l->values[l->count - 1];
+                --l->count;
+                ++r->count;
+            }
+            else
+            {
+                l->keys[l->count] = r->keys[0];
+                l->values[l->count] = r->values[0];
+                ++l->count;
+                std::copy(r->keys + 1, r->keys + r->count, r->keys);
+                std::copy(r->values + 1, r->values + r->count, r->values);
+                --r->count;
+            }
+            parent->keys[sep] = r->keys[0];
+        }
+        else
+        {
+            InnerNode* l = asInner(left);
+            InnerNode* r = asInner(right);
+            if (sibling == left)
+            {
+                std::copy_backward(r->keys, r->keys + r->count, r->keys + r->count + 1);
+                std::copy_backward(r->children, r->children + r->count + 1,
+                                   r->children + r->count + 2);
+                r->keys[0] = parent->keys[sep];
+                r->children[0] = l->children[l->count];
+                parent->keys[sep] = l->keys[l->count - 1];
+                --l->count;
+                ++r->count;
+            }
+            else
+            {
+                l->keys[l->count] = parent->keys[sep];
+                l->children[l->count + 1] = r->children[0];
+                ++l->count;
+                parent->keys[sep] = r->keys[0];
+                std::copy(r->keys + 1, r->keys + r->count, r->keys);
+                std::copy(r->children + 1, r->children + r->count + 1, r->children);
+                --r->count;
+            }
+        }
+        return;
+    }
+
+    // Merge the right node into the left one.
+    if (node->isLeaf)
+    {
+        LeafNode* l = asLeaf(left);
+        LeafNode* r = asLeaf(right);
+        std::copy(r->keys, r->keys + r->count, l->keys + l->count);
+        std::copy(r->values, r->values + r->count, l->values + l->count);
+        l->count += r->count;
+        l->next = r->next;
+        if (r->next != NULL)
+        {
+            r->next->prev = l;
+        }
+        else
+        {
+            mLastLeaf = l;
+        }
+        delete r;
+    }
+    else
+    {
+        InnerNode* l = asInner(left);
+        InnerNode* r = asInner(right);
+        l->keys[l->count] = parent->keys[sep];
+        std::copy(r->keys, r->keys + r->count, l->keys + l->count + 1);
+        std::copy(r->children, r->children + r->count + 1, l->children + l->count + 1);
+        l->count += r->count + 1;
+        delete r;
+    }
+    std::copy(parent->keys + sep + 1, parent->keys + parent->count, parent->keys + sep);
+    std::copy(parent->children + sep + 2, parent->children + parent->count + 1,
+              parent->children + sep + 1);
+    --parent->count;
+    rebalance(path, depth - 1, parent);
+}
+
+#endif  // _SRC_BASE_BTREE_MAP_H
@@ -16,7 +16,8 @@ public:
     bool IsSingle() const { return mIndex == INVALID_INDEX; }
 
 private:
-    template <typename T, HeapNode T::*M, typename Comparator>
+    template <typename T, HeapNode T::*M, typename Comparator,
+              size_t ARITY, typename KeyOf>
     friend class IntrusiveHeap;
 
     size_t mIndex;
@@ -25,6 +26,52 @@ private:
     DISALLOW_COPY_AND_ASSIGN(HeapNode);
 };
 
+/**
+ * A KeyOf functor for IntrusiveHeap which caches the member P of T.
+ */
+template <typename T, typename K, K T::*P>
+struct HeapMemberKey
+{
+    typedef K KeyType;
+    const K& operator()(const T& obj) const { return obj.*P; }
+};
+
+namespace detail {
+
+/**
+ * The element stored in the array of IntrusiveHeap.  With a KeyOf functor,
+ * the key is copied next to the node, so comparisons during sifting only
+ * touch the array.
+ */
+template <typename T, HeapNode T::*M, typename KeyOf>
+struct HeapElement
+{
+    typedef typename KeyOf::KeyType KeyType;
+
+    HeapElement(): key(), node(NULL) {}
+    explicit HeapElement(T* obj): key(KeyOf()(*obj)), node(&(obj->*M)) {}
+
+    const KeyType& Key() const { return key; }
+
+    KeyType key;
+    HeapNode* node;
+};
+
+template <typename T, HeapNode T::*M>
+struct HeapElement<T, M, void>
+{
+    typedef T KeyType;
+
+    HeapElement(): node(NULL) {}
+    explicit HeapElement(T* obj): node(&(obj->*M)) {}
+
+    const KeyType& Key() const { return *MemberToObject(node, M); }
+
+    HeapNode* node;
+};
+
+}  // namespace detail
+
 /**
  * A intrusive-style heap
  *
@@ -36,9 +83,22 @@ private:
  * NOTE: Recommend to reserve enough space once heap is created to avoid
  *       frequent memory allocation at runtime.
  *
+ * Large heaps spend most of the time on cache misses when sifting.  Two
+ * knobs help here:
+ * 1. ARITY: a 4-ary or 8-ary heap is less deep, and the children of a
+ *    node are adjacent in the array.
+ * 2. KeyOf: a functor with 'KeyType' typedef, which extracts the sort key
+ *    of an object.  The key is then cached in the array beside the node,
+ *    so sifting never dereferences the objects.  Comparator compares keys
+ *    instead of objects in this case.  After changing the key of an
+ *    object in the heap, call update() to re-cache the key and sift the
+ *    object to its new place.
+ *
  * @param T           type of object
  * @param M           member pointer to HeapNode
- * @param Comparator  a functor to determine order of object
+ * @param Comparator  a functor to determine order of object (or key)
+ * @param ARITY       number of children per node
+ * @param KeyOf       functor to extract the cached key, or void
  *
  * Usage:
  *   struct Record
@@ -56,13 +116,22 @@ private:
  *   Record a(1);
  *   heap.push(&a);
  *   const Record& element = heap.top();
+ *
+ *   typedef IntrusiveHeap<
+ *       Record,
+ *       &Record::node,
+ *       std::greater<uint64_t>,
+ *       4,
+ *       HeapMemberKey<Record, uint64_t, &Record::value> > TimerHeap;
  */
 template <typename T,
           HeapNode T::*M,
-          typename Comparator = std::less<T> >
+          typename Comparator = std::less<T>,
+          size_t ARITY = 2,
+          typename KeyOf = void>
 class IntrusiveHeap
 {
-    typedef HeapNode* element_type;
+    typedef detail::HeapElement<T, M, KeyOf> element_type;
 public:
     /**
      * Construct an empty heap whose initial capacity is zero.
@@ -80,9 +149,26 @@ public:
     /** Insert one obj and place it in order. */
     void push(T* obj);
 
+    /**
+     * Insert objects in the range [first, last).  When the heap at least
+     * doubles, the whole heap is rebuilt in O(n) instead of pushing one
+     * by one.
+     */
+    template <typename InputIt>
+    void push(InputIt first, InputIt last);
+
     /** Remove one obj and re-adjust heap. */
     void erase(T* obj);
 
+    /**
+     * Re-adjust obj after its order has changed, cheaper than erase() and
+     * push().  With a cached key, the key is re-read from obj.
+     */
+    void update(T* obj);
+
+    /** Move all objects of 'other' into this heap. */
+    void merge(IntrusiveHeap* other);
+
     /** Get top object with max/min value. */
     T* top() { return mCount == 0 ? NULL : &getObj(0); }
 
@@ -105,25 +191,35 @@ public:
     {
         for (size_t i = 0; i < mCount; ++i)
         {
-            mArray[i]->mIndex = HeapNode::INVALID_INDEX;
-            mArray[i] = NULL;
+            mArray[i].node->mIndex = HeapNode::INVALID_INDEX;
+            mArray[i] = element_type();
         }
         mCount = 0;
     }
 
 private:
-    void setObj(size_t index, T* obj)
+    void setElement(size_t index, const element_type& element)
+    {
+        mArray[index] = element;
+        element.node->mIndex = index;
+    }
+
+    // Make room for 'count' more objects.
+    void grow(size_t count)
     {
-        HeapNode* node = &(obj->*M);
-        ASSERT_DEBUG(node->IsSingle());
-        mArray[index] = node;
-        mArray[index]->mIndex = index;
+        if (UNLIKELY(mCount + count > mArray.capacity()))
+        {
+            // Initialize 4K memory (512 * sizeof(HeapNode*))) on first push
+            size_t oldCapacity = mArray.capacity();
+            size_t newCapacity = oldCapacity == 0 ? 512 : oldCapacity * 2;
+            expand(newCapacity > mCount + count ? newCapacity : mCount + count);
+        }
     }
 
     T& getObj(size_t index) const
     {
         ASSERT_DEBUG(index < mCount);
-        return *MemberToObject(mArray[index], M);
+        return *MemberToObject(mArray[index].node, M);
     }
 
     size_t getIndex(const T& obj) const
@@ -133,43 +229,71 @@ private:
         return index;
     }
 
-    bool compare(size_t l, size_t r) const
-    {
-        return mComparator(getObj(l), getObj(r));
-    }
-
-    void swap(size_t l, size_t r)
+    bool compare(const element_type& l, const element_type& r) const
     {
-        HeapNode* a = mArray[l];
-        HeapNode* b = mArray[r];
-        mArray[r] = a;
-        mArray[l] = b;
-        a->mIndex = r;
-        b->mIndex = l;
+        return mComparator(l.Key(), r.Key());
     }
 
+    // Both shifts move a hole instead of swapping, so every level
+    // costs one write to the array.
     void shiftUp(size_t k)
     {
-        size_t p = parent(k);
-        while (k > 0 && compare(p, k))
+        element_type element = mArray[k];
+        while (k > 0)
         {
-            swap(p, k);
+            size_t p = parent(k);
+            if (!compare(mArray[p], element)) break;
+            setElement(k, mArray[p]);
             k = p;
-            p = parent(k);
         }
+        setElement(k, element);
     }
 
     void shiftDown(size_t k)
     {
-        while (left(k) < mCount)
+        element_type element = mArray[k];
+        while (true)
         {
-            size_t l = left(k);
-            size_t r = right(k);
-            size_t m = (r < mCount && compare(l, r)) ? r : l;
-            if (compare(m, k)) return;
-            swap(m, k);
+            size_t first = firstChild(k);
+            if (first >= mCount) break;
+            size_t last = first + ARITY < mCount ? first + ARITY : mCount;
+            size_t m = first;
+            for (size_t c = first + 1; c < last; ++c)
+            {
+                if (compare(mArray[m], mArray[c])) m = c;
+            }
+            if (!compare(element, mArray[m])) break;
+            setElement(k, mArray[m]);
             k = m;
         }
+        setElement(k, element);
+    }
+
+    // The object at 'index' was changed or replaced, move it up or down.
+    void adjust(size_t index)
+    {
+        if (index > 0 && compare(mArray[parent(index)], mArray[index]))
+        {
+            shiftUp(index);
+        }
+        else
+        {
+            shiftDown(index);
+        }
+    }
+
+    // Restore the heap after appending objects from 'oldCount'.  Floyd's
+    // heapify is O(n), while shifting up costs O(log(n)) per object.
+    void rebuild(size_t oldCount)
+    {
+        if (mCount - oldCount >= oldCount)
+        {
+            buildHeap();
+        }
+        else
+        {
+            for (size_t i = oldCount; i < mCount; ++i) { shiftUp(i); }
+        }
     }
 
     void expand(size_t newCapacity)
@@ -178,20 +302,20 @@ private:
         // will not move elements once reallocate memory
         if (newCapacity > mArray.capacity())
         {
-            mArray.resize(newCapacity, NULL);
+            mArray.resize(newCapacity, element_type());
             ASSERT_DEBUG(mArray.capacity() == newCapacity);
         }
     }
 
     void buildHeap()
     {
-        int64_t index = static_cast<int64_t>(mCount / 2);
-        while (--index >= 0) { shiftDown(index); }
+        if (mCount < 2) return;
+        int64_t index = static_cast<int64_t>(parent(mCount - 1));
+        for (; index >= 0; --index) { shiftDown(index); }
     }
 
-    static size_t left(size_t i) { return 2 * i + 1; }
-    static size_t right(size_t i) { return 2 * i + 2; }
-    static size_t parent(size_t i) { return (i - 1) / 2; }
+    static size_t firstChild(size_t i) { return ARITY * i + 1; }
+    static size_t parent(size_t i) { return (i - 1) / ARITY; }
 
     std::vector<element_type> mArray;
     size_t mCount;
@@ -202,71 +326,125 @@ private:
 
 template <typename T,
           HeapNode T::*M,
-          typename Comparator>
-IntrusiveHeap<T, M, Comparator>::
+          typename Comparator,
+          size_t ARITY,
+          typename KeyOf>
+IntrusiveHeap<T, M, Comparator, ARITY, KeyOf>::
 IntrusiveHeap(const Comparator& comparator)
     : mCount(0),
       mComparator(comparator)
 {
+    STATIC_ASSERT(ARITY >= 2);
 }
 
 template <typename T,
           HeapNode T::*M,
-          typename Comparator>
+          typename Comparator,
+          size_t ARITY,
+          typename KeyOf>
 template <typename InputIt>
-IntrusiveHeap<T, M, Comparator>::
+IntrusiveHeap<T, M, Comparator, ARITY, KeyOf>::
 IntrusiveHeap(InputIt first, InputIt last, const Comparator& comparator)
     : mCount(0),
       mComparator(comparator)
 {
+    STATIC_ASSERT(ARITY >= 2);
     size_t capacity = 0;
     for (InputIt iter = first; iter != last; ++iter)
     {
         ++capacity;
     }
     expand(capacity);
-
-    for (InputIt iter = first; iter != last; ++iter)
-    {
-        mArray[mCount++] = &((*iter).*M);
-    }
-    buildHeap();
+    push(first, last);
 }
 
 template <typename T,
           HeapNode T::*M,
-          typename Comparator>
-inline void IntrusiveHeap<T, M, Comparator>::
+          typename Comparator,
+          size_t ARITY,
+          typename KeyOf>
+inline void IntrusiveHeap<T, M, Comparator, ARITY, KeyOf>::
     push(T* obj)
 {
-    if (UNLIKELY(mCount >= mArray.capacity()))
+    grow(1);
+    ASSERT_DEBUG((obj->*M).IsSingle());
+    setElement(mCount, element_type(obj));
+    shiftUp(mCount++);
+}
+
+template <typename T,
+          HeapNode T::*M,
+          typename Comparator,
+          size_t ARITY,
+          typename KeyOf>
+template <typename InputIt>
+void IntrusiveHeap<T, M, Comparator, ARITY, KeyOf>::
+    push(InputIt first, InputIt last)
+{
+    size_t oldCount = mCount;
+    for (InputIt iter = first; iter != last; ++iter)
     {
-        // Initialize 4K memory (512 * sizeof(HeapNode*))) on first push
-        ASSERT_DEBUG(mCount == mArray.capacity());
-        size_t oldCapacity = mArray.capacity();
-        size_t newCapacity = oldCapacity == 0 ? 512 : oldCapacity * 2;
-        expand(newCapacity);
+        grow(1);
+        ASSERT_DEBUG(((*iter).*M).IsSingle());
+        setElement(mCount++, element_type(&(*iter)));
     }
-    setObj(mCount, obj);
-    shiftUp(mCount++);
+    rebuild(oldCount);
 }
 
 template <typename T,
           HeapNode T::*M,
-          typename Comparator>
-inline void IntrusiveHeap<T, M, Comparator>::
+          typename Comparator,
+          size_t ARITY,
+          typename KeyOf>
+inline void IntrusiveHeap<T, M, Comparator, ARITY, KeyOf>::
     erase(T* obj)
 {
     HeapNode* node = &(obj->*M);
     size_t index = node->mIndex;
     ASSERT_DEBUG(index != HeapNode::INVALID_INDEX);
     ASSERT_DEBUG(mCount > index);
-    swap(index, mCount - 1);    // Avoid judging the last object
-    shiftUp(index);
     --mCount;
-    mArray[mCount] = NULL;
+    if (index != mCount)
+    {
+        // Fill the hole with the last object, which might go either way
+        setElement(index, mArray[mCount]);
+        adjust(index);
+    }
+    mArray[mCount] = element_type();
     node->mIndex = HeapNode::INVALID_INDEX;
-    shiftDown(index);
+}
+
+template <typename T,
+          HeapNode T::*M,
+          typename Comparator,
+          size_t ARITY,
+          typename KeyOf>
+inline void IntrusiveHeap<T, M, Comparator, ARITY, KeyOf>::
+    update(T* obj)
+{
+    size_t index = getIndex(*obj);
+    mArray[index] = element_type(obj);
+    adjust(index);
+}
+
+template <typename T,
+          HeapNode T::*M,
+          typename Comparator,
+          size_t ARITY,
+          typename KeyOf>
+void IntrusiveHeap<T, M, Comparator, ARITY, KeyOf>::
+    merge(IntrusiveHeap* other)
+{
+    ASSERT_DEBUG(other != this);
+    size_t oldCount = mCount;
+    grow(other->mCount);
+    for (size_t i = 0; i < other->mCount; ++i)
+    {
+        setElement(mCount++, other->mArray[i]);
+        other->mArray[i] = element_type();
+    }
+    other->mCount = 0;
+    rebuild(oldCount);
 }
 
 #endif // _SRC_BASE_INTRUSIVE_HEAP_H
@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <utility>
+#include <vector>
 
 #include "src/base/intrusive_rbtree.h"
 #include "src/common/macros.h"
@@ -86,6 +87,28 @@ public:
     }
     iterator erase(const iterator& iter) { return mTree.erase(iter); }
     void erase(pointer v) { mTree.erase(v); }
+    size_type erase_range(const key_type& lo, const key_type& hi,
+                          std::vector<pointer>* removed = NULL)
+    {
+        return mTree.erase_range(lo, hi, removed);
+    }
+
+    // Bulk routines, see IntrusiveRBTree
+    template <typename InputIt>
+    size_type insert_sorted(InputIt first, InputIt last, std::vector<pointer>* duplicates = NULL)
+    {
+        return mTree.insert_sorted_unique(first, last, duplicates);
+    }
+    size_type merge(IntrusiveMap* other, std::vector<pointer>* duplicates = NULL)
+    {
+        return mTree.merge_unique(&other->mTree, duplicates);
+    }
+    size_type difference(const IntrusiveMap& other, std::vector<pointer>* removed = NULL)
+    {
+        return mTree.difference(other.mTree, removed);
+    }
+    void split(const key_type& key, IntrusiveMap* right) { mTree.split(key, &right->mTree); }
+    void join(IntrusiveMap* right) { mTree.join(&right->mTree); }
 
     // Size routines
     size_type size() const { return mTree.size(); }
@@ -153,6 +176,25 @@ public:
     size_type erase(const key_type& key) { return mTree.erase(key); }
     iterator erase(const iterator& iter) { return mTree.erase(iter); }
     void erase(pointer v) { mTree.erase(v); }
+    size_type erase_range(const key_type& lo, const key_type& hi,
+                          std::vector<pointer>* removed = NULL)
+    {
+        return mTree.erase_range(lo, hi, removed);
+    }
+
+    // Bulk routines, see IntrusiveRBTree
+    template <typename InputIt>
+    size_type insert_sorted(InputIt first, InputIt last)
+    {
+        return mTree.insert_sorted_multi(first, last);
+    }
+    size_type merge(IntrusiveMultiMap* other) { return mTree.merge_multi(&other->mTree); }
+    size_type difference(const IntrusiveMultiMap& other, std::vector<pointer>* removed = NULL)
+    {
+        return mTree.difference(other.mTree, removed);
+    }
+    void split(const key_type& key, IntrusiveMultiMap* right) { mTree.split(key, &right->mTree); }
+    void join(IntrusiveMultiMap* right) { mTree.join(&right->mTree); }
 
     // Size routines
     size_type size() const { return mTree.size(); }
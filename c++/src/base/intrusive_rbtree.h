@@ -2,12 +2,14 @@
 #define _SRC_BASE_INTRUSIVE_RBTREE_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <algorithm>
 #include <functional>
 #include <iostream>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "src/common/assert.h"
 #include "src/common/common.h"
@@ -20,13 +22,15 @@ struct IntrusiveRBTreeNode
     IntrusiveRBTreeNode* right;
     bool isRed; // Is a red node.
     bool isL; // Is left child of parent.  Always true for root.
+    uint32_t count; // Size of the subtree, only maintained by order statistic trees.
 
     IntrusiveRBTreeNode()
         : parent(NULL),
           left(NULL),
           right(NULL),
           isRed(false),
-          isL(false)
+          isL(false),
+          count(0)
     {
     }
 
@@ -36,12 +40,29 @@ struct IntrusiveRBTreeNode
     }
 };
 
+/**
+ * An intrusive red-black tree.
+ *
+ * With OrderStatistic enabled, every node keeps the size of its subtree,
+ * which is maintained during insertion, removal and rotations.  Then
+ * select(), rank() and count_range() run in O(log(n)).  The size is stored
+ * in the padding of IntrusiveRBTreeNode, so it costs no memory, but limits
+ * the tree to 2^32 - 1 objects.
+ *
+ * Bulk operations are built on split() and join(), which cut a tree by a key
+ * and concatenate two trees in O(log(n)).  insert_sorted_*(), merge_*() and
+ * difference() take O(m * log(n / m + 1)) for m objects instead of m separate
+ * descents and rebalances, erase_range() takes O(log(n)) plus the walk over
+ * the removed objects.  Without OrderStatistic, split() has to walk over the
+ * moved objects to keep size() right.
+ */
 template<
     typename Key,
     typename Value,
     Key Value::*KeyMember,
     IntrusiveRBTreeNode Value::*LinkMember,
-    typename Comparator = std::less<Key> >
+    typename Comparator = std::less<Key>,
+    bool OrderStatistic = false>
 class IntrusiveRBTree
 {
 public:
@@ -173,6 +194,93 @@ public:
         return ret;
     }
 
+    /**
+     * Return the k-th (0-based) object in order, or end() if k >= size().
+     * Only for order statistic trees.
+     */
+    iterator select(size_type k)
+    {
+        STATIC_ASSERT(OrderStatistic);
+        IntrusiveRBTreeNode* x = mRoot;
+        while (x != NULL)
+        {
+            size_type leftCount = _count(x->left);
+            if (k < leftCount)
+            {
+                x = x->left;
+            }
+            else if (k == leftCount)
+            {
+                break;
+            }
+            else
+            {
+                k -= leftCount + 1;
+                x = x->right;
+            }
+        }
+        return iterator(this, x);
+    }
+
+    const_iterator select(size_type k) const
+    {
+        return const_cast<IntrusiveRBTree*>(this)->select(k);
+    }
+
+    /**
+     * Return the number of objects less than 'key', i.e. the position of
+     * lower_bound(key).  Only for order statistic trees.
+     */
+    size_type rank(const Key& key) const
+    {
+        STATIC_ASSERT(OrderStatistic);
+        IntrusiveRBTreeNode* x = mRoot;
+        size_type ret = 0;
+        while (x != NULL)
+        {
+            if (mComparator(_get_value_ptr(x)->*KeyMember, key))
+            {
+                ret += _count(x->left) + 1;
+                x = x->right;
+            }
+            else
+            {
+                x = x->left;
+            }
+        }
+        return ret;
+    }
+
+    /**
+     * Return the position of the object, so that select(rank(v)) refers
+     * to v.  Only for order statistic trees.
+     */
+    size_type rank(const Value* v) const
+    {
+        STATIC_ASSERT(OrderStatistic);
+        const IntrusiveRBTreeNode* x = &(v->*LinkMember);
+        size_type ret = _count(x->left);
+        for (; x->parent != NULL; x = x->parent)
+        {
+            if (!x->isL)
+            {
+                ret += _count(x->parent->left) + 1;
+            }
+        }
+        return ret;
+    }
+
+    /**
+     * Return the number of objects in [lo, hi).  Only for order statistic
+     * trees.
+     */
+    size_type count_range(const Key& lo, const Key& hi) const
+    {
+        size_type l = rank(lo);
+        size_type h = rank(hi);
+        return h > l ? h - l : 0;
+    }
+
     std::pair<iterator, bool> insert_unique(Value* v)
     {
         iterator iter = lower_bound(v->*KeyMember);
@@ -229,6 +337,25 @@ public:
         nextIter++;
         IntrusiveRBTreeNode** nodeRef = (node->*LinkMember).parent == NULL ?
             &mRoot : (node->*LinkMember).parent->child(ref->isL);
+        if (OrderStatistic)
+        {
+            // The node physically removed is either the node itself, or its
+            // predecessor which then replaces it.  Anyway, all nodes on the
+            // path from it to the root lose one.
+            IntrusiveRBTreeNode* removed = ref;
+            if (ref->left != NULL && ref->right != NULL)
+            {
+                removed = ref->left;
+                while (removed->right != NULL)
+                {
+                    removed = removed->right;
+                }
+            }
+            for (IntrusiveRBTreeNode* x = removed->parent; x != NULL; x = x->parent)
+            {
+                --x->count;
+            }
+        }
         bool needAdjust = false;
         bool isL = false;
         IntrusiveRBTreeNode** parentRef = NULL;
@@ -359,6 +486,123 @@ public:
         mSize = 0;
     }
 
+    /**
+     * Move all objects not less than 'key' into 'right', which must be empty.
+     */
+    void split(const Key& key, IntrusiveRBTree* right)
+    {
+        ASSERT(right->empty());
+        Subtree l, r;
+        _split(_get_subtree(), key, /* isUpper */ false, &l, &r);
+        size_type rightSize = _subtree_size(r.root);
+        _set_root(l.root, mSize - rightSize);
+        right->_set_root(r.root, rightSize);
+    }
+
+    /**
+     * Move all objects of 'right' to the end of this tree.  No key of 'right'
+     * may be less than any key of this tree.
+     */
+    void join(IntrusiveRBTree* right)
+    {
+        ASSERT_DEBUG(empty() || right->empty() ||
+                     !mComparator((*right->begin()).*KeyMember, (*--end()).*KeyMember));
+        Subtree root = _join2(_get_subtree(), right->_get_subtree());
+        _set_root(root.root, mSize + right->mSize);
+        right->clear();
+    }
+
+    /**
+     * Insert the objects of a range sorted by key.  Objects with keys already
+     * in the tree (or repeated in the range) are left out, and appended to
+     * 'duplicates' if given.  Return the number of inserted objects.
+     */
+    template <typename InputIt>
+    size_type insert_sorted_unique(InputIt first, InputIt last,
+                                   std::vector<Value*>* duplicates = NULL)
+    {
+        Subtree batch = _build_sorted(first, last, /* isMulti */ false, duplicates);
+        size_type inserted = 0;
+        Subtree root = _union(_get_subtree(), batch, /* isMulti */ false,
+                              duplicates, &inserted);
+        _set_root(root.root, mSize + inserted);
+        return inserted;
+    }
+
+    /**
+     * Insert the objects of a range sorted by key.  Like insert_multi(),
+     * objects go after the existing ones with equal keys.
+     */
+    template <typename InputIt>
+    size_type insert_sorted_multi(InputIt first, InputIt last)
+    {
+        Subtree batch = _build_sorted(first, last, /* isMulti */ true, NULL);
+        size_type inserted = 0;
+        Subtree root = _union(_get_subtree(), batch, /* isMulti */ true, NULL, &inserted);
+        _set_root(root.root, mSize + inserted);
+        return inserted;
+    }
+
+    /**
+     * Move all objects of 'other' into this tree, leaving out those whose
+     * keys are already here, which are appended to 'duplicates' if given.
+     */
+    size_type merge_unique(IntrusiveRBTree* other, std::vector<Value*>* duplicates = NULL)
+    {
+        size_type inserted = 0;
+        Subtree root = _union(_get_subtree(), other->_get_subtree(), /* isMulti */ false,
+                              duplicates, &inserted);
+        other->clear();
+        _set_root(root.root, mSize + inserted);
+        return inserted;
+    }
+
+    /**
+     * Move all objects of 'other' into this tree, after the existing ones
+     * with equal keys.
+     */
+    size_type merge_multi(IntrusiveRBTree* other)
+    {
+        size_type inserted = 0;
+        Subtree root = _union(_get_subtree(), other->_get_subtree(), /* isMulti */ true,
+                              NULL, &inserted);
+        other->clear();
+        _set_root(root.root, mSize + inserted);
+        return inserted;
+    }
+
+    /**
+     * Remove all objects whose keys are found in 'other', which is left
+     * unchanged.  Removed objects are appended to 'removed' if given, not
+     * necessarily in order.
+     */
+    size_type difference(const IntrusiveRBTree& other, std::vector<Value*>* removed = NULL)
+    {
+        size_type count = 0;
+        Subtree root = _difference(_get_subtree(), other.mRoot, removed, &count);
+        _set_root(root.root, mSize - count);
+        return count;
+    }
+
+    /**
+     * Remove all objects in [lo, hi).  Removed objects are appended to
+     * 'removed' if given.
+     */
+    size_type erase_range(const Key& lo, const Key& hi, std::vector<Value*>* removed = NULL)
+    {
+        if (!mComparator(lo, hi))
+        {
+            return 0;
+        }
+        Subtree l, m, r;
+        _split(_get_subtree(), lo, /* isUpper */ false, &l, &m);
+        _split(m, hi, /* isUpper */ false, &m, &r);
+        size_type count = _subtree_size(m.root);
+        _collect(m.root, removed);
+        _set_root(_join2(l, r).root, mSize - count);
+        return count;
+    }
+
     void validate_tree() const
     {
         size_type size = 0;
@@ -399,6 +643,10 @@ public:
         }
         size += validate(node->left, node, true, level, expectLevel, node->isRed);
         size += validate(node->right, node, false, level, expectLevel, node->isRed);
+        if (OrderStatistic)
+        {
+            ASSERT(node->count == size);
+        }
         return size;
     }
 
@@ -440,6 +688,7 @@ private:
         ASSERT_DEBUG(_get_value_ptr(*childRef) == *child);
         ASSERT_DEBUG(_get_value_ptr(*nodeRef) == *node);
         bool isL = (*childRef)->isL;
+        IntrusiveRBTreeNode* oldRoot = *nodeRef;
         IntrusiveRBTreeNode** childRef2 = (*childRef)->child(!isL);
         if (*childRef2 != NULL)
         {
@@ -454,6 +703,422 @@ private:
         *childRef2 = *nodeRef;
         *nodeRef = newRoot;
         std::swap(*node, *child);
+        if (OrderStatistic)
+        {
+            // The subtree keeps the same objects under the new root.
+            newRoot->count = oldRoot->count;
+            oldRoot->count = _count(oldRoot->left) + _count(oldRoot->right) + 1;
+        }
+    }
+
+    static size_type _count(const IntrusiveRBTreeNode* node)
+    {
+        return node == NULL ? 0 : node->count;
+    }
+
+    // The helpers below work on detached subtrees, which always have black
+    // roots.  Black heights are passed along, so that joining two subtrees
+    // costs their difference in height rather than a walk down to measure.
+    struct Subtree
+    {
+        IntrusiveRBTreeNode* root;
+        int height;     // Black nodes on each path down, including the root
+    };
+
+    static Subtree _make_subtree(IntrusiveRBTreeNode* root, int height)
+    {
+        Subtree t = { _make_root(root), height };
+        return t;
+    }
+
+    Subtree _get_subtree() const
+    {
+        return _make_subtree(mRoot, _black_height(mRoot));
+    }
+
+    void _set_root(IntrusiveRBTreeNode* root, size_type size)
+    {
+        mRoot = _make_root(root);
+        mSize = size;
+    }
+
+    static IntrusiveRBTreeNode* _make_root(IntrusiveRBTreeNode* node)
+    {
+        if (node != NULL)
+        {
+            node->parent = NULL;
+            node->isL = true;
+            node->isRed = false;
+        }
+        return node;
+    }
+
+    static void _set_child(IntrusiveRBTreeNode* parent, bool isL, IntrusiveRBTreeNode* child)
+    {
+        *parent->child(isL) = child;
+        if (child != NULL)
+        {
+            child->parent = parent;
+            child->isL = isL;
+        }
+    }
+
+    static void _update_count(IntrusiveRBTreeNode* node)
+    {
+        if (OrderStatistic)
+        {
+            node->count = _count(node->left) + _count(node->right) + 1;
+        }
+    }
+
+    size_type _subtree_size(const IntrusiveRBTreeNode* node) const
+    {
+        if (OrderStatistic || node == NULL)
+        {
+            return _count(node);
+        }
+        return _subtree_size(node->left) + _subtree_size(node->right) + 1;
+    }
+
+    static int _black_height(const IntrusiveRBTreeNode* node)
+    {
+        int height = 0;
+        for (; node != NULL; node = node->left)
+        {
+            height += !node->isRed;
+        }
+        return height;
+    }
+
+    // Rotate 'node' above its parent.
+    static void _rotate_up(IntrusiveRBTreeNode* node)
+    {
+        IntrusiveRBTreeNode* parent = node->parent;
+        IntrusiveRBTreeNode* grand = parent->parent;
+        bool parentIsL = parent->isL;
+        bool isL = node->isL;
+        _set_child(parent, isL, *node->child(!isL));
+        _set_child(node, !isL, parent);
+        if (grand != NULL)
+        {
+            _set_child(grand, parentIsL, node);
+        }
+        else
+        {
+            node->parent = NULL;
+            node->isL = true;
+        }
+        _update_count(parent);
+        _update_count(node);
+    }
+
+    // Fix a red 'node' which might have a red parent, return the new root.
+    // 'grown' is set if the root turned red, i.e. the black height grows.
+    static IntrusiveRBTreeNode* _fix_red(IntrusiveRBTreeNode* node, bool* grown)
+    {
+        while (node->parent != NULL && node->parent->isRed)
+        {
+            IntrusiveRBTreeNode* parent = node->parent;
+            IntrusiveRBTreeNode* grand = parent->parent;
+            IntrusiveRBTreeNode* uncle = *grand->child(!parent->isL);
+            if (uncle != NULL && uncle->isRed)
+            {
+                parent->isRed = false;
+                uncle->isRed = false;
+                grand->isRed = true;
+                node = grand;
+                continue;
+            }
+            if (node->isL != parent->isL)
+            {
+                _rotate_up(node);
+                parent = node;
+            }
+            _rotate_up(parent);
+            parent->isRed = false;
+            grand->isRed = true;
+            node = parent;
+            break;
+        }
+        while (node->parent != NULL)
+        {
+            node = node->parent;
+        }
+        *grown = node->isRed;
+        return _make_root(node);
+    }
+
+    // Join 'left', 'node' and 'right', where keys of 'left' <= key of 'node'
+    // <= keys of 'right'.  The taller tree adopts the other one, together with
+    // 'node', at a black node of the same black height on its spine.
+    static Subtree _join(Subtree left, IntrusiveRBTreeNode* node, Subtree right)
+    {
+        if (left.height == right.height)
+        {
+            _set_child(node, true, left.root);
+            _set_child(node, false, right.root);
+            _update_count(node);
+            return _make_subtree(node, left.height + 1);
+        }
+        // Descend the right spine of 'left', or the left spine of 'right'.
+        bool isL = left.height < right.height;
+        const Subtree& tall = isL ? right : left;
+        const Subtree& other = isL ? left : right;
+        int height = tall.height;
+        IntrusiveRBTreeNode* parent = NULL;
+        IntrusiveRBTreeNode* x = tall.root;
+        while (x != NULL && (x->isRed || height > other.height))
+        {
+            height -= !x->isRed;
+            parent = x;
+            x = *x->child(isL);
+        }
+        ASSERT_DEBUG(parent != NULL && height == other.height);
+        node->isRed = true;
+        _set_child(node, isL, other.root);
+        _set_child(node, !isL, x);
+        _set_child(parent, isL, node);
+        for (IntrusiveRBTreeNode* p = node; p != NULL; p = p->parent)
+        {
+            _update_count(p);
+        }
+        bool grown = false;
+        IntrusiveRBTreeNode* root = _fix_red(node, &grown);
+        return _make_subtree(root, tall.height + grown);
+    }
+
+    // Detach the children of the root of 't' as two subtrees.
+    static void _expose(Subtree t, Subtree* left, Subtree* right)
+    {
+        IntrusiveRBTreeNode* l = t.root->left;
+        IntrusiveRBTreeNode* r = t.root->right;
+        // A red child gains one in height when it turns into a black root.
+        *left = _make_subtree(l, t.height - 1 + (l != NULL && l->isRed));
+        *right = _make_subtree(r, t.height - 1 + (r != NULL && r->isRed));
+        t.root->left = NULL;
+        t.root->right = NULL;
+    }
+
+    // Remove the last node of 't' into 'last', return the rest.
+    static Subtree _split_last(Subtree t, IntrusiveRBTreeNode** last)
+    {
+        Subtree left, right;
+        _expose(t, &left, &right);
+        if (right.root == NULL)
+        {
+            *last = t.root;
+            return left;
+        }
+        right = _split_last(right, last);
+        return _join(left, t.root, right);
+    }
+
+    static Subtree _join2(Subtree left, Subtree right)
+    {
+        if (left.root == NULL)
+        {
+            return right;
+        }
+        IntrusiveRBTreeNode* last = NULL;
+        left = _split_last(left, &last);
+        return _join(left, last, right);
+    }
+
+    // Split 't' into keys before 'key' and the rest.  With isUpper, equal
+    // keys go to the left instead.
+    void _split(Subtree t, const Key& key, bool isUpper, Subtree* left, Subtree* right) const
+    {
+        if (t.root == NULL)
+        {
+            *left = t;
+            *right = t;
+            return;
+        }
+        Subtree l, r, m;
+        _expose(t, &l, &r);
+        const Key& rootKey = _get_value_ptr(t.root)->*KeyMember;
+        if (isUpper ? mComparator(key, rootKey) : !mComparator(rootKey, key))
+        {
+            _split(l, key, isUpper, left, &m);
+            *right = _join(m, t.root, r);
+        }
+        else
+        {
+            _split(r, key, isUpper, &m, right);
+            *left = _join(l, t.root, m);
+        }
+    }
+
+    // Merge 'batch' into 't'.  Equal keys of 'batch' go after those of 't'
+    // in multi mode, or are left out otherwise.
+    Subtree _union(Subtree t, Subtree batch, bool isMulti,
+                   std::vector<Value*>* duplicates, size_type* inserted) const
+    {
+        if (batch.root == NULL)
+        {
+            return t;
+        }
+        if (t.root == NULL)
+        {
+            *inserted += _subtree_size(batch.root);
+            return batch;
+        }
+        Subtree batchLeft, batchRight;
+        _expose(batch, &batchLeft, &batchRight);
+        if (batchLeft.root == NULL && batchRight.root == NULL)
+        {
+            // A plain descent beats a split and a join for a single node.
+            return _insert_one(t, batch.root, isMulti, duplicates, inserted);
+        }
+        const Key& key = _get_value_ptr(batch.root)->*KeyMember;
+        Subtree left, right;
+        IntrusiveRBTreeNode* node = batch.root;
+        if (isMulti)
+        {
+            _split(t, key, /* isUpper */ true, &left, &right);
+            ++*inserted;
+        }
+        else
+        {
+            Subtree equal;
+            _split(t, key, /* isUpper */ false, &left, &right);
+            _split(right, key, /* isUpper */ true, &equal, &right);
+            if (equal.root != NULL)
+            {
+                // Keep the existing one.
+                ASSERT_DEBUG(equal.root->left == NULL && equal.root->right == NULL);
+                if (duplicates != NULL)
+                {
+                    duplicates->push_back(_get_value_ptr(batch.root));
+                }
+                node = equal.root;
+            }
+            else
+            {
+                ++*inserted;
+            }
+        }
+        left = _union(left, batchLeft, isMulti, duplicates, inserted);
+        right = _union(right, batchRight, isMulti, duplicates, inserted);
+        return _join(left, node, right);
+    }
+
+    Subtree _insert_one(Subtree t, IntrusiveRBTreeNode* node, bool isMulti,
+                        std::vector<Value*>* duplicates, size_type* inserted) const
+    {
+        const Key& key = _get_value_ptr(node)->*KeyMember;
+        IntrusiveRBTreeNode* parent = NULL;
+        IntrusiveRBTreeNode* x = t.root;
+        bool isL = true;
+        while (x != NULL)
+        {
+            const Key& xKey = _get_value_ptr(x)->*KeyMember;
+            isL = mComparator(key, xKey);
+            if (!isMulti && !isL && !mComparator(xKey, key))
+            {
+                if (duplicates != NULL)
+                {
+                    duplicates->push_back(_get_value_ptr(node));
+                }
+                return t;
+            }
+            parent = x;
+            x = *x->child(isL);
+        }
+        ++*inserted;
+        node->isRed = true;
+        _update_count(node);
+        if (parent == NULL)
+        {
+            return _make_subtree(node, 1);
+        }
+        _set_child(parent, isL, node);
+        for (IntrusiveRBTreeNode* p = parent; p != NULL; p = p->parent)
+        {
+            _update_count(p);
+        }
+        bool grown = false;
+        IntrusiveRBTreeNode* root = _fix_red(node, &grown);
+        return _make_subtree(root, t.height + grown);
+    }
+
+    Subtree _difference(Subtree t, const IntrusiveRBTreeNode* other,
+                        std::vector<Value*>* removed, size_type* count) const
+    {
+        if (t.root == NULL || other == NULL)
+        {
+            return t;
+        }
+        const Key& key = _get_value_ptr(const_cast<IntrusiveRBTreeNode*>(other))->*KeyMember;
+        Subtree left, equal, right;
+        _split(t, key, /* isUpper */ false, &left, &right);
+        _split(right, key, /* isUpper */ true, &equal, &right);
+        *count += _subtree_size(equal.root);
+        _collect(equal.root, removed);
+        left = _difference(left, other->left, removed, count);
+        right = _difference(right, other->right, removed, count);
+        return _join2(left, right);
+    }
+
+    static void _collect(IntrusiveRBTreeNode* node, std::vector<Value*>* out)
+    {
+        if (node == NULL || out == NULL)
+        {
+            return;
+        }
+        _collect(node->left, out);
+        out->push_back(_get_value_ptr(node));
+        _collect(node->right, out);
+    }
+
+    // Build a balanced tree from a sorted range.  Nodes in the last, partial
+    // level are red, the others are black.
+    template <typename InputIt>
+    Subtree _build_sorted(InputIt first, InputIt last, bool isMulti,
+                          std::vector<Value*>* duplicates) const
+    {
+        std::vector<IntrusiveRBTreeNode*> nodes;
+        for (InputIt iter = first; iter != last; ++iter)
+        {
+            Value* v = &(*iter);
+            if (!nodes.empty())
+            {
+                const Key& prevKey = _get_value_ptr(nodes.back())->*KeyMember;
+                ASSERT_DEBUG(!mComparator(v->*KeyMember, prevKey));
+                if (!isMulti && !mComparator(prevKey, v->*KeyMember))
+                {
+                    if (duplicates != NULL)
+                    {
+                        duplicates->push_back(v);
+                    }
+                    continue;
+                }
+            }
+            nodes.push_back(&(v->*LinkMember));
+        }
+        int blackDepth = 0;
+        while ((2UL << blackDepth) - 1 <= nodes.size())
+        {
+            ++blackDepth;
+        }
+        return _make_subtree(_build_balanced(nodes, 0, nodes.size(), 0, blackDepth), blackDepth);
+    }
+
+    static IntrusiveRBTreeNode* _build_balanced(const std::vector<IntrusiveRBTreeNode*>& nodes,
+                                                size_t begin, size_t end,
+                                                int depth, int blackDepth)
+    {
+        if (begin == end)
+        {
+            return NULL;
+        }
+        size_t mid = begin + (end - begin) / 2;
+        IntrusiveRBTreeNode* node = nodes[mid];
+        node->isRed = depth >= blackDepth;
+        _set_child(node, true, _build_balanced(nodes, begin, mid, depth + 1, blackDepth));
+        _set_child(node, false, _build_balanced(nodes, mid + 1, end, depth + 1, blackDepth));
+        _update_count(node);
+        return node;
     }
 
     void _remove(IntrusiveRBTreeNode** node, bool isL)
@@ -523,6 +1188,15 @@ private:
         (*nodeRef)->left = NULL;
         (*nodeRef)->right = NULL;
         (*nodeRef)->isRed = true;
+        if (OrderStatistic)
+        {
+            ASSERT_DEBUG(mSize < UINT32_MAX);
+            newNode->count = 1;
+            for (IntrusiveRBTreeNode* x = newNode->parent; x != NULL; x = x->parent)
+            {
+                ++x->count;
+            }
+        }
         for (;;)
         {
             if (*parentRef == NULL)
@@ -731,8 +1405,9 @@ template<
     typename Value,
     Key Value::*KeyMember,
     IntrusiveRBTreeNode Value::*LinkMember,
-    typename Comparator>
-class IntrusiveRBTree<Key, Value, KeyMember, LinkMember, Comparator>
+    typename Comparator,
+    bool OrderStatistic>
+class IntrusiveRBTree<Key, Value, KeyMember, LinkMember, Comparator, OrderStatistic>
     ::iterator
 {
 public:
@@ -842,8 +1517,9 @@ template<
     typename Value,
     Key Value::*KeyMember,
     IntrusiveRBTreeNode Value::*LinkMember,
-    typename Comparator>
-class IntrusiveRBTree<Key, Value, KeyMember, LinkMember, Comparator>
+    typename Comparator,
+    bool OrderStatistic>
+class IntrusiveRBTree<Key, Value, KeyMember, LinkMember, Comparator, OrderStatistic>
     ::const_iterator
 {
 public:
@@ -0,0 +1,415 @@
+#ifndef _SRC_BASE_MAPPED_SLOT_VECTOR_H
+#define _SRC_BASE_MAPPED_SLOT_VECTOR_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+
+#include "src/base/atomic_pointer.h"
+#include "src/base/status.h"
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+
+/**
+ * @class MappedSlotVector is a SlotVector persisted in a file.  It keeps the same two-level
+ *        layout: the file starts with a one-page header, followed by the slots, each of which
+ *        is mapped individually when it's needed.  The file is extended slot by slot with
+ *        ftruncate(), so never written parts are holes of a sparse file.  Reopening a file
+ *        only maps the used slots, no element is read or rebuilt.
+ *
+ *        The header keeps two sizes:
+ *        1. size, updated on every change.  The mapping is MAP_SHARED, so it survives a crash
+ *           of the process, and can be followed by read-only attachers in other processes.
+ *        2. checkpoint size, updated by Checkpoint() after all slots were msync()-ed.  Only
+ *           elements below it are guaranteed to survive a crash of the system.  Open() still
+ *           restores to 'size', callers caring about power loss should Resize() to
+ *           GetCheckpointSize() after an unclean shutdown.
+ *
+ *        Only one process can open the file in read-write mode (guarded by flock()).  Read-only
+ *        attachers call Refresh() to see the elements appended since.  The file never shrinks,
+ *        so the slots an attacher still maps after the writer shrinks stay readable (as zeros)
+ *        until its next Refresh().  Like SlotVector, the writer is not thread-safe.
+ *
+ * @template _ValueType The element type, must be trivially copyable as it's stored in the file
+ *           byte by byte.  Obviously it should not contain pointers either.
+ * @template _SLOT_INDEX_BITS Same as SlotVector.
+ * @template _VALUE_INDEX_BITS Same as SlotVector.  Slots are aligned to pages in the file,
+ *           so better make "sizeof(_ValueType) << _VALUE_INDEX_BITS" a multiple of page size.
+ */
+template<typename _ValueType,
+         uint32_t _SLOT_INDEX_BITS,
+         uint32_t _VALUE_INDEX_BITS>
+class MappedSlotVector
+{
+public:
+    typedef _ValueType ValueType;
+
+    enum
+    {
+        SLOT_INDEX_BITS = _SLOT_INDEX_BITS,
+        MAX_SLOT_NUM = 1U << SLOT_INDEX_BITS,
+        VALUE_INDEX_BITS = _VALUE_INDEX_BITS,
+        SLOT_LENGTH = 1U << VALUE_INDEX_BITS,
+        VALUE_INDEX_MASK = SLOT_LENGTH - 1,
+        MAX_LENGTH = 1ULL << (SLOT_INDEX_BITS + VALUE_INDEX_BITS),
+        VALUE_SIZE = sizeof(ValueType),
+        SLOT_SIZE = VALUE_SIZE << VALUE_INDEX_BITS,
+        FILE_PAGE_SIZE = 4096,
+        HEADER_SIZE = FILE_PAGE_SIZE,
+        SLOT_FILE_SIZE = (SLOT_SIZE + FILE_PAGE_SIZE - 1) / FILE_PAGE_SIZE * FILE_PAGE_SIZE,
+    };
+
+    enum OpenMode
+    {
+        kReadWrite,
+        kReadOnly,
+    };
+
+    MappedSlotVector()
+        : mFd(-1),
+          mReadOnly(false),
+          mHeader(NULL),
+          mSize(0),
+          mMappedSlots(0)
+    {
+        STATIC_ASSERT(__has_trivial_copy(ValueType));
+        STATIC_ASSERT(__has_trivial_destructor(ValueType));
+    }
+
+    ~MappedSlotVector()
+    {
+        Close();
+    }
+
+    /**
+     * @brief Open or create the file.  Return INVALID_PARAMETER if the file was created
+     *        with a different value size or layout, and INTERNAL_ERROR on system errors,
+     *        or if another process has already opened it in read-write mode.
+     */
+    Status Open(const std::string& path, OpenMode mode = kReadWrite)
+    {
+        ASSERT(mFd < 0);
+        mReadOnly = (mode == kReadOnly);
+        mFd = ::open(path.c_str(), mReadOnly ? O_RDONLY : O_RDWR | O_CREAT, 0644);
+        if (mFd < 0)
+        {
+            return errnoStatus("open " + path);
+        }
+        Status status = openInternal();
+        if (!status.IsOk())
+        {
+            release();
+        }
+        return status;
+    }
+
+    /**
+     * @brief Unmap all slots and close the file.  A writer makes a checkpoint first.
+     */
+    Status Close()
+    {
+        Status status;
+        if (mFd < 0)
+        {
+            return status;
+        }
+        if (!mReadOnly)
+        {
+            status = Checkpoint();
+        }
+        release();
+        return status;
+    }
+
+    /**
+     * @brief msync() all slots and then the header.  When async is true, use MS_ASYNC,
+     *        which only schedules the writeback.
+     */
+    Status Checkpoint(bool async = false)
+    {
+        ASSERT(!mReadOnly);
+        int flags = async ? MS_ASYNC : MS_SYNC;
+        for (uint32_t i = 0; i < mMappedSlots; ++i)
+        {
+            if (::msync(mSlots[i], SLOT_FILE_SIZE, flags) != 0)
+            {
+                return errnoStatus("msync slot");
+            }
+        }
+        mHeader->checkpointSize = mSize;
+        if (::msync(mHeader, HEADER_SIZE, flags) != 0)
+        {
+            return errnoStatus("msync header");
+        }
+        return OK;
+    }
+
+    /**
+     * @brief For read-only attachers, follow the size set by the writer since last call:
+     *        map the slots appended, and unmap those shrunk.
+     */
+    Status Refresh()
+    {
+        uint64_t size = mHeader->size;
+        MemoryBarrier();
+        unmapSlots(slotNum(size));
+        Status status = mapSlots(size);
+        if (status.IsOk())
+        {
+            mSize = size;
+        }
+        return status;
+    }
+
+    Status PushBack(const ValueType& value)
+    {
+        ASSERT(!mReadOnly);
+        ASSERT(mSize < MAX_LENGTH);
+        if (UNLIKELY((mSize >> VALUE_INDEX_BITS) >= mMappedSlots))
+        {
+            Status status = mapSlots(mSize + 1);
+            if (!status.IsOk())
+            {
+                return status;
+            }
+        }
+        memcpy(&(*this)[mSize], &value, VALUE_SIZE);
+        publishSize(mSize + 1);
+        return OK;
+    }
+
+    /**
+     * @brief Change the size.  New elements are zero-filled.  Slots no longer used are
+     *        unmapped and their space is freed, but the file keeps its length, as read-only
+     *        attachers may still map them.
+     */
+    Status Resize(uint64_t newSize)
+    {
+        ASSERT(!mReadOnly);
+        ASSERT(newSize <= MAX_LENGTH);
+        if (newSize > mSize)
+        {
+            // The tail of the last slot might keep the data before a shrink,
+            // while the newly extended parts of the file are always zero.
+            uint64_t mappedLength = static_cast<uint64_t>(mMappedSlots) << VALUE_INDEX_BITS;
+            for (uint64_t i = mSize; i < MIN(newSize, mappedLength); ++i)
+            {
+                memset(&(*this)[i], 0, VALUE_SIZE);
+            }
+            Status status = mapSlots(newSize);
+            if (!status.IsOk())
+            {
+                return status;
+            }
+            publishSize(newSize);
+        }
+        else if (newSize < mSize)
+        {
+            publishSize(newSize);
+            uint32_t slots = slotNum(newSize);
+            if (mMappedSlots > slots)
+            {
+                // Truncating would raise SIGBUS in attachers reading the slots, punch
+                // holes instead, which read as zeros.
+                uint64_t offset = slotOffset(slots);
+                if (::fallocate(mFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                offset, slotOffset(mMappedSlots) - offset) != 0)
+                {
+                    for (uint32_t i = slots; i < mMappedSlots; ++i)
+                    {
+                        memset(mSlots[i], 0, SLOT_FILE_SIZE);
+                    }
+                }
+                unmapSlots(slots);
+            }
+        }
+        return OK;
+    }
+
+    ValueType& operator[](uint64_t index)
+    {
+        return mSlots[index >> VALUE_INDEX_BITS][index & VALUE_INDEX_MASK];
+    }
+
+    const ValueType& operator[](uint64_t index) const
+    {
+        return mSlots[index >> VALUE_INDEX_BITS][index & VALUE_INDEX_MASK];
+    }
+
+    uint64_t Size() const
+    {
+        return mSize;
+    }
+
+    uint64_t GetCheckpointSize() const
+    {
+        return mHeader->checkpointSize;
+    }
+
+    bool IsReadOnly() const
+    {
+        return mReadOnly;
+    }
+
+private:
+    struct FileHeader
+    {
+        uint64_t magic;
+        uint32_t valueSize;
+        uint32_t slotIndexBits;
+        uint32_t valueIndexBits;
+        uint32_t reserved;
+        volatile uint64_t size;
+        volatile uint64_t checkpointSize;
+    };
+
+    static const uint64_t kMagic = 0x4543564F4C534D4DULL;  // "MMSLOVCE"
+
+    static uint64_t slotOffset(uint32_t slotIndex)
+    {
+        return HEADER_SIZE + static_cast<uint64_t>(slotIndex) * SLOT_FILE_SIZE;
+    }
+
+    static Status errnoStatus(const std::string& what)
+    {
+        return Status(INTERNAL_ERROR, what + ": " + ::strerror(errno));
+    }
+
+    Status openInternal()
+    {
+        if (!mReadOnly && ::flock(mFd, LOCK_EX | LOCK_NB) != 0)
+        {
+            return errnoStatus("flock");
+        }
+        struct stat st;
+        if (::fstat(mFd, &st) != 0)
+        {
+            return errnoStatus("fstat");
+        }
+        bool created = (st.st_size == 0);
+        if (created && mReadOnly)
+        {
+            return Status(INTERNAL_ERROR, "empty file");
+        }
+        if (created && ::ftruncate(mFd, HEADER_SIZE) != 0)
+        {
+            return errnoStatus("ftruncate");
+        }
+        void* addr = ::mmap(NULL, HEADER_SIZE, protection(), MAP_SHARED, mFd, 0);
+        if (addr == MAP_FAILED)
+        {
+            return errnoStatus("mmap header");
+        }
+        mHeader = static_cast<FileHeader*>(addr);
+        if (created)
+        {
+            mHeader->magic = kMagic;
+            mHeader->valueSize = VALUE_SIZE;
+            mHeader->slotIndexBits = SLOT_INDEX_BITS;
+            mHeader->valueIndexBits = VALUE_INDEX_BITS;
+            mHeader->size = 0;
+            mHeader->checkpointSize = 0;
+        }
+        if (mHeader->magic != kMagic ||
+            mHeader->valueSize != VALUE_SIZE ||
+            mHeader->slotIndexBits != SLOT_INDEX_BITS ||
+            mHeader->valueIndexBits != VALUE_INDEX_BITS)
+        {
+            return Status(INVALID_PARAMETER, "layout mismatch");
+        }
+        return Refresh();
+    }
+
+    void release()
+    {
+        for (uint32_t i = 0; i < mMappedSlots; ++i)
+        {
+            ::munmap(mSlots[i], SLOT_FILE_SIZE);
+        }
+        if (mHeader != NULL)
+        {
+            ::munmap(mHeader, HEADER_SIZE);
+        }
+        ::close(mFd);
+        mFd = -1;
+        mHeader = NULL;
+        mSize = 0;
+        mMappedSlots = 0;
+    }
+
+    int protection() const
+    {
+        return mReadOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+    }
+
+    static uint32_t slotNum(uint64_t size)
+    {
+        return static_cast<uint32_t>((size + SLOT_LENGTH - 1) >> VALUE_INDEX_BITS);
+    }
+
+    // Make sure the slots holding 'size' elements are mapped.
+    Status mapSlots(uint64_t size)
+    {
+        uint32_t slots = slotNum(size);
+        if (slots <= mMappedSlots)
+        {
+            return OK;
+        }
+        if (!mReadOnly)
+        {
+            struct stat st;
+            if (::fstat(mFd, &st) != 0)
+            {
+                return errnoStatus("fstat");
+            }
+            if (static_cast<uint64_t>(st.st_size) < slotOffset(slots) &&
+                ::ftruncate(mFd, slotOffset(slots)) != 0)
+            {
+                return errnoStatus("ftruncate");
+            }
+        }
+        for (; mMappedSlots < slots; ++mMappedSlots)
+        {
+            void* addr = ::mmap(NULL, SLOT_FILE_SIZE, protection(), MAP_SHARED,
+                                mFd, slotOffset(mMappedSlots));
+            if (addr == MAP_FAILED)
+            {
+                return errnoStatus("mmap slot");
+            }
+            mSlots[mMappedSlots] = static_cast<ValueType*>(addr);
+        }
+        return OK;
+    }
+
+    void unmapSlots(uint32_t slots)
+    {
+        while (mMappedSlots > slots)
+        {
+            ::munmap(mSlots[--mMappedSlots], SLOT_FILE_SIZE);
+        }
+    }
+
+    void publishSize(uint64_t size)
+    {
+        // Readers in other processes see the elements before the size.
+        MemoryBarrier();
+        mHeader->size = mSize = size;
+    }
+
+    int mFd;
+    bool mReadOnly;
+    FileHeader* mHeader;
+    uint64_t mSize;
+    uint32_t mMappedSlots;
+    ValueType* mSlots[MAX_SLOT_NUM];
+
+    DISALLOW_COPY_AND_ASSIGN(MappedSlotVector);
+};
+
+#endif  // _SRC_BASE_MAPPED_SLOT_VECTOR_H
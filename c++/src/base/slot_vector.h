@@ -2,10 +2,12 @@
 #define _SRC_BASE_SLOT_VECTOR_H
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 #include "src/common/assert.h"
 #include "src/common/macros.h"
+#include "src/sync/atomic.h"
 #include "src/sync/lock.h"
 
 /**
@@ -254,14 +256,245 @@ private:
     SlotVector& operator=(const SlotVector&);
 };
 
+/**
+ * @class ConcurrentSlotVector is an append-only variant of SlotVector, which can be shared
+ *        by many producer threads and lock-free readers, e.g. as a log or an index.
+ *        1. PushBack() reserves an index by an atomic add on the reserved size.
+ *        2. Slots are allocated lazily by the first producer reaching them, and published
+ *           by CAS on the slot table.  The loser of the race frees its allocation.
+ *        3. After constructing the element, the producer commits it by advancing the
+ *           committed size from its index to index + 1 by CAS.  So commits are in index
+ *           order, and a producer may wait for the earlier ones.
+ *        Readers load the committed size by Size(), and every element with an index less
+ *        than it is fully constructed and can be read without any lock.
+ *
+ *        Elements are never removed except by Clear(), which, like the destructor, must
+ *        not run concurrently with any other method.  The same sizing warning of
+ *        SlotVector applies: allocate instances on the heap.
+ */
+template<typename _ValueType,
+         uint32_t _SLOT_INDEX_BITS,
+         uint32_t _VALUE_INDEX_BITS>
+class ConcurrentSlotVector
+{
+public:
+    typedef _ValueType ValueType;
+
+    enum
+    {
+        SLOT_INDEX_BITS = _SLOT_INDEX_BITS,
+        MAX_SLOT_NUM = 1U << SLOT_INDEX_BITS,
+        VALUE_INDEX_BITS = _VALUE_INDEX_BITS,
+        SLOT_LENGTH = 1U << VALUE_INDEX_BITS,
+        VALUE_INDEX_MASK = SLOT_LENGTH - 1,
+        MAX_LENGTH = 1ULL << (SLOT_INDEX_BITS + VALUE_INDEX_BITS),
+        VALUE_SIZE = sizeof(ValueType),
+        SLOT_SIZE = VALUE_SIZE << VALUE_INDEX_BITS,
+    };
+
+    ConcurrentSlotVector() : mReserved(0), mCommitted(0)
+    {
+        memset(const_cast<char**>(mSlots), 0, sizeof(mSlots));
+    }
+
+    ~ConcurrentSlotVector()
+    {
+        Clear();
+    }
+
+    /**
+     * @brief Append a copy of value, and return its index.  It's visible to readers
+     *        once all the elements before it are committed.
+     */
+    uint64_t PushBack(const ValueType& value)
+    {
+        uint64_t index = AtomicExchangeAdd(&mReserved, static_cast<uint64_t>(1));
+        ASSERT(index < MAX_LENGTH);
+        char* slot = getOrAllocSlot(index >> VALUE_INDEX_BITS);
+        new (slot + VALUE_SIZE * (index & VALUE_INDEX_MASK)) ValueType(value);
+        Sleeper sleeper;
+        while (!AtomicCompareExchange(&mCommitted, index + 1, index))
+        {
+            sleeper.Pause();
+        }
+        return index;
+    }
+
+    /**
+     * @brief Note that only the elements with index less than Size() are safe to access.
+     */
+    ValueType& operator[](uint64_t index)
+    {
+        return reinterpret_cast<ValueType*>(mSlots[index >> VALUE_INDEX_BITS])
+            [index & VALUE_INDEX_MASK];
+    }
+
+    const ValueType& operator[](uint64_t index) const
+    {
+        return reinterpret_cast<const ValueType*>(mSlots[index >> VALUE_INDEX_BITS])
+            [index & VALUE_INDEX_MASK];
+    }
+
+    /**
+     * @brief Get the number of committed elements, which are fully constructed.
+     */
+    uint64_t Size() const
+    {
+        return AtomicGet(&mCommitted, std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Destruct all elements and dealloc all slots.  Not thread-safe.
+     */
+    void Clear()
+    {
+        ASSERT(mReserved == mCommitted);
+        for (uint64_t i = 0; i < mCommitted; ++i)
+        {
+            (*this)[i].~ValueType();
+        }
+        for (uint32_t i = 0; i < MAX_SLOT_NUM && mSlots[i] != NULL; ++i)
+        {
+            delete[] mSlots[i];
+            mSlots[i] = NULL;
+        }
+        mReserved = mCommitted = 0;
+    }
+
+    uint64_t GetMemorySize() const
+    {
+        return sizeof(*this) +
+               ((Size() + SLOT_LENGTH - 1) >> VALUE_INDEX_BITS) * SLOT_SIZE;
+    }
+
+private:
+    char* getOrAllocSlot(uint32_t slotIndex)
+    {
+        char* slot = AtomicGet(&mSlots[slotIndex]);
+        if (UNLIKELY(slot == NULL))
+        {
+            char* newSlot = new char[SLOT_SIZE];
+            if (AtomicCompareExchange(&mSlots[slotIndex], newSlot, static_cast<char*>(NULL)))
+            {
+                return newSlot;
+            }
+            delete[] newSlot;
+            slot = AtomicGet(&mSlots[slotIndex]);
+        }
+        return slot;
+    }
+
+    // Producers hit mReserved and readers hit mCommitted, keep them apart.
+    volatile uint64_t mReserved;
+    char mReservedPadding[64 - sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+    volatile uint64_t mCommitted;
+    char mCommittedPadding[64 - sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+    char* volatile mSlots[MAX_SLOT_NUM];
+
+    DISALLOW_COPY_AND_ASSIGN(ConcurrentSlotVector);
+};
+
+namespace detail
+{
+
+/**
+ * Storage of one item in slot vector pools.  The first 4 bytes of 'data' are used
+ * as the link of free list when the item is not allocated.  When generations are
+ * enabled, 'generation' is bumped on every allocation and deallocation, so an odd
+ * generation means the item is in use.  It starts from 0, as SlotVector
+ * value-initializes new elements.
+ */
+template<typename ValueType, bool ENABLE_GENERATION>
+struct SlotVectorPoolItem
+{
+    char data[sizeof(ValueType) < sizeof(uint32_t) ? sizeof(uint32_t) : sizeof(ValueType)]  // NOLINT
+        __attribute__((aligned(__alignof__(ValueType))));
+    volatile uint32_t generation;
+
+    uint32_t GetGeneration() const
+    {
+        return AtomicGet(&generation);
+    }
+
+    void BumpGeneration()
+    {
+        AtomicInc(&generation);
+    }
+
+    bool BumpGeneration(uint32_t expected)
+    {
+        return AtomicCompareExchange(&generation, expected + 1, expected);
+    }
+};
+
+template<typename ValueType>
+struct SlotVectorPoolItem<ValueType, false>
+{
+    char data[sizeof(ValueType) < sizeof(uint32_t) ? sizeof(uint32_t) : sizeof(ValueType)];  // NOLINT
+
+    uint32_t GetGeneration() const
+    {
+        return 0;
+    }
+
+    void BumpGeneration()
+    {
+    }
+
+    bool BumpGeneration(uint32_t expected)
+    {
+        return true;
+    }
+};
+
+/**
+ * A handle is "generation << 32 | index".
+ */
+struct SlotVectorPoolHandle
+{
+    static uint64_t Make(uint32_t index, uint32_t generation)
+    {
+        return (static_cast<uint64_t>(generation) << 32) | index;
+    }
+
+    static uint32_t GetIndex(uint64_t handle)
+    {
+        return static_cast<uint32_t>(handle);
+    }
+
+    static uint32_t GetGeneration(uint64_t handle)
+    {
+        return static_cast<uint32_t>(handle >> 32);
+    }
+};
+
+}  // namespace detail
+
+/**
+ * @class SlotVectorPool is an index-addressed object pool on top of SlotVector.  Item
+ *        addresses never change, and an item can be referred by either its pointer or its
+ *        32-bit index.
+ *
+ *        Indexes are reused after deallocation, so a stale index silently resolves to
+ *        whatever object reuses the slot.  When _ENABLE_GENERATION is true, every item also
+ *        carries a 32-bit generation, and the Handle API packs "generation << 32 | index"
+ *        into a 64-bit handle.  GetItemByHandle()/IsHandleValid() reject stale handles in
+ *        O(1) by comparing the generations, and DeallocHandle() makes sure a handle is
+ *        released only once.  It costs 4 more bytes per item (plus padding).  When
+ *        generations are disabled, handles are plain indexes and the Handle API falls
+ *        back to the index API.
+ *        Note that the generation wraps after 2^31 reuses of the same slot.
+ */
 template<typename _ValueType,
          uint32_t _SLOT_INDEX_BITS,
          uint32_t _VALUE_INDEX_BITS,
-         typename LockType = stone::SimpleMutex>
+         typename LockType = SimpleMutex,
+         bool _ENABLE_GENERATION = false>
 class SlotVectorPool
 {
 public:
     typedef _ValueType ValueType;
+    typedef uint64_t Handle;
 
     enum
     {
@@ -273,6 +506,7 @@ public:
         MAX_LENGTH = 1ULL << (SLOT_INDEX_BITS + VALUE_INDEX_BITS),
         VALUE_SIZE = sizeof(ValueType),
         SLOT_SIZE = VALUE_SIZE << VALUE_INDEX_BITS,
+        ENABLE_GENERATION = _ENABLE_GENERATION,
     };
 
     SlotVectorPool()
@@ -289,7 +523,7 @@ public:
     {
         // TODO(allen.zfh): enable it later, currently will assert
 #if 0
-        typename LockType::Locker lock(mMutex);
+        ScopedLock<LockType> lock(mMutex);
         size_t freeCnt = 1;
         uint32_t itemIndex = mNextFreeItemIndex;
         while (itemIndex != 0)
@@ -304,7 +538,7 @@ public:
 
     ValueType* AllocItem(uint32_t* blockItemIndex)
     {
-        typename LockType::Locker lock(mMutex);
+        ScopedLock<LockType> lock(mMutex);
         uint32_t itemIndex = 0;
         ValueType* item = NULL;
         if (LIKELY(mNextFreeItemIndex != 0))
@@ -324,6 +558,7 @@ public:
             itemIndex = mNewFreeItemIndex++;
             item = GetItem(itemIndex);
         }
+        mSlotVector[itemIndex].BumpGeneration();
         new (item) ValueType();
         *blockItemIndex = itemIndex;
         return item;
@@ -331,16 +566,14 @@ public:
 
     ValueType* GetItem(uint32_t blockItemIndex)
     {
-        return reinterpret_cast<ValueType*>(&mSlotVector[blockItemIndex]);
+        return reinterpret_cast<ValueType*>(mSlotVector[blockItemIndex].data);
     }
 
     void DeallocItem(uint32_t blockItemIndex)
     {
-        typename LockType::Locker lock(mMutex);
-        ValueType* value = GetItem(blockItemIndex);
-        value->~ValueType();
-        *(reinterpret_cast<uint32_t*>(value)) = mNextFreeItemIndex;
-        mNextFreeItemIndex = blockItemIndex;
+        ScopedLock<LockType> lock(mMutex);
+        mSlotVector[blockItemIndex].BumpGeneration();
+        releaseItem(blockItemIndex);
     }
 
     bool IsItemIndexValid(uint32_t blockItemIndex)
@@ -348,15 +581,445 @@ public:
         return blockItemIndex < mNewFreeItemIndex;
     }
 
+    /**
+     * @brief Allocate an item and return its handle.
+     */
+    ValueType* AllocHandle(Handle* handle)
+    {
+        uint32_t itemIndex = 0;
+        ValueType* item = AllocItem(&itemIndex);
+        *handle = GetHandle(itemIndex);
+        return item;
+    }
+
+    /**
+     * @brief Get the current handle of an allocated item.
+     */
+    Handle GetHandle(uint32_t blockItemIndex)
+    {
+        return detail::SlotVectorPoolHandle::Make(
+                blockItemIndex, mSlotVector[blockItemIndex].GetGeneration());
+    }
+
+    /**
+     * @brief Return NULL if the handle is stale, i.e. the item has been deallocated
+     *        (and maybe reused) since the handle was created.
+     */
+    ValueType* GetItemByHandle(Handle handle)
+    {
+        return IsHandleValid(handle) ?
+            GetItem(detail::SlotVectorPoolHandle::GetIndex(handle)) : NULL;
+    }
+
+    bool IsHandleValid(Handle handle)
+    {
+        uint32_t itemIndex = detail::SlotVectorPoolHandle::GetIndex(handle);
+        if (!IsItemIndexValid(itemIndex))
+        {
+            return false;
+        }
+        if (!ENABLE_GENERATION)
+        {
+            return true;
+        }
+        uint32_t generation = detail::SlotVectorPoolHandle::GetGeneration(handle);
+        return (generation & 1) != 0 &&
+               mSlotVector[itemIndex].GetGeneration() == generation;
+    }
+
+    /**
+     * @brief Deallocate the item referred by the handle.  Return false if the handle
+     *        is stale.  Without generations, double deallocation can not be detected.
+     */
+    bool DeallocHandle(Handle handle)
+    {
+        ScopedLock<LockType> lock(mMutex);
+        if (!IsHandleValid(handle))
+        {
+            return false;
+        }
+        uint32_t itemIndex = detail::SlotVectorPoolHandle::GetIndex(handle);
+        mSlotVector[itemIndex].BumpGeneration();
+        releaseItem(itemIndex);
+        return true;
+    }
+
 private:
+    void releaseItem(uint32_t blockItemIndex)
+    {
+        ValueType* value = GetItem(blockItemIndex);
+        value->~ValueType();
+        *(reinterpret_cast<uint32_t*>(value)) = mNextFreeItemIndex;
+        mNextFreeItemIndex = blockItemIndex;
+    }
+
     mutable LockType mMutex;
     uint32_t mNextFreeItemIndex;
     uint32_t mNewFreeItemIndex;
-    struct ValueContainer
+    typedef detail::SlotVectorPoolItem<ValueType, _ENABLE_GENERATION> ValueContainer;
+    SlotVector<ValueContainer, _SLOT_INDEX_BITS, _VALUE_INDEX_BITS> mSlotVector;
+};
+
+/**
+ * @class LockFreeSlotVectorPool is a drop-in replacement of SlotVectorPool for pools shared by
+ *        many threads.  AllocItem/DeallocItem do not take any lock in the common path:
+ *        1. Every thread owns a local cache of free item indexes, which serves most of the
+ *           alloc/dealloc requests without any atomic operation.
+ *        2. The global free list is a Treiber stack.  The stack head packs a 32-bit item index
+ *           and a 32-bit tag into one 64-bit word, the tag is bumped on every successful CAS,
+ *           so that a head popped and pushed back in between can not be mistaken (ABA).
+ *        3. New indexes are reserved in batches by an atomic add on mNewFreeItemIndex.
+ *        Growing the underlying SlotVector is the only operation done under mMutex (besides
+ *        the one-off registration of a thread local cache).
+ *
+ *        Note that items cached by a thread are not visible to other threads until the cache
+ *        overflows or the thread exits.  Each pool instance consumes one pthread key, so it's
+ *        intended for long-lived pools (like handle tables), not for temporary ones.
+ *
+ *        The Handle API behaves the same as SlotVectorPool's.  DeallocHandle() bumps the
+ *        generation by CAS, so only one of the threads racing on the same handle wins.  But
+ *        looking up a handle is not atomic with deallocating it: a handle must not be looked
+ *        up while another thread may deallocate it.
+ */
+template<typename _ValueType,
+         uint32_t _SLOT_INDEX_BITS,
+         uint32_t _VALUE_INDEX_BITS,
+         bool _ENABLE_GENERATION = false>
+class LockFreeSlotVectorPool
+{
+public:
+    typedef _ValueType ValueType;
+    typedef uint64_t Handle;
+
+    enum
+    {
+        SLOT_INDEX_BITS = _SLOT_INDEX_BITS,
+        MAX_SLOT_NUM = 1U << SLOT_INDEX_BITS,
+        VALUE_INDEX_BITS = _VALUE_INDEX_BITS,
+        SLOT_LENGTH = 1U << VALUE_INDEX_BITS,
+        VALUE_INDEX_MASK = SLOT_LENGTH - 1,
+        MAX_LENGTH = 1ULL << (SLOT_INDEX_BITS + VALUE_INDEX_BITS),
+        VALUE_SIZE = sizeof(ValueType),
+        SLOT_SIZE = VALUE_SIZE << VALUE_INDEX_BITS,
+        LOCAL_CACHE_SIZE = 64,
+        LOCAL_CACHE_BATCH = LOCAL_CACHE_SIZE / 2,
+        ENABLE_GENERATION = _ENABLE_GENERATION,
+    };
+
+    LockFreeSlotVectorPool()
+        : mFreeHead(0),
+          mNewFreeItemIndex(1),
+          mCapacity(0),
+          mCaches(NULL)
+    {
+        STATIC_ASSERT(VALUE_SIZE >= sizeof(uint32_t));  // NOLINT(runtime/sizeof)
+        STATIC_ASSERT(MAX_LENGTH < UINT32_MAX);
+        STATIC_ASSERT(SLOT_LENGTH >= LOCAL_CACHE_BATCH);
+        CheckPthreadError(::pthread_key_create(&mCacheKey, &releaseLocalCache));
+        mSlotVector.Resize(SLOT_LENGTH);
+        mCapacity = SLOT_LENGTH;
+    }
+
+    ~LockFreeSlotVectorPool()
+    {
+        // Threads exiting after this point will not call releaseLocalCache().
+        CheckPthreadError(::pthread_key_delete(mCacheKey));
+        while (mCaches != NULL)
+        {
+            LocalCache* cache = mCaches;
+            mCaches = cache->next;
+            delete cache;
+        }
+    }
+
+    ValueType* AllocItem(uint32_t* blockItemIndex)
+    {
+        LocalCache* cache = getLocalCache();
+        if (UNLIKELY(cache->count == 0))
+        {
+            uint32_t itemIndex = 0;
+            if (popGlobal(&itemIndex))
+            {
+                cache->items[cache->count++] = itemIndex;
+            }
+            else
+            {
+                reserveNewItems(cache);
+            }
+        }
+        uint32_t itemIndex = cache->items[--cache->count];
+        ValueType* item = GetItem(itemIndex);
+        mSlotVector[itemIndex].BumpGeneration();
+        new (item) ValueType();
+        *blockItemIndex = itemIndex;
+        return item;
+    }
+
+    ValueType* GetItem(uint32_t blockItemIndex)
+    {
+        return reinterpret_cast<ValueType*>(mSlotVector[blockItemIndex].data);
+    }
+
+    void DeallocItem(uint32_t blockItemIndex)
+    {
+        mSlotVector[blockItemIndex].BumpGeneration();
+        releaseItem(blockItemIndex);
+    }
+
+    bool IsItemIndexValid(uint32_t blockItemIndex)
+    {
+        // mNewFreeItemIndex is bumped before grow() allocates the slots, the
+        // capacity only after, so check both.
+        return blockItemIndex != 0 &&
+               blockItemIndex < AtomicGet(&mNewFreeItemIndex) &&
+               blockItemIndex < AtomicGet(&mCapacity, std::memory_order_acquire);
+    }
+
+    ValueType* AllocHandle(Handle* handle)
+    {
+        uint32_t itemIndex = 0;
+        ValueType* item = AllocItem(&itemIndex);
+        *handle = GetHandle(itemIndex);
+        return item;
+    }
+
+    Handle GetHandle(uint32_t blockItemIndex)
+    {
+        return detail::SlotVectorPoolHandle::Make(
+                blockItemIndex, mSlotVector[blockItemIndex].GetGeneration());
+    }
+
+    /**
+     * @brief Return NULL if the handle is stale.  The check is not atomic with a concurrent
+     *        DeallocHandle() of the same handle, after which the item may be reused at once,
+     *        so callers must rule that out, e.g. by letting only the owner of the handle
+     *        deallocate it.
+     */
+    ValueType* GetItemByHandle(Handle handle)
+    {
+        return IsHandleValid(handle) ?
+            GetItem(detail::SlotVectorPoolHandle::GetIndex(handle)) : NULL;
+    }
+
+    /**
+     * @brief Whether the handle was valid when checked, see GetItemByHandle().
+     */
+    bool IsHandleValid(Handle handle)
+    {
+        uint32_t itemIndex = detail::SlotVectorPoolHandle::GetIndex(handle);
+        if (!IsItemIndexValid(itemIndex))
+        {
+            return false;
+        }
+        if (!ENABLE_GENERATION)
+        {
+            return true;
+        }
+        uint32_t generation = detail::SlotVectorPoolHandle::GetGeneration(handle);
+        return (generation & 1) != 0 &&
+               mSlotVector[itemIndex].GetGeneration() == generation;
+    }
+
+    bool DeallocHandle(Handle handle)
     {
-        char data[VALUE_SIZE < sizeof(uint32_t) ? sizeof(uint32_t) : VALUE_SIZE];   // NOLINT
+        uint32_t itemIndex = detail::SlotVectorPoolHandle::GetIndex(handle);
+        uint32_t generation = detail::SlotVectorPoolHandle::GetGeneration(handle);
+        if (!IsItemIndexValid(itemIndex) ||
+            (ENABLE_GENERATION && (generation & 1) == 0) ||
+            !mSlotVector[itemIndex].BumpGeneration(generation))
+        {
+            return false;
+        }
+        releaseItem(itemIndex);
+        return true;
+    }
+
+private:
+    struct LocalCache
+    {
+        LockFreeSlotVectorPool* pool;
+        LocalCache* next;
+        bool inUse;
+        uint32_t count;
+        uint32_t items[LOCAL_CACHE_SIZE];
     };
+
+    static uint64_t packHead(uint32_t index, uint32_t tag)
+    {
+        return (static_cast<uint64_t>(tag) << 32) | index;
+    }
+
+    static uint32_t headIndex(uint64_t head)
+    {
+        return static_cast<uint32_t>(head);
+    }
+
+    static uint32_t headTag(uint64_t head)
+    {
+        return static_cast<uint32_t>(head >> 32);
+    }
+
+    void releaseItem(uint32_t blockItemIndex)
+    {
+        ValueType* value = GetItem(blockItemIndex);
+        value->~ValueType();
+        LocalCache* cache = getLocalCache();
+        if (UNLIKELY(cache->count == LOCAL_CACHE_SIZE))
+        {
+            flushLocalCache(cache, LOCAL_CACHE_BATCH);
+        }
+        cache->items[cache->count++] = blockItemIndex;
+    }
+
+    // The first 4 bytes of a free item are used as the link of free list.
+    uint32_t* nextLink(uint32_t index)
+    {
+        return reinterpret_cast<uint32_t*>(GetItem(index));
+    }
+
+    FORCE_INLINE LocalCache* getLocalCache()
+    {
+        LocalCache* cache = static_cast<LocalCache*>(::pthread_getspecific(mCacheKey));
+        return LIKELY(cache != NULL) ? cache : registerLocalCache();
+    }
+
+    LocalCache* registerLocalCache()
+    {
+        LocalCache* cache = NULL;
+        {
+            ScopedLock<SimpleMutex> lock(mMutex);
+            for (cache = mCaches; cache != NULL; cache = cache->next)
+            {
+                if (!cache->inUse)
+                {
+                    break;
+                }
+            }
+            if (cache == NULL)
+            {
+                cache = new LocalCache;
+                cache->pool = this;
+                cache->count = 0;
+                cache->next = mCaches;
+                mCaches = cache;
+            }
+            cache->inUse = true;
+        }
+        CheckPthreadError(::pthread_setspecific(mCacheKey, cache));
+        return cache;
+    }
+
+    // Called at exit of threads which have touched this pool.
+    static void releaseLocalCache(void* arg)
+    {
+        LocalCache* cache = static_cast<LocalCache*>(arg);
+        LockFreeSlotVectorPool* pool = cache->pool;
+        pool->flushLocalCache(cache, cache->count);
+        ScopedLock<SimpleMutex> lock(pool->mMutex);
+        cache->inUse = false;
+    }
+
+    // Return the oldest 'count' items in local cache to the global free list.
+    void flushLocalCache(LocalCache* cache, uint32_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        for (uint32_t i = 0; i + 1 < count; ++i)
+        {
+            *nextLink(cache->items[i]) = cache->items[i + 1];
+        }
+        pushGlobal(cache->items[0], cache->items[count - 1]);
+        cache->count -= count;
+        memmove(cache->items, cache->items + count, cache->count * sizeof(uint32_t));
+    }
+
+    // Push a chain of free items linked from 'first' to 'last'.
+    void pushGlobal(uint32_t first, uint32_t last)
+    {
+        uint64_t head;
+        do
+        {
+            head = AtomicGet(&mFreeHead);
+            AtomicSet(nextLink(last), headIndex(head));
+        }
+        while (!AtomicCompareExchange(&mFreeHead,
+                                      packHead(first, headTag(head) + 1),
+                                      head));
+    }
+
+    bool popGlobal(uint32_t* itemIndex)
+    {
+        uint64_t head;
+        uint32_t index;
+        do
+        {
+            head = AtomicGet(&mFreeHead);
+            index = headIndex(head);
+            if (index == 0)
+            {
+                return false;
+            }
+            // The item might be popped and reused by others in the meantime,
+            // in which case the tag has changed and the CAS will fail.
+        }
+        while (!AtomicCompareExchange(&mFreeHead,
+                                      packHead(AtomicGet(nextLink(index)), headTag(head) + 1),
+                                      head));
+        *itemIndex = index;
+        return true;
+    }
+
+    // Reserve a batch of never used indexes into the empty local cache.
+    void reserveNewItems(LocalCache* cache)
+    {
+        ASSERT_DEBUG(cache->count == 0);
+        uint32_t first = AtomicExchangeAdd(&mNewFreeItemIndex,
+                                           static_cast<uint32_t>(LOCAL_CACHE_BATCH));
+        uint32_t last = first + LOCAL_CACHE_BATCH - 1;
+        ASSERT(last < MAX_LENGTH);
+        if (UNLIKELY(last >= AtomicGet(&mCapacity)))
+        {
+            grow(last);
+        }
+        // Pop from the lowest index.
+        for (uint32_t index = last; index >= first; --index)
+        {
+            cache->items[cache->count++] = index;
+        }
+    }
+
+    void grow(uint32_t itemIndex)
+    {
+        ScopedLock<SimpleMutex> lock(mMutex);
+        uint32_t capacity = mSlotVector.Size();
+        if (itemIndex < capacity)
+        {
+            return;
+        }
+        while (mSlotVector.Size() <= itemIndex)
+        {
+            mSlotVector.Resize(mSlotVector.Size() + SLOT_LENGTH);
+        }
+        // Full barrier, publish the new slots before the new capacity.
+        AtomicExchangeAdd(&mCapacity,
+                          static_cast<uint32_t>(mSlotVector.Size() - capacity));
+    }
+
+    // Frequently modified by all threads, pad them to separate cache lines.
+    volatile uint64_t mFreeHead;
+    char mFreeHeadPadding[64 - sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+    volatile uint32_t mNewFreeItemIndex;
+    volatile uint32_t mCapacity;
+    char mNewFreeItemIndexPadding[64 - 2 * sizeof(uint32_t)];  // NOLINT(runtime/sizeof)
+    pthread_key_t mCacheKey;
+    SimpleMutex mMutex;
+    LocalCache* mCaches;
+    typedef detail::SlotVectorPoolItem<ValueType, _ENABLE_GENERATION> ValueContainer;
     SlotVector<ValueContainer, _SLOT_INDEX_BITS, _VALUE_INDEX_BITS> mSlotVector;
+
+    DISALLOW_COPY_AND_ASSIGN(LockFreeSlotVectorPool);
 };
 
 #endif  // _SRC_BASE_SLOT_VECTOR_H
@@ -0,0 +1,286 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "src/base/btree_map.h"
+#include "src/base/gettime.h"
+#include "src/base/intrusive_map.h"
+
+template <typename K>
+static void testNodeSearch(K base)
+{
+    typedef detail::BTreeNodeSearch<K, std::less<K> > Search;
+    std::less<K> comparator;
+    for (uint32_t n = 0; n < 20; ++n)
+    {
+        std::vector<K> keys;
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            keys.push_back(base + static_cast<K>(i * 2));
+        }
+        for (uint32_t i = 0; i < n * 2 + 2; ++i)
+        {
+            K key = base + static_cast<K>(i) - 1;
+            const K* data = keys.empty() ? NULL : &keys[0];
+            EXPECT_EQ(std::lower_bound(keys.begin(), keys.end(), key) - keys.begin(),
+                      Search::LowerBound(data, n, key, comparator));
+            EXPECT_EQ(std::upper_bound(keys.begin(), keys.end(), key) - keys.begin(),
+                      Search::UpperBound(data, n, key, comparator));
+        }
+    }
+}
+
+TEST(BTreeMap, NodeSearch)
+{
+    // Around zero and the sign bit
+    testNodeSearch<int32_t>(-10);
+    testNodeSearch<uint32_t>(0x7FFFFFF0U);
+    testNodeSearch<int64_t>(-10);
+    testNodeSearch<uint64_t>(0x7FFFFFFFFFFFFFF0ULL);
+}
+
+template <typename MapType, typename K>
+static void testRandom(K (*makeKey)(int))
+{
+    MapType map;
+    std::map<K, int> checker;
+    for (int round = 0; round < 20000; ++round)
+    {
+        K key = makeKey(rand() % 5000);    // NOLINT(runtime/threadsafe_fn)
+        if (rand() % 3 != 0)    // NOLINT(runtime/threadsafe_fn)
+        {
+            std::pair<typename MapType::iterator, bool> ret = map.insert(key, round);
+            bool inserted = checker.insert(std::make_pair(key, round)).second;
+            EXPECT_EQ(inserted, ret.second);
+            EXPECT_TRUE(ret.first.key() == key);
+            EXPECT_EQ(checker[key], ret.first.value());
+        }
+        else
+        {
+            EXPECT_EQ(checker.erase(key), map.erase(key));
+        }
+        if (round % 1000 == 0)
+        {
+            map.validate();
+        }
+    }
+    map.validate();
+    ASSERT_EQ(checker.size(), map.size());
+
+    // Forward and backward iteration
+    typename MapType::iterator iter = map.begin();
+    for (typename std::map<K, int>::iterator i = checker.begin(); i != checker.end(); ++i, ++iter)
+    {
+        ASSERT_TRUE(iter != map.end());
+        EXPECT_TRUE(i->first == iter.key());
+        EXPECT_EQ(i->second, iter.value());
+    }
+    EXPECT_TRUE(iter == map.end());
+    for (typename std::map<K, int>::reverse_iterator i = checker.rbegin();
+         i != checker.rend(); ++i)
+    {
+        --iter;
+        EXPECT_TRUE(i->first == iter.key());
+    }
+    EXPECT_TRUE(iter == map.begin());
+
+    // Lookups
+    for (int i = -1; i < 5001; ++i)
+    {
+        K key = makeKey(i);
+        typename std::map<K, int>::iterator lower = checker.lower_bound(key);
+        typename MapType::iterator lower2 = map.lower_bound(key);
+        EXPECT_EQ(lower == checker.end(), lower2 == map.end());
+        if (lower != checker.end() && lower2 != map.end())
+        {
+            EXPECT_TRUE(lower->first == lower2.key());
+        }
+        typename std::map<K, int>::iterator upper = checker.upper_bound(key);
+        typename MapType::iterator upper2 = map.upper_bound(key);
+        EXPECT_EQ(upper == checker.end(), upper2 == map.end());
+        if (upper != checker.end() && upper2 != map.end())
+        {
+            EXPECT_TRUE(upper->first == upper2.key());
+        }
+        EXPECT_EQ(checker.count(key), map.count(key));
+    }
+
+    // Erase everything through iterators
+    iter = map.begin();
+    while (iter != map.end())
+    {
+        iter = map.erase(iter);
+    }
+    map.validate();
+    EXPECT_TRUE(map.empty());
+}
+
+static int32_t makeInt32(int i) { return i * 7 - 100; }
+static uint64_t makeUint64(int i) { return 0x7FFFFFFFFFFFF000ULL + i * 3; }
+static std::string makeString(int i)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%05d", i);
+    return buf;
+}
+
+TEST(BTreeMap, Random)
+{
+    testRandom<BTreeMap<int32_t, int>, int32_t>(makeInt32);
+    testRandom<BTreeMap<uint64_t, int>, uint64_t>(makeUint64);
+    testRandom<BTreeMap<std::string, int>, std::string>(makeString);
+    // Small nodes make a deep tree.
+    testRandom<BTreeMap<int32_t, int, std::less<int32_t>, 64>, int32_t>(makeInt32);
+}
+
+TEST(BTreeMap, Subscript)
+{
+    BTreeMap<uint64_t, uint64_t> map;
+    map[3] = 4;
+    map[3] += 1;
+    EXPECT_EQ(5UL, map[3]);
+    EXPECT_EQ(0UL, map[4]);
+    EXPECT_EQ(2UL, map.size());
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_TRUE(map.begin() == map.end());
+}
+
+TEST(BTreeMap, ConstIterator)
+{
+    typedef BTreeMap<uint64_t, uint64_t> Map;
+    Map map;
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        map.insert(i, i * 2);
+    }
+    const Map& constMap = map;
+    static_assert(std::is_same<const uint64_t&,
+                               decltype(constMap.find(1).value())>::value,
+                  "a const map hands out const values");
+    static_assert(std::is_same<uint64_t&, decltype(map.find(1).value())>::value,
+                  "a map hands out mutable values");
+    static_assert(std::is_convertible<Map::iterator, Map::const_iterator>::value,
+                  "an iterator converts to a const_iterator");
+    static_assert(!std::is_convertible<Map::const_iterator, Map::iterator>::value,
+                  "a const_iterator does not convert to an iterator");
+
+    uint64_t expected = 0;
+    for (Map::const_iterator iter = constMap.begin(); iter != constMap.end(); ++iter)
+    {
+        EXPECT_EQ(expected, iter.key());
+        EXPECT_EQ(expected * 2, iter.value());
+        ++expected;
+    }
+    EXPECT_EQ(1000UL, expected);
+    EXPECT_TRUE(constMap.find(1000) == constMap.end());
+    EXPECT_EQ(20UL, constMap.lower_bound(10).value());
+    EXPECT_EQ(22UL, constMap.upper_bound(10).value());
+
+    // An iterator converts to, and compares with, a const_iterator.
+    Map::iterator iter = map.find(5);
+    iter.value() = 1;
+    Map::const_iterator constIter = iter;
+    EXPECT_TRUE(constIter == iter);
+    EXPECT_TRUE(iter == constIter);
+    EXPECT_EQ(1UL, constIter.value());
+    EXPECT_TRUE(++constIter != iter);
+}
+
+struct BTreeBenchNode
+{
+    uint64_t key;
+    MapLinkNode node;
+};
+
+typedef IntrusiveMap<uint64_t, BTreeBenchNode,
+                     &BTreeBenchNode::key, &BTreeBenchNode::node> BenchIntrusiveMap;
+
+// Lookup and range scan latency at growing sizes.  Raise kMaxBenchmarkKeys
+// up to 10^8 for a full run, the default keeps the unit test fast.
+TEST(BTreeMap, Benchmark)
+{
+    const size_t kMaxBenchmarkKeys = 1000000;
+    const size_t kLookups = 1000000;
+    for (size_t count = 1000; count <= kMaxBenchmarkKeys; count *= 10)
+    {
+        std::vector<uint64_t> keys(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            keys[i] = (static_cast<uint64_t>(rand()) << 31) | rand();    // NOLINT
+        }
+        std::vector<uint64_t> probes(kLookups);
+        for (size_t i = 0; i < kLookups; ++i)
+        {
+            probes[i] = keys[rand() % count];    // NOLINT(runtime/threadsafe_fn)
+        }
+
+        BTreeMap<uint64_t, uint64_t> btree;
+        std::map<uint64_t, uint64_t> stdMap;
+        BenchIntrusiveMap intrusiveMap;
+        std::vector<BTreeBenchNode> nodes(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            btree.insert(keys[i], i);
+            stdMap.insert(std::make_pair(keys[i], i));
+            nodes[i].key = keys[i];
+            intrusiveMap.insert(&nodes[i]);
+        }
+
+        uint64_t sum = 0;
+        uint64_t start = GetCurrentTimeInUs();
+        for (size_t i = 0; i < kLookups; ++i)
+        {
+            sum += btree.find(probes[i]).value();
+        }
+        uint64_t btreeFind = GetCurrentTimeInUs() - start;
+        start = GetCurrentTimeInUs();
+        for (size_t i = 0; i < kLookups; ++i)
+        {
+            sum += stdMap.find(probes[i])->second;
+        }
+        uint64_t stdFind = GetCurrentTimeInUs() - start;
+        start = GetCurrentTimeInUs();
+        for (size_t i = 0; i < kLookups; ++i)
+        {
+            sum += intrusiveMap.find(probes[i])->key;
+        }
+        uint64_t intrusiveFind = GetCurrentTimeInUs() - start;
+
+        start = GetCurrentTimeInUs();
+        for (BTreeMap<uint64_t, uint64_t>::iterator iter = btree.begin();
+             iter != btree.end(); ++iter)
+        {
+            sum += iter.value();
+        }
+        uint64_t btreeScan = GetCurrentTimeInUs() - start;
+        start = GetCurrentTimeInUs();
+        for (std::map<uint64_t, uint64_t>::iterator iter = stdMap.begin();
+             iter != stdMap.end(); ++iter)
+        {
+            sum += iter->second;
+        }
+        uint64_t stdScan = GetCurrentTimeInUs() - start;
+        start = GetCurrentTimeInUs();
+        for (BenchIntrusiveMap::iterator iter = intrusiveMap.begin();
+             iter != intrusiveMap.end(); ++iter)
+        {
+            sum += iter->key;
+        }
+        uint64_t intrusiveScan = GetCurrentTimeInUs() - start;
+
+        fprintf(stderr, ">>> %lu keys: find BTreeMap %luns, std::map %luns, IntrusiveMap %luns; "
+                "scan BTreeMap %luns, std::map %luns, IntrusiveMap %luns (%lu)\n",
+                count,
+                btreeFind * 1000UL / kLookups, stdFind * 1000UL / kLookups,
+                intrusiveFind * 1000UL / kLookups,
+                btreeScan * 1000UL / count, stdScan * 1000UL / count,
+                intrusiveScan * 1000UL / count, sum % 10);
+        intrusiveMap.clear();
+    }
+}
@@ -3,6 +3,7 @@
 #include <queue>
 #include <vector>
 
+#include "src/base/gettime.h"
 #include "src/base/intrusive_heap.h"
 #include "src/base/intrusive_list.h"
 #include "src/memory/mempool.h"
@@ -296,3 +297,245 @@ TEST_F(IntrusiveHeapTest, Reserve)
     EXPECT_EQ(newCapacity, heap.capacity());
 }
 
+
+typedef HeapMemberKey<Record, int, &Record::value> RecordKey;
+typedef IntrusiveHeap<
+    Record, &Record::heapNode, std::less<Record>, 4> MaxHeap4;
+typedef IntrusiveHeap<
+    Record, &Record::heapNode, std::less<int>, 4, RecordKey> KeyedMaxHeap4;
+typedef IntrusiveHeap<
+    Record, &Record::heapNode, std::less<int>, 8, RecordKey> KeyedMaxHeap8;
+typedef IntrusiveHeap<
+    Record, &Record::heapNode, std::greater<int>, 3, RecordKey> KeyedMinHeap3;
+
+template <typename HeapType>
+static void checkOrder(HeapType* heap, bool maxHeap)
+{
+    int prevValue = maxHeap ? INT32_MAX : INT32_MIN;
+    while (!heap->empty())
+    {
+        Record* record = heap->top();
+        if (maxHeap)
+        {
+            EXPECT_GE(prevValue, record->value);
+        }
+        else
+        {
+            EXPECT_LE(prevValue, record->value);
+        }
+        prevValue = record->value;
+        heap->pop();
+        EXPECT_TRUE(record->heapNode.IsSingle());
+    }
+}
+
+template <typename HeapType>
+static void testVariant(bool maxHeap)
+{
+    MemPool pool;
+    HeapType heap;
+    std::vector<Record*> records;
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        // Small values to have plenty of duplicates
+        int value = rand() % 1000;    // NOLINT(runtime/threadsafe_fn)
+        Record* record = pool.New<Record>(value);
+        heap.push(record);
+        records.push_back(record);
+    }
+    for (size_t i = 0; i < records.size(); i += 3)
+    {
+        heap.erase(records[i]);
+        EXPECT_TRUE(records[i]->heapNode.IsSingle());
+    }
+    EXPECT_EQ(records.size() - (records.size() + 2) / 3, heap.size());
+    checkOrder(&heap, maxHeap);
+
+    IntrusiveList<Record, &Record::listNode> list;
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        list.push_back(records[i]);
+    }
+    HeapType heap2(list.begin(), list.end());
+    EXPECT_EQ(records.size(), heap2.size());
+    heap2.erase(records[records.size() / 2]);
+    checkOrder(&heap2, maxHeap);
+}
+
+TEST_F(IntrusiveHeapTest, Arity)
+{
+    testVariant<MaxHeap4>(true);
+    testVariant<KeyedMaxHeap4>(true);
+    testVariant<KeyedMaxHeap8>(true);
+    testVariant<KeyedMinHeap3>(false);
+}
+
+template <typename HeapType>
+static void benchmarkHeap(const char* name, const std::vector<Record*>& records)
+{
+    const size_t count = records.size();
+    HeapType heap;
+    heap.reserve(count);
+
+    uint64_t start = GetCurrentTimeInUs();
+    for (size_t i = 0; i < count; ++i)
+    {
+        heap.push(records[i]);
+    }
+    uint64_t pushed = GetCurrentTimeInUs();
+    // Erase a half at random positions, then pop the rest.
+    for (size_t i = 0; i < count; i += 2)
+    {
+        heap.erase(records[i]);
+    }
+    uint64_t erased = GetCurrentTimeInUs();
+    while (!heap.empty())
+    {
+        heap.pop();
+    }
+    uint64_t popped = GetCurrentTimeInUs();
+    fprintf(stderr, ">>> %s: push %luns, erase %luns, pop %luns\n", name,
+            (pushed - start) * 1000UL / count,
+            (erased - pushed) * 2000UL / count,
+            (popped - erased) * 2000UL / count);
+}
+
+TEST_F(IntrusiveHeapTest, Benchmark)
+{
+    // Values are random, so neighbours in the heap are scattered in memory.
+    MemPool pool;
+    const size_t count = 1000000;
+    std::vector<Record*> records;
+    records.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        int value = rand();    // NOLINT(runtime/threadsafe_fn)
+        records.push_back(pool.New<Record>(value));
+    }
+    benchmarkHeap<MaxHeap>("Binary heap", records);
+    benchmarkHeap<MaxHeap4>("4-ary heap", records);
+    benchmarkHeap<KeyedMaxHeap4>("4-ary heap with cached key", records);
+    benchmarkHeap<KeyedMaxHeap8>("8-ary heap with cached key", records);
+}
+
+template <typename HeapType>
+static void testUpdate(bool maxHeap)
+{
+    MemPool pool;
+    HeapType heap;
+    std::vector<Record*> records;
+    for (size_t i = 0; i < 4096; ++i)
+    {
+        int value = rand() % 10000;    // NOLINT(runtime/threadsafe_fn)
+        Record* record = pool.New<Record>(value);
+        heap.push(record);
+        records.push_back(record);
+    }
+    // Move objects both ways, including the top one.
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        size_t index = rand() % records.size();    // NOLINT(runtime/threadsafe_fn)
+        Record* record = i % 10 == 0 ? heap.top() : records[index];
+        record->value = rand() % 10000;    // NOLINT(runtime/threadsafe_fn)
+        heap.update(record);
+    }
+    EXPECT_EQ(records.size(), heap.size());
+    checkOrder(&heap, maxHeap);
+}
+
+TEST_F(IntrusiveHeapTest, Update)
+{
+    testUpdate<MaxHeap>(true);
+    testUpdate<MinHeap>(false);
+    testUpdate<KeyedMaxHeap4>(true);
+    testUpdate<KeyedMinHeap3>(false);
+}
+
+template <typename HeapType>
+static void testMerge(size_t leftCount, size_t rightCount)
+{
+    MemPool pool;
+    HeapType left;
+    HeapType right;
+    for (size_t i = 0; i < leftCount + rightCount; ++i)
+    {
+        int value = rand();    // NOLINT(runtime/threadsafe_fn)
+        Record* record = pool.New<Record>(value);
+        (i < leftCount ? left : right).push(record);
+    }
+    left.merge(&right);
+    EXPECT_TRUE(right.empty());
+    EXPECT_EQ(leftCount + rightCount, left.size());
+
+    // 'right' is still usable
+    Record* record = pool.New<Record>(1);
+    right.push(record);
+    EXPECT_EQ(record, right.top());
+    right.pop();
+    checkOrder(&left, true);
+}
+
+TEST_F(IntrusiveHeapTest, Merge)
+{
+    // Both shifting up and rebuilding
+    testMerge<MaxHeap>(3000, 100);
+    testMerge<MaxHeap>(100, 3000);
+    testMerge<KeyedMaxHeap8>(3000, 100);
+    testMerge<KeyedMaxHeap8>(0, 3000);
+}
+
+TEST_F(IntrusiveHeapTest, PushRange)
+{
+    MemPool pool;
+    MaxHeap heap;
+    std::vector<Record*> records;
+    for (size_t round = 0; round < 4; ++round)
+    {
+        IntrusiveList<Record, &Record::listNode> list;
+        for (size_t i = 0; i < static_cast<size_t>(1000) << round; ++i)
+        {
+            int value = rand();    // NOLINT(runtime/threadsafe_fn)
+            Record* record = pool.New<Record>(value);
+            list.push_back(record);
+        }
+        heap.push(list.begin(), list.end());
+    }
+    EXPECT_EQ(15000UL, heap.size());
+    checkOrder(&heap, true);
+}
+
+TEST_F(IntrusiveHeapTest, UpdateBenchmark)
+{
+    MemPool pool;
+    const size_t count = 100000;
+    const size_t updates = 1000000;
+    std::vector<Record*> records;
+    KeyedMaxHeap4 heap;
+    for (size_t i = 0; i < count; ++i)
+    {
+        int value = rand() % 1000000;    // NOLINT(runtime/threadsafe_fn)
+        records.push_back(pool.New<Record>(value));
+        heap.push(records.back());
+    }
+
+    uint64_t start = GetCurrentTimeInUs();
+    for (size_t i = 0; i < updates; ++i)
+    {
+        Record* record = records[i % count];
+        record->value += (i & 1) ? 1000 : -1000;
+        heap.erase(record);
+        heap.push(record);
+    }
+    uint64_t end = GetCurrentTimeInUs();
+    fprintf(stderr, ">>> Erase and push: %luns\n", (end - start) * 1000UL / updates);
+
+    start = GetCurrentTimeInUs();
+    for (size_t i = 0; i < updates; ++i)
+    {
+        Record* record = records[i % count];
+        record->value += (i & 1) ? 1000 : -1000;
+        heap.update(record);
+    }
+    end = GetCurrentTimeInUs();
+    fprintf(stderr, ">>> Update: %luns\n", (end - start) * 1000UL / updates);
+}
@@ -2,6 +2,7 @@
 
 #include <gtest/gtest.h>
 #include <set>
+#include <vector>
 
 struct MapTestNode
 {
@@ -242,3 +243,45 @@ TEST(IntrusiveMap, BasicTest)
     NodeAllocatorArray allocator;
     IntrusiveMapTest(&map, &allocator, &randSeed);
 }
+
+typedef IntrusiveMultiMap<
+    int,
+    MapTestNode,
+    &MapTestNode::key,
+    &MapTestNode::link> MultiMapForTest;
+
+TEST(IntrusiveMap, BulkTest)
+{
+    MapTestNode nodes[100];
+    for (int i = 0; i < 100; ++i)
+    {
+        nodes[i].key = i / 2;
+    }
+    MapForTest map;
+    std::vector<MapTestNode*> duplicates;
+    EXPECT_EQ(50U, map.insert_sorted(nodes, nodes + 100, &duplicates));
+    EXPECT_EQ(50U, duplicates.size());
+    map.validate_map();
+
+    MapForTest right;
+    map.split(20, &right);
+    EXPECT_EQ(20U, map.size());
+    EXPECT_EQ(30U, right.size());
+    EXPECT_EQ(30U, map.merge(&right));
+    EXPECT_EQ(50U, map.size());
+    EXPECT_EQ(10U, map.erase_range(20, 30));
+    EXPECT_EQ(40U, map.size());
+    map.validate_map();
+    map.clear();
+
+    MultiMapForTest multiMap;
+    EXPECT_EQ(100U, multiMap.insert_sorted(nodes, nodes + 100));
+    MultiMapForTest other;
+    multiMap.split(25, &other);
+    EXPECT_EQ(50U, multiMap.size());
+    multiMap.join(&other);
+    EXPECT_EQ(100U, multiMap.size());
+    EXPECT_EQ(10U, multiMap.erase_range(0, 5));
+    multiMap.validate_map();
+    multiMap.clear();
+}
@@ -1,10 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <stdio.h>
 #include <algorithm>
 #include <map>
 #include <set>
 #include <vector>
 
+#include "src/base/gettime.h"
 #include "src/base/intrusive_map.h"
 #include "src/base/intrusive_rbtree.h"
 
@@ -444,6 +446,354 @@ TEST(IntrusiveRBTree, MultiRandom)
     }
 }
 
+typedef IntrusiveRBTree<
+    int,
+    TestNode,
+    &TestNode::key,
+    &TestNode::node,
+    std::less<int>,
+    true> OrderStatisticTree;
+
+static void CheckOrderStatistic(const OrderStatisticTree& tree,
+                                const std::multiset<int>& checker)
+{
+    tree.validate_tree();
+    std::vector<int> keys(checker.begin(), checker.end());
+    ASSERT_EQ(keys.size(), tree.size());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        OrderStatisticTree::const_iterator iter = tree.select(i);
+        ASSERT_TRUE(iter != tree.end());
+        EXPECT_EQ(keys[i], iter->key);
+        EXPECT_EQ(i, tree.rank(&(*iter)));
+    }
+    EXPECT_TRUE(tree.select(keys.size()) == tree.end());
+    for (int key = -1; key <= 1001; key += 7)
+    {
+        size_t rank = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        EXPECT_EQ(rank, tree.rank(key));
+        int hi = key + 50;
+        EXPECT_EQ(static_cast<size_t>(std::distance(checker.lower_bound(key),
+                                                    checker.lower_bound(hi))),
+                  tree.count_range(key, hi));
+        EXPECT_EQ(0UL, tree.count_range(hi, key));
+    }
+}
+
+TEST(IntrusiveRBTree, OrderStatistic)
+{
+    OrderStatisticTree tree;
+    std::multiset<int> checker;
+    std::vector<TestNode> nodes(2000);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        nodes[i].key = rand() % 1000;    // NOLINT(runtime/threadsafe_fn)
+        if (i % 3 == 0)
+        {
+            tree.insert_multi(&nodes[i]);
+        }
+        else if (i % 3 == 1)
+        {
+            tree.insert_unique(tree.lower_bound(nodes[i].key), &nodes[i]);
+            if (checker.count(nodes[i].key) != 0)
+            {
+                // Not inserted, use as a multi one.
+                tree.insert_multi(tree.begin(), &nodes[i]);
+            }
+        }
+        else
+        {
+            tree.insert_multi(tree.upper_bound(nodes[i].key), &nodes[i]);
+        }
+        checker.insert(nodes[i].key);
+    }
+    CheckOrderStatistic(tree, checker);
+
+    // Erase by value, by iterator and by key
+    for (size_t i = 0; i < nodes.size(); i += 4)
+    {
+        tree.erase(&nodes[i]);
+        checker.erase(checker.find(nodes[i].key));
+    }
+    CheckOrderStatistic(tree, checker);
+    for (size_t i = 0; i < 200; ++i)
+    {
+        size_t k = rand() % tree.size();    // NOLINT(runtime/threadsafe_fn)
+        OrderStatisticTree::iterator iter = tree.select(k);
+        checker.erase(checker.find(iter->key));
+        tree.erase(iter);
+    }
+    CheckOrderStatistic(tree, checker);
+    for (int key = 0; key < 1000; key += 3)
+    {
+        EXPECT_EQ(checker.erase(key), tree.erase(key));
+    }
+    CheckOrderStatistic(tree, checker);
+}
+
+static bool TestNodeKeyLess(const TestNode& a, const TestNode& b)
+{
+    return a.key < b.key;
+}
+
+template <typename TreeType>
+static void CheckKeys(const TreeType& tree, const std::multiset<int>& checker)
+{
+    tree.validate_tree();
+    ASSERT_EQ(checker.size(), tree.size());
+    typename TreeType::const_iterator iter = tree.begin();
+    for (std::multiset<int>::const_iterator i = checker.begin(); i != checker.end(); ++i, ++iter)
+    {
+        EXPECT_EQ(*i, iter->key);
+    }
+}
+
+template <typename TreeType>
+static void TestBulkUnique()
+{
+    TreeType tree;
+    std::multiset<int> checker;
+    std::vector<TestNode> nodes(3000);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        nodes[i].key = rand() % 2000;    // NOLINT(runtime/threadsafe_fn)
+    }
+    // Sorted batches of different sizes, with duplicates inside and across.
+    size_t begin = 0;
+    for (size_t batch = 1; begin < nodes.size(); batch *= 3)
+    {
+        size_t end = std::min(nodes.size(), begin + batch);
+        std::sort(&nodes[begin], &nodes[0] + end, TestNodeKeyLess);
+        std::vector<TestNode*> duplicates;
+        size_t expected = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (checker.count(nodes[i].key) == 0)
+            {
+                checker.insert(nodes[i].key);
+                ++expected;
+            }
+        }
+        EXPECT_EQ(expected, tree.insert_sorted_unique(&nodes[begin], &nodes[0] + end,
+                                                      &duplicates));
+        EXPECT_EQ(end - begin - expected, duplicates.size());
+        CheckKeys(tree, checker);
+        begin = end;
+    }
+
+    // Split and join back
+    for (int key = -1; key <= 2001; key += 250)
+    {
+        TreeType right;
+        tree.split(key, &right);
+        tree.validate_tree();
+        right.validate_tree();
+        EXPECT_EQ(static_cast<size_t>(std::distance(checker.begin(), checker.lower_bound(key))),
+                  tree.size());
+        EXPECT_TRUE(tree.empty() || (--tree.end())->key < key);
+        EXPECT_TRUE(right.empty() || right.begin()->key >= key);
+        tree.join(&right);
+        EXPECT_TRUE(right.empty());
+        CheckKeys(tree, checker);
+    }
+
+    // Union with another tree
+    std::vector<TestNode> others(1000);
+    TreeType other;
+    std::multiset<int> otherChecker;
+    for (size_t i = 0; i < others.size(); ++i)
+    {
+        others[i].key = rand() % 4000;    // NOLINT(runtime/threadsafe_fn)
+        if (other.insert_unique(&others[i]).second)
+        {
+            otherChecker.insert(others[i].key);
+        }
+    }
+    size_t expected = 0;
+    FOREACH(iter, otherChecker)
+    {
+        if (checker.count(*iter) == 0)
+        {
+            checker.insert(*iter);
+            ++expected;
+        }
+    }
+    std::vector<TestNode*> duplicates;
+    EXPECT_EQ(expected, tree.merge_unique(&other, &duplicates));
+    EXPECT_EQ(otherChecker.size() - expected, duplicates.size());
+    EXPECT_TRUE(other.empty());
+    CheckKeys(tree, checker);
+
+    // Difference: remove the odd keys
+    TreeType odd;
+    std::vector<TestNode> odds(2000);
+    for (size_t i = 0; i < odds.size(); ++i)
+    {
+        odds[i].key = i * 2 + 1;
+        odd.insert_unique(&odds[i]);
+    }
+    std::vector<TestNode*> removed;
+    size_t count = tree.difference(odd, &removed);
+    EXPECT_EQ(count, removed.size());
+    for (size_t i = 0; i < removed.size(); ++i)
+    {
+        EXPECT_EQ(1, removed[i]->key % 2);
+        checker.erase(removed[i]->key);
+    }
+    EXPECT_EQ(2000UL, odd.size());
+    CheckKeys(tree, checker);
+    odd.clear();
+
+    // Erase ranges
+    for (int lo = 0; lo < 4000; lo += 500)
+    {
+        int hi = lo + 100;
+        removed.clear();
+        size_t n = std::distance(checker.lower_bound(lo), checker.lower_bound(hi));
+        EXPECT_EQ(n, tree.erase_range(lo, hi, &removed));
+        EXPECT_EQ(n, removed.size());
+        checker.erase(checker.lower_bound(lo), checker.lower_bound(hi));
+        CheckKeys(tree, checker);
+    }
+    EXPECT_EQ(0UL, tree.erase_range(100, 100));
+    EXPECT_EQ(checker.size(), tree.erase_range(-1, 4000));
+    EXPECT_TRUE(tree.empty());
+}
+
+template <typename TreeType>
+static void TestBulkMulti()
+{
+    TreeType tree;
+    std::multiset<int> checker;
+    std::vector<TestNode> nodes(3000);
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        nodes[i].key = rand() % 300;    // NOLINT(runtime/threadsafe_fn)
+        nodes[i].value1 = i;
+    }
+    for (size_t begin = 0; begin < nodes.size(); begin += 500)
+    {
+        // Stable sort, so that value1 grows along equal keys.
+        std::stable_sort(&nodes[begin], &nodes[begin] + 500, TestNodeKeyLess);
+        EXPECT_EQ(500UL, tree.insert_sorted_multi(&nodes[begin], &nodes[begin] + 500));
+        for (size_t i = begin; i < begin + 500; ++i)
+        {
+            checker.insert(nodes[i].key);
+        }
+    }
+    CheckKeys(tree, checker);
+    // New objects go after existing ones with equal keys.
+    for (typename TreeType::iterator iter = tree.begin(); iter != tree.end(); ++iter)
+    {
+        typename TreeType::iterator next = iter;
+        ++next;
+        if (next != tree.end() && next->key == iter->key)
+        {
+            EXPECT_LT(iter->value1, next->value1);
+        }
+    }
+
+    TreeType right;
+    tree.split(150, &right);
+    EXPECT_EQ(static_cast<size_t>(std::distance(checker.begin(), checker.lower_bound(150))),
+              tree.size());
+    tree.merge_multi(&right);
+    CheckKeys(tree, checker);
+
+    TreeType evens;
+    std::vector<TestNode> evenNodes(150);
+    for (size_t i = 0; i < evenNodes.size(); ++i)
+    {
+        evenNodes[i].key = i * 2;
+        evens.insert_multi(&evenNodes[i]);
+    }
+    size_t expected = 0;
+    for (int key = 0; key < 300; key += 2)
+    {
+        expected += checker.erase(key);
+    }
+    EXPECT_EQ(expected, tree.difference(evens));
+    CheckKeys(tree, checker);
+    evens.clear();
+
+    size_t n = std::distance(checker.lower_bound(51), checker.lower_bound(99));
+    EXPECT_EQ(n, tree.erase_range(51, 99));
+    checker.erase(checker.lower_bound(51), checker.lower_bound(99));
+    CheckKeys(tree, checker);
+    tree.clear();
+}
+
+TEST(IntrusiveRBTree, BulkOperations)
+{
+    TestBulkUnique<RBTreeTestType>();
+    TestBulkUnique<OrderStatisticTree>();
+    TestBulkMulti<RBTreeTestType>();
+    TestBulkMulti<OrderStatisticTree>();
+}
+
+// Insert sorted batches into a tree of 10^6 objects, with keys spread over
+// the tree or falling into one gap.
+TEST(IntrusiveRBTree, BulkBenchmark)
+{
+    const size_t count = 1000000;
+    std::vector<TestNode> nodes(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        nodes[i].key = rand() & ~0xFFFFF;    // NOLINT(runtime/threadsafe_fn)
+    }
+    RBTreeTestType tree;
+    for (size_t i = 0; i < count; ++i)
+    {
+        tree.insert_multi(&nodes[i]);
+    }
+    for (size_t batch = 10000; batch <= count; batch *= 10)
+    {
+        for (int clustered = 0; clustered < 2; ++clustered)
+        {
+            std::vector<TestNode> batchNodes(batch);
+            int base = rand() & ~0xFFFFF;    // NOLINT(runtime/threadsafe_fn)
+            for (size_t i = 0; i < batch; ++i)
+            {
+                batchNodes[i].key = clustered ? base + (rand() & 0xFFFFE) + 1    // NOLINT
+                                              : rand();    // NOLINT(runtime/threadsafe_fn)
+            }
+            std::sort(batchNodes.begin(), batchNodes.end(), TestNodeKeyLess);
+
+            uint64_t start = GetCurrentTimeInUs();
+            for (size_t i = 0; i < batch; ++i)
+            {
+                tree.insert_multi(&batchNodes[i]);
+            }
+            uint64_t oneByOne = GetCurrentTimeInUs() - start;
+            for (size_t i = 0; i < batch; ++i)
+            {
+                tree.erase(&batchNodes[i]);
+            }
+            start = GetCurrentTimeInUs();
+            tree.insert_sorted_multi(batchNodes.begin(), batchNodes.end());
+            uint64_t bulk = GetCurrentTimeInUs() - start;
+            if (!clustered)
+            {
+                for (size_t i = 0; i < batch; ++i)
+                {
+                    tree.erase(&batchNodes[i]);
+                }
+                fprintf(stderr, ">>> spread batch of %lu into %lu: one by one %luus, "
+                        "insert_sorted_multi %luus\n", batch, count, oneByOne, bulk);
+                continue;
+            }
+            start = GetCurrentTimeInUs();
+            size_t erased = tree.erase_range(batchNodes.front().key,
+                                             batchNodes.back().key + 1);
+            uint64_t eraseRange = GetCurrentTimeInUs() - start;
+            fprintf(stderr, ">>> clustered batch of %lu into %lu: one by one %luus, "
+                    "insert_sorted_multi %luus; erase_range of %lu %luus\n",
+                    batch, count, oneByOne, bulk, erased, eraseRange);
+        }
+    }
+    tree.clear();
+}
+
 static void GenerateValues(std::vector<TestNode*>* out, int n)
 {
     std::set<int> keys;
@@ -0,0 +1,170 @@
+#include <gtest/gtest.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+
+#include "src/base/mapped_slot_vector.h"
+
+struct MappedItem
+{
+    uint64_t key;
+    uint64_t value;
+};
+
+typedef MappedSlotVector<MappedItem, 8, 8> SmallMappedSlotVector;
+
+class MappedSlotVectorTest : public testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/mapped_slot_vector_test.%d", getpid());
+        mPath = path;
+        unlink(mPath.c_str());
+    }
+
+    virtual void TearDown()
+    {
+        unlink(mPath.c_str());
+    }
+
+    static void append(SmallMappedSlotVector* vec, uint64_t from, uint64_t to)
+    {
+        for (uint64_t i = from; i < to; ++i)
+        {
+            MappedItem item = { i, i * 2 };
+            ASSERT_TRUE(vec->PushBack(item).IsOk());
+        }
+    }
+
+    std::string mPath;
+};
+
+TEST_F(MappedSlotVectorTest, Reopen)
+{
+    SmallMappedSlotVector* vec = new SmallMappedSlotVector;
+    ASSERT_TRUE(vec->Open(mPath).IsOk());
+    EXPECT_EQ(0UL, vec->Size());
+    append(vec, 0, 1000);
+    EXPECT_EQ(1000UL, vec->Size());
+    EXPECT_EQ(0UL, vec->GetCheckpointSize());
+    ASSERT_TRUE(vec->Checkpoint().IsOk());
+    EXPECT_EQ(1000UL, vec->GetCheckpointSize());
+    ASSERT_TRUE(vec->Close().IsOk());
+
+    ASSERT_TRUE(vec->Open(mPath).IsOk());
+    ASSERT_EQ(1000UL, vec->Size());
+    for (uint64_t i = 0; i < vec->Size(); ++i)
+    {
+        EXPECT_EQ(i, (*vec)[i].key);
+        EXPECT_EQ(i * 2, (*vec)[i].value);
+    }
+    append(vec, 1000, 1500);
+    delete vec;
+
+    // Destructor closes and checkpoints as well.
+    vec = new SmallMappedSlotVector;
+    ASSERT_TRUE(vec->Open(mPath).IsOk());
+    EXPECT_EQ(1500UL, vec->Size());
+    EXPECT_EQ(1500UL, vec->GetCheckpointSize());
+    EXPECT_EQ(1499UL, (*vec)[1499].key);
+    delete vec;
+}
+
+TEST_F(MappedSlotVectorTest, Resize)
+{
+    SmallMappedSlotVector* vec = new SmallMappedSlotVector;
+    ASSERT_TRUE(vec->Open(mPath).IsOk());
+    append(vec, 0, 1000);
+    ASSERT_TRUE(vec->Resize(100).IsOk());
+    EXPECT_EQ(100UL, vec->Size());
+    EXPECT_EQ(99UL, (*vec)[99].key);
+
+    // Grown elements are zero, even where old data was left in the last slot.
+    ASSERT_TRUE(vec->Resize(2000).IsOk());
+    EXPECT_EQ(2000UL, vec->Size());
+    EXPECT_EQ(99UL, (*vec)[99].key);
+    for (uint64_t i = 100; i < vec->Size(); ++i)
+    {
+        EXPECT_EQ(0UL, (*vec)[i].key);
+        EXPECT_EQ(0UL, (*vec)[i].value);
+    }
+    delete vec;
+}
+
+TEST_F(MappedSlotVectorTest, ReadOnlyAttach)
+{
+    SmallMappedSlotVector* writer = new SmallMappedSlotVector;
+    ASSERT_TRUE(writer->Open(mPath).IsOk());
+    append(writer, 0, 100);
+
+    // Only one writer at a time.
+    SmallMappedSlotVector* other = new SmallMappedSlotVector;
+    EXPECT_FALSE(other->Open(mPath).IsOk());
+    delete other;
+
+    SmallMappedSlotVector* reader = new SmallMappedSlotVector;
+    ASSERT_TRUE(reader->Open(mPath, SmallMappedSlotVector::kReadOnly).IsOk());
+    EXPECT_TRUE(reader->IsReadOnly());
+    EXPECT_EQ(100UL, reader->Size());
+
+    append(writer, 100, 1000);
+    EXPECT_EQ(100UL, reader->Size());
+    ASSERT_TRUE(reader->Refresh().IsOk());
+    ASSERT_EQ(1000UL, reader->Size());
+    for (uint64_t i = 0; i < reader->Size(); ++i)
+    {
+        EXPECT_EQ(i, (*reader)[i].key);
+    }
+    delete reader;
+    delete writer;
+}
+
+TEST_F(MappedSlotVectorTest, ShrinkWithAttacher)
+{
+    SmallMappedSlotVector* writer = new SmallMappedSlotVector;
+    ASSERT_TRUE(writer->Open(mPath).IsOk());
+    append(writer, 0, 1000);
+    SmallMappedSlotVector* reader = new SmallMappedSlotVector;
+    ASSERT_TRUE(reader->Open(mPath, SmallMappedSlotVector::kReadOnly).IsOk());
+    ASSERT_EQ(1000UL, reader->Size());
+
+    // The file keeps its length, the shrunk slots read as zeros until Refresh().
+    ASSERT_TRUE(writer->Resize(100).IsOk());
+    EXPECT_EQ(0UL, (*reader)[999].key);
+    EXPECT_EQ(0UL, (*reader)[999].value);
+    ASSERT_TRUE(reader->Refresh().IsOk());
+    EXPECT_EQ(100UL, reader->Size());
+
+    ASSERT_TRUE(writer->Resize(1000).IsOk());
+    ASSERT_TRUE(reader->Refresh().IsOk());
+    ASSERT_EQ(1000UL, reader->Size());
+    EXPECT_EQ(99UL, (*reader)[99].key);
+    for (uint64_t i = 100; i < reader->Size(); ++i)
+    {
+        EXPECT_EQ(0UL, (*reader)[i].key);
+    }
+    delete reader;
+    delete writer;
+}
+
+TEST_F(MappedSlotVectorTest, LayoutMismatch)
+{
+    SmallMappedSlotVector* vec = new SmallMappedSlotVector;
+    ASSERT_TRUE(vec->Open(mPath).IsOk());
+    append(vec, 0, 10);
+    delete vec;
+
+    MappedSlotVector<uint64_t, 8, 8>* other = new MappedSlotVector<uint64_t, 8, 8>;
+    Status status = other->Open(mPath);
+    EXPECT_EQ(INVALID_PARAMETER, status.Code());
+    delete other;
+
+    // The file is left untouched.
+    vec = new SmallMappedSlotVector;
+    ASSERT_TRUE(vec->Open(mPath).IsOk());
+    EXPECT_EQ(10UL, vec->Size());
+    delete vec;
+}
@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <set>
+#include <vector>
+
+#include "src/base/slot_vector.h"
+
+struct PoolItem
+{
+    uint64_t owner;
+    uint64_t value;
+
+    PoolItem() : owner(0), value(0) {}
+};
+
+typedef SlotVector<uint64_t, 8, 4> SmallSlotVector;
+typedef ConcurrentSlotVector<PoolItem, 12, 6> SmallConcurrentSlotVector;
+typedef SlotVectorPool<PoolItem, 8, 6> SmallPool;
+typedef LockFreeSlotVectorPool<PoolItem, 12, 6> SmallLockFreePool;
+
+TEST(SlotVector, PushBackAndResize)
+{
+    SmallSlotVector* vec = new SmallSlotVector;
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        vec->PushBack(i);
+    }
+    EXPECT_EQ(100UL, vec->Size());
+    uint64_t* addr = &(*vec)[17];
+    vec->Resize(1000);
+    EXPECT_EQ(1000UL, vec->Size());
+    EXPECT_EQ(addr, &(*vec)[17]);
+    for (uint64_t i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(i, (*vec)[i]);
+    }
+    vec->Resize(3);
+    EXPECT_EQ(2UL, vec->Back());
+    vec->PopBack();
+    EXPECT_EQ(2UL, vec->Size());
+    delete vec;
+}
+
+struct AppendInfo
+{
+    SmallConcurrentSlotVector* vec;
+    volatile bool* stop;
+    uint64_t producer;
+};
+
+static void* appendProducer(void* args)
+{
+    AppendInfo* info = static_cast<AppendInfo*>(args);
+    for (uint64_t i = 0; i < 10000; ++i)
+    {
+        PoolItem item;
+        item.owner = info->producer;
+        item.value = i;
+        uint64_t index = info->vec->PushBack(item);
+        EXPECT_LE(index + 1, info->vec->Size());
+    }
+    return NULL;
+}
+
+static void* appendReader(void* args)
+{
+    AppendInfo* info = static_cast<AppendInfo*>(args);
+    uint64_t checked = 0;
+    while (!*info->stop)
+    {
+        // Every committed element must be fully constructed.
+        uint64_t size = info->vec->Size();
+        for (; checked < size; ++checked)
+        {
+            const PoolItem& item = (*info->vec)[checked];
+            EXPECT_NE(0UL, item.owner);
+            EXPECT_LT(item.value, 10000UL);
+        }
+    }
+    return NULL;
+}
+
+TEST(ConcurrentSlotVector, ConcurrentAppend)
+{
+    const uint32_t kProducerCount = 4;
+    SmallConcurrentSlotVector* vec = new SmallConcurrentSlotVector;
+    volatile bool stop = false;
+    pthread_t reader;
+    AppendInfo readerInfo = { vec, &stop, 0 };
+    pthread_create(&reader, NULL, appendReader, &readerInfo);
+
+    pthread_t producers[kProducerCount];
+    AppendInfo infos[kProducerCount];
+    for (uint32_t i = 0; i < kProducerCount; ++i)
+    {
+        infos[i].vec = vec;
+        infos[i].stop = &stop;
+        infos[i].producer = i + 1;
+        pthread_create(&producers[i], NULL, appendProducer, &infos[i]);
+    }
+    for (uint32_t i = 0; i < kProducerCount; ++i)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    stop = true;
+    pthread_join(reader, NULL);
+
+    // Elements of each producer keep their order.
+    ASSERT_EQ(kProducerCount * 10000UL, vec->Size());
+    std::vector<uint64_t> next(kProducerCount + 1, 0);
+    for (uint64_t i = 0; i < vec->Size(); ++i)
+    {
+        const PoolItem& item = (*vec)[i];
+        EXPECT_EQ(next[item.owner]++, item.value);
+    }
+    vec->Clear();
+    EXPECT_EQ(0UL, vec->Size());
+    delete vec;
+}
+
+// 'slack' is the number of reserved but never used items which might be
+// handed out before the freed ones.
+template <typename PoolType>
+static void testPoolReuse(size_t slack)
+{
+    PoolType* pool = new PoolType;
+    std::vector<uint32_t> indexes;
+    std::set<PoolItem*> items;
+    for (int i = 0; i < 1000; ++i)
+    {
+        uint32_t index = 0;
+        PoolItem* item = pool->AllocItem(&index);
+        EXPECT_NE(0U, index);
+        EXPECT_TRUE(pool->IsItemIndexValid(index));
+        EXPECT_EQ(item, pool->GetItem(index));
+        EXPECT_EQ(0UL, item->value);
+        item->value = i;
+        indexes.push_back(index);
+        EXPECT_TRUE(items.insert(item).second);
+    }
+    for (size_t i = 0; i < indexes.size(); ++i)
+    {
+        EXPECT_EQ(i, pool->GetItem(indexes[i])->value);
+        pool->DeallocItem(indexes[i]);
+    }
+    // Freed items are reused before allocating new ones.
+    size_t reused = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        uint32_t index = 0;
+        reused += items.count(pool->AllocItem(&index));
+    }
+    EXPECT_GE(reused + slack, 1000UL);
+    delete pool;
+}
+
+TEST(SlotVectorPool, AllocDealloc)
+{
+    testPoolReuse<SmallPool>(0);
+}
+
+TEST(LockFreeSlotVectorPool, AllocDealloc)
+{
+    testPoolReuse<SmallLockFreePool>(SmallLockFreePool::LOCAL_CACHE_BATCH);
+}
+
+static void* lockFreePoolWorker(void* args)
+{
+    SmallLockFreePool* pool = static_cast<SmallLockFreePool*>(args);
+    uint64_t self = static_cast<uint64_t>(ThisThread::GetId());
+    std::vector<uint32_t> indexes;
+    for (int round = 0; round < 200; ++round)
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            uint32_t index = 0;
+            PoolItem* item = pool->AllocItem(&index);
+            item->owner = self;
+            item->value = index;
+            indexes.push_back(index);
+        }
+        for (size_t i = 0; i < indexes.size(); ++i)
+        {
+            // Nobody else should have got the same item.
+            PoolItem* item = pool->GetItem(indexes[i]);
+            EXPECT_EQ(self, item->owner);
+            EXPECT_EQ(indexes[i], item->value);
+            pool->DeallocItem(indexes[i]);
+        }
+        indexes.clear();
+    }
+    return NULL;
+}
+
+TEST(LockFreeSlotVectorPool, MultiThread)
+{
+    const uint32_t kThreadCount = 8;
+    SmallLockFreePool* pool = new SmallLockFreePool;
+    pthread_t tids[kThreadCount];
+    for (uint32_t i = 0; i < kThreadCount; ++i)
+    {
+        pthread_create(&tids[i], NULL, lockFreePoolWorker, pool);
+    }
+    for (uint32_t i = 0; i < kThreadCount; ++i)
+    {
+        pthread_join(tids[i], NULL);
+    }
+    // Local caches were flushed on thread exit, so the items are
+    // reused rather than allocating new ones.
+    uint32_t index = 0;
+    pool->AllocItem(&index);
+    EXPECT_LT(index, kThreadCount * (100 + SmallLockFreePool::LOCAL_CACHE_SIZE +
+                                    SmallLockFreePool::LOCAL_CACHE_BATCH));
+    delete pool;
+}
+
+typedef SlotVectorPool<PoolItem, 8, 6, SimpleMutex, true> GenerationPool;
+typedef LockFreeSlotVectorPool<PoolItem, 8, 6, true> LockFreeGenerationPool;
+
+template <typename PoolType>
+static void testHandle()
+{
+    PoolType* pool = new PoolType;
+    uint64_t handle = 0;
+    PoolItem* item = pool->AllocHandle(&handle);
+    uint32_t index = static_cast<uint32_t>(handle);
+    EXPECT_EQ(item, pool->GetItemByHandle(handle));
+    EXPECT_TRUE(pool->IsHandleValid(handle));
+    EXPECT_EQ(handle, pool->GetHandle(index));
+
+    // A stale handle must not resolve to the item reusing its slot.
+    EXPECT_TRUE(pool->DeallocHandle(handle));
+    EXPECT_FALSE(pool->IsHandleValid(handle));
+    EXPECT_FALSE(pool->DeallocHandle(handle));
+    uint64_t newHandle = 0;
+    PoolItem* newItem = pool->AllocHandle(&newHandle);
+    EXPECT_EQ(item, newItem);
+    EXPECT_EQ(index, static_cast<uint32_t>(newHandle));
+    EXPECT_NE(handle, newHandle);
+    EXPECT_TRUE(pool->GetItemByHandle(handle) == NULL);
+    EXPECT_EQ(newItem, pool->GetItemByHandle(newHandle));
+
+    // The index API keeps generations up to date.
+    pool->DeallocItem(index);
+    EXPECT_FALSE(pool->IsHandleValid(newHandle));
+    pool->AllocItem(&index);
+    EXPECT_TRUE(pool->IsHandleValid(pool->GetHandle(index)));
+    EXPECT_FALSE(pool->IsHandleValid(newHandle));
+    delete pool;
+}
+
+TEST(SlotVectorPool, Handle)
+{
+    testHandle<GenerationPool>();
+
+    // Without generations handles are plain indexes.
+    SmallPool* pool = new SmallPool;
+    uint64_t handle = 0;
+    PoolItem* item = pool->AllocHandle(&handle);
+    EXPECT_EQ(item, pool->GetItem(static_cast<uint32_t>(handle)));
+    EXPECT_EQ(0UL, handle >> 32);
+    EXPECT_EQ(item, pool->GetItemByHandle(handle));
+    EXPECT_TRUE(pool->DeallocHandle(handle));
+    delete pool;
+}
+
+TEST(LockFreeSlotVectorPool, Handle)
+{
+    testHandle<LockFreeGenerationPool>();
+}
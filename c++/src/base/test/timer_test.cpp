@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+
+#include <functional>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/base/intrusive_heap.h"
+#include "src/base/timer.h"
+
+struct TimerRecord
+{
+    uint64_t expireTime;
+    uint64_t firedAt;
+    int fireCount;
+    TimerNode timerNode;
+    HeapNode heapNode;
+
+    TimerRecord() : expireTime(0), firedAt(0), fireCount(0) {}
+};
+
+typedef TimingWheel<TimerRecord, &TimerRecord::timerNode> Wheel;
+
+struct RecordFire
+{
+    explicit RecordFire(uint64_t* n) : now(n) {}
+
+    void operator()(TimerRecord* record)
+    {
+        EXPECT_FALSE(record->timerNode.IsScheduled());
+        record->firedAt = *now;
+        ++record->fireCount;
+    }
+
+    uint64_t* now;
+};
+
+TEST(TimingWheel, FireInOrder)
+{
+    const uint64_t start = 1000000;
+    Wheel wheel(1000, start);
+    const size_t count = 10000;
+    std::vector<TimerRecord> records(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Spread over all levels, including ones far beyond the wheel.
+        uint64_t delay = rand() % (1ULL << (i % 40));    // NOLINT(runtime/threadsafe_fn)
+        records[i].expireTime = start + delay;
+        wheel.Schedule(&records[i], records[i].expireTime);
+        EXPECT_TRUE(records[i].timerNode.IsScheduled());
+    }
+    EXPECT_EQ(count, wheel.Size());
+
+    // Advance with growing steps.
+    uint64_t now = start;
+    uint64_t step = 100;
+    size_t fired = 0;
+    while (!wheel.Empty())
+    {
+        now += step;
+        step += step / 4;
+        fired += wheel.Advance(now, RecordFire(&now));
+    }
+    EXPECT_EQ(count, fired);
+    for (size_t i = 0; i < count; ++i)
+    {
+        const TimerRecord& record = records[i];
+        EXPECT_EQ(1, record.fireCount);
+        EXPECT_GE(record.firedAt, record.expireTime);
+    }
+}
+
+TEST(TimingWheel, Precision)
+{
+    const uint64_t start = 1000000;
+    Wheel wheel(1000, start);
+    std::vector<TimerRecord> records(3000);
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        records[i].expireTime = start + i * 997;
+        wheel.Schedule(&records[i], records[i].expireTime);
+    }
+    // Advance tick by tick, every timer fires within one tick.
+    for (uint64_t now = start; !wheel.Empty(); now += 1000)
+    {
+        wheel.Advance(now, RecordFire(&now));
+    }
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        EXPECT_GE(records[i].firedAt, records[i].expireTime);
+        EXPECT_LT(records[i].firedAt, records[i].expireTime + 1000);
+    }
+}
+
+TEST(TimingWheel, CancelAndReschedule)
+{
+    const uint64_t start = 1000000;
+    Wheel wheel(1000, start);
+    TimerRecord a, b, c;
+    wheel.Schedule(&a, start + 10000);
+    wheel.Schedule(&b, start + 20000);
+    wheel.Schedule(&c, start - 5000);    // Already expired
+    EXPECT_EQ(3UL, wheel.Size());
+
+    EXPECT_TRUE(wheel.Cancel(&a));
+    EXPECT_FALSE(wheel.Cancel(&a));
+    EXPECT_FALSE(a.timerNode.IsScheduled());
+    wheel.Schedule(&b, start + 500000);
+    EXPECT_EQ(start + 500000, b.timerNode.GetExpireTime());
+    EXPECT_EQ(2UL, wheel.Size());
+
+    uint64_t now = start;
+    EXPECT_EQ(1UL, wheel.Advance(now, RecordFire(&now)));
+    EXPECT_EQ(1, c.fireCount);
+    now = start + 400000;
+    EXPECT_EQ(0UL, wheel.Advance(now, RecordFire(&now)));
+    now = start + 500000;
+    EXPECT_EQ(1UL, wheel.Advance(now, RecordFire(&now)));
+    EXPECT_EQ(0, a.fireCount);
+    EXPECT_EQ(1, b.fireCount);
+    EXPECT_TRUE(wheel.Empty());
+
+    wheel.Schedule(&a, now + 1000000);
+    wheel.Clear();
+    EXPECT_FALSE(a.timerNode.IsScheduled());
+    EXPECT_TRUE(wheel.Empty());
+}
+
+struct Periodic
+{
+    Periodic(Wheel* w, uint64_t* n) : wheel(w), now(n) {}
+
+    void operator()(TimerRecord* record)
+    {
+        ++record->fireCount;
+        if (record->fireCount < 10)
+        {
+            record->expireTime += 5000;
+            wheel->Schedule(record, record->expireTime);
+        }
+    }
+
+    Wheel* wheel;
+    uint64_t* now;
+};
+
+TEST(TimingWheel, RescheduleInHandler)
+{
+    const uint64_t start = 1000000;
+    Wheel wheel(1000, start);
+    TimerRecord record;
+    record.expireTime = start + 5000;
+    wheel.Schedule(&record, record.expireTime);
+    uint64_t now = start + 1000000;
+    // Each period is in the past, so fires on the next tick of the same call.
+    EXPECT_EQ(10UL, wheel.Advance(now, Periodic(&wheel, &now)));
+    EXPECT_EQ(10, record.fireCount);
+    EXPECT_TRUE(wheel.Empty());
+}
+
+struct HeapRecordCompare
+{
+    bool operator()(const TimerRecord& left, const TimerRecord& right) const
+    {
+        return left.expireTime > right.expireTime;
+    }
+};
+
+typedef IntrusiveHeap<TimerRecord, &TimerRecord::heapNode, HeapRecordCompare> TimerHeap;
+
+struct NoopFire
+{
+    void operator()(TimerRecord* record) {}
+};
+
+// Connection timers: most of them are pushed back on activity before they
+// expire, and only a few fire.
+TEST(TimingWheel, Benchmark)
+{
+    const size_t count = 200000;
+    const size_t rounds = 100;
+    const uint64_t timeout = 10 * 1000000;
+    std::vector<TimerRecord> records(count);
+    std::vector<uint32_t> active(count * rounds / 10);
+    for (size_t i = 0; i < active.size(); ++i)
+    {
+        active[i] = rand() % count;    // NOLINT(runtime/threadsafe_fn)
+    }
+
+    Wheel wheel(1000, 0);
+    uint64_t start = GetCurrentTimeInUs();
+    for (size_t i = 0; i < count; ++i)
+    {
+        wheel.Schedule(&records[i], rand() % timeout);    // NOLINT(runtime/threadsafe_fn)
+    }
+    size_t fired = 0;
+    uint64_t now = 0;
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        now += 1000;
+        for (size_t i = round * count / 10; i < (round + 1) * count / 10; ++i)
+        {
+            wheel.Schedule(&records[active[i]], now + timeout);
+        }
+        fired += wheel.Advance(now, NoopFire());
+    }
+    uint64_t end = GetCurrentTimeInUs();
+    fprintf(stderr, ">>> TimingWheel: %luns per operation, %lu fired\n",
+            (end - start) * 1000UL / (count + active.size()), fired);
+    wheel.Clear();
+
+    TimerHeap heap;
+    start = GetCurrentTimeInUs();
+    for (size_t i = 0; i < count; ++i)
+    {
+        records[i].expireTime = rand() % timeout;    // NOLINT(runtime/threadsafe_fn)
+        heap.push(&records[i]);
+    }
+    fired = 0;
+    now = 0;
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        now += 1000;
+        for (size_t i = round * count / 10; i < (round + 1) * count / 10; ++i)
+        {
+            TimerRecord* record = &records[active[i]];
+            if (!record->heapNode.IsSingle())
+            {
+                heap.erase(record);
+            }
+            record->expireTime = now + timeout;
+            heap.push(record);
+        }
+        while (!heap.empty() && heap.top()->expireTime <= now)
+        {
+            heap.pop();
+            ++fired;
+        }
+    }
+    end = GetCurrentTimeInUs();
+    fprintf(stderr, ">>> IntrusiveHeap: %luns per operation, %lu fired\n",
+            (end - start) * 1000UL / (count + active.size()), fired);
+    heap.clear();
+}
@@ -1,4 +1,246 @@
 #ifndef _SRC_BASE_TIMER_H
 #define _SRC_BASE_TIMER_H
 
+#include <stdint.h>
+
+#include "src/base/gettime.h"
+#include "src/base/intrusive_list.h"
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+
+class TimerNode
+{
+public:
+    TimerNode() : mExpireTime(0) {}
+    bool IsScheduled() const { return !mLink.IsSingle(); }
+    uint64_t GetExpireTime() const { return mExpireTime; }
+
+private:
+    template <typename T, TimerNode T::*M>
+    friend class TimingWheel;
+
+    LinkNode mLink;
+    uint64_t mExpireTime;
+
+    DISALLOW_COPY_AND_ASSIGN(TimerNode);
+};
+
+/**
+ * An intrusive hierarchical timing wheel.
+ *
+ * Time is divided into ticks.  The wheel has LEVEL_NUM levels of SLOT_NUM
+ * slots each, slots of level 'l' span SLOT_NUM^l ticks.  A timer is linked
+ * into the slot of the lowest level covering its expire tick, so Schedule()
+ * and Cancel() are O(1).  When the lowest level wraps around, the next
+ * slot of the upper level is cascaded, i.e. its timers are re-linked into
+ * lower levels.  Timers further than SLOT_NUM^LEVEL_NUM ticks are parked in
+ * the top level and cascaded until they are close enough.
+ *
+ * A timer never fires before its expire time, but might fire up to one tick
+ * later.  The wheel is not thread-safe.
+ *
+ * @param T  type of object
+ * @param M  member pointer to TimerNode
+ *
+ * Usage:
+ *   struct Connection
+ *   {
+ *       TimerNode timer;
+ *       ...
+ *   };
+ *   struct OnTimeout
+ *   {
+ *       void operator()(Connection* conn) { conn->Close(); }
+ *   };
+ *
+ *   TimingWheel<Connection, &Connection::timer> wheel(1000);  // 1ms ticks
+ *   wheel.Schedule(conn, GetCurrentTimeInUs() + 30 * 1000000);
+ *   ...
+ *   wheel.Advance(GetCurrentTimeInUs(), OnTimeout());
+ */
+template <typename T, TimerNode T::*M>
+class TimingWheel
+{
+public:
+    enum
+    {
+        SLOT_BITS = 8,
+        SLOT_NUM = 1U << SLOT_BITS,
+        SLOT_MASK = SLOT_NUM - 1,
+        LEVEL_NUM = 4,
+    };
+
+    /**
+     * @param tickInUs  granularity of the wheel
+     * @param now       the time to start from
+     */
+    explicit TimingWheel(uint64_t tickInUs = 1000, uint64_t now = GetCurrentTimeInUs())
+        : mTickInUs(tickInUs),
+          mCurrentTick(now / tickInUs),
+          mCount(0)
+    {
+        ASSERT(tickInUs > 0);
+    }
+
+    ~TimingWheel() { Clear(); }
+
+    /**
+     * Arm the timer of 'obj' to fire at 'expireTime' (in us), or re-arm it
+     * if already scheduled.  A time in the past fires on next Advance().
+     */
+    void Schedule(T* obj, uint64_t expireTime)
+    {
+        TimerNode* node = &(obj->*M);
+        if (node->IsScheduled())
+        {
+            node->mLink.Unlink();
+            --mCount;
+        }
+        node->mExpireTime = expireTime;
+        link(obj);
+        ++mCount;
+    }
+
+    /** Arm the timer of 'obj' to fire 'delay' us from now. */
+    void ScheduleAfter(T* obj, uint64_t delay)
+    {
+        Schedule(obj, GetCurrentTimeInUs() + delay);
+    }
+
+    /** Disarm the timer of 'obj', return false if it's not scheduled. */
+    bool Cancel(T* obj)
+    {
+        TimerNode* node = &(obj->*M);
+        if (!node->IsScheduled())
+        {
+            return false;
+        }
+        node->mLink.Unlink();
+        --mCount;
+        return true;
+    }
+
+    /**
+     * Fire all timers expired at 'now' by calling handler(T*).  The timer
+     * is disarmed before the call, so the handler may schedule it again, or
+     * destroy the object.  A timer re-armed in the past by the handler fires
+     * again on the next tick, which might be in the same call.  Return the
+     * number of fired timers.
+     */
+    template <typename Handler>
+    size_t Advance(uint64_t now, Handler handler)
+    {
+        uint64_t nowTick = now / mTickInUs;
+        size_t fired = 0;
+        while (mCurrentTick <= nowTick)
+        {
+            if (mCount == 0)
+            {
+                // Nothing to cascade or fire, jump to the end directly.
+                mCurrentTick = nowTick + 1;
+                break;
+            }
+            uint32_t index = mCurrentTick & SLOT_MASK;
+            if (index == 0)
+            {
+                cascade();
+            }
+            // Move on before firing, so that timers scheduled in the past
+            // by the handler go to the next tick rather than this one.
+            TimerList expired;
+            expired.swap(&mSlots[0][index]);
+            ++mCurrentTick;
+            while (!expired.empty())
+            {
+                TimerNode* node = expired.pop_front();
+                --mCount;
+                ++fired;
+                handler(MemberToObject(node, M));
+            }
+        }
+        return fired;
+    }
+
+    template <typename Handler>
+    size_t Advance(Handler handler)
+    {
+        return Advance(GetCurrentTimeInUs(), handler);
+    }
+
+    /** Disarm all timers. */
+    void Clear()
+    {
+        for (uint32_t level = 0; level < LEVEL_NUM; ++level)
+        {
+            for (uint32_t slot = 0; slot < SLOT_NUM; ++slot)
+            {
+                mSlots[level][slot].clear();
+            }
+        }
+        mCount = 0;
+    }
+
+    size_t Size() const { return mCount; }
+
+    bool Empty() const { return mCount == 0; }
+
+    uint64_t GetTickInUs() const { return mTickInUs; }
+
+private:
+    typedef IntrusiveList<TimerNode, &TimerNode::mLink> TimerList;
+
+    void link(T* obj)
+    {
+        TimerNode* node = &(obj->*M);
+        uint64_t expireTick = (node->mExpireTime + mTickInUs - 1) / mTickInUs;
+        if (expireTick < mCurrentTick)
+        {
+            expireTick = mCurrentTick;
+        }
+        uint64_t delta = expireTick - mCurrentTick;
+        uint32_t level = 0;
+        while (level < LEVEL_NUM - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1))))
+        {
+            ++level;
+        }
+        if (level == LEVEL_NUM - 1)
+        {
+            uint64_t maxDelta = (1ULL << (SLOT_BITS * LEVEL_NUM)) - 1;
+            if (delta > maxDelta)
+            {
+                expireTick = mCurrentTick + maxDelta;
+            }
+        }
+        uint32_t slot = (expireTick >> (SLOT_BITS * level)) & SLOT_MASK;
+        mSlots[level][slot].push_back(node);
+    }
+
+    // Called when the lowest level wraps around.  Re-link the current slot
+    // of upper levels, until a level which doesn't wrap around.
+    void cascade()
+    {
+        for (uint32_t level = 1; level < LEVEL_NUM; ++level)
+        {
+            uint32_t slot = (mCurrentTick >> (SLOT_BITS * level)) & SLOT_MASK;
+            TimerList timers;
+            timers.swap(&mSlots[level][slot]);
+            while (!timers.empty())
+            {
+                link(MemberToObject(timers.pop_front(), M));
+            }
+            if (slot != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    const uint64_t mTickInUs;
+    uint64_t mCurrentTick;      // The next tick to process
+    size_t mCount;
+    TimerList mSlots[LEVEL_NUM][SLOT_NUM];
+
+    DISALLOW_COPY_AND_ASSIGN(TimingWheel);
+};
+
 #endif  // _SRC_BASE_TIMER_H
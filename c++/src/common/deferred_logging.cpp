@@ -0,0 +1,476 @@
+#include "src/common/deferred_logging.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+
+#include "src/base/gettime.h"
+#include "src/common/assert.h"
+#include "src/sync/micro_lock.h"
+#include "src/sync/posix_lock.h"
+#include "src/sync/scoped_lock.h"
+#include "src/sync/worker_rounds.h"
+#include "src/thread/this_thread.h"
+
+namespace
+{
+
+enum
+{
+    kWriteIntervalUs = 10 * 1000,
+    kWriteBatchSize = 256 * 1024,
+    kCalibrationIntervalUs = 1000 * 1000,
+};
+
+const char* const kLevelSymbols[] = {
+    "ALL", "PROFILE", "DEBUG", "INFO", "WARNING", "ERROR", "FATAL"
+};
+
+struct DeferredLogSite
+{
+    const char* format;
+    const char* filename;
+    int line;
+    DeferredLogLevel level;
+    const uint8_t* argTypes;
+    uint32_t argNum;
+};
+
+/**
+ * Cycles to wall time.  The rate is measured against the wall clock over
+ * the life of the writer, "cpu MHz" is a guess to start with only.
+ */
+class CycleClock
+{
+public:
+    CycleClock()
+        : mBaseUs(GetCurrentTimeInUs()),
+          mBaseCycles(GetCpuCycles()),
+          mCyclesPerUs(GetCpuMHz()),
+          mLastSecond(0)
+    {
+        mSecondText[0] = '\0';
+    }
+
+    void Calibrate()
+    {
+        uint64_t us = GetCurrentTimeInUs();
+        uint64_t cycles = GetCpuCycles();
+        if (us - mBaseUs >= kCalibrationIntervalUs)
+        {
+            mCyclesPerUs = static_cast<double>(cycles - mBaseCycles) / (us - mBaseUs);
+        }
+    }
+
+    /** Append "2018-03-22 10:10:10.123456" of 'cycles'. */
+    void AppendTime(uint64_t cycles, std::string* text)
+    {
+        int64_t elapsed = static_cast<int64_t>(cycles - mBaseCycles) / mCyclesPerUs;
+        uint64_t us = mBaseUs + elapsed;
+        time_t second = us / 1000000;
+        if (second != mLastSecond)
+        {
+            struct tm t;
+            localtime_r(&second, &t);
+            strftime(mSecondText, sizeof(mSecondText), "%Y-%m-%d %H:%M:%S", &t);
+            mLastSecond = second;
+        }
+        char usText[8];
+        snprintf(usText, sizeof(usText), ".%06u", static_cast<uint32_t>(us % 1000000));
+        text->append(mSecondText).append(usText);
+    }
+
+private:
+    uint64_t mBaseUs;
+    uint64_t mBaseCycles;
+    double mCyclesPerUs;
+    time_t mLastSecond;
+    char mSecondText[32];
+};
+
+void appendFormatted(std::string* text, const char* format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int size = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (size < 0)
+    {
+        return;
+    }
+    if (static_cast<size_t>(size) < sizeof(buf))
+    {
+        text->append(buf, size);
+        return;
+    }
+    size_t offset = text->size();
+    text->resize(offset + size + 1);
+    va_start(args, format);
+    vsnprintf(&(*text)[offset], size + 1, format, args);
+    va_end(args);
+    text->resize(offset + size);
+}
+
+template<typename T>
+T readArg(const char** cursor)
+{
+    T value;
+    memcpy(&value, *cursor, sizeof(value));
+    *cursor += sizeof(value);
+    return value;
+}
+
+template<typename T>
+void appendArg(std::string* text, const char* spec, const int* stars, int starNum, T value)
+{
+    switch (starNum)
+    {
+    case 0:
+        appendFormatted(text, spec, value);
+        break;
+    case 1:
+        appendFormatted(text, spec, stars[0], value);
+        break;
+    default:
+        appendFormatted(text, spec, stars[0], stars[1], value);
+        break;
+    }
+}
+
+/** printf() the raw 'args' with the format of 'site'. */
+void decodeMessage(const DeferredLogSite* site, const char* args, std::string* text)
+{
+    const char* format = site->format;
+    uint32_t argIndex = 0;
+    std::string spec;
+    while (*format != '\0')
+    {
+        const char* percent = strchr(format, '%');
+        if (percent == NULL)
+        {
+            text->append(format);
+            break;
+        }
+        text->append(format, percent - format);
+        if (percent[1] == '%')
+        {
+            text->push_back('%');
+            format = percent + 2;
+            continue;
+        }
+        // "%[flags][width][.precision][length]conversion"
+        const char* conversion = percent + 1 + strspn(percent + 1, "-+ #0'123456789.*hlLqjzt");
+        if (*conversion == '\0')
+        {
+            text->append(percent);
+            break;
+        }
+        format = conversion + 1;
+        spec.assign(percent, format);
+        int stars[2];
+        int starNum = 0;
+        for (const char* c = percent; c < conversion; ++c)
+        {
+            if (*c == '*' && starNum < 2 && argIndex < site->argNum)
+            {
+                uint8_t type = site->argTypes[argIndex++];
+                stars[starNum++] = type == detail::kDeferredInt32 || type == detail::kDeferredUint32
+                    ? readArg<int32_t>(&args) : static_cast<int>(readArg<int64_t>(&args));
+            }
+        }
+        if (*conversion == 'n')
+        {
+            continue;
+        }
+        if (argIndex >= site->argNum)
+        {
+            text->append(spec);
+            continue;
+        }
+        uint8_t type = site->argTypes[argIndex++];
+        if ((type == detail::kDeferredString) != (*conversion == 's'))
+        {
+            // Unreachable with a checked format, skip the arg.
+            if (type == detail::kDeferredString)
+            {
+                args += readArg<uint32_t>(&args);
+            }
+            else
+            {
+                args += type == detail::kDeferredInt32 || type == detail::kDeferredUint32
+                    ? sizeof(int32_t) : sizeof(int64_t);
+            }
+            text->append("?");
+            continue;
+        }
+        switch (type)
+        {
+        case detail::kDeferredInt32:
+            appendArg(text, spec.c_str(), stars, starNum, readArg<int32_t>(&args));
+            break;
+        case detail::kDeferredUint32:
+            appendArg(text, spec.c_str(), stars, starNum, readArg<uint32_t>(&args));
+            break;
+        case detail::kDeferredInt64:
+            appendArg(text, spec.c_str(), stars, starNum, readArg<int64_t>(&args));
+            break;
+        case detail::kDeferredUint64:
+            appendArg(text, spec.c_str(), stars, starNum, readArg<uint64_t>(&args));
+            break;
+        case detail::kDeferredDouble:
+            appendArg(text, spec.c_str(), stars, starNum, readArg<double>(&args));
+            break;
+        case detail::kDeferredPointer:
+            appendArg(text, spec.c_str(), stars, starNum,
+                      reinterpret_cast<void*>(readArg<uint64_t>(&args)));
+            break;
+        case detail::kDeferredString:
+            {
+                uint32_t length = readArg<uint32_t>(&args);
+                std::string value(args, length);
+                args += length;
+                appendArg(text, spec.c_str(), stars, starNum, value.c_str());
+            }
+            break;
+        default:
+            ASSERT(false);
+        }
+    }
+}
+
+void writeAll(int fd, std::string* text)
+{
+    size_t done = 0;
+    while (done < text->size())
+    {
+        ssize_t size = ::write(fd, text->data() + done, text->size() - done);
+        if (size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (size <= 0)
+        {
+            break;  // Nowhere to report it
+        }
+        done += size;
+    }
+    text->clear();
+}
+
+}  // anonymous namespace
+
+/** The writer and the registries, allocated on first use and never freed. */
+struct DeferredLogger::State
+{
+    State()
+        : buffers(NULL), siteNum(0), output(STDERR_FILENO), droppedLogs(0)
+    {
+        memset(sites, 0, sizeof(sites));
+        CheckPthreadError(pthread_key_create(&bufferKey, &DeferredLogger::unregisterThread));
+        CheckPthreadError(pthread_create(&writer, NULL, &DeferredLogger::writerMain, this));
+        CheckPthreadError(pthread_detach(writer));
+    }
+
+    SimpleMutex mutex;              // Guards registrations
+    Buffer* volatile buffers;
+    DeferredLogSite* sites[kMaxSites];
+    uint32_t siteNum;
+    pthread_key_t bufferKey;
+    pthread_t writer;
+
+    volatile int32_t output;
+    volatile uint64_t droppedLogs;
+    WorkerRounds rounds;            // Of the writer
+};
+
+__thread DeferredLogger::Buffer* DeferredLogger::tBuffer = NULL;
+volatile DeferredLogLevel DeferredLogger::sLevel = DEFERRED_LOG_LEVEL_PROFILE;
+volatile bool DeferredLogger::sBlockWhenFull = false;
+
+DeferredLogger::State* DeferredLogger::getState()
+{
+    static State* sState = new State;
+    return sState;
+}
+
+uint32_t DeferredLogger::RegisterSite(volatile uint32_t* siteId, DeferredLogLevel level,
+                                      const char* filename, int line, const char* format,
+                                      const uint8_t* argTypes, uint32_t argNum)
+{
+    State* state = getState();
+    ScopedLock<SimpleMutex> lock(state->mutex);
+    uint32_t id = AtomicGet(siteId);
+    if (id != 0)
+    {
+        return id;
+    }
+    ASSERT(state->siteNum + 1 < kMaxSites);
+    DeferredLogSite* site = new DeferredLogSite;
+    site->format = format;
+    site->filename = filename;
+    site->line = line;
+    site->level = level;
+    site->argTypes = argTypes;
+    site->argNum = argNum;
+    id = ++state->siteNum;
+    state->sites[id] = site;
+    // Entries carrying the id are published after it, with their buffer.
+    AtomicSet(siteId, id);
+    return id;
+}
+
+DeferredLogger::Buffer* DeferredLogger::registerThread()
+{
+    State* state = getState();
+    Buffer* buffer = NULL;
+    {
+        ScopedLock<SimpleMutex> lock(state->mutex);
+        // The buffer of an exited thread, once the writer has drained it.
+        for (buffer = state->buffers; buffer != NULL; buffer = buffer->next)
+        {
+            if (AtomicGet(&buffer->inUse) == 0 && AtomicGet(&buffer->head) == buffer->tail)
+            {
+                break;
+            }
+        }
+        if (buffer == NULL)
+        {
+            void* memory = NULL;
+            int ret = posix_memalign(&memory, 64, sizeof(Buffer));
+            ASSERT(ret == 0);
+            buffer = static_cast<Buffer*>(memory);
+            buffer->tail = 0;
+            buffer->head = 0;
+            buffer->next = state->buffers;
+            AtomicSet(&state->buffers, buffer);
+        }
+        buffer->cachedHead = buffer->head;
+        buffer->tid = ThisThread::GetId();
+        buffer->inUse = 1;
+    }
+    CheckPthreadError(pthread_setspecific(state->bufferKey, buffer));
+    tBuffer = buffer;
+    return buffer;
+}
+
+void DeferredLogger::unregisterThread(void* arg)
+{
+    Buffer* buffer = static_cast<Buffer*>(arg);
+    State* state = getState();
+    ScopedLock<SimpleMutex> lock(state->mutex);
+    // A later log of the thread, from another destructor, registers again.
+    tBuffer = NULL;
+    AtomicSet(&buffer->inUse, 0);
+}
+
+char* DeferredLogger::reserveSlow(size_t size, DeferredLogLevel level)
+{
+    Buffer* buffer = tBuffer;
+    if (buffer == NULL)
+    {
+        buffer = registerThread();
+    }
+    State* state = getState();
+    if (UNLIKELY(size > kMaxEntrySize))
+    {
+        AtomicInc(&state->droppedLogs, std::memory_order_relaxed);
+        return NULL;
+    }
+    Sleeper sleeper;
+    while (true)
+    {
+        uint64_t tail = buffer->tail;
+        size_t offset = tail & (kBufferSize - 1);
+        // An entry never wraps, a skip entry fills the end of the buffer.
+        size_t skip = offset + size > kBufferSize ? kBufferSize - offset : 0;
+        buffer->cachedHead = AtomicGet(&buffer->head, std::memory_order_acquire);
+        if (tail + skip + size - buffer->cachedHead <= kBufferSize)
+        {
+            if (skip != 0)
+            {
+                Entry* entry = reinterpret_cast<Entry*>(buffer->data + offset);
+                entry->siteId = 0;
+                entry->size = skip;
+                AtomicSet(&buffer->tail, tail + skip);
+            }
+            return buffer->data + ((tail + skip) & (kBufferSize - 1));
+        }
+        state->rounds.WakeUp();
+        if (!AtomicGet(&sBlockWhenFull, std::memory_order_relaxed)
+            && level < DEFERRED_LOG_LEVEL_FATAL)
+        {
+            AtomicInc(&state->droppedLogs, std::memory_order_relaxed);
+            return NULL;
+        }
+        sleeper.Pause();
+    }
+}
+
+void* DeferredLogger::writerMain(void* arg)
+{
+    State* state = static_cast<State*>(arg);
+    CycleClock clock;
+    std::string text;
+    text.reserve(2 * kWriteBatchSize);
+    while (true)
+    {
+        state->rounds.BeginRound();
+        clock.Calibrate();
+        size_t decoded = 0;
+        for (Buffer* buffer = AtomicGet(&state->buffers); buffer != NULL; buffer = buffer->next)
+        {
+            uint64_t head = buffer->head;
+            uint64_t tail = AtomicGet(&buffer->tail, std::memory_order_acquire);
+            while (head != tail)
+            {
+                const Entry* entry = reinterpret_cast<const Entry*>(
+                    buffer->data + (head & (kBufferSize - 1)));
+                head += entry->size;
+                if (entry->siteId == 0)
+                {
+                    continue;
+                }
+                const DeferredLogSite* site = state->sites[entry->siteId];
+                text.push_back('[');
+                clock.AppendTime(entry->cycles, &text);
+                appendFormatted(&text, "]\t[%s]\t[%u]\t[%s:%d]\t",
+                                kLevelSymbols[MIN(site->level / 100, 6)],
+                                buffer->tid, site->filename, site->line);
+                decodeMessage(site, reinterpret_cast<const char*>(entry + 1), &text);
+                text.push_back('\n');
+                ++decoded;
+                if (text.size() >= kWriteBatchSize)
+                {
+                    writeAll(AtomicGet(&state->output), &text);
+                    AtomicSet(&buffer->head, head);
+                }
+            }
+            AtomicSet(&buffer->head, head);
+        }
+        writeAll(AtomicGet(&state->output), &text);
+
+        state->rounds.EndRound(decoded == 0, kWriteIntervalUs);
+    }
+    return NULL;
+}
+
+void DeferredLogger::SetOutput(int fd)
+{
+    AtomicSet(&getState()->output, static_cast<int32_t>(fd));
+}
+
+void DeferredLogger::Flush()
+{
+    getState()->rounds.WaitForRound(kWriteIntervalUs);
+}
+
+uint64_t DeferredLogger::GetDroppedLogCount()
+{
+    return AtomicGet(&getState()->droppedLogs, std::memory_order_relaxed);
+}
@@ -0,0 +1,322 @@
+#ifndef _SRC_COMMON_DEFERRED_LOGGING_H
+#define _SRC_COMMON_DEFERRED_LOGGING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#include "src/common/macros.h"
+#include "src/cpu/cpu.h"
+#include "src/sync/atomic.h"
+
+/**
+ * Deferred-format logging, after NanoLog.
+ *
+ * A call site registers its level, file, line, printf format and argument
+ * types once.  Every log then copies just the site id, a cycle counter
+ * and the raw argument bytes into a buffer of the calling thread, and
+ * takes no lock, makes no system call and formats nothing.  A background
+ * thread decodes the buffers into the text of src/common/logging.h,
+ *   "[time]\t[LEVEL]\t[tid]\t[file:line]\t" + message,
+ * and writes it to the output.
+ *
+ * Arguments may be integers, enums, floating point numbers, pointers and
+ * C strings, which are copied.  Formats are checked at compile time.  A
+ * log that doesn't fit the buffer of its thread is dropped, or waits with
+ * SetBlockWhenFull(); FATAL logs always wait.
+ *
+ * Usage:
+ *   DEFERRED_LOGF_INFO("read %s at %lu, %d bytes", path, offset, size);
+ *   DeferredLogger::Flush();    // e.g. before exiting
+ */
+
+enum DeferredLogLevel
+{
+    DEFERRED_LOG_LEVEL_PROFILE = 100,  // The values of LogLevel
+    DEFERRED_LOG_LEVEL_DEBUG   = 200,
+    DEFERRED_LOG_LEVEL_INFO    = 300,
+    DEFERRED_LOG_LEVEL_WARNING = 400,
+    DEFERRED_LOG_LEVEL_ERROR   = 500,
+    DEFERRED_LOG_LEVEL_FATAL   = 600,
+};
+
+class DeferredLogger
+{
+public:
+    enum
+    {
+        kBufferSize = 1 << 20,      // Per thread
+        kMaxEntrySize = kBufferSize / 4,
+        kMaxSites = 1 << 16,
+        kMaxArgs = 32,
+    };
+
+    /** The header of an entry in a thread buffer, followed by the args. */
+    struct Entry
+    {
+        uint32_t siteId;            // 0 for a skip to the buffer start
+        uint32_t size;              // Including the header, 8-byte aligned
+        uint64_t cycles;
+    };
+
+    static bool IsLevelEnabled(DeferredLogLevel level)
+    {
+        return level >= AtomicGet(&sLevel, std::memory_order_relaxed);
+    }
+
+    static void SetLevel(DeferredLogLevel level) { AtomicSet(&sLevel, level); }
+
+    /**
+     * Write the decoded text to 'fd', stderr by default.  Flush() before to
+     * have the logs so far in the old output, which is kept open until
+     * another output is set.
+     */
+    static void SetOutput(int fd);
+
+    static void SetBlockWhenFull(bool block) { AtomicSet(&sBlockWhenFull, block); }
+
+    /** Block until everything logged before is written to the output. */
+    static void Flush();
+
+    static uint64_t GetDroppedLogCount();
+
+    /**
+     * Room for an entry of 'size' bytes in the calling thread's buffer, or
+     * NULL if it's dropped.  Publish it with Commit().
+     */
+    static char* Reserve(size_t size, DeferredLogLevel level)
+    {
+        Buffer* buffer = tBuffer;
+        if (LIKELY(buffer != NULL))
+        {
+            uint64_t tail = buffer->tail;
+            size_t offset = tail & (kBufferSize - 1);
+            if (LIKELY(offset + size <= kBufferSize
+                       && tail + size - buffer->cachedHead <= kBufferSize))
+            {
+                return buffer->data + offset;
+            }
+        }
+        return reserveSlow(size, level);
+    }
+
+    static void Commit(size_t size)
+    {
+        Buffer* buffer = tBuffer;
+        AtomicSet(&buffer->tail, buffer->tail + size);
+    }
+
+    /** Register a call site once, return its id in '*siteId'. */
+    static uint32_t RegisterSite(volatile uint32_t* siteId, DeferredLogLevel level,
+                                 const char* filename, int line, const char* format,
+                                 const uint8_t* argTypes, uint32_t argNum)
+        __attribute__((noinline));
+
+private:
+    /** A thread buffer, an SPSC ring of entries. */
+    struct Buffer
+    {
+        // Owned by the thread
+        volatile uint64_t tail;
+        uint64_t cachedHead;
+        char tailPadding[64 - 2 * sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+        // Owned by the writer
+        volatile uint64_t head;
+        char headPadding[64 - sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+        Buffer* next;
+        volatile int32_t inUse;     // Buffers of exited threads are reused
+        uint32_t tid;
+        char data[kBufferSize];
+    };
+
+    struct State;
+
+    static char* reserveSlow(size_t size, DeferredLogLevel level) __attribute__((noinline));
+    static Buffer* registerThread();
+    static void unregisterThread(void* buffer);
+    static State* getState();
+    static void* writerMain(void* arg);
+
+    static __thread Buffer* tBuffer;
+    static volatile DeferredLogLevel sLevel;
+    static volatile bool sBlockWhenFull;
+
+    DeferredLogger();
+};
+
+namespace detail
+{
+
+enum DeferredArgType
+{
+    kDeferredInt32 = 1,             // Anything promoted to int
+    kDeferredUint32,
+    kDeferredInt64,
+    kDeferredUint64,
+    kDeferredDouble,
+    kDeferredString,                // uint32_t length, then the bytes
+    kDeferredPointer,
+};
+
+template<typename T, typename Enable = void>
+struct DeferredArg;
+
+template<typename T>
+struct DeferredArg<T, typename std::enable_if<
+    std::is_integral<T>::value || std::is_enum<T>::value>::type>
+{
+    // The types printf() gets after the default promotions.
+    static const bool kWide = sizeof(T) > sizeof(int32_t);
+    static const bool kUnsigned = std::is_unsigned<T>::value && sizeof(T) >= sizeof(int32_t);
+    typedef typename std::conditional<kWide,
+            typename std::conditional<kUnsigned, uint64_t, int64_t>::type,
+            typename std::conditional<kUnsigned, uint32_t, int32_t>::type>::type Stored;
+    static const uint8_t kType = kWide ? (kUnsigned ? kDeferredUint64 : kDeferredInt64)
+                                       : (kUnsigned ? kDeferredUint32 : kDeferredInt32);
+
+    static size_t Size(T, size_t*) { return sizeof(Stored); }
+    static char* Encode(char* buffer, T value, size_t)
+    {
+        Stored stored = static_cast<Stored>(value);
+        memcpy(buffer, &stored, sizeof(stored));
+        return buffer + sizeof(stored);
+    }
+};
+
+template<typename T>
+struct DeferredArg<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+    static const uint8_t kType = kDeferredDouble;
+
+    static size_t Size(T, size_t*)
+    {
+        static_assert(sizeof(T) <= sizeof(double), "long double is not supported");
+        return sizeof(double);
+    }
+    static char* Encode(char* buffer, T value, size_t)
+    {
+        double stored = value;
+        memcpy(buffer, &stored, sizeof(stored));
+        return buffer + sizeof(stored);
+    }
+};
+
+template<typename T>
+struct DeferredArg<T*, typename std::enable_if<
+    !std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static const uint8_t kType = kDeferredPointer;
+
+    static size_t Size(T*, size_t*) { return sizeof(uint64_t); }
+    static char* Encode(char* buffer, T* value, size_t)
+    {
+        uint64_t stored = reinterpret_cast<uint64_t>(value);
+        memcpy(buffer, &stored, sizeof(stored));
+        return buffer + sizeof(stored);
+    }
+};
+
+template<typename T>
+struct DeferredArg<T*, typename std::enable_if<
+    std::is_same<typename std::remove_cv<T>::type, char>::value>::type>
+{
+    static const uint8_t kType = kDeferredString;
+
+    static size_t Size(T* value, size_t* length)
+    {
+        *length = value != NULL ? strlen(value) : 0;
+        return sizeof(uint32_t) + *length;
+    }
+    static char* Encode(char* buffer, T* value, size_t length)
+    {
+        uint32_t stored = length;
+        memcpy(buffer, &stored, sizeof(stored));
+        memcpy(buffer + sizeof(stored), value, length);
+        return buffer + sizeof(stored) + length;
+    }
+};
+
+inline size_t DeferredArgsSize(size_t*)
+{
+    return 0;
+}
+
+template<typename T, typename... Rest>
+inline size_t DeferredArgsSize(size_t* lengths, T value, Rest... rest)
+{
+    return DeferredArg<T>::Size(value, lengths) + DeferredArgsSize(lengths + 1, rest...);
+}
+
+inline void EncodeDeferredArgs(char*, const size_t*)
+{
+}
+
+template<typename T, typename... Rest>
+inline void EncodeDeferredArgs(char* buffer, const size_t* lengths, T value, Rest... rest)
+{
+    buffer = DeferredArg<T>::Encode(buffer, value, *lengths);
+    EncodeDeferredArgs(buffer, lengths + 1, rest...);
+}
+
+/** Never called, lets the compiler check the format. */
+inline void CheckDeferredLogFormat(const char*, ...) __attribute__((format(printf, 1, 2)));
+inline void CheckDeferredLogFormat(const char*, ...)
+{
+}
+
+}  // namespace detail
+
+template<typename... Args>
+inline void DeferredLog(volatile uint32_t* siteId, DeferredLogLevel level,
+                        const char* filename, int line, const char* format,
+                        Args... args)
+{
+    static_assert(sizeof...(Args) <= DeferredLogger::kMaxArgs, "too many args");
+    uint32_t id = AtomicGet(siteId, std::memory_order_acquire);
+    if (UNLIKELY(id == 0))
+    {
+        static const uint8_t kArgTypes[] = { detail::DeferredArg<Args>::kType..., 0 };
+        id = DeferredLogger::RegisterSite(siteId, level, filename, line, format,
+                                          kArgTypes, sizeof...(Args));
+    }
+    size_t lengths[sizeof...(Args) + 1];
+    size_t size = sizeof(DeferredLogger::Entry) + detail::DeferredArgsSize(lengths, args...);
+    size = (size + 7) & ~static_cast<size_t>(7);
+    char* buffer = DeferredLogger::Reserve(size, level);
+    if (UNLIKELY(buffer == NULL))
+    {
+        return;
+    }
+    DeferredLogger::Entry* entry = reinterpret_cast<DeferredLogger::Entry*>(buffer);
+    entry->siteId = id;
+    entry->size = size;
+    entry->cycles = GetCpuCycles();
+    detail::EncodeDeferredArgs(buffer + sizeof(*entry), lengths, args...);
+    DeferredLogger::Commit(size);
+}
+
+#define DEFERRED_LOGF(level, format, ...)                                   \
+    do {                                                                    \
+        if (false)                                                          \
+        {                                                                   \
+            detail::CheckDeferredLogFormat(format, ##__VA_ARGS__);          \
+        }                                                                   \
+        if (DeferredLogger::IsLevelEnabled(level))                          \
+        {                                                                   \
+            static volatile uint32_t sDeferredLogSiteId = 0;                \
+            DeferredLog(&sDeferredLogSiteId, level, __FILE__, __LINE__,     \
+                        format, ##__VA_ARGS__);                             \
+        }                                                                   \
+    } while (false)
+
+#define DEFERRED_LOGF_PROFILE(...) DEFERRED_LOGF(DEFERRED_LOG_LEVEL_PROFILE, __VA_ARGS__)
+#define DEFERRED_LOGF_DEBUG(...)   DEFERRED_LOGF(DEFERRED_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define DEFERRED_LOGF_INFO(...)    DEFERRED_LOGF(DEFERRED_LOG_LEVEL_INFO, __VA_ARGS__)
+#define DEFERRED_LOGF_WARNING(...) DEFERRED_LOGF(DEFERRED_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define DEFERRED_LOGF_ERROR(...)   DEFERRED_LOGF(DEFERRED_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define DEFERRED_LOGF_FATAL(...)   DEFERRED_LOGF(DEFERRED_LOG_LEVEL_FATAL, __VA_ARGS__)
+
+#endif  // _SRC_COMMON_DEFERRED_LOGGING_H
@@ -0,0 +1,787 @@
+#include "src/common/file_logging.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/sync/atomic.h"
+#include "src/sync/futex.h"
+#include "src/sync/lock.h"
+#include "src/sync/ring_buffer.h"
+
+FileLoggingOptions::FileLoggingOptions()
+    : level(LOG_LEVEL_DEFAULT),
+      bufferSize(1024 * 1024),
+      bufferNum(4),
+      flushIntervalMs(100),
+      maxFileSize(300 * 1024 * 1024),
+      rotateIntervalSec(0),
+      maxFileNum(10),
+      maxDay(30),
+      compress(false),
+      directIO(false),
+      syncPolicy(FILE_LOGGING_SYNC_NONE)
+{
+}
+
+static bool WriteLogFile(int fd, const char* data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t ret = pwrite(fd, data, size, offset);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "Can't write log file, errno=%s\n", strerror(errno));
+            return false;
+        }
+        data += ret;
+        size -= ret;
+        offset += ret;
+    }
+    return true;
+}
+
+class LogFileCompressor;
+
+static LogFileCompressor* sLogFileCompressor = NULL;
+static pthread_once_t     sLogFileCompressorOnce = PTHREAD_ONCE_INIT;
+
+/*
+ * The thread compressing the rotated files of all file logging systems
+ *
+ * A rotated file waits under a temporary name, and becomes path.1.gz once
+ * it's compressed, shifting the older ones as RotateLogFiles does.  The
+ * files are compressed in the order they were rotated.
+ */
+class LogFileCompressor
+{
+public:
+    static LogFileCompressor* GetInstance()
+    {
+        pthread_once(&sLogFileCompressorOnce, &LogFileCompressor::createInstance);
+        return AtomicGet(&sLogFileCompressor);
+    }
+
+    // NULL if nothing has been compressed
+    static LogFileCompressor* GetStartedInstance()
+    {
+        return AtomicGet(&sLogFileCompressor);
+    }
+
+    void Push(const std::string& file, const FileLoggingOptions& options)
+    {
+        Job job = { file, options.path, options.maxFileNum, options.maxDay };
+        {
+            ScopedLock<SimpleMutex> lock(mMutex);
+            mJobs.push_back(job);
+        }
+        AtomicInc(&mPushed);
+        FutexWake(&mPushed, 1);
+    }
+
+    // wait until the files pushed before are compressed
+    void WaitForIdle()
+    {
+        int32_t target = AtomicGet(&mPushed);
+        while (true)
+        {
+            int32_t done = AtomicGet(&mDone);
+            if (static_cast<int32_t>(done - target) >= 0)
+            {
+                break;
+            }
+            FutexWait(&mDone, done);
+        }
+    }
+
+private:
+    struct Job
+    {
+        std::string file;
+        std::string path;
+        int maxFileNum;
+        int maxDay;
+    };
+
+    LogFileCompressor() : mPushed(0), mDone(0)
+    {
+    }
+
+    static void createInstance()
+    {
+        LogFileCompressor* compressor = new LogFileCompressor;
+        pthread_t thread;
+        int ret = pthread_create(&thread, NULL, &LogFileCompressor::compressorThread,
+                compressor);
+        if (ret != 0)
+        {
+            fprintf(stderr, "Create thread error in LogFileCompressor");
+            abort();
+        }
+        pthread_detach(thread);
+        AtomicSet(&sLogFileCompressor, compressor);
+    }
+
+    static void* compressorThread(void* param)
+    {
+        static_cast<LogFileCompressor*>(param)->run();
+        return NULL;
+    }
+
+    void run()
+    {
+        while (true)
+        {
+            int32_t pushed = AtomicGet(&mPushed);
+            Job job;
+            bool found = false;
+            {
+                ScopedLock<SimpleMutex> lock(mMutex);
+                if (!mJobs.empty())
+                {
+                    job = mJobs.front();
+                    mJobs.pop_front();
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                FutexWait(&mPushed, pushed);
+                continue;
+            }
+            compress(job);
+            AtomicInc(&mDone);
+            FutexWake(&mDone, INT32_MAX);
+        }
+    }
+
+    static void compress(const Job& job)
+    {
+        std::string gzip = CompressLogFile(job.file);
+        if (gzip.empty())
+        {
+            fprintf(stderr, "Can't compress %s\n", job.file.c_str());
+            return;
+        }
+        if (job.maxFileNum < 2)
+        {
+            remove(gzip.c_str());
+            return;
+        }
+        std::string last = StringPrintf("%s.%d.gz", job.path.c_str(), job.maxFileNum - 1);
+        if (remove(last.c_str()) != 0 && errno != ENOENT)
+        {
+            fprintf(stderr, "Can't remove %s, errno=%s\n", last.c_str(), strerror(errno));
+        }
+        const int secPerDay = 3600 * 24;
+        time_t now = time(NULL);
+        for (int n = job.maxFileNum - 2; n > 0; --n)
+        {
+            std::string src = StringPrintf("%s.%d.gz", job.path.c_str(), n);
+            struct stat status;
+            if (stat(src.c_str(), &status) != 0)
+            {
+                continue;
+            }
+            if ((now - status.st_mtime) / secPerDay >= job.maxDay)
+            {
+                remove(src.c_str());
+                continue;
+            }
+            std::string dest = StringPrintf("%s.%d.gz", job.path.c_str(), n + 1);
+            if (rename(src.c_str(), dest.c_str()) != 0)
+            {
+                fprintf(stderr, "Can't rename %s to %s, errno=%s\n", src.c_str(),
+                        dest.c_str(), strerror(errno));
+            }
+        }
+        std::string first = job.path + ".1.gz";
+        if (rename(gzip.c_str(), first.c_str()) != 0)
+        {
+            fprintf(stderr, "Can't rename %s to %s, errno=%s\n", gzip.c_str(),
+                    first.c_str(), strerror(errno));
+        }
+    }
+
+    SimpleMutex mMutex;
+    std::deque<Job> mJobs;
+    volatile int32_t mPushed;       // futex, the compressor sleeps on
+    volatile int32_t mDone;         // futex, WaitForIdle sleeps on
+};
+
+/*
+ * The logger of a file logging system, and the thread writing its file
+ *
+ * Loggers copy the logs into the current buffer under mLock.  A full
+ * buffer goes to the thread by mFullBuffers, and comes back by
+ * mFreeBuffers once written.  Both rings are SPSC, their logger side is
+ * serialized by mLock, which the thread also takes to hand over a partly
+ * filled buffer.
+ *
+ * The thread owns the files.  It rotates the live file by renaming it,
+ * then renames the standby file, opened in advance, to the live path and
+ * writes on to it.  With O_DIRECT, the partial last block of the file is
+ * kept in mTail and rewritten with the next buffer.
+ */
+class FileLoggerAdaptor : public ILoggerAdaptor
+{
+public:
+    explicit FileLoggerAdaptor(const FileLoggingOptions& options);
+    ~FileLoggerAdaptor();
+
+    // rotate the file left by an earlier run, begin a new one
+    void Start();
+    // write and sync (by the policy) the logs appended before
+    void Flush();
+    // write all logs and close the file, later logs are dropped
+    void Stop();
+
+    /*override*/ void AppendLog(const LoggingHeader& header,
+                                RefCountedLoggingData* loggingData);
+    /*override*/ void AppendLogBatch(const LoggingHeader* const* headers,
+                                     RefCountedLoggingData* const* loggingData,
+                                     size_t count);
+
+private:
+    enum
+    {
+        kAlignment = 4096,
+    };
+
+    struct Buffer
+    {
+        char* data;                 // Room for a block more than mBufferSize
+        size_t size;
+    };
+
+    typedef SpscRingBuffer<Buffer*> BufferRing;
+
+    static void* writerThread(void* param);
+
+    void append(const char* data, size_t size);
+    Buffer* takeFreeBuffer();
+    void sealCurrent();
+    bool trySealCurrent();
+    void wakeUp();
+
+    void run();
+    void writeFullBuffers();
+    void writeBuffer(Buffer* buffer);
+    void syncFile();
+    void rotate();
+    void moveLiveFile();
+    int openFile(const std::string& path);
+    uint64_t getNextRotateTime(uint64_t now);
+
+    FileLoggingOptions mOptions;
+    std::string mStandbyPath;
+    size_t mBufferSize;
+    std::vector<Buffer> mBuffers;
+    BufferRing mFullBuffers;
+    BufferRing mFreeBuffers;
+    pthread_t mThread;
+
+    // taken by loggers
+    MicroLock mLock;
+    Buffer* mCurrent;
+    bool mStarted;
+
+    volatile int32_t mStopping;
+    volatile int32_t mWakeups;      // futex, the thread sleeps on
+    volatile int32_t mSleeping;
+    volatile int32_t mFlushRequests;
+    volatile int32_t mFlushesDone;  // futex, Flush sleeps on
+
+    // owned by the thread
+    int mFd;
+    int mStandbyFd;
+    bool mDirect;
+    uint64_t mFileSize;
+    char* mTail;
+    size_t mTailSize;
+    uint64_t mNextRotateTime;       // in seconds, 0 for never
+};
+
+FileLoggerAdaptor::FileLoggerAdaptor(const FileLoggingOptions& options)
+    : mOptions(options),
+      mStandbyPath(options.path + ".next"),
+      mBufferSize((MAX(options.bufferSize, 1U) + kAlignment - 1) & ~(kAlignment - 1)),
+      mBuffers(MAX(options.bufferNum, 2U)),
+      mFullBuffers(mBuffers.size()),
+      mFreeBuffers(mBuffers.size()),
+      mCurrent(NULL),
+      mStarted(false),
+      mStopping(0),
+      mWakeups(0),
+      mSleeping(0),
+      mFlushRequests(0),
+      mFlushesDone(0),
+      mFd(-1),
+      mStandbyFd(-1),
+      mDirect(options.directIO),
+      mFileSize(0),
+      mTail(NULL),
+      mTailSize(0),
+      mNextRotateTime(0)
+{
+    mLogLevel = options.level;
+}
+
+FileLoggerAdaptor::~FileLoggerAdaptor()
+{
+    Stop();
+    for (size_t idx = 0; idx < mBuffers.size(); ++idx)
+    {
+        free(mBuffers[idx].data);
+    }
+    free(mTail);
+}
+
+void FileLoggerAdaptor::Start()
+{
+    if (mStarted || mFd >= 0)
+    {
+        return;
+    }
+    if (access(mOptions.path.c_str(), F_OK) == 0)
+    {
+        moveLiveFile();
+    }
+    mFd = openFile(mOptions.path);
+    if (mFd < 0)
+    {
+        return;
+    }
+    mStandbyFd = openFile(mStandbyPath);
+
+    void* tail = NULL;
+    if (posix_memalign(&tail, kAlignment, kAlignment) != 0)
+    {
+        fprintf(stderr, "posix_memalign fail in FileLoggerAdaptor");
+        abort();
+    }
+    mTail = static_cast<char*>(tail);
+    for (size_t idx = 0; idx < mBuffers.size(); ++idx)
+    {
+        void* data = NULL;
+        if (posix_memalign(&data, kAlignment, mBufferSize + kAlignment) != 0)
+        {
+            fprintf(stderr, "posix_memalign fail in FileLoggerAdaptor");
+            abort();
+        }
+        mBuffers[idx].data = static_cast<char*>(data);
+        mBuffers[idx].size = 0;
+        mFreeBuffers.Push(&mBuffers[idx]);
+    }
+    mNextRotateTime = getNextRotateTime(time(NULL));
+
+    int ret = pthread_create(&mThread, NULL, &FileLoggerAdaptor::writerThread, this);
+    if (ret != 0)
+    {
+        fprintf(stderr, "Create thread error in FileLoggerAdaptor");
+        abort();
+    }
+    ScopedLock<MicroLock> lock(mLock);
+    mStarted = true;
+}
+
+void FileLoggerAdaptor::Flush()
+{
+    {
+        ScopedLock<MicroLock> lock(mLock);
+        if (!mStarted)
+        {
+            return;
+        }
+    }
+    int32_t target = AtomicInc(&mFlushRequests);
+    while (AtomicGet(&mStopping) == 0)
+    {
+        int32_t done = AtomicGet(&mFlushesDone);
+        if (static_cast<int32_t>(done - target) >= 0)
+        {
+            break;
+        }
+        AtomicInc(&mWakeups);
+        FutexWake(&mWakeups, 1);
+        FutexWait(&mFlushesDone, done, mOptions.flushIntervalMs * 1000);
+    }
+}
+
+void FileLoggerAdaptor::Stop()
+{
+    {
+        ScopedLock<MicroLock> lock(mLock);
+        if (!mStarted)
+        {
+            return;
+        }
+        mStarted = false;
+    }
+    AtomicSet(&mStopping, 1);
+    AtomicInc(&mWakeups);
+    FutexWake(&mWakeups, 1);
+    pthread_join(mThread, NULL);
+
+    // the thread is gone, write the rest for it
+    sealCurrent();
+    writeFullBuffers();
+    if (mOptions.syncPolicy != FILE_LOGGING_SYNC_NONE)
+    {
+        syncFile();
+    }
+    close(mFd);
+    mFd = -1;
+    if (mStandbyFd >= 0)
+    {
+        close(mStandbyFd);
+        unlink(mStandbyPath.c_str());
+        mStandbyFd = -1;
+    }
+    LogFileCompressor* compressor = LogFileCompressor::GetStartedInstance();
+    if (compressor != NULL)
+    {
+        compressor->WaitForIdle();
+    }
+}
+
+void FileLoggerAdaptor::AppendLog(const LoggingHeader& header,
+                                  RefCountedLoggingData* loggingData)
+{
+    const LoggingHeader* headers = &header;
+    AppendLogBatch(&headers, &loggingData, 1);
+}
+
+void FileLoggerAdaptor::AppendLogBatch(const LoggingHeader* const* headers,
+                                       RefCountedLoggingData* const* loggingData,
+                                       size_t count)
+{
+    {
+        ScopedLock<MicroLock> lock(mLock);
+        if (LIKELY(mStarted))
+        {
+            for (size_t idx = 0; idx < count; ++idx)
+            {
+                append(loggingData[idx]->data(), loggingData[idx]->size());
+            }
+        }
+    }
+    for (size_t idx = 0; idx < count; ++idx)
+    {
+        loggingData[idx]->Release();
+    }
+}
+
+// with mLock held
+void FileLoggerAdaptor::append(const char* data, size_t size)
+{
+    // keep a log in one buffer, so that rotating doesn't split it
+    if (mCurrent != NULL && mCurrent->size + size > mBufferSize && size <= mBufferSize)
+    {
+        mFullBuffers.Push(mCurrent);
+        mCurrent = NULL;
+        wakeUp();
+    }
+    while (size > 0)
+    {
+        if (mCurrent == NULL)
+        {
+            mCurrent = takeFreeBuffer();
+        }
+        size_t bytes = MIN(size, mBufferSize - mCurrent->size);
+        memcpy(mCurrent->data + mCurrent->size, data, bytes);
+        mCurrent->size += bytes;
+        data += bytes;
+        size -= bytes;
+        if (mCurrent->size == mBufferSize)
+        {
+            mFullBuffers.Push(mCurrent);
+            mCurrent = NULL;
+            wakeUp();
+        }
+    }
+}
+
+// with mLock held
+FileLoggerAdaptor::Buffer* FileLoggerAdaptor::takeFreeBuffer()
+{
+    Buffer* buffer = NULL;
+    if (LIKELY(mFreeBuffers.Pop(&buffer)))
+    {
+        return buffer;
+    }
+    Sleeper sleeper;
+    do
+    {
+        wakeUp();
+        sleeper.Pause();
+    } while (!mFreeBuffers.Pop(&buffer));
+    return buffer;
+}
+
+void FileLoggerAdaptor::sealCurrent()
+{
+    ScopedLock<MicroLock> lock(mLock);
+    if (mCurrent != NULL && mCurrent->size > 0)
+    {
+        mFullBuffers.Push(mCurrent);
+        mCurrent = NULL;
+    }
+}
+
+// a logger may hold mLock waiting for the thread to free a buffer
+bool FileLoggerAdaptor::trySealCurrent()
+{
+    if (!mLock.TryLock())
+    {
+        return false;
+    }
+    if (mCurrent != NULL && mCurrent->size > 0)
+    {
+        mFullBuffers.Push(mCurrent);
+        mCurrent = NULL;
+    }
+    mLock.Unlock();
+    return true;
+}
+
+void FileLoggerAdaptor::wakeUp()
+{
+    if (AtomicGet(&mSleeping) != 0)
+    {
+        AtomicInc(&mWakeups);
+        FutexWake(&mWakeups, 1);
+    }
+}
+
+void* FileLoggerAdaptor::writerThread(void* param)
+{
+    static_cast<FileLoggerAdaptor*>(param)->run();
+    return NULL;
+}
+
+void FileLoggerAdaptor::run()
+{
+    const uint64_t flushIntervalUs = mOptions.flushIntervalMs * 1000ULL;
+    uint64_t lastSealTime = GetCurrentTimeInUs();
+    int32_t flushesDone = 0;
+    while (AtomicGet(&mStopping) == 0)
+    {
+        int32_t wakeups = AtomicGet(&mWakeups);
+        int32_t flushes = AtomicGet(&mFlushRequests);
+        uint64_t now = GetCurrentTimeInUs();
+        bool sealed = false;
+        if (flushes != flushesDone || now - lastSealTime >= flushIntervalUs)
+        {
+            sealed = trySealCurrent();
+            lastSealTime = sealed ? now : lastSealTime;
+        }
+
+        Buffer* buffer = NULL;
+        bool written = false;
+        while (mFullBuffers.Pop(&buffer))
+        {
+            writeBuffer(buffer);
+            mFreeBuffers.Push(buffer);
+            written = true;
+            if (mOptions.maxFileSize != 0 && mFileSize >= mOptions.maxFileSize)
+            {
+                rotate();
+            }
+        }
+        if (mNextRotateTime != 0 && now / 1000000 >= mNextRotateTime)
+        {
+            if (mFileSize > 0)
+            {
+                rotate();
+            }
+            mNextRotateTime = getNextRotateTime(now / 1000000);
+        }
+
+        if (flushes != flushesDone && sealed)
+        {
+            if (mOptions.syncPolicy == FILE_LOGGING_SYNC_FLUSH)
+            {
+                syncFile();
+            }
+            flushesDone = flushes;
+            AtomicSet(&mFlushesDone, flushes);
+            FutexWake(&mFlushesDone, INT32_MAX);
+        }
+        else if (!written)
+        {
+            AtomicSet(&mSleeping, 1);
+            __sync_synchronize();
+            FutexWait(&mWakeups, wakeups, flushIntervalUs);
+            AtomicSet(&mSleeping, 0);
+        }
+    }
+}
+
+void FileLoggerAdaptor::writeFullBuffers()
+{
+    Buffer* buffer = NULL;
+    while (mFullBuffers.Pop(&buffer))
+    {
+        writeBuffer(buffer);
+        mFreeBuffers.Push(buffer);
+    }
+}
+
+void FileLoggerAdaptor::writeBuffer(Buffer* buffer)
+{
+    if (!mDirect)
+    {
+        WriteLogFile(mFd, buffer->data, buffer->size, mFileSize);
+    }
+    else
+    {
+        // the whole blocks from the partial last one of the file
+        size_t bytes = mTailSize + buffer->size;
+        size_t aligned = (bytes + kAlignment - 1) & ~static_cast<size_t>(kAlignment - 1);
+        memmove(buffer->data + mTailSize, buffer->data, buffer->size);
+        memcpy(buffer->data, mTail, mTailSize);
+        memset(buffer->data + bytes, 0, aligned - bytes);
+        WriteLogFile(mFd, buffer->data, aligned, mFileSize - mTailSize);
+        mTailSize = bytes & (kAlignment - 1);
+        memcpy(mTail, buffer->data + bytes - mTailSize, mTailSize);
+        if (mTailSize != 0 && ftruncate(mFd, mFileSize + buffer->size) != 0)
+        {
+            fprintf(stderr, "Can't truncate log file, errno=%s\n", strerror(errno));
+        }
+    }
+    mFileSize += buffer->size;
+    buffer->size = 0;
+    if (mOptions.syncPolicy == FILE_LOGGING_SYNC_WRITE)
+    {
+        syncFile();
+    }
+}
+
+void FileLoggerAdaptor::syncFile()
+{
+    if (fdatasync(mFd) != 0)
+    {
+        fprintf(stderr, "Can't sync log file, errno=%s\n", strerror(errno));
+    }
+}
+
+void FileLoggerAdaptor::rotate()
+{
+    if (mStandbyFd < 0)
+    {
+        mStandbyFd = openFile(mStandbyPath);
+        if (mStandbyFd < 0)
+        {
+            return; // go on with the live file
+        }
+    }
+    if (mOptions.syncPolicy != FILE_LOGGING_SYNC_NONE)
+    {
+        syncFile();
+    }
+    moveLiveFile();
+    if (rename(mStandbyPath.c_str(), mOptions.path.c_str()) != 0)
+    {
+        fprintf(stderr, "Can't rename %s to %s, errno=%s\n", mStandbyPath.c_str(),
+                mOptions.path.c_str(), strerror(errno));
+    }
+    close(mFd);
+    mFd = mStandbyFd;
+    mFileSize = 0;
+    mTailSize = 0;
+    mStandbyFd = openFile(mStandbyPath);
+}
+
+void FileLoggerAdaptor::moveLiveFile()
+{
+    if (!mOptions.compress)
+    {
+        RotateLogFiles(mOptions.path, false, mOptions.maxFileNum, mOptions.maxDay);
+        return;
+    }
+    // compressed and rotated by the compressor
+    std::string file = StringPrintf("%s.%lu", mOptions.path.c_str(), GetCurrentTimeInUs());
+    if (rename(mOptions.path.c_str(), file.c_str()) != 0)
+    {
+        fprintf(stderr, "Can't rename %s to %s, errno=%s\n", mOptions.path.c_str(),
+                file.c_str(), strerror(errno));
+        return;
+    }
+    LogFileCompressor::GetInstance()->Push(file, mOptions);
+}
+
+int FileLoggerAdaptor::openFile(const std::string& path)
+{
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    int fd = open(path.c_str(), flags | (mDirect ? O_DIRECT : 0), 0644);
+    if (fd < 0 && mDirect && errno == EINVAL)
+    {
+        fprintf(stderr, "No O_DIRECT for %s, write through the page cache\n", path.c_str());
+        mDirect = false;
+        fd = open(path.c_str(), flags, 0644);
+    }
+    if (fd < 0)
+    {
+        fprintf(stderr, "Can't open %s, errno=%s\n", path.c_str(), strerror(errno));
+    }
+    return fd;
+}
+
+uint64_t FileLoggerAdaptor::getNextRotateTime(uint64_t now)
+{
+    uint64_t interval = mOptions.rotateIntervalSec;
+    if (interval == 0)
+    {
+        return 0;
+    }
+    // Multiples of local time, so that daily rotation is at local midnight.
+    time_t seconds = static_cast<time_t>(now);
+    struct tm local;
+    int64_t offset = localtime_r(&seconds, &local) != NULL ? local.tm_gmtoff : 0;
+    uint64_t localNow = now + offset;
+    return (localNow / interval + 1) * interval - offset;
+}
+
+class FileLoggingSystem : public ILoggingSystem
+{
+public:
+    FileLoggingSystem(const std::string& name, const FileLoggingOptions& options)
+        : ILoggingSystem(name), mAdaptor(options)
+    {
+    }
+    ~FileLoggingSystem() {}
+
+    /*override*/ ILoggerAdaptor* GetLogger(const std::string& key)
+    {
+        return &mAdaptor;
+    }
+
+    /*override*/ void Setup() { mAdaptor.Start(); }
+    /*override*/ bool LoadConfig(const std::string& jsonContent) { return true; }
+    /*override*/ void FlushLog() { mAdaptor.Flush(); }
+    /*override*/ void TearDown() { mAdaptor.Stop(); }
+
+private:
+    FileLoggerAdaptor mAdaptor;
+};
+
+ILoggingSystem* CreateFileLoggingSystem(const std::string& name,
+                                        const FileLoggingOptions& options)
+{
+    return new FileLoggingSystem(name, options);
+}
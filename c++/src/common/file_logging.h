@@ -0,0 +1,57 @@
+#ifndef _SRC_COMMON_FILE_LOGGING_H
+#define _SRC_COMMON_FILE_LOGGING_H
+
+#include <stdint.h>
+#include <string>
+
+#include "src/common/logging.h"
+
+enum FileLoggingSyncPolicy
+{
+    FILE_LOGGING_SYNC_NONE,         // Leave it to the page cache
+    FILE_LOGGING_SYNC_FLUSH,        // fdatasync on FlushLog and rotation
+    FILE_LOGGING_SYNC_WRITE,        // fdatasync after every write
+};
+
+struct FileLoggingOptions
+{
+    FileLoggingOptions();
+
+    std::string path;               // Rotated to path.1, path.2, ...
+    LogLevel level;
+    uint32_t bufferSize;            // Of each buffer, rounded up to 4KB
+    uint32_t bufferNum;             // At least 2
+    uint32_t flushIntervalMs;       // Write a partly filled buffer after
+    uint64_t maxFileSize;           // Rotate beyond, 0 for no limit
+    uint32_t rotateIntervalSec;     // Rotate at multiples of, in local time, 0 for never
+    int maxFileNum;                 // See RotateLogFiles
+    int maxDay;
+    bool compress;                  // gzip rotated files
+    bool directIO;                  // O_DIRECT, if the file system allows
+    FileLoggingSyncPolicy syncPolicy;
+};
+
+/*
+ * @brief, a logging system writing the logs of all keys to one file
+ *
+ *   Loggers only copy the logs into large aligned buffers, a background
+ *   thread of the system writes the full ones, and those partly filled
+ *   for flushIntervalMs.  Loggers wait only when all buffers are full.
+ *
+ *   The thread rotates the file by size and by time.  The next file is
+ *   opened in advance, so rotating is renaming the files and switching
+ *   to the open one, and compressing the rotated file is left to another
+ *   background thread.
+ *
+ *   Setup opens the file, TearDown writes everything and closes it.
+ *
+ * Usage:
+ *   FileLoggingOptions options;
+ *   options.path = "/apsara/log/server.LOG";
+ *   options.compress = true;
+ *   RegisterLoggingSystem(CreateFileLoggingSystem("file", options));
+ */
+ILoggingSystem* CreateFileLoggingSystem(const std::string& name,
+                                        const FileLoggingOptions& options);
+
+#endif  // _SRC_COMMON_FILE_LOGGING_H
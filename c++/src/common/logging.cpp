@@ -1,12 +1,14 @@
 #include "src/common/logging.h"
 
 #include <dlfcn.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <google/protobuf/message.h>
 
 #include <tr1/unordered_map>
+#include <vector>
 
 #include "src/common/assert.h"
 #include "src/common/flag.h"
@@ -14,6 +16,9 @@
 #include "src/common/self_thread.h"
 #include "src/sync/atomic.h"
 #include "src/sync/lock.h"
+#include "src/sync/micro_lock.h"
+#include "src/sync/ring_buffer.h"
+#include "src/sync/worker_rounds.h"
 
 #include "include/routine_thread_pool.h"
 
@@ -21,6 +26,15 @@ DECLARE_FLAG_BOOL(common_EnableApsaraLoggingSystem);
 DECLARE_FLAG_BOOL(common_AutoInitLoggingSystem);
 DECLARE_FLAG_BOOL(common_EnableAsyncLogging);
 
+DEFINE_FLAG_INT64(common_AsyncLoggingBufferRecords,
+        "logs each thread may buffer for the async logging thread", 4096);
+DEFINE_FLAG_INT64(common_AsyncLoggingMaxPendingBytes,
+        "bytes of logs all threads may buffer for the async logging thread",
+        64 * 1024 * 1024);
+DEFINE_FLAG_BOOL(common_AsyncLoggingBlockWhenFull,
+        "wait for the async logging thread when its buffers are full,"
+        " instead of dropping the log", false);
+
 // GLOBAL_NOLINT
 
 struct GZlib
@@ -183,10 +197,10 @@ static std::string FormatUserKey(const std::string& key)
 struct AppendLogTaskClosure : public ::google::protobuf::Closure
 {
     AppendLogTaskClosure(const char* data_, uint32_t size_,
-            ILoggerAdaptor** adaptorList_, const ConstLoggingHeader& header_,
-            size_t headerLen_, size_t tid_)
+            uint32_t capacity_, ILoggerAdaptor** adaptorList_,
+            const ConstLoggingHeader& header_, size_t headerLen_, size_t tid_)
         : refData(data_, size_, MAX_SUPPORT_LOGGING_SYSTEM),
-          adaptorList(adaptorList_), task(this)
+          adaptorList(adaptorList_), capacity(capacity_), task(this)
     {
         header.filename = header_.filename;
         header.function = header_.function;
@@ -213,9 +227,12 @@ struct AppendLogTaskClosure : public ::google::protobuf::Closure
     RefCountedLoggingData refData;
     ILoggerAdaptor** adaptorList;
     LoggingHeader header;
+    uint32_t capacity;  // of the buffer holding data and this closure
     EasyTask task;
 };
 
+typedef SpscRingBuffer<AppendLogTaskClosure*> AsyncLogRecords;
+
 class TLSLogHelper
 {
 public:
@@ -238,9 +255,11 @@ public:
         }
         memset(mLastLogTimeInHour, 0, sizeof(mLastLogTimeInHour));
         memset(mLogCounter, 0, sizeof(mLogCounter));
+        mAsyncRecords = NULL;
         mNextFree = NULL;
         mNext = static_cast<TLSLogHelper*>(sTLSLogHelperListHeader);
-        sTLSLogHelperListHeader = this;
+        // the async logging thread walks the list without sRWLock
+        AtomicSet(&sTLSLogHelperListHeader, static_cast<void*>(this));
     }
 
     void EnableLogging()    { mLoggingEnabled = true;  }
@@ -258,6 +277,19 @@ public:
         sTLSLogHelperFreeListHeader = this;
     }
 
+    // async logging records of the owner thread, the helper and its records
+    // outlive the thread, and are taken over by the next thread reusing it
+    AsyncLogRecords* GetAsyncRecords()
+    {
+        if (UNLIKELY(mAsyncRecords == NULL))
+        {
+            AtomicSet(&mAsyncRecords, new AsyncLogRecords(
+                        INT64_FLAG(common_AsyncLoggingBufferRecords)));
+        }
+        return mAsyncRecords;
+    }
+    AsyncLogRecords* PeekAsyncRecords() { return AtomicGet(&mAsyncRecords); }
+
     // counter related
     void AddCounter(LogLevelIndex index)   { mLogCounter[index]++;      }
     size_t GetCounter(LogLevelIndex index) { return mLogCounter[index]; }
@@ -325,6 +357,7 @@ private:
     };
 
     char mHeaderData[LOG_LEVEL_INDEX_NONE][LOGGING_MAX_HEADER_FRAGMENT_LEN];
+    AsyncLogRecords* volatile mAsyncRecords;
     TLSLogHelper* mNext;
     TLSLogHelper* mNextFree;
     uint64_t mLastLogTimeInHour[LOG_LEVEL_INDEX_NONE];
@@ -382,6 +415,244 @@ static TLSLogHelper* GetTLSLogHelper()
     return helper;
 }
 
+class AsyncLogFlusher;
+
+static AsyncLogFlusher* sAsyncLogFlusher = NULL;
+static pthread_once_t   sAsyncLogFlusherOnce = PTHREAD_ONCE_INIT;
+static __thread bool    sInAsyncLogFlusher = false;
+
+/*
+ * The thread of async logging
+ *
+ * Each thread hands its logs over in the SPSC ring of its TLSLogHelper, so
+ * logging takes no lock and makes no system call.  The flusher drains the
+ * rings in rounds, and passes the logs of a round to each adaptor with one
+ * AppendLogBatch.  The logs of a thread keep their order, those of
+ * different threads may interleave differently than they were made.
+ *
+ * Memory is bounded by the rings and common_AsyncLoggingMaxPendingBytes,
+ * beyond which logs are dropped, or wait for the flusher with
+ * common_AsyncLoggingBlockWhenFull.  FATAL logs are never dropped, and
+ * their thread waits until they are passed to the adaptors.
+ */
+class AsyncLogFlusher
+{
+public:
+    static AsyncLogFlusher* GetInstance()
+    {
+        AsyncLogFlusher* flusher = AtomicGet(&sAsyncLogFlusher);
+        if (UNLIKELY(flusher == NULL))
+        {
+            pthread_once(&sAsyncLogFlusherOnce, &AsyncLogFlusher::createInstance);
+            flusher = AtomicGet(&sAsyncLogFlusher);
+        }
+        return flusher;
+    }
+
+    // NULL if async logging has never been used
+    static AsyncLogFlusher* GetStartedInstance()
+    {
+        return AtomicGet(&sAsyncLogFlusher);
+    }
+
+    // return false if the log is dropped, the caller frees it then
+    bool Push(AppendLogTaskClosure* task)
+    {
+        AsyncLogRecords* records = GetTLSLogHelper()->GetAsyncRecords();
+        if (LIKELY(tryPush(records, task)))
+        {
+            if (UNLIKELY(mRounds.IsSleeping())
+                    && records->Size() * 2 >= records->Capacity())
+            {
+                mRounds.WakeUp();
+            }
+            return true;
+        }
+        if (!BOOL_FLAG(common_AsyncLoggingBlockWhenFull)
+                && task->header.level < LOG_LEVEL_FATAL)
+        {
+            AtomicInc(&mDroppedLogs, std::memory_order_relaxed);
+            return false;
+        }
+        Sleeper sleeper;
+        do
+        {
+            mRounds.WakeUp();
+            sleeper.Pause();
+        } while (!tryPush(records, task));
+        return true;
+    }
+
+    // wait until all logs pushed before are passed to adaptors
+    void WaitForDrain()
+    {
+        if (sInAsyncLogFlusher)
+        {
+            return; // called by an adaptor, the logs wait for the next round
+        }
+        mRounds.WaitForRound(kFlushIntervalUs);
+    }
+
+    uint64_t GetDroppedLogCount()
+    {
+        return AtomicGet(&mDroppedLogs, std::memory_order_relaxed);
+    }
+
+private:
+    enum
+    {
+        kMaxBatchRecords = 256,
+        kFlushIntervalUs = 10 * 1000,
+    };
+
+    struct AdaptorBatch
+    {
+        std::vector<const LoggingHeader*> headers;
+        std::vector<RefCountedLoggingData*> loggingData;
+    };
+
+    AsyncLogFlusher()
+        : mPendingBytes(0), mDroppedLogs(0)
+    {
+    }
+
+    static void createInstance()
+    {
+        AsyncLogFlusher* flusher = new AsyncLogFlusher;
+        pthread_t thread;
+        int ret = pthread_create(&thread, NULL, &AsyncLogFlusher::flusherThread,
+                flusher);
+        if (ret != 0)
+        {
+            fprintf(stderr, "Create thread error in AsyncLogFlusher");
+            abort();
+        }
+        pthread_detach(thread);
+        AtomicSet(&sAsyncLogFlusher, flusher);
+    }
+
+    static void* flusherThread(void* param)
+    {
+        sInAsyncLogFlusher = true;
+        static_cast<AsyncLogFlusher*>(param)->run();
+        return NULL;
+    }
+
+    bool tryPush(AsyncLogRecords* records, AppendLogTaskClosure* task)
+    {
+        uint64_t capacity = task->capacity;
+        uint64_t pending = AtomicAdd(&mPendingBytes, capacity,
+                std::memory_order_relaxed);
+        // a single log larger than the limit still goes alone
+        if (LIKELY(pending <= static_cast<uint64_t>(
+                        INT64_FLAG(common_AsyncLoggingMaxPendingBytes))
+                    || pending == capacity)
+                && LIKELY(records->Push(task)))
+        {
+            return true;
+        }
+        AtomicSub(&mPendingBytes, capacity, std::memory_order_relaxed);
+        return false;
+    }
+
+    void run()
+    {
+        AppendLogTaskClosure* tasks[kMaxBatchRecords];
+        while (true)
+        {
+            mRounds.BeginRound();
+            size_t count = 0;
+            size_t drained = 0;
+            TLSLogHelper* helper = static_cast<TLSLogHelper*>(
+                    AtomicGet(&sTLSLogHelperListHeader));
+            for (; helper != NULL; helper = helper->GetNext())
+            {
+                AsyncLogRecords* records = helper->PeekAsyncRecords();
+                if (records == NULL)
+                {
+                    continue;
+                }
+                // take no more than a ringful, so that a round ends while
+                // the thread keeps logging, and still takes all its logs
+                // made before the round began
+                size_t limit = records->Capacity();
+                while (limit > 0)
+                {
+                    size_t popped = records->PopBatch(tasks + count,
+                            MIN(limit, kMaxBatchRecords - count));
+                    if (popped == 0)
+                    {
+                        break;
+                    }
+                    limit -= popped;
+                    count += popped;
+                    if (count == kMaxBatchRecords)
+                    {
+                        dispatch(tasks, count);
+                        drained += count;
+                        count = 0;
+                    }
+                }
+            }
+            dispatch(tasks, count);
+            drained += count;
+
+            mRounds.EndRound(drained == 0, kFlushIntervalUs);
+        }
+    }
+
+    void dispatch(AppendLogTaskClosure** tasks, size_t count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        uint64_t bytes = 0;
+        for (size_t idx = 0; idx < count; ++idx)
+        {
+            AppendLogTaskClosure* task = tasks[idx];
+            bytes += task->capacity;
+            size_t appendCnt = 0;
+            ILoggerAdaptor** adaptorList = task->adaptorList;
+            while (*adaptorList != NULL)
+            {
+                ILoggerAdaptor* adaptor = *adaptorList;
+                if (LIKELY(adaptor->IsLevelEnabled(task->header.level)))
+                {
+                    AdaptorBatch& batch = mBatches[adaptor];
+                    batch.headers.push_back(&task->header);
+                    batch.loggingData.push_back(&task->refData);
+                    ++appendCnt;
+                }
+                ++adaptorList;
+            }
+            // the adaptors hold the rest, and the data lives until they
+            // release them all
+            task->refData.SubRef(MAX_SUPPORT_LOGGING_SYSTEM - appendCnt);
+        }
+        for (typeof(mBatches.end()) it = mBatches.begin();
+                it != mBatches.end(); ++it)
+        {
+            AdaptorBatch& batch = it->second;
+            if (batch.headers.empty())
+            {
+                continue;
+            }
+            it->first->AppendLogBatch(&batch.headers[0], &batch.loggingData[0],
+                    batch.headers.size());
+            batch.headers.clear();
+            batch.loggingData.clear();
+        }
+        AtomicSub(&mPendingBytes, bytes, std::memory_order_relaxed);
+    }
+
+    volatile uint64_t mPendingBytes;
+    volatile uint64_t mDroppedLogs;
+    WorkerRounds mRounds;
+    // owned by the flusher thread
+    std::tr1::unordered_map<ILoggerAdaptor*, AdaptorBatch> mBatches;
+};
+
 ILoggingSystem::ILoggingSystem(const std::string& name)
 {
     mName = name;
@@ -445,11 +716,21 @@ void Logger::AppendLog(const ConstLoggingHeader& header, size_t headerLen, size_
     }
     AppendLogTaskClosure* taskClosure = reinterpret_cast<AppendLogTaskClosure*>(
             const_cast<char*>(data) + capacity - sizeof(AppendLogTaskClosure));
-    new (taskClosure) AppendLogTaskClosure(data, size, mAdaptorList, header,
-            headerLen, tid);
-    if (false && LIKELY(BOOL_FLAG(common_EnableAsyncLogging)))
+    new (taskClosure) AppendLogTaskClosure(data, size, capacity, mAdaptorList,
+            header, headerLen, tid);
+    // the flusher itself logs synchronously, it might wait for itself otherwise
+    if (LIKELY(BOOL_FLAG(common_EnableAsyncLogging)) && !sInAsyncLogFlusher)
     {
-        PushTaskToNonCriticalTaskThreadPool(&taskClosure->task, 0);
+        AsyncLogFlusher* flusher = AsyncLogFlusher::GetInstance();
+        if (UNLIKELY(!flusher->Push(taskClosure)))
+        {
+            free(const_cast<char*>(data));
+        }
+        else if (UNLIKELY(header.level >= LOG_LEVEL_FATAL))
+        {
+            // an abort may follow, hand it to the adaptors before that
+            flusher->WaitForDrain();
+        }
     }
     else
     {
@@ -659,6 +940,11 @@ void InitLoggingSystem()
 
 void UninitLoggingSystem()
 {
+    AsyncLogFlusher* flusher = AsyncLogFlusher::GetStartedInstance();
+    if (flusher != NULL)
+    {
+        flusher->WaitForDrain();
+    }
     if (sLoggingSystemInit)
     {
         std::map<std::string, ILoggingSystem*>* logsystemMap
@@ -680,6 +966,12 @@ void UninitLoggingSystem()
 
 void FlushLog()
 {
+    // before taking sRWLock, adaptors may take it
+    AsyncLogFlusher* flusher = AsyncLogFlusher::GetStartedInstance();
+    if (flusher != NULL)
+    {
+        flusher->WaitForDrain();
+    }
     if (sLoggingSystemInit)
     {
         std::map<std::string, ILoggingSystem*>* logsystemMap
@@ -694,6 +986,12 @@ void FlushLog()
     }
 }
 
+uint64_t GetDroppedLogCount()
+{
+    AsyncLogFlusher* flusher = AsyncLogFlusher::GetStartedInstance();
+    return flusher == NULL ? 0 : flusher->GetDroppedLogCount();
+}
+
 static void RotateLogFile(
         const std::string& src,
         const std::string& dest,
@@ -722,7 +1020,7 @@ static void RotateLogFile(
     }
 }
 
-static std::string CompressLogFile(const std::string& src)
+std::string CompressLogFile(const std::string& src)
 {
     static GZlib gzlib;
     if (gzlib.mGzOpen == NULL)
@@ -839,7 +1137,7 @@ void RotateLogFiles(const std::string& path,
         }
         else
         {
-            src = CompressLogFile(src);
+            src = CompressLogFile(path);
             if (src.empty())
             {
                 continue;
@@ -138,6 +138,23 @@ public:
      */
     virtual void AppendLog(const LoggingHeader& header, RefCountedLoggingData* loggingData) = 0;
 
+    /*
+     * append a batch of log data, called by the async logging thread
+     * @param headers and loggingData of 'count' logs, in the order each
+     *  thread logged them, every loggingData needs a Release()
+     *  the default calls AppendLog one by one, a file based adaptor may
+     *  write the whole batch with a single writev
+     */
+    virtual void AppendLogBatch(const LoggingHeader* const* headers,
+                                RefCountedLoggingData* const* loggingData,
+                                size_t count)
+    {
+        for (size_t idx = 0; idx < count; ++idx)
+        {
+            AppendLog(*headers[idx], loggingData[idx]);
+        }
+    }
+
     /*
      * return log level for this adaptor
      * It is LoggingSystem's responsible to set the Logger's level or update when LoadConfig
@@ -190,13 +207,30 @@ std::string StringPrintf(const char* fmt, ...) __attribute__((format(printf, 1,
 void InitLoggingSystem();
 void UninitLoggingSystem();
 
+/*
+ * @brief, wait until the async logging thread has handed every log made
+ *         before to the logging systems, then flush all of them
+ */
 void FlushLog();
+
+/*
+ * @brief, number of logs dropped by async logging because its buffers
+ *         were full, see common_AsyncLoggingBlockWhenFull
+ */
+uint64_t GetDroppedLogCount();
+
 void RotateLogFiles(const std::string& path,
                     bool bCompress,
                     int maxFileNum,
                     int maxDay,
                     std::string* tmpFile = NULL);
 
+/*
+ * @brief, gzip 'src' to src.gz and remove 'src'
+ * @return: the path of the gzip file, or "" on failure
+ */
+std::string CompressLogFile(const std::string& src);
+
 bool LoadConfig(const std::string& jsonContent);
 bool LoadConfigFile(const std::string&  filePath="");
 void ReloadLogLevel();
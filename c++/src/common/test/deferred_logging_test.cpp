@@ -0,0 +1,197 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/common/deferred_logging.h"
+#include "src/thread/this_thread.h"
+
+/** Logs go to a temporary file while alive. */
+class DeferredLogCapture
+{
+public:
+    DeferredLogCapture()
+    {
+        char path[] = "/tmp/deferred_logging_test.XXXXXX";
+        mFd = mkstemp(path);
+        unlink(path);
+        DeferredLogger::Flush();
+        DeferredLogger::SetOutput(mFd);
+    }
+
+    ~DeferredLogCapture()
+    {
+        DeferredLogger::Flush();
+        DeferredLogger::SetOutput(STDERR_FILENO);
+        close(mFd);
+    }
+
+    std::vector<std::string> GetLines()
+    {
+        DeferredLogger::Flush();
+        std::string text;
+        char buf[4096];
+        ssize_t size = 0;
+        for (off_t offset = 0; (size = pread(mFd, buf, sizeof(buf), offset)) > 0; offset += size)
+        {
+            text.append(buf, size);
+        }
+        std::vector<std::string> lines;
+        size_t begin = 0;
+        size_t end = 0;
+        while ((end = text.find('\n', begin)) != std::string::npos)
+        {
+            lines.push_back(text.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        return lines;
+    }
+
+private:
+    int mFd;
+};
+
+/** The message after "[time]\t[LEVEL]\t[tid]\t[file:line]\t". */
+static std::string deferredLogMessage(const std::string& line)
+{
+    size_t pos = 0;
+    for (int i = 0; i < 4 && pos != std::string::npos; ++i)
+    {
+        pos = line.find("]\t", pos);
+        pos = pos == std::string::npos ? pos : pos + 2;
+    }
+    return pos == std::string::npos ? "" : line.substr(pos);
+}
+
+TEST(DeferredLogging, Format)
+{
+    DeferredLogCapture capture;
+    int line = __LINE__ + 1;
+    DEFERRED_LOGF_INFO("no args");
+    std::string name = "chunk";
+    char* volatile nullString = NULL;
+    int value = 7;
+    DEFERRED_LOGF_WARNING("%s %d %u %ld %lu %c %5.2f %x %%", name.c_str(), -1, 2U,
+                          -3L, 4UL, 'z', 3.14159, 255);
+    DEFERRED_LOGF_ERROR("[%*d] [%-*.*s] [%p] [%s]", 4, 42, 6, 3, "abcdef", &value,
+                        nullString);
+    DEFERRED_LOGF_DEBUG("%hhd %hd %lld %llu %.1e", static_cast<char>(-5),
+                        static_cast<short>(-6), -7LL, 8ULL, 1.5e10);
+
+    std::vector<std::string> lines = capture.GetLines();
+    ASSERT_EQ(4U, lines.size());
+    char header[256];
+    snprintf(header, sizeof(header), "]\t[INFO]\t[%d]\t[%s:%d]\t", ThisThread::GetId(),
+             __FILE__, line);
+    EXPECT_EQ('[', lines[0][0]);
+    EXPECT_NE(std::string::npos, lines[0].find(header)) << lines[0];
+    EXPECT_EQ("no args", deferredLogMessage(lines[0]));
+    EXPECT_NE(std::string::npos, lines[1].find("]\t[WARNING]\t"));
+    EXPECT_EQ("chunk -1 2 -3 4 z  3.14 ff %", deferredLogMessage(lines[1]));
+    char expected[256];
+    snprintf(expected, sizeof(expected), "[  42] [abc   ] [%p] []", &value);
+    EXPECT_EQ(expected, deferredLogMessage(lines[2]));
+    EXPECT_EQ("-5 -6 -7 8 1.5e+10", deferredLogMessage(lines[3]));
+
+    // The time, "2018-03-22 10:10:10.123456"
+    uint64_t now = GetCurrentTimeInUs();
+    time_t second = now / 1000000;
+    struct tm t;
+    localtime_r(&second, &t);
+    char date[16];
+    strftime(date, sizeof(date), "[%Y-%m-%d ", &t);
+    EXPECT_EQ(0U, lines[0].find(date)) << lines[0];
+    EXPECT_EQ(']', lines[0][27]);
+}
+
+TEST(DeferredLogging, Level)
+{
+    DeferredLogCapture capture;
+    DeferredLogger::SetLevel(DEFERRED_LOG_LEVEL_WARNING);
+    DEFERRED_LOGF_INFO("hidden %d", 1);
+    DEFERRED_LOGF_WARNING("shown %d", 2);
+    DeferredLogger::SetLevel(DEFERRED_LOG_LEVEL_PROFILE);
+    std::vector<std::string> lines = capture.GetLines();
+    ASSERT_EQ(1U, lines.size());
+    EXPECT_EQ("shown 2", deferredLogMessage(lines[0]));
+}
+
+enum
+{
+    kDeferredLogThreads = 4,
+    kDeferredLogsPerThread = 50000,
+};
+
+static void* deferredLogMany(void* arg)
+{
+    const char* tag = static_cast<const char*>(arg);
+    for (int i = 0; i < kDeferredLogsPerThread; ++i)
+    {
+        DEFERRED_LOGF_INFO("%s %d", tag, i);
+    }
+    return NULL;
+}
+
+TEST(DeferredLogging, MultiThread)
+{
+    DeferredLogCapture capture;
+    DeferredLogger::SetBlockWhenFull(true);
+    uint64_t dropped = DeferredLogger::GetDroppedLogCount();
+    const char* tags[kDeferredLogThreads] = { "a", "b", "c", "d" };
+    pthread_t threads[kDeferredLogThreads];
+    for (int i = 0; i < kDeferredLogThreads; ++i)
+    {
+        pthread_create(&threads[i], NULL, deferredLogMany, const_cast<char*>(tags[i]));
+    }
+    for (int i = 0; i < kDeferredLogThreads; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    DeferredLogger::SetBlockWhenFull(false);
+    EXPECT_EQ(dropped, DeferredLogger::GetDroppedLogCount());
+
+    // Every log once, and in order within a thread.
+    std::vector<std::string> lines = capture.GetLines();
+    ASSERT_EQ(static_cast<size_t>(kDeferredLogThreads * kDeferredLogsPerThread), lines.size());
+    int next[kDeferredLogThreads] = { 0 };
+    for (size_t i = 0; i < lines.size(); ++i)
+    {
+        std::string message = deferredLogMessage(lines[i]);
+        int thread = message[0] - 'a';
+        ASSERT_TRUE(thread >= 0 && thread < kDeferredLogThreads) << lines[i];
+        ASSERT_EQ(next[thread], atoi(message.c_str() + 2)) << lines[i];
+        ++next[thread];
+    }
+}
+
+TEST(DeferredLogging, Benchmark)
+{
+    DeferredLogCapture capture;
+    // Bursts that fit the buffer, to time the call site and not the writer.
+    const int kBursts = 100;
+    const int kLoops = 10000;
+    std::string name = "chunk";
+    uint64_t logging = 0;
+    uint64_t draining = 0;
+    uint64_t dropped = DeferredLogger::GetDroppedLogCount();
+    for (int burst = 0; burst < kBursts; ++burst)
+    {
+        uint64_t start = GetCurrentTimeInUs();
+        for (int i = 0; i < kLoops; ++i)
+        {
+            DEFERRED_LOGF_INFO("read %s at %lu, %d bytes", name.c_str(), i * 4096UL, 4096);
+        }
+        uint64_t end = GetCurrentTimeInUs();
+        DeferredLogger::Flush();
+        logging += end - start;
+        draining += GetCurrentTimeInUs() - end;
+    }
+    EXPECT_EQ(dropped, DeferredLogger::GetDroppedLogCount());
+    fprintf(stderr, ">>> DeferredLogging: %.1f ns per log, %.1f ns per log to write\n",
+            logging * 1000.0 / (kBursts * kLoops), draining * 1000.0 / (kBursts * kLoops));
+}
@@ -1,7 +1,19 @@
 #include <gtest/gtest.h>
 
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "src/common/file_logging.h"
 #include "src/common/logging.h"
 
+DECLARE_FLAG_BOOL(common_EnableAsyncLogging);
+DECLARE_FLAG_BOOL(common_AsyncLoggingBlockWhenFull);
+
 DEFINE_FLAG_INT64(LoggingPerformanceTestNumber, "", 1024);
 DEFINE_FLAG_INT64(LoggingPerformanceTestSleepTime, "", 0);
 DEFINE_FLAG_BOOL(LoggingPerformanceTestDisableApsaraTest, "", false);
@@ -14,22 +26,84 @@ static apsara::logging::Logger* sApsaraLogger =
 class ScreenLoggerAdaptor : public ILoggerAdaptor
 {
 public:
-    ScreenLoggerAdaptor() {}
+    ScreenLoggerAdaptor()
+        : mBatchCount(0), mRecordCount(0), mByteCount(0), mWrittenBytes(0),
+          mOrderErrors(0)
+    {
+    }
     ~ScreenLoggerAdaptor() {}
 
     /*override*/ void AppendLog(const LoggingHeader& header,
                                 RefCountedLoggingData* loggingData)
     {
-        write(STDERR_FILENO, loggingData->data(), loggingData->size());
+        ssize_t written = write(STDERR_FILENO, loggingData->data(), loggingData->size());
+        __sync_fetch_and_add(&mRecordCount, 1);
+        __sync_fetch_and_add(&mByteCount, loggingData->size());
+        __sync_fetch_and_add(&mWrittenBytes, written > 0 ? written : 0);
         loggingData->Release();
     }
-private:
+
+    /*override*/ void AppendLogBatch(const LoggingHeader* const* headers,
+                                     RefCountedLoggingData* const* loggingData,
+                                     size_t count)
+    {
+        struct iovec iov[IOV_MAX];
+        size_t done = 0;
+        while (done < count)
+        {
+            size_t num = std::min(count - done, static_cast<size_t>(IOV_MAX));
+            for (size_t idx = 0; idx < num; ++idx)
+            {
+                iov[idx].iov_base = const_cast<char*>(loggingData[done + idx]->data());
+                iov[idx].iov_len = loggingData[done + idx]->size();
+            }
+            ssize_t written = writev(STDERR_FILENO, iov, num);
+            for (size_t idx = 0; idx < num; ++idx)
+            {
+                checkOrder(*headers[done + idx], loggingData[done + idx]);
+                __sync_fetch_and_add(&mByteCount, loggingData[done + idx]->size());
+                loggingData[done + idx]->Release();
+            }
+            __sync_fetch_and_add(&mRecordCount, num);
+            __sync_fetch_and_add(&mWrittenBytes, written > 0 ? written : 0);
+            done += num;
+        }
+        mBatchCount++;
+    }
+
+    // the logs of a thread carrying ("AsyncSeq", n) must come in order of n,
+    // only called by the async logging thread
+    void checkOrder(const LoggingHeader& header, RefCountedLoggingData* loggingData)
+    {
+        std::string text(loggingData->data(), loggingData->size());
+        size_t pos = text.find("AsyncSeq");
+        if (pos == std::string::npos)
+        {
+            return;
+        }
+        pos = text.find_first_of("0123456789", pos + 8);
+        int64_t seq = pos == std::string::npos ? -1 : atoll(text.c_str() + pos);
+        int64_t& next = mNextSeq[header.tid];
+        if (seq != next)
+        {
+            mOrderErrors++;
+        }
+        next = seq + 1;
+    }
+
+    size_t mBatchCount;
+    volatile uint64_t mRecordCount;
+    volatile uint64_t mByteCount;
+    volatile uint64_t mWrittenBytes;
+    size_t mOrderErrors;
+    std::map<uint32_t, int64_t> mNextSeq;
 };
 
 class ScreenLoggingSystem : public ILoggingSystem
 {
 public:
-    ScreenLoggingSystem() : ILoggingSystem("screen")
+    explicit ScreenLoggingSystem(const std::string& name = "screen")
+        : ILoggingSystem(name)
     {
     }
     ~ScreenLoggingSystem() {}
@@ -43,15 +117,35 @@ public:
     /*override */ bool LoadConfig(const std::string& jsonContent) {return true;}
     /*override */ void FlushLog() {}
     /*override */ void TearDown() {}
+
+    size_t GetBatchCount() { return mScreenLoggerAdaptor.mBatchCount; }
+    ScreenLoggerAdaptor* GetAdaptor() { return &mScreenLoggerAdaptor; }
 private:
     ScreenLoggerAdaptor mScreenLoggerAdaptor;
 };
 
+struct AsyncLoggingTestArgs
+{
+    uint64_t loopCnt;
+};
+
+static void* LogAsyncSeq(void* param)
+{
+    AsyncLoggingTestArgs* args = static_cast<AsyncLoggingTestArgs*>(param);
+    for (uint64_t idx = 0; idx < args->loopCnt; ++idx)
+    {
+        PGLOG_WARNING(sLogger, (__FUNCTION__, "Async")("AsyncSeq", idx));
+    }
+    return NULL;
+}
+
 class LoggingTest: public apsara::UnitTestFixtureBase<LoggingTest>
 {
 public:
     APSARA_UNIT_TEST_CASE(TestLogging, 10240);
     APSARA_UNIT_TEST_CASE(TestLoggingAdaptor, 10240);
+    APSARA_UNIT_TEST_CASE(TestAsyncLogging, 10240);
+    APSARA_UNIT_TEST_CASE(TestFileLogging, 10240);
 
 public:
     void TestLogging()
@@ -156,4 +250,92 @@ public:
 
         DisableLoggingSystem(loggingSystem->GetName());
     }
+
+    void TestAsyncLogging()
+    {
+        // a name of its own, "screen" is registered by TestLoggingAdaptor
+        ScreenLoggingSystem* loggingSystem = new ScreenLoggingSystem("async_screen");
+        RegisterLoggingSystem(loggingSystem);
+        EnableLoggingSystem(loggingSystem->GetName());
+        BOOL_FLAG(common_EnableAsyncLogging) = true;
+        BOOL_FLAG(common_AsyncLoggingBlockWhenFull) = true;
+
+        const int threadNum = 4;
+        AsyncLoggingTestArgs args;
+        args.loopCnt = INT64_FLAG(LoggingPerformanceTestNumber);
+        std::vector<pthread_t> threads(threadNum);
+        uint64_t start = apsara::common::GetCurrentTimeInUs();
+        for (int idx = 0; idx < threadNum; ++idx)
+        {
+            pthread_create(&threads[idx], NULL, &LogAsyncSeq, &args);
+        }
+        for (int idx = 0; idx < threadNum; ++idx)
+        {
+            pthread_join(threads[idx], NULL);
+        }
+        uint64_t end = apsara::common::GetCurrentTimeInUs();
+        // every log is on screen when FlushLog returns
+        FlushLog();
+        ScreenLoggerAdaptor* adaptor = loggingSystem->GetAdaptor();
+        fprintf(stderr, ">>> Async Logging: Latency: %luns, Drain: %luus, Batches: %zu\n",
+                (end - start) * 1000UL / (args.loopCnt * threadNum),
+                apsara::common::GetCurrentTimeInUs() - end,
+                loggingSystem->GetBatchCount());
+        EXPECT_GT(loggingSystem->GetBatchCount(), 0U);
+        EXPECT_EQ(0UL, GetDroppedLogCount());
+        EXPECT_EQ(args.loopCnt * threadNum, adaptor->mRecordCount);
+        EXPECT_EQ(adaptor->mByteCount, adaptor->mWrittenBytes);
+        EXPECT_EQ(0U, adaptor->mOrderErrors);
+        EXPECT_EQ(static_cast<size_t>(threadNum), adaptor->mNextSeq.size());
+        for (typeof(adaptor->mNextSeq.end()) it = adaptor->mNextSeq.begin();
+                it != adaptor->mNextSeq.end(); ++it)
+        {
+            EXPECT_EQ(static_cast<int64_t>(args.loopCnt), it->second);
+        }
+
+        BOOL_FLAG(common_AsyncLoggingBlockWhenFull) = false;
+        BOOL_FLAG(common_EnableAsyncLogging) = false;
+        DisableLoggingSystem(loggingSystem->GetName());
+    }
+
+    void TestFileLogging()
+    {
+        char dir[] = "/tmp/file_logging_test.XXXXXX";
+        ASSERT_TRUE(mkdtemp(dir) != NULL);
+        FileLoggingOptions options;
+        options.path = std::string(dir) + "/logging_test.LOG";
+        options.bufferSize = 64 * 1024;
+        options.maxFileSize = 256 * 1024;
+        options.maxFileNum = 3;
+        options.compress = true;
+        ILoggingSystem* loggingSystem = CreateFileLoggingSystem("file", options);
+        RegisterLoggingSystem(loggingSystem);
+        EnableLoggingSystem(loggingSystem->GetName());
+
+        uint64_t loopCnt = INT64_FLAG(LoggingPerformanceTestNumber) * 32;
+        uint64_t start = apsara::common::GetCurrentTimeInUs();
+        for (size_t idx = 0; idx < loopCnt; ++idx)
+        {
+            PGLOG_WARNING(sLogger, (__FUNCTION__, idx)
+                    ("ToFile", "RotatedAndCompressed"));
+        }
+        uint64_t end = apsara::common::GetCurrentTimeInUs();
+        // every log is in the files when FlushLog returns
+        FlushLog();
+        fprintf(stderr, ">>> File Logging: Latency: %luns, Drain: %luus\n",
+                (end - start) * 1000UL / loopCnt,
+                apsara::common::GetCurrentTimeInUs() - end);
+        struct stat status;
+        EXPECT_EQ(0, stat(options.path.c_str(), &status));
+        EXPECT_LE(static_cast<uint64_t>(status.st_size), options.maxFileSize);
+
+        // TearDown waits for the compression
+        DisableLoggingSystem(loggingSystem->GetName());
+        loggingSystem->TearDown();
+        EXPECT_EQ(0, access((options.path + ".1.gz").c_str(), F_OK));
+        EXPECT_EQ(0, access((options.path + ".2.gz").c_str(), F_OK));
+        EXPECT_NE(0, access((options.path + ".3.gz").c_str(), F_OK));
+        EXPECT_NE(0, access((options.path + ".next").c_str(), F_OK));
+        system((std::string("rm -rf ") + dir).c_str());
+    }
 };
@@ -256,7 +256,7 @@ MemCache::PageHeader* MemCache::initPage(void* page)
 MemCache::PageHeader* MemCache::findPage(void* page)
 {
     uint64_t addr = reinterpret_cast<uint64_t>(page);
-    addr &= ~(mPageSize - 1);
+    addr &= ~static_cast<uint64_t>(mPageSize - 1);
     return reinterpret_cast<PageHeader*>(addr);
 }
 
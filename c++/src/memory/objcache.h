@@ -88,7 +88,7 @@ void ObjectCache<T>::init(const char* const name, bool construct)
 template <typename T>
 inline void ObjectCache<T>::constructHelper(void* ptr)
 {
-    new (ptr) T;
+    ::new (ptr) T;
 }
 
 template <typename T>
@@ -2,90 +2,96 @@
 #define _SRC_SYNC_ATOMIC_H
 
 #include <stdint.h>
+#include <atomic>
+#include <type_traits>
+
+/**
+ * Atomic operations on plain (volatile) memory, on the GCC __atomic
+ * builtins.
+ *
+ * Every operation takes an optional std::memory_order.  The defaults keep
+ * the old __sync behaviour where it matters: read-modify-writes are
+ * sequentially consistent, loads are too (a plain load on x86, ldar on
+ * ARM), and AtomicSet is a release store.  Pass a weaker order on hot
+ * paths that don't need a full fence, e.g. relaxed increments of
+ * statistics, an acquire CAS to lock and a release exchange to unlock.
+ *
+ * 16-byte values are only supported by AtomicCompareExchange and
+ * DoubleWordCAS, with cmpxchg16b on x86_64 and casp (or ldaxp/stlxp
+ * before ARMv8.1) on aarch64; both are always full barriers.
+ */
 
 namespace detail
 {
 
+/** A CAS may not fail with a release order, the builtins reject it. */
+inline int FailureOrder(std::memory_order order)
+{
+    return order == std::memory_order_release ? __ATOMIC_RELAXED
+        : order == std::memory_order_acq_rel ? __ATOMIC_ACQUIRE
+        : static_cast<int>(order);
+}
+
 class AtomicDetailDefault
 {
 public:
     template<typename T>
-    static void Set(volatile T* target, T value)
+    static T Get(volatile T* target, std::memory_order order)
     {
-        *target = value;
+        typename std::remove_const<T>::type value;
+        __atomic_load(target, &value, order);
+        return value;
     }
     template<typename T>
-    static T Exchange(volatile T* target, T value)
+    static void Set(volatile T* target, T value, std::memory_order order)
     {
-        return __sync_lock_test_and_set(target, value);
+        __atomic_store(target, &value, order);
     }
     template<typename T>
-    static T ExchangeAdd(volatile T* target, T value)
+    static T Exchange(volatile T* target, T value, std::memory_order order)
     {
-        return __sync_fetch_and_add(target, value);
+        T old;
+        __atomic_exchange(target, &value, &old, order);
+        return old;
     }
     template<typename T>
-    static bool CompareExchange(volatile T* target, T exchange, T compare)
+    static T ExchangeAdd(volatile T* target, T value, std::memory_order order)
     {
-        return __sync_bool_compare_and_swap(target, compare, exchange);
+        return __atomic_fetch_add(target, value, order);
     }
-};
-
-template<int Size>
-class AtomicDetail
-{
-public:
-    template<typename T>
-    static void Set(volatile T* target, T value);
-    template<typename T>
-    static bool CompareExchange(volatile T* target, T exchange, T compare);
     template<typename T>
-    static T ExchangeAdd(volatile T* target, T value);
+    static T ExchangeOr(volatile T* target, T value, std::memory_order order)
+    {
+        return __atomic_fetch_or(target, value, order);
+    }
     template<typename T>
-    static T Exchange(volatile T* target, T value);
-};
-
-template<>
-class AtomicDetail<1> : public AtomicDetailDefault
-{
-};
-
-template<>
-class AtomicDetail<2> : public AtomicDetailDefault
-{
-};
-
-template<>
-class AtomicDetail<4> : public AtomicDetailDefault
-{
-};
-
-#if __i386__
-
-template<>
-class AtomicDetail<8> : public AtomicDetailDefault
-{
-public:
+    static T ExchangeAnd(volatile T* target, T value, std::memory_order order)
+    {
+        return __atomic_fetch_and(target, value, order);
+    }
     template<typename T>
-    static void Set(volatile T* target, T value)
+    static bool CompareExchange(volatile T* target, T exchange, T compare,
+                                std::memory_order order)
     {
-        __sync_lock_test_and_set(target, value);
+        return __atomic_compare_exchange(target, &compare, &exchange, false,
+                                         order, FailureOrder(order));
     }
 };
 
-#elif __x86_64__
-
-template<>
-class AtomicDetail<8> : public AtomicDetailDefault
+template<int Size>
+class AtomicDetail : public AtomicDetailDefault
 {
 };
 
+#if __x86_64__
+
 template<>
 class AtomicDetail<16>
 {
 public:
     template<typename T>
-    static bool CompareExchange(volatile T* target, T exchange, T compare)
+    static bool CompareExchange(volatile T* target, T exchange, T compare,
+                                std::memory_order)
     {
         uint64_t *cmp = reinterpret_cast<uint64_t*>(&compare);
         uint64_t *with = reinterpret_cast<uint64_t*>(&exchange);
@@ -96,15 +102,69 @@ public:
              "setz %0"
              : "=q" (result), "+m" (*target), "+d" (cmp[1]), "+a" (cmp[0])
              : "c" (with[1]), "b" (with[0])
-             : "cc"
+             : "cc", "memory"
             );
         return result;
     }
 };
 
-#else
+#elif __aarch64__
 
-#error ARCHITECT NOT SUPPORTED
+template<>
+class AtomicDetail<16>
+{
+public:
+    template<typename T>
+    static bool CompareExchange(volatile T* target, T exchange, T compare,
+                                std::memory_order)
+    {
+        uint64_t *cmp = reinterpret_cast<uint64_t*>(&compare);
+        uint64_t *with = reinterpret_cast<uint64_t*>(&exchange);
+#if defined(__ARM_FEATURE_ATOMICS)
+        // casp takes even-odd register pairs.
+        register uint64_t old0 __asm__("x0") = cmp[0];
+        register uint64_t old1 __asm__("x1") = cmp[1];
+        register uint64_t new0 __asm__("x2") = with[0];
+        register uint64_t new1 __asm__("x3") = with[1];
+        __asm__ __volatile__
+            (
+             "caspal %0, %1, %3, %4, %2"
+             : "+r" (old0), "+r" (old1), "+Q" (*target)
+             : "r" (new0), "r" (new1)
+             : "memory"
+            );
+        return old0 == cmp[0] && old1 == cmp[1];
+#else
+        uint64_t old0;
+        uint64_t old1;
+        uint32_t failed;
+        do
+        {
+            __asm__ __volatile__
+                (
+                 "ldaxp %0, %1, %2"
+                 : "=&r" (old0), "=&r" (old1)
+                 : "Q" (*target)
+                 : "memory"
+                );
+            if (old0 != cmp[0] || old1 != cmp[1])
+            {
+                __asm__ __volatile__("clrex" : : : "memory");
+                return false;
+            }
+            __asm__ __volatile__
+                (
+                 "stlxp %w0, %2, %3, %1"
+                 : "=&r" (failed), "=Q" (*target)
+                 : "r" (with[0]), "r" (with[1])
+                 : "memory"
+                );
+        }
+        while (failed != 0);
+        return true;
+#endif
+    }
+};
 
 #endif
 
@@ -115,94 +175,139 @@ public:
  * If equal, set 'exchange' into 'target' buffer and return true
  */
 template<typename T>
-inline bool AtomicCompareExchange(volatile T* target, T exchange, T compare)
+inline bool AtomicCompareExchange(volatile T* target, T exchange, T compare,
+                                  std::memory_order order = std::memory_order_seq_cst)
 {
     return detail::AtomicDetail<sizeof(T)>::CompareExchange(
         target,
         exchange,
-        compare);
+        compare,
+        order);
+}
+
+/**
+ * AtomicCompareExchange() of a 16-byte value, e.g. a pointer and a tag.
+ * 'target' must be 16-byte aligned.
+ */
+template<typename T>
+inline bool DoubleWordCAS(volatile T* target, T exchange, T compare)
+{
+    static_assert(sizeof(T) == 16, "DoubleWordCAS takes 16-byte values");
+    return detail::AtomicDetail<16>::CompareExchange(
+        target,
+        exchange,
+        compare,
+        std::memory_order_seq_cst);
 }
 
 /**
  * Add 'value' to '*target', and return the original value.
  */
 template<typename T>
-inline T AtomicExchangeAdd(volatile T* target, T value)
+inline T AtomicExchangeAdd(volatile T* target, T value,
+                           std::memory_order order = std::memory_order_seq_cst)
+{
+    return detail::AtomicDetail<sizeof(T)>::ExchangeAdd(target, value, order);
+}
+
+/**
+ * Bitwise or 'value' into '*target', and return the original value.
+ */
+template<typename T>
+inline T AtomicExchangeOr(volatile T* target, T value,
+                          std::memory_order order = std::memory_order_seq_cst)
+{
+    return detail::AtomicDetail<sizeof(T)>::ExchangeOr(target, value, order);
+}
+
+/**
+ * Bitwise and 'value' into '*target', and return the original value.
+ */
+template<typename T>
+inline T AtomicExchangeAnd(volatile T* target, T value,
+                           std::memory_order order = std::memory_order_seq_cst)
 {
-    return detail::AtomicDetail<sizeof(T)>::ExchangeAdd(target, value);
+    return detail::AtomicDetail<sizeof(T)>::ExchangeAnd(target, value, order);
 }
 
 /**
  * Substract 'value' from '*target', and return the original value.
  */
 template<typename T>
-inline T AtomicExchangeSub(volatile T* target, T value)
+inline T AtomicExchangeSub(volatile T* target, T value,
+                           std::memory_order order = std::memory_order_seq_cst)
 {
-    return AtomicExchangeAdd(target, static_cast<T>(-value));
+    return AtomicExchangeAdd(target, static_cast<T>(-value), order);
 }
 
 /**
  * Add 'value' to '*target', and return the new value in 'target'.
  */
 template<typename T>
-inline T AtomicAdd(volatile T* target, T value)
+inline T AtomicAdd(volatile T* target, T value,
+                   std::memory_order order = std::memory_order_seq_cst)
 {
-    return AtomicExchangeAdd(target, value) + value;
+    return AtomicExchangeAdd(target, value, order) + value;
 }
 
 /**
  * Substract 'value' from 'target', and return the new value in target.
  */
 template<typename T>
-inline T AtomicSub(volatile T* target, T value)
+inline T AtomicSub(volatile T* target, T value,
+                   std::memory_order order = std::memory_order_seq_cst)
 {
-    return AtomicExchangeSub(target, value) - value;
+    return AtomicExchangeSub(target, value, order) - value;
 }
 
 /**
  * Set 'value' into 'target', and return the old value in target.
  */
 template<typename T>
-inline T AtomicExchange(volatile T* target, T value)
+inline T AtomicExchange(volatile T* target, T value,
+                        std::memory_order order = std::memory_order_seq_cst)
 {
-    return detail::AtomicDetail<sizeof(T)>::Exchange(target, value);
+    return detail::AtomicDetail<sizeof(T)>::Exchange(target, value, order);
 }
 
 /**
  * Set 'value' into '*target'
  */
 template<typename T>
-inline void AtomicSet(volatile T* target, T value)
+inline void AtomicSet(volatile T* target, T value,
+                      std::memory_order order = std::memory_order_release)
 {
-    detail::AtomicDetail<sizeof(T)>::Set(target, value);
+    detail::AtomicDetail<sizeof(T)>::Set(target, value, order);
 }
 
 /**
  * Get the value in '*target'
  */
 template<typename T>
-inline T AtomicGet(volatile T* target)
+inline T AtomicGet(volatile T* target,
+                   std::memory_order order = std::memory_order_seq_cst)
 {
-    T value = *target;
-    return value;
+    return detail::AtomicDetail<sizeof(T)>::Get(target, order);
 }
 
 /**
  * Add 1 to '*target', and return the new value in 'target'.
  */
 template<typename T>
-inline T AtomicInc(volatile T* target)
+inline T AtomicInc(volatile T* target,
+                   std::memory_order order = std::memory_order_seq_cst)
 {
-    return AtomicAdd(target, static_cast<T>(1));
+    return AtomicAdd(target, static_cast<T>(1), order);
 }
 
 /**
  * Substract 1 from '*target', and return the new value in 'target'.
  */
 template<typename T>
-inline T AtomicDec(volatile T* target)
+inline T AtomicDec(volatile T* target,
+                   std::memory_order order = std::memory_order_seq_cst)
 {
-    return AtomicSub(target, static_cast<T>(1));
+    return AtomicSub(target, static_cast<T>(1), order);
 }
 
 #endif // _SRC_SYNC_ATOMIC_H
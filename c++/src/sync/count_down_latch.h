@@ -0,0 +1,204 @@
+#ifndef _SRC_SYNC_COUNT_DOWN_LATCH_H
+#define _SRC_SYNC_COUNT_DOWN_LATCH_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "src/base/gettime.h"
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+#include "src/sync/futex.h"
+
+/**
+ * Let threads wait until CountDown() is called 'count' times.
+ *
+ * CountDown() is one atomic decrement; only the one reaching zero looks
+ * at the waiters, and makes a system call only if some thread is asleep.
+ * Waiters sleep on the count itself.  Once zero, the count stays there,
+ * extra CountDown() calls are ignored.
+ *
+ * Usage:
+ *   CountDownLatch started(workerNum);
+ *   // in every worker:  ...init...; started.CountDown();
+ *   started.Wait();
+ */
+class CountDownLatch
+{
+public:
+    explicit CountDownLatch(int32_t count);
+
+    void CountDown();
+
+    /** Block until the count reaches zero. */
+    void Wait();
+
+    /** Return false if the count is not zero within 'timeoutInUs'. */
+    bool TimedWait(int64_t timeoutInUs);
+
+    int32_t GetCount() const { return AtomicGet(&mCount); }
+
+private:
+    bool wait(int64_t timeoutInUs);
+
+    volatile int32_t mCount;
+    volatile int32_t mWaiters;
+
+    DISALLOW_COPY_AND_ASSIGN(CountDownLatch);
+};
+
+/**
+ * A reusable barrier for 'count' threads.
+ *
+ * Sense-reversing: the last thread to arrive resets the count and flips
+ * the sense word, which releases the phase; the others spin on the sense
+ * for a while (not on a uniprocessor), then sleep on it with a futex.
+ * Because arrivals of the next phase count against the reset counter, the
+ * barrier can be reused at once.
+ *
+ * Usage:
+ *   Barrier barrier(threadNum);
+ *   // in every thread, for each phase:
+ *   ComputePhase(i);
+ *   if (barrier.Wait()) { ...one thread merges... }
+ *   barrier.Wait();
+ */
+class Barrier
+{
+public:
+    explicit Barrier(int32_t count);
+
+    /** Return true in exactly one thread of each phase, the last to arrive. */
+    bool Wait();
+
+private:
+    enum
+    {
+        kSpinRounds = 200,
+    };
+
+    const int32_t mCount;
+    const int32_t mSpinRounds;
+    volatile int32_t mRemaining;
+    volatile int32_t mSense;
+    volatile int32_t mWaiters;
+
+    DISALLOW_COPY_AND_ASSIGN(Barrier);
+};
+
+inline CountDownLatch::CountDownLatch(int32_t count)
+    : mCount(count), mWaiters(0)
+{
+    ASSERT(count >= 0);
+}
+
+inline void CountDownLatch::CountDown()
+{
+    while (true)
+    {
+        int32_t count = AtomicGet(&mCount);
+        if (count == 0)
+        {
+            return;
+        }
+        if (AtomicCompareExchange(&mCount, count - 1, count))
+        {
+            // The exchange is a full barrier, so a waiter which registered
+            // before it is seen here, and one which registers after it
+            // sees zero.
+            if (count == 1 && AtomicGet(&mWaiters) != 0)
+            {
+                FutexWake(&mCount, INT_MAX);
+            }
+            return;
+        }
+    }
+}
+
+inline void CountDownLatch::Wait()
+{
+    wait(-1);
+}
+
+inline bool CountDownLatch::TimedWait(int64_t timeoutInUs)
+{
+    return wait(timeoutInUs);
+}
+
+inline bool CountDownLatch::wait(int64_t timeoutInUs)
+{
+    if (AtomicGet(&mCount) == 0)
+    {
+        return true;
+    }
+    uint64_t deadline = timeoutInUs >= 0 ? GetCurrentTimeInUs() + timeoutInUs : 0;
+    bool reached = true;
+    AtomicInc(&mWaiters);
+    while (true)
+    {
+        int32_t count = AtomicGet(&mCount);
+        if (count == 0)
+        {
+            break;
+        }
+        int64_t left = -1;
+        if (timeoutInUs >= 0)
+        {
+            uint64_t now = GetCurrentTimeInUs();
+            if (now >= deadline)
+            {
+                reached = false;
+                break;
+            }
+            left = deadline - now;
+        }
+        FutexWait(&mCount, count, left);
+    }
+    AtomicDec(&mWaiters);
+    return reached;
+}
+
+inline Barrier::Barrier(int32_t count)
+    : mCount(count),
+      mSpinRounds(sysconf(_SC_NPROCESSORS_ONLN) > 1 ? kSpinRounds : 0),
+      mRemaining(count),
+      mSense(0),
+      mWaiters(0)
+{
+    ASSERT(count > 0);
+}
+
+inline bool Barrier::Wait()
+{
+    // Read the sense before arriving, the last one may flip it right after.
+    int32_t sense = AtomicGet(&mSense);
+    if (AtomicDec(&mRemaining) == 0)
+    {
+        AtomicSet(&mRemaining, mCount);
+        // The exchange is a full barrier before reading mWaiters.
+        AtomicExchange(&mSense, sense ^ 1);
+        if (AtomicGet(&mWaiters) != 0)
+        {
+            FutexWake(&mSense, INT_MAX);
+        }
+        return true;
+    }
+    for (int i = 0; i < mSpinRounds; ++i)
+    {
+        if (AtomicGet(&mSense) != sense)
+        {
+            return false;
+        }
+        asm volatile("pause" ::: "memory");
+    }
+    AtomicInc(&mWaiters);
+    while (AtomicGet(&mSense) == sense)
+    {
+        FutexWait(&mSense, sense);
+    }
+    AtomicDec(&mWaiters);
+    return false;
+}
+
+#endif  // _SRC_SYNC_COUNT_DOWN_LATCH_H
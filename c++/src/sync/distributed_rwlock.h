@@ -0,0 +1,242 @@
+#ifndef _SRC_SYNC_DISTRIBUTED_RWLOCK_H
+#define _SRC_SYNC_DISTRIBUTED_RWLOCK_H
+
+#include <stdint.h>
+
+#include "src/base/gettime.h"
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+#include "src/sync/micro_lock.h"
+#include "src/thread/this_thread.h"
+
+/**
+ * Read-write lock for read-mostly data, in the style of the Linux brlock.
+ *
+ * Reader counts are spread over padded slots, and each thread always uses
+ * the same slot, so concurrent readers on different cores do not share a
+ * cache line.  A reader increments its slot and checks the writer word;
+ * a writer claims the writer word and waits until every slot drains.
+ * Readers back off while a writer is pending, so writers don't starve.
+ *
+ * Writing costs a scan of all kSlotNum slots, and the lock takes about
+ * 4KB; use it for config and routing tables, not per-object locking.
+ * Same interface as MicroRWLock, so it works with ScopedRWLock.
+ */
+class DistributedRWLock
+{
+public:
+    enum
+    {
+        kSlotNum = 64,
+    };
+
+    DistributedRWLock();
+
+    void ReadLock();
+
+    void ReadUnlock();
+
+    void WriteLock();
+
+    void WriteUnlock();
+
+    bool IsReadLocked() const;
+
+    bool IsWriteLocked() const;
+
+    bool IsLocked() const;
+
+    bool TryReadLock();
+
+    bool TryWriteLock();
+
+    bool TimedReadLock(uint64_t timeoutInUs);
+
+    bool TimedWriteLock(uint64_t timeoutInUs);
+
+    int GetWriteLockOwner() const;
+
+private:
+    struct Slot
+    {
+        volatile int32_t readers;
+        char padding[64 - sizeof(int32_t)];  // NOLINT(runtime/sizeof)
+    };
+
+    /** The slot of the calling thread, assigned round robin. */
+    Slot* getSlot();
+    bool hasReaders() const;
+
+    volatile int32_t mWriter;   // Writer's tid, or 0
+    char mWriterPadding[64 - sizeof(int32_t)];  // NOLINT(runtime/sizeof)
+    Slot mSlots[kSlotNum];
+
+    DISALLOW_COPY_AND_ASSIGN(DistributedRWLock);
+};
+
+inline DistributedRWLock::DistributedRWLock() : mWriter(0)
+{
+    for (int i = 0; i < kSlotNum; ++i)
+    {
+        mSlots[i].readers = 0;
+    }
+}
+
+inline void DistributedRWLock::ReadLock()
+{
+    Slot* slot = getSlot();
+    while (true)
+    {
+        // The increment is a full barrier before reading mWriter, and the
+        // writer's CAS one before it scans the slots.
+        AtomicInc(&slot->readers);
+        if (LIKELY(AtomicGet(&mWriter) == 0))
+        {
+            return;
+        }
+        AtomicDec(&slot->readers);
+        Sleeper sleeper;
+        while (AtomicGet(&mWriter) != 0)
+        {
+            sleeper.Pause();
+        }
+    }
+}
+
+inline void DistributedRWLock::ReadUnlock()
+{
+    AtomicDec(&getSlot()->readers);
+}
+
+inline void DistributedRWLock::WriteLock()
+{
+    int32_t tid = ThisThread::GetId();
+    Sleeper sleeper;
+    while (!AtomicCompareExchange(&mWriter, tid, 0))
+    {
+        sleeper.Pause();
+    }
+    while (hasReaders())
+    {
+        sleeper.Pause();
+    }
+}
+
+inline void DistributedRWLock::WriteUnlock()
+{
+    AtomicSet(&mWriter, 0);
+}
+
+inline bool DistributedRWLock::IsReadLocked() const
+{
+    return hasReaders();
+}
+
+inline bool DistributedRWLock::IsWriteLocked() const
+{
+    return AtomicGet(&mWriter) != 0;
+}
+
+inline bool DistributedRWLock::IsLocked() const
+{
+    return IsWriteLocked() || IsReadLocked();
+}
+
+inline bool DistributedRWLock::TryReadLock()
+{
+    Slot* slot = getSlot();
+    AtomicInc(&slot->readers);
+    if (AtomicGet(&mWriter) == 0)
+    {
+        return true;
+    }
+    AtomicDec(&slot->readers);
+    return false;
+}
+
+inline bool DistributedRWLock::TryWriteLock()
+{
+    if (!AtomicCompareExchange(&mWriter, static_cast<int32_t>(ThisThread::GetId()), 0))
+    {
+        return false;
+    }
+    if (hasReaders())
+    {
+        WriteUnlock();
+        return false;
+    }
+    return true;
+}
+
+inline bool DistributedRWLock::TimedReadLock(uint64_t timeoutInUs)
+{
+    uint64_t begin = GetCurrentTimeInUs();
+    Sleeper sleeper;
+    while (!TryReadLock())
+    {
+        uint64_t now = GetCurrentTimeInUs();
+        if (now >= begin && now - begin >= timeoutInUs)
+        {
+            return false;
+        }
+        sleeper.Pause();
+    }
+    return true;
+}
+
+inline bool DistributedRWLock::TimedWriteLock(uint64_t timeoutInUs)
+{
+    uint64_t begin = GetCurrentTimeInUs();
+    int32_t tid = ThisThread::GetId();
+    Sleeper sleeper;
+    while (!AtomicCompareExchange(&mWriter, tid, 0))
+    {
+        uint64_t now = GetCurrentTimeInUs();
+        if (now >= begin && now - begin >= timeoutInUs)
+        {
+            return false;
+        }
+        sleeper.Pause();
+    }
+    while (hasReaders())
+    {
+        uint64_t now = GetCurrentTimeInUs();
+        if (now >= begin && now - begin >= timeoutInUs)
+        {
+            WriteUnlock();
+            return false;
+        }
+        sleeper.Pause();
+    }
+    return true;
+}
+
+inline int DistributedRWLock::GetWriteLockOwner() const
+{
+    return AtomicGet(&mWriter);
+}
+
+inline DistributedRWLock::Slot* DistributedRWLock::getSlot()
+{
+    static volatile uint32_t sNextSlot = 0;
+    static __thread int32_t tSlot = -1;
+    if (UNLIKELY(tSlot < 0))
+    {
+        tSlot = AtomicExchangeAdd(&sNextSlot, 1U) % kSlotNum;
+    }
+    return &mSlots[tSlot];
+}
+
+inline bool DistributedRWLock::hasReaders() const
+{
+    // Slots may go negative when threads unlock through another slot than
+    // they locked with, so only the sum is meaningful.
+    int32_t readers = 0;
+    for (int i = 0; i < kSlotNum; ++i)
+    {
+        readers += AtomicGet(&mSlots[i].readers);
+    }
+    return readers != 0;
+}
+
+#endif  // _SRC_SYNC_DISTRIBUTED_RWLOCK_H
@@ -0,0 +1,291 @@
+#ifndef _SRC_SYNC_FAIR_LOCK_H
+#define _SRC_SYNC_FAIR_LOCK_H
+
+#include <stdint.h>
+
+#include "src/base/gettime.h"
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+#include "src/sync/futex.h"
+#include "src/sync/micro_lock.h"
+#include "src/thread/this_thread.h"
+
+/**
+ * FIFO spin locks.  Unlike MicroLock, waiters are served in arrival order,
+ * so nobody starves under heavy contention.
+ *
+ * Queued waiters never sleep on a timer, as the next in line would stall
+ * every handover: they spin a while, then yield or park until woken.
+ *
+ * TimedLock() does not queue: it retries TryLock() until the timeout, so a
+ * timed locker may be overtaken by queued ones.
+ */
+
+namespace detail
+{
+
+enum
+{
+    kFairLockMaxSpins = 1000,
+    kFairLockMaxYields = 100,
+};
+
+}  // namespace detail
+
+/**
+ * Ticket lock.  One atomic add to take a ticket, one store to unlock.
+ * All waiters still poll the same cache line, which the handover
+ * invalidates, and yield the CPU after spinning rather than park, as
+ * Unlock() can't tell whom to wake; prefer McsLock beyond a handful of
+ * contending cores.
+ */
+class TicketLock
+{
+public:
+    TicketLock() : mNext(0), mServing(0) {}
+
+    void Lock();
+
+    bool TryLock();
+
+    void Unlock();
+
+    bool IsLocked() const;
+
+    bool TimedLock(uint64_t timeoutInUs);
+
+private:
+    volatile uint32_t mNext;
+    volatile uint32_t mServing;
+
+    DISALLOW_COPY_AND_ASSIGN(TicketLock);
+};
+
+/**
+ * MCS queue lock.  Every waiter spins on a flag in its own queue node, and
+ * the owner hands the lock to its successor by clearing that flag, so a
+ * handover touches one remote cache line however many threads wait.  A
+ * waiter spinning too long yields, then parks on the flag as a futex, and
+ * only then does the handover make a system call.
+ *
+ * Queue nodes come from a per-thread table, so Lock() never allocates; a
+ * thread may hold up to kMaxHeldLocks MCS locks at the same time.
+ */
+class McsLock
+{
+public:
+    enum
+    {
+        kMaxHeldLocks = 32,
+    };
+
+    McsLock() : mTail(NULL), mHolder(NULL) {}
+
+    void Lock();
+
+    bool TryLock();
+
+    void Unlock();
+
+    bool IsLocked() const;
+
+    bool TimedLock(uint64_t timeoutInUs);
+
+private:
+    enum
+    {
+        kNodeFree = 0,      // The lock is handed over
+        kNodeWaiting = 1,
+        kNodeParked = 2,    // Asleep, to be woken up by the handover
+    };
+
+    struct Node
+    {
+        Node* volatile next;
+        volatile int32_t locked;
+    } __attribute__((aligned(64)));
+
+    // The nodes of a thread, and the bitmap of those in use
+    struct ThreadNodes
+    {
+        Node nodes[kMaxHeldLocks];
+        uint32_t used;
+    };
+
+    static ThreadNodes* threadNodes();
+    static Node* allocNode();
+    static void freeNode(Node* node);
+
+    Node* volatile mTail;
+    Node* mHolder;      // Only touched by the owner
+
+    DISALLOW_COPY_AND_ASSIGN(McsLock);
+};
+
+inline void TicketLock::Lock()
+{
+    uint32_t ticket = AtomicExchangeAdd(&mNext, 1U);
+    for (uint32_t spins = 0; AtomicGet(&mServing) != ticket; ++spins)
+    {
+        if (spins < detail::kFairLockMaxSpins)
+        {
+            asm volatile("pause");
+        }
+        else
+        {
+            ThisThread::Yield();
+        }
+    }
+}
+
+inline bool TicketLock::TryLock()
+{
+    uint32_t serving = AtomicGet(&mServing);
+    return AtomicCompareExchange(&mNext, serving + 1, serving);
+}
+
+inline void TicketLock::Unlock()
+{
+    // Only the owner writes mServing.
+    AtomicSet(&mServing, mServing + 1);
+}
+
+inline bool TicketLock::IsLocked() const
+{
+    return AtomicGet(&mNext) != AtomicGet(&mServing);
+}
+
+inline bool TicketLock::TimedLock(uint64_t timeoutInUs)
+{
+    uint64_t begin = GetCurrentTimeInUs();
+    Sleeper sleeper;
+    while (!TryLock())
+    {
+        uint64_t now = GetCurrentTimeInUs();
+        if (now >= begin && now - begin >= timeoutInUs)
+        {
+            return false;
+        }
+        sleeper.Pause();
+    }
+    return true;
+}
+
+inline void McsLock::Lock()
+{
+    Node* node = allocNode();
+    node->next = NULL;
+    node->locked = kNodeWaiting;
+    Node* prev = AtomicExchange(&mTail, node);
+    if (prev != NULL)
+    {
+        AtomicSet(&prev->next, node);
+        for (uint32_t spins = 0; AtomicGet(&node->locked) != kNodeFree; ++spins)
+        {
+            if (spins < detail::kFairLockMaxSpins)
+            {
+                asm volatile("pause");
+            }
+            else if (spins < detail::kFairLockMaxSpins + detail::kFairLockMaxYields)
+            {
+                ThisThread::Yield();
+            }
+            else
+            {
+                // Returns at once if the lock was handed over meanwhile.
+                AtomicCompareExchange(&node->locked, static_cast<int32_t>(kNodeParked),
+                                      static_cast<int32_t>(kNodeWaiting));
+                FutexWait(&node->locked, kNodeParked);
+            }
+        }
+    }
+    mHolder = node;
+}
+
+inline bool McsLock::TryLock()
+{
+    if (AtomicGet(&mTail) != NULL)
+    {
+        return false;
+    }
+    Node* node = allocNode();
+    node->next = NULL;
+    if (AtomicCompareExchange(&mTail, node, static_cast<Node*>(NULL)))
+    {
+        mHolder = node;
+        return true;
+    }
+    freeNode(node);
+    return false;
+}
+
+inline void McsLock::Unlock()
+{
+    Node* node = mHolder;
+    Node* next = AtomicGet(&node->next);
+    if (next == NULL)
+    {
+        if (AtomicCompareExchange(&mTail, static_cast<Node*>(NULL), node))
+        {
+            freeNode(node);
+            return;
+        }
+        // A successor swapped the tail and is about to link itself.
+        while ((next = AtomicGet(&node->next)) == NULL)
+        {
+            asm volatile("pause");
+        }
+    }
+    // The successor may return and reuse its node before the wake, which
+    // is then a harmless spurious one.
+    if (AtomicExchange(&next->locked, static_cast<int32_t>(kNodeFree)) == kNodeParked)
+    {
+        FutexWake(&next->locked, 1);
+    }
+    freeNode(node);
+}
+
+inline bool McsLock::IsLocked() const
+{
+    return AtomicGet(&mTail) != NULL;
+}
+
+inline bool McsLock::TimedLock(uint64_t timeoutInUs)
+{
+    uint64_t begin = GetCurrentTimeInUs();
+    Sleeper sleeper;
+    while (!TryLock())
+    {
+        uint64_t now = GetCurrentTimeInUs();
+        if (now >= begin && now - begin >= timeoutInUs)
+        {
+            return false;
+        }
+        sleeper.Pause();
+    }
+    return true;
+}
+
+inline McsLock::ThreadNodes* McsLock::threadNodes()
+{
+    static __thread ThreadNodes sThreadNodes;
+    return &sThreadNodes;
+}
+
+inline McsLock::Node* McsLock::allocNode()
+{
+    ThreadNodes* nodes = threadNodes();
+    ASSERT(nodes->used != 0xFFFFFFFF);
+    int index = __builtin_ctz(~nodes->used);
+    nodes->used |= 1U << index;
+    return &nodes->nodes[index];
+}
+
+inline void McsLock::freeNode(Node* node)
+{
+    ThreadNodes* nodes = threadNodes();
+    nodes->used &= ~(1U << (node - nodes->nodes));
+}
+
+#endif  // _SRC_SYNC_FAIR_LOCK_H
@@ -0,0 +1,40 @@
+#ifndef _SRC_SYNC_FUTEX_H
+#define _SRC_SYNC_FUTEX_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/**
+ * Thin wrappers of the futex system call on process-private words.
+ */
+
+/**
+ * Sleep while '*addr' equals 'expected', until woken up or 'timeoutInUs'
+ * passes (never if negative).  Return false on timeout.  Spurious wakeups
+ * are possible, callers must re-check their condition.
+ */
+inline bool FutexWait(volatile int32_t* addr, int32_t expected, int64_t timeoutInUs = -1)
+{
+    struct timespec ts;
+    struct timespec* timeout = NULL;
+    if (timeoutInUs >= 0)
+    {
+        ts.tv_sec = timeoutInUs / 1000000;
+        ts.tv_nsec = (timeoutInUs % 1000000) * 1000;
+        timeout = &ts;
+    }
+    int ret = ::syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+    return ret == 0 || errno != ETIMEDOUT;
+}
+
+/** Wake up to 'count' threads sleeping on 'addr', return the number woken. */
+inline int FutexWake(volatile int32_t* addr, int count)
+{
+    return ::syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+#endif  // _SRC_SYNC_FUTEX_H
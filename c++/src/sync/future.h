@@ -0,0 +1,726 @@
+#ifndef _SRC_SYNC_FUTURE_H
+#define _SRC_SYNC_FUTURE_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <google/protobuf/stubs/callback.h>
+
+#include "src/base/gettime.h"
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+#include "src/memory/objcache.h"
+#include "src/sync/atomic.h"
+#include "src/sync/futex.h"
+#include "src/sync/posix_lock.h"
+#include "src/sync/scoped_lock.h"
+#include "src/thread/thread_check.h"
+
+template <typename T> class Future;
+template <typename T> class Promise;
+
+template <typename T>
+Future<std::vector<T> > WhenAll(const std::vector<Future<T> >& futures);
+
+template <typename T>
+Future<std::pair<size_t, T> > WhenAny(const std::vector<Future<T> >& futures);
+
+namespace detail
+{
+
+/** Notified once when the value of a FutureState is set. */
+class FutureCallback
+{
+public:
+    virtual ~FutureCallback() {}
+    virtual void OnReady() = 0;
+};
+
+/**
+ * The state shared by a Promise and its Futures.
+ *
+ * All synchronization goes through the 32-bit word 'mState': setting the
+ * value and installing the callback each set a bit with an atomic OR, and
+ * whichever comes second runs the callback.  Blocked waiters set a third
+ * bit and sleep on the word itself, so SetValue() only makes a system call
+ * when somebody is actually waiting.
+ *
+ * States are allocated from a cache of the calling thread, which takes
+ * and gives back states to a process-wide ObjectCache in batches, so only
+ * one in kCacheBatch allocations takes the lock.
+ */
+template <typename T>
+class FutureState
+{
+public:
+    FutureState() : mState(0), mRefCount(1), mCallback(NULL) {}
+
+    ~FutureState()
+    {
+        if (mState & kValueSet)
+        {
+            value()->~T();
+        }
+    }
+
+    static void* operator new(size_t size)
+    {
+        ASSERT_DEBUG(size == sizeof(FutureState));
+        LocalCache* local = getLocalCache();
+        if (UNLIKELY(local->head == NULL))
+        {
+            refill(local);
+        }
+        FreeState* state = local->head;
+        local->head = state->next;
+        --local->size;
+        return state;
+    }
+
+    static void operator delete(void* ptr)
+    {
+        LocalCache* local = getLocalCache();
+        FreeState* state = static_cast<FreeState*>(ptr);
+        state->next = local->head;
+        local->head = state;
+        if (UNLIKELY(++local->size > kMaxCachedStates))
+        {
+            spill(local, kCacheBatch);
+        }
+    }
+
+    // A new reference is made from an existing one, so needs no ordering.
+    void Ref() { AtomicInc(&mRefCount, std::memory_order_relaxed); }
+
+    void Unref()
+    {
+        if (AtomicDec(&mRefCount, std::memory_order_acq_rel) == 0)
+        {
+            delete this;
+        }
+    }
+
+    bool IsReady() const { return (AtomicGet(&mState) & kValueSet) != 0; }
+
+    /** Only valid once IsReady(). */
+    const T& Value() const { return *value(); }
+
+    void SetValue(const T& v)
+    {
+        ASSERT(!IsReady());
+        new (&mStorage) T(v);
+        int32_t old = setBits(kValueSet);
+        if (old & kWaiters)
+        {
+            FutexWake(&mState, INT_MAX);
+        }
+        if (old & kCallbackSet)
+        {
+            mCallback->OnReady();
+        }
+    }
+
+    /** At most one callback per state; run at once if ready already. */
+    void SetCallback(FutureCallback* callback)
+    {
+        ASSERT(mCallback == NULL);
+        mCallback = callback;
+        int32_t old = setBits(kCallbackSet);
+        if (old & kValueSet)
+        {
+            callback->OnReady();
+        }
+    }
+
+    /** Wait until ready or 'timeoutInUs' passes (never if negative). */
+    bool Wait(int64_t timeoutInUs)
+    {
+        for (int i = 0; i < kSpinRounds; ++i)
+        {
+            if (IsReady())
+            {
+                return true;
+            }
+            asm volatile("pause" ::: "memory");
+        }
+        uint64_t deadline = timeoutInUs >= 0 ? GetCurrentTimeInUs() + timeoutInUs : 0;
+        while (true)
+        {
+            int32_t state = AtomicGet(&mState);
+            if (state & kValueSet)
+            {
+                return true;
+            }
+            if (!(state & kWaiters)
+                && !AtomicCompareExchange(&mState, state | kWaiters, state))
+            {
+                continue;
+            }
+            int64_t left = -1;
+            if (timeoutInUs >= 0)
+            {
+                uint64_t now = GetCurrentTimeInUs();
+                if (now >= deadline)
+                {
+                    return false;
+                }
+                left = deadline - now;
+            }
+            FutexWait(&mState, state | kWaiters, left);
+        }
+    }
+
+private:
+    enum
+    {
+        kValueSet = 1,
+        kCallbackSet = 2,
+        kWaiters = 4,
+        kSpinRounds = 16,
+        kCacheBatch = 32,
+        kMaxCachedStates = 2 * kCacheBatch,
+    };
+
+    /** A state in a cache, the memory of a FutureState. */
+    struct FreeState
+    {
+        FreeState* next;
+    };
+
+    struct LocalCache
+    {
+        FreeState* head;
+        uint32_t size;
+        bool registered;            // To give the states back at thread exit
+    };
+
+    struct StateCache
+    {
+        StateCache() : objects("future_state")
+        {
+            CheckPthreadError(pthread_key_create(&key, &releaseLocalCache));
+        }
+        SpinLock lock;
+        ObjectCache<FutureState> objects;
+        pthread_key_t key;
+    };
+
+    // Never freed, so states may outlive static destruction.
+    static StateCache* getCache()
+    {
+        static StateCache* sCache = new StateCache;
+        return sCache;
+    }
+
+    static LocalCache* getLocalCache()
+    {
+        static __thread LocalCache tCache;
+        if (UNLIKELY(!tCache.registered))
+        {
+            tCache.registered = true;
+            CheckPthreadError(pthread_setspecific(getCache()->key, &tCache));
+        }
+        return &tCache;
+    }
+
+    static void refill(LocalCache* local) __attribute__((noinline))
+    {
+        StateCache* cache = getCache();
+        ScopedLock<SpinLock> lock(cache->lock);
+        for (int i = 0; i < kCacheBatch; ++i)
+        {
+            FreeState* state = reinterpret_cast<FreeState*>(cache->objects.Alloc());
+            state->next = local->head;
+            local->head = state;
+        }
+        local->size += kCacheBatch;
+    }
+
+    static void spill(LocalCache* local, uint32_t count) __attribute__((noinline))
+    {
+        StateCache* cache = getCache();
+        ScopedLock<SpinLock> lock(cache->lock);
+        for (uint32_t i = 0; i < count && local->head != NULL; ++i)
+        {
+            FreeState* state = local->head;
+            local->head = state->next;
+            --local->size;
+            cache->objects.Dealloc(reinterpret_cast<FutureState*>(state));
+        }
+    }
+
+    static void releaseLocalCache(void* arg)
+    {
+        LocalCache* local = static_cast<LocalCache*>(arg);
+        spill(local, local->size);
+        local->registered = false;
+    }
+
+    /** Atomically OR 'bits' into the state, return the old state. */
+    int32_t setBits(int32_t bits)
+    {
+        while (true)
+        {
+            int32_t state = AtomicGet(&mState);
+            if (AtomicCompareExchange(&mState, state | bits, state))
+            {
+                return state;
+            }
+        }
+    }
+
+    T* value() { return reinterpret_cast<T*>(&mStorage); }
+    const T* value() const { return reinterpret_cast<const T*>(&mStorage); }
+
+    volatile int32_t mState;
+    volatile int32_t mRefCount;
+    FutureCallback* mCallback;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type mStorage;
+
+    DISALLOW_COPY_AND_ASSIGN(FutureState);
+};
+
+/** What the state of a Future<void> holds. */
+struct FutureVoid
+{
+};
+
+/** How a Future<T> stores and returns its value. */
+template <typename T>
+struct FutureTraits
+{
+    typedef T Stored;
+    typedef const T& Reference;
+
+    static Reference Get(const FutureState<T>* state) { return state->Value(); }
+};
+
+template <>
+struct FutureTraits<void>
+{
+    typedef FutureVoid Stored;
+    typedef void Reference;
+
+    static void Get(const FutureState<FutureVoid>*) {}
+};
+
+/** The value type of calling 'Func' with a 'const T&', or nothing if void. */
+template <typename Func, typename T>
+struct FutureResultOf
+{
+    typedef typename std::decay<
+        typename std::result_of<Func(const T&)>::type>::type type;
+};
+
+template <typename Func>
+struct FutureResultOf<Func, void>
+{
+    typedef typename std::decay<typename std::result_of<Func()>::type>::type type;
+};
+
+/**
+ * Set 'promise' to 'func' of the value of 'source', void on either side.
+ * Run() takes the promise as a template parameter, as Promise is still
+ * incomplete here.
+ */
+template <typename T, typename R>
+struct FutureInvoker
+{
+    template <typename Func, typename PromiseType>
+    static void Run(Func& func, const FutureState<T>* source, PromiseType* promise)
+    {
+        promise->SetValue(func(source->Value()));
+    }
+};
+
+template <typename T>
+struct FutureInvoker<T, void>
+{
+    template <typename Func, typename PromiseType>
+    static void Run(Func& func, const FutureState<T>* source, PromiseType* promise)
+    {
+        func(source->Value());
+        promise->SetValue();
+    }
+};
+
+template <typename R>
+struct FutureInvoker<void, R>
+{
+    template <typename Func, typename PromiseType>
+    static void Run(Func& func, const FutureState<FutureVoid>*, PromiseType* promise)
+    {
+        promise->SetValue(func());
+    }
+};
+
+template <>
+struct FutureInvoker<void, void>
+{
+    template <typename Func, typename PromiseType>
+    static void Run(Func& func, const FutureState<FutureVoid>*, PromiseType* promise)
+    {
+        func();
+        promise->SetValue();
+    }
+};
+
+/** An executor which runs tasks in the calling thread. */
+class InlineExecutor
+{
+public:
+    void Submit(google::protobuf::Closure* task) { task->Run(); }
+};
+
+/**
+ * The continuation of Future::Then().  It is the callback of the source
+ * state and, when run on an executor, the task submitted to it too.
+ */
+template <typename T, typename Func, typename Executor>
+class ThenCallback : public FutureCallback, public google::protobuf::Closure
+{
+public:
+    typedef typename FutureResultOf<Func, T>::type ResultType;
+    typedef FutureState<typename FutureTraits<T>::Stored> SourceState;
+
+    ThenCallback(SourceState* source, Executor* executor, const Func& func)
+        : mSource(source), mExecutor(executor), mFunc(func)
+    {
+        mSource->Ref();
+    }
+
+    virtual ~ThenCallback() { mSource->Unref(); }
+
+    Future<ResultType> GetFuture() const { return mPromise.GetFuture(); }
+
+    virtual void OnReady()
+    {
+        if (mExecutor == NULL)
+        {
+            Run();
+        }
+        else
+        {
+            mExecutor->Submit(this);
+        }
+    }
+
+    virtual void Run()
+    {
+        FutureInvoker<T, ResultType>::Run(mFunc, mSource, &mPromise);
+        delete this;
+    }
+
+private:
+    SourceState* mSource;
+    Executor* mExecutor;
+    Func mFunc;
+    Promise<ResultType> mPromise;
+
+    DISALLOW_COPY_AND_ASSIGN(ThenCallback);
+};
+
+/** Registered with every input state, the last one sets the result. */
+template <typename T>
+class WhenAllContext : public FutureCallback
+{
+public:
+    explicit WhenAllContext(const std::vector<Future<T> >& futures)
+        : mFutures(futures), mPending(futures.size()) {}
+
+    Future<std::vector<T> > GetFuture() const { return mPromise.GetFuture(); }
+
+    virtual void OnReady()
+    {
+        if (AtomicDec(&mPending) != 0)
+        {
+            return;
+        }
+        std::vector<T> values;
+        values.reserve(mFutures.size());
+        for (size_t i = 0; i < mFutures.size(); ++i)
+        {
+            values.push_back(mFutures[i].Get());
+        }
+        mPromise.SetValue(values);
+        delete this;
+    }
+
+private:
+    std::vector<Future<T> > mFutures;
+    volatile size_t mPending;
+    Promise<std::vector<T> > mPromise;
+
+    DISALLOW_COPY_AND_ASSIGN(WhenAllContext);
+};
+
+/** The first input state to be ready sets the result. */
+template <typename T>
+class WhenAnyContext
+{
+public:
+    struct Slot : public FutureCallback
+    {
+        virtual void OnReady() { context->onReady(index); }
+
+        WhenAnyContext* context;
+        size_t index;
+    };
+
+    explicit WhenAnyContext(const std::vector<Future<T> >& futures)
+        : mFutures(futures), mSlots(futures.size()), mPending(futures.size()), mDone(0)
+    {
+        for (size_t i = 0; i < mSlots.size(); ++i)
+        {
+            mSlots[i].context = this;
+            mSlots[i].index = i;
+        }
+    }
+
+    Future<std::pair<size_t, T> > GetFuture() const { return mPromise.GetFuture(); }
+
+    Slot* GetSlot(size_t index) { return &mSlots[index]; }
+
+private:
+    void onReady(size_t index)
+    {
+        if (AtomicCompareExchange(&mDone, 1, 0))
+        {
+            mPromise.SetValue(std::make_pair(index, mFutures[index].Get()));
+        }
+        if (AtomicDec(&mPending) == 0)
+        {
+            delete this;
+        }
+    }
+
+    std::vector<Future<T> > mFutures;
+    std::vector<Slot> mSlots;
+    volatile size_t mPending;
+    volatile int32_t mDone;
+    Promise<std::pair<size_t, T> > mPromise;
+
+    DISALLOW_COPY_AND_ASSIGN(WhenAnyContext);
+};
+
+}  // namespace detail
+
+/**
+ * The read side of a value which is produced asynchronously, by the
+ * Promise it comes from.
+ *
+ * Future and Promise are cheap handles to a reference counted shared
+ * state, copying them shares the state.  The value is set once and read
+ * any number of times; at most one continuation (Then(), or being an
+ * input of WhenAll()/WhenAny()) may be attached to a state.  A Promise
+ * must be fulfilled eventually, otherwise waiters block forever and the
+ * continuation is leaked.
+ *
+ * A Future<void> only tells that something is done: Get() returns nothing,
+ * its continuations take no argument, and Promise<void>::SetValue() none.
+ * Continuations returning void give a Future<void>.
+ *
+ * Usage:
+ *   Promise<int> promise;
+ *   Future<std::string> future = promise.GetFuture().Then(&FormatSize);
+ *   pool.Submit(stone::NewClosure(&ComputeSize, promise));
+ *   ...
+ *   const std::string& text = future.Get();
+ */
+template <typename T>
+class Future
+{
+public:
+    Future() : mState(NULL) {}
+
+    Future(const Future& other) : mState(other.mState)
+    {
+        if (mState != NULL)
+        {
+            mState->Ref();
+        }
+    }
+
+    Future& operator=(const Future& other)
+    {
+        Future(other).swap(*this);
+        return *this;
+    }
+
+    ~Future()
+    {
+        if (mState != NULL)
+        {
+            mState->Unref();
+        }
+    }
+
+    void swap(Future& other) { std::swap(mState, other.mState); }
+
+    /** Whether it refers to a shared state, i.e. came from a Promise. */
+    bool IsValid() const { return mState != NULL; }
+
+    bool IsReady() const { return mState->IsReady(); }
+
+    /** Spin for a while, then block until ready. */
+    void Wait() const { mState->Wait(-1); }
+
+    /** Return false if not ready within 'timeoutInUs'. */
+    bool TimedWait(int64_t timeoutInUs) const { return mState->Wait(timeoutInUs); }
+
+    /** Wait, and return the value. */
+    typename detail::FutureTraits<T>::Reference Get() const
+    {
+        if (!mState->IsReady())
+        {
+            mState->Wait(-1);
+        }
+        return detail::FutureTraits<T>::Get(mState);
+    }
+
+    /**
+     * Return the future of 'func(value)'.  'func' runs in the thread which
+     * sets the value, or in the calling thread if it is set already.
+     */
+    template <typename Func>
+    Future<typename detail::FutureResultOf<Func, T>::type> Then(Func func) const
+    {
+        return Then(static_cast<detail::InlineExecutor*>(NULL), func);
+    }
+
+    /**
+     * Like Then(func), but 'func' runs as a task submitted to 'executor',
+     * which is anything with Submit(google::protobuf::Closure*), such as a
+     * ThreadPool.  A NULL 'executor' runs it inline.
+     */
+    template <typename Executor, typename Func>
+    Future<typename detail::FutureResultOf<Func, T>::type> Then(Executor* executor,
+                                                                 Func func) const
+    {
+        ASSERT(mState != NULL);
+        detail::ThenCallback<T, Func, Executor>* callback =
+            new detail::ThenCallback<T, Func, Executor>(mState, executor, func);
+        Future<typename detail::FutureResultOf<Func, T>::type> future = callback->GetFuture();
+        mState->SetCallback(callback);
+        return future;
+    }
+
+private:
+    friend class Promise<T>;
+    friend Future<std::vector<T> > WhenAll<T>(const std::vector<Future<T> >& futures);
+    friend Future<std::pair<size_t, T> > WhenAny<T>(const std::vector<Future<T> >& futures);
+
+    typedef detail::FutureState<typename detail::FutureTraits<T>::Stored> State;
+
+    explicit Future(State* state) : mState(state)
+    {
+        mState->Ref();
+    }
+
+    State* mState;
+};
+
+/**
+ * The write side of a Future.  The value must be set exactly once.
+ */
+template <typename T>
+class Promise
+{
+public:
+    Promise() : mState(new State) {}
+
+    Promise(const Promise& other) : mState(other.mState)
+    {
+        mState->Ref();
+    }
+
+    Promise& operator=(const Promise& other)
+    {
+        Promise(other).swap(*this);
+        return *this;
+    }
+
+    ~Promise() { mState->Unref(); }
+
+    void swap(Promise& other) { std::swap(mState, other.mState); }
+
+    Future<T> GetFuture() const { return Future<T>(mState); }
+
+    /** Wake up the waiters, and run the continuation in this thread. */
+    void SetValue(const typename detail::FutureTraits<T>::Stored& value)
+    {
+        mState->SetValue(value);
+    }
+
+    /** The SetValue() of a Promise<void>. */
+    void SetValue() { mState->SetValue(detail::FutureVoid()); }
+
+private:
+    typedef detail::FutureState<typename detail::FutureTraits<T>::Stored> State;
+
+    State* mState;
+};
+
+/** Return a future which is ready with 'value'. */
+template <typename T>
+Future<T> MakeReadyFuture(const T& value)
+{
+    Promise<T> promise;
+    promise.SetValue(value);
+    return promise.GetFuture();
+}
+
+inline Future<void> MakeReadyFuture()
+{
+    Promise<void> promise;
+    promise.SetValue();
+    return promise.GetFuture();
+}
+
+/**
+ * Return a future of the values of all 'futures', in order, which is
+ * ready when the last of them is.  Each of 'futures' must be a different
+ * state without a continuation.
+ */
+template <typename T>
+Future<std::vector<T> > WhenAll(const std::vector<Future<T> >& futures)
+{
+    if (futures.empty())
+    {
+        return MakeReadyFuture(std::vector<T>());
+    }
+    detail::WhenAllContext<T>* context = new detail::WhenAllContext<T>(futures);
+    Future<std::vector<T> > result = context->GetFuture();
+    // The last SetCallback() may free 'context', so iterate 'futures'.
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        futures[i].mState->SetCallback(context);
+    }
+    return result;
+}
+
+/**
+ * Return a future of the index and value of the first of 'futures' to be
+ * ready.  'futures' must not be empty, and the same restrictions as
+ * WhenAll() apply.  Internal bookkeeping is freed when all are ready.
+ */
+template <typename T>
+Future<std::pair<size_t, T> > WhenAny(const std::vector<Future<T> >& futures)
+{
+    ASSERT(!futures.empty());
+    detail::WhenAnyContext<T>* context = new detail::WhenAnyContext<T>(futures);
+    Future<std::pair<size_t, T> > result = context->GetFuture();
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        futures[i].mState->SetCallback(context->GetSlot(i));
+    }
+    return result;
+}
+
+#endif  // _SRC_SYNC_FUTURE_H
@@ -0,0 +1,289 @@
+#include "src/sync/lock_profiler.h"
+
+#include <execinfo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "src/sync/atomic.h"
+
+struct LockProfiler::Entry
+{
+    const void* volatile lock;      // NULL if free, kClaimedLock while being claimed
+    const char* type;
+    volatile uint64_t acquisitions;
+    volatile uint64_t contentions;
+    volatile uint64_t waitCycles;
+    volatile uint64_t maxWaitCycles;
+    volatile uint64_t holdCycles;
+    volatile uint64_t maxHoldCycles;
+    volatile uint64_t waitHistogram[kHistogramBuckets];
+    volatile int32_t slowestBusy;   // Guards 'slowest', never waited for
+    CallSite slowest[kSlowestSites];
+};
+
+namespace
+{
+
+enum
+{
+    kMaxProbes = 64,
+};
+
+// Holds an entry until its type is set, so readers never see it without one.
+const void* const kClaimedLock = reinterpret_cast<const void*>(1);
+
+struct HeldLock
+{
+    const void* lock;
+    void* entry;
+    uint64_t since;
+};
+
+// The locks the thread holds, innermost last.
+__thread HeldLock tHeldLocks[LockProfiler::kMaxHeldLocks];
+__thread uint32_t tHeldLockNum = 0;
+
+void atomicMax(volatile uint64_t* target, uint64_t value)
+{
+    uint64_t old = AtomicGet(target);
+    while (value > old && !AtomicCompareExchange(target, value, old))
+    {
+        old = AtomicGet(target);
+    }
+}
+
+bool compareWaitCycles(const LockProfiler::LockStats& a, const LockProfiler::LockStats& b)
+{
+    return a.waitCycles > b.waitCycles;
+}
+
+double cyclesToUs(uint64_t cycles)
+{
+    return static_cast<double>(cycles) / GetCpuMHz();
+}
+
+bool compareCallSite(const LockProfiler::CallSite& a, const LockProfiler::CallSite& b)
+{
+    return a.waitCycles > b.waitCycles;
+}
+
+}  // anonymous namespace
+
+LockProfiler::Entry* volatile LockProfiler::sEntries = NULL;
+volatile uint64_t LockProfiler::sDroppedLocks = 0;
+
+LockProfiler::Entry* LockProfiler::findEntry(const void* lock, const char* type)
+{
+    Entry* entries = AtomicGet(&sEntries);
+    if (UNLIKELY(entries == NULL))
+    {
+        // Zeroed pages are only backed once touched.
+        Entry* allocated = static_cast<Entry*>(calloc(kMaxLocks, sizeof(Entry)));
+        if (!AtomicCompareExchange(&sEntries, allocated, static_cast<Entry*>(NULL)))
+        {
+            free(allocated);
+        }
+        entries = AtomicGet(&sEntries);
+    }
+    uint64_t hash = reinterpret_cast<uint64_t>(lock) * 0x9E3779B97F4A7C15ULL;
+    uint32_t index = static_cast<uint32_t>(hash >> 52);
+    for (uint32_t i = 0; i < kMaxProbes; ++i)
+    {
+        Entry* entry = &entries[(index + i) & (kMaxLocks - 1)];
+        const void* owner = AtomicGet(&entry->lock);
+        if (owner == NULL
+            && AtomicCompareExchange(&entry->lock, kClaimedLock, static_cast<const void*>(NULL)))
+        {
+            entry->type = type;
+            AtomicSet(&entry->lock, lock);
+            return entry;
+        }
+        // Another thread may be claiming the entry for the same lock.
+        while ((owner = AtomicGet(&entry->lock)) == kClaimedLock)
+        {
+            asm volatile("pause" ::: "memory");
+        }
+        if (owner == lock)
+        {
+            return entry;
+        }
+    }
+    AtomicInc(&sDroppedLocks);
+    return NULL;
+}
+
+void LockProfiler::OnAcquire(const void* lock, const char* type, uint64_t waitCycles,
+                             bool contended, const void* callSite)
+{
+    Entry* entry = findEntry(lock, type);
+    if (entry != NULL)
+    {
+        AtomicInc(&entry->acquisitions);
+        if (contended)
+        {
+            AtomicInc(&entry->contentions);
+            AtomicAdd(&entry->waitCycles, waitCycles);
+            atomicMax(&entry->maxWaitCycles, waitCycles);
+            recordSlowest(entry, callSite, waitCycles);
+        }
+        int bucket = 63 - __builtin_clzll(waitCycles | 1);
+        AtomicInc(&entry->waitHistogram[MIN(bucket, kHistogramBuckets - 1)]);
+    }
+    if (tHeldLockNum < kMaxHeldLocks)
+    {
+        HeldLock held = { lock, entry, GetCpuCycles() };
+        tHeldLocks[tHeldLockNum++] = held;
+    }
+}
+
+void LockProfiler::OnRelease(const void* lock)
+{
+    // Locks are mostly released innermost first.
+    for (uint32_t i = tHeldLockNum; i > 0; --i)
+    {
+        HeldLock* held = &tHeldLocks[i - 1];
+        if (held->lock != lock)
+        {
+            continue;
+        }
+        Entry* entry = static_cast<Entry*>(held->entry);
+        if (entry != NULL)
+        {
+            uint64_t holdCycles = GetCpuCycles() - held->since;
+            AtomicAdd(&entry->holdCycles, holdCycles);
+            atomicMax(&entry->maxHoldCycles, holdCycles);
+        }
+        memmove(held, held + 1, (tHeldLockNum - i) * sizeof(*held));
+        --tHeldLockNum;
+        return;
+    }
+}
+
+void LockProfiler::recordSlowest(Entry* entry, const void* callSite, uint64_t waitCycles)
+{
+    // Cheap reject before taking the flag; a busy flag loses the sample.
+    CallSite* fastest = &entry->slowest[0];
+    for (int i = 1; i < kSlowestSites; ++i)
+    {
+        if (entry->slowest[i].waitCycles < fastest->waitCycles)
+        {
+            fastest = &entry->slowest[i];
+        }
+    }
+    if (waitCycles <= fastest->waitCycles
+        || !AtomicCompareExchange(&entry->slowestBusy, 1, 0))
+    {
+        return;
+    }
+    fastest = &entry->slowest[0];
+    for (int i = 0; i < kSlowestSites; ++i)
+    {
+        if (entry->slowest[i].address == callSite)
+        {
+            fastest = &entry->slowest[i];
+            break;
+        }
+        if (entry->slowest[i].waitCycles < fastest->waitCycles)
+        {
+            fastest = &entry->slowest[i];
+        }
+    }
+    if (waitCycles > fastest->waitCycles)
+    {
+        fastest->address = callSite;
+        fastest->waitCycles = waitCycles;
+    }
+    AtomicSet(&entry->slowestBusy, 0);
+}
+
+void LockProfiler::GetStats(std::vector<LockStats>* stats)
+{
+    stats->clear();
+    Entry* entries = AtomicGet(&sEntries);
+    if (entries == NULL)
+    {
+        return;
+    }
+    for (uint32_t i = 0; i < kMaxLocks; ++i)
+    {
+        Entry* entry = &entries[i];
+        const void* lock = AtomicGet(&entry->lock);
+        if (lock == NULL || lock == kClaimedLock)
+        {
+            continue;
+        }
+        LockStats s;
+        s.lock = lock;
+        s.type = entry->type;
+        s.acquisitions = AtomicGet(&entry->acquisitions);
+        s.contentions = AtomicGet(&entry->contentions);
+        s.waitCycles = AtomicGet(&entry->waitCycles);
+        s.maxWaitCycles = AtomicGet(&entry->maxWaitCycles);
+        s.holdCycles = AtomicGet(&entry->holdCycles);
+        s.maxHoldCycles = AtomicGet(&entry->maxHoldCycles);
+        for (int j = 0; j < kHistogramBuckets; ++j)
+        {
+            s.waitHistogram[j] = AtomicGet(&entry->waitHistogram[j]);
+        }
+        memcpy(s.slowest, entry->slowest, sizeof(s.slowest));
+        std::sort(s.slowest, s.slowest + kSlowestSites, compareCallSite);
+        stats->push_back(s);
+    }
+    std::sort(stats->begin(), stats->end(), compareWaitCycles);
+}
+
+void LockProfiler::Dump(FILE* file, size_t topN)
+{
+    std::vector<LockStats> stats;
+    GetStats(&stats);
+    fprintf(file, "Lock profile: %zu locks, %lu dropped\n",
+            stats.size(), GetDroppedLocks());
+    for (size_t i = 0; i < stats.size() && i < topN; ++i)
+    {
+        const LockStats& s = stats[i];
+        uint64_t acquisitions = MAX(s.acquisitions, 1UL);
+        fprintf(file,
+                "%s %p: %lu acquisitions, %.2f%% contended, "
+                "wait us total %.1f avg %.3f max %.1f, "
+                "hold us total %.1f avg %.3f max %.1f\n",
+                s.type, s.lock, s.acquisitions,
+                100.0 * s.contentions / acquisitions,
+                cyclesToUs(s.waitCycles), cyclesToUs(s.waitCycles) / acquisitions,
+                cyclesToUs(s.maxWaitCycles),
+                cyclesToUs(s.holdCycles), cyclesToUs(s.holdCycles) / acquisitions,
+                cyclesToUs(s.maxHoldCycles));
+        fprintf(file, "    wait histogram (cycles):");
+        for (int j = 0; j < kHistogramBuckets; ++j)
+        {
+            if (s.waitHistogram[j] != 0)
+            {
+                fprintf(file, " <%lu:%lu", 2UL << j, s.waitHistogram[j]);
+            }
+        }
+        fprintf(file, "\n");
+        for (int j = 0; j < kSlowestSites && s.slowest[j].address != NULL; ++j)
+        {
+            void* address = const_cast<void*>(s.slowest[j].address);
+            char** symbols = backtrace_symbols(&address, 1);
+            fprintf(file, "    waited %.1f us at %s\n", cyclesToUs(s.slowest[j].waitCycles),
+                    symbols != NULL ? symbols[0] : "?");
+            free(symbols);
+        }
+    }
+}
+
+void LockProfiler::Reset()
+{
+    Entry* entries = AtomicGet(&sEntries);
+    if (entries != NULL)
+    {
+        memset(entries, 0, kMaxLocks * sizeof(Entry));
+    }
+    AtomicSet(&sDroppedLocks, 0UL);
+}
+
+uint64_t LockProfiler::GetDroppedLocks()
+{
+    return AtomicGet(&sDroppedLocks);
+}
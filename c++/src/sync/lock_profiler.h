@@ -0,0 +1,119 @@
+#ifndef _SRC_SYNC_LOCK_PROFILER_H
+#define _SRC_SYNC_LOCK_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "src/common/macros.h"
+#include "src/cpu/cpu.h"
+
+/**
+ * Contention profile of MicroLock and MutexBase instances.
+ *
+ * Compiled in with -DENABLE_LOCK_PROFILING=1 (`LOCK_PROFILING=1 ./compile.sh`);
+ * otherwise the hooks below expand to nothing and the locks are unchanged.
+ * When compiled in, every acquisition is timed with GetCpuCycles() and
+ * reported to OnAcquire(), every release to OnRelease().
+ *
+ * Statistics are kept per lock address in a fixed table claimed with CAS,
+ * so recording never takes a lock and never allocates.  Locks beyond
+ * kMaxLocks are only counted in GetDroppedLocks().  A lock destroyed and
+ * another created at the same address share an entry.
+ *
+ * Usage:
+ *   LockProfiler::Dump(stderr, 20);     // the 20 locks waited for most
+ */
+class LockProfiler
+{
+public:
+    enum
+    {
+        kMaxLocks = 4096,
+        kHistogramBuckets = 32,     // Bucket i: waits of [2^i, 2^(i+1)) cycles
+        kSlowestSites = 4,
+        kMaxHeldLocks = 16,         // Per thread, for hold times
+    };
+
+    struct CallSite
+    {
+        const void* address;        // Return address into the locker
+        uint64_t waitCycles;
+    };
+
+    struct LockStats
+    {
+        const void* lock;
+        const char* type;
+        uint64_t acquisitions;
+        uint64_t contentions;       // Acquisitions which had to wait
+        uint64_t waitCycles;
+        uint64_t maxWaitCycles;
+        uint64_t holdCycles;
+        uint64_t maxHoldCycles;
+        uint64_t waitHistogram[kHistogramBuckets];
+        CallSite slowest[kSlowestSites];
+    };
+
+    /** Record that the calling thread acquired 'lock' after 'waitCycles'. */
+    static void OnAcquire(const void* lock, const char* type, uint64_t waitCycles,
+                          bool contended, const void* callSite);
+
+    /** Record that the calling thread released 'lock'. */
+    static void OnRelease(const void* lock);
+
+    /** Stats of every lock seen, by total wait time, most first. */
+    static void GetStats(std::vector<LockStats>* stats);
+
+    /** Print the 'topN' locks waited for most, with times in us. */
+    static void Dump(FILE* file, size_t topN);
+
+    /** Forget everything.  Not atomic with concurrent recording. */
+    static void Reset();
+
+    static uint64_t GetDroppedLocks();
+
+private:
+    struct Entry;
+
+    static Entry* findEntry(const void* lock, const char* type);
+    static void recordSlowest(Entry* entry, const void* callSite, uint64_t waitCycles);
+
+    static Entry* volatile sEntries;    // kMaxLocks of them, allocated on first use
+    static volatile uint64_t sDroppedLocks;
+
+    LockProfiler();
+};
+
+#if defined(ENABLE_LOCK_PROFILING) && ENABLE_LOCK_PROFILING == 1
+
+#define LOCK_PROFILE_ENABLED 1
+
+/**
+ * Keep profiled lock functions out of line, so that the return address
+ * is the call site of the lock at any optimization level.
+ */
+#define LOCK_PROFILE_NOINLINE __attribute__((noinline))
+
+#define LOCK_PROFILE_BEGIN()                                            \
+    uint64_t lockProfileBegin = GetCpuCycles()
+
+#define LOCK_PROFILE_ACQUIRED(lock, type, contended)                    \
+    LockProfiler::OnAcquire(lock, type, GetCpuCycles() - lockProfileBegin, \
+                            contended, __builtin_return_address(0))
+
+#define LOCK_PROFILE_RELEASED(lock)                                     \
+    LockProfiler::OnRelease(lock)
+
+#else
+
+#define LOCK_PROFILE_ENABLED 0
+#define LOCK_PROFILE_NOINLINE
+#define LOCK_PROFILE_BEGIN()
+#define LOCK_PROFILE_ACQUIRED(lock, type, contended)
+#define LOCK_PROFILE_RELEASED(lock)
+
+#endif
+
+#endif  // _SRC_SYNC_LOCK_PROFILER_H
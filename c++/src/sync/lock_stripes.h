@@ -0,0 +1,244 @@
+#ifndef _SRC_SYNC_LOCK_STRIPES_H
+#define _SRC_SYNC_LOCK_STRIPES_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <functional>
+#include <new>
+
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+#include "src/sync/micro_lock.h"
+
+/**
+ * One MicroLock per cache line.  Stripes never false-share, at 64 bytes a
+ * lock; the default layout of LockStripes.
+ */
+class PaddedLockArray
+{
+public:
+    explicit PaddedLockArray(uint32_t size);
+
+    ~PaddedLockArray();
+
+    void Lock(uint32_t index) { at(index)->Lock(); }
+
+    bool TryLock(uint32_t index) { return at(index)->TryLock(); }
+
+    void Unlock(uint32_t index) { at(index)->Unlock(); }
+
+    bool IsLocked(uint32_t index) const { return mLocks[index].lock.IsLocked(); }
+
+    bool TimedLock(uint32_t index, uint64_t timeoutInUs)
+    {
+        return at(index)->TimedLock(timeoutInUs);
+    }
+
+    uint32_t Size() const { return mSize; }
+
+private:
+    struct PaddedLock
+    {
+        MicroLock lock;
+        char padding[64 - sizeof(MicroLock)];  // NOLINT(runtime/sizeof)
+    };
+
+    MicroLock* at(uint32_t index)
+    {
+        ASSERT_DEBUG(index < mSize);
+        return &mLocks[index].lock;
+    }
+
+    uint32_t mSize;
+    PaddedLock* mLocks;
+
+    DISALLOW_COPY_AND_ASSIGN(PaddedLockArray);
+};
+
+/** One bit per lock, see MicroLockVector. */
+typedef MicroLockVector PackedLockArray;
+
+/**
+ * A fixed table of locks, each guarding the keys which hash to it.
+ *
+ * The number of stripes is rounded up to a power of two.  Hashes are
+ * mixed before being masked, so std::hash of integers, which is the
+ * identity, spreads well too.  'LockArray' chooses the layout:
+ * PaddedLockArray for hot stripes, PackedLockArray when there are many
+ * of them, e.g. one per bucket of a large table.
+ *
+ * Code that needs several stripes at once must take them with LockMany(),
+ * which locks in ascending order, so two such lockers can't deadlock.
+ *
+ * Usage:
+ *   LockStripes<> stripes(1024);
+ *   {
+ *       ScopedStripeLock<LockStripes<> > lock(&stripes, stripes.GetStripeOf(key));
+ *       ...
+ *   }
+ *   uint32_t both[] = { stripes.GetStripeOf(from), stripes.GetStripeOf(to) };
+ *   ScopedMultiStripeLock<LockStripes<> > lock(&stripes, both, COUNT_OF(both));
+ */
+template <typename LockArray = PaddedLockArray>
+class LockStripes
+{
+public:
+    explicit LockStripes(uint32_t stripeNum)
+        : mLocks(roundUpToPowerOfTwo(stripeNum))
+    {
+    }
+
+    uint32_t GetStripeNum() const { return mLocks.Size(); }
+
+    uint32_t GetStripe(uint64_t hash) const
+    {
+        // The finalizer of MurmurHash3
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 33;
+        return static_cast<uint32_t>(hash) & (mLocks.Size() - 1);
+    }
+
+    template <typename Key>
+    uint32_t GetStripeOf(const Key& key) const
+    {
+        return GetStripe(std::hash<Key>()(key));
+    }
+
+    void Lock(uint32_t stripe) { mLocks.Lock(stripe); }
+
+    bool TryLock(uint32_t stripe) { return mLocks.TryLock(stripe); }
+
+    void Unlock(uint32_t stripe) { mLocks.Unlock(stripe); }
+
+    bool IsLocked(uint32_t stripe) const { return mLocks.IsLocked(stripe); }
+
+    bool TimedLock(uint32_t stripe, uint64_t timeoutInUs)
+    {
+        return mLocks.TimedLock(stripe, timeoutInUs);
+    }
+
+    /**
+     * Lock the given stripes in ascending order.  'stripes' is sorted and
+     * deduplicated in place; return the number of distinct stripes, which
+     * is what UnlockMany() takes.
+     */
+    size_t LockMany(uint32_t* stripes, size_t count);
+
+    void UnlockMany(const uint32_t* stripes, size_t count);
+
+private:
+    static uint32_t roundUpToPowerOfTwo(uint32_t n)
+    {
+        ASSERT(n > 0 && n <= (1U << 31));
+        uint32_t size = 1;
+        while (size < n)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    LockArray mLocks;
+
+    DISALLOW_COPY_AND_ASSIGN(LockStripes);
+};
+
+/** Hold one stripe for the scope. */
+template <typename Stripes>
+class ScopedStripeLock
+{
+public:
+    ScopedStripeLock(Stripes* stripes, uint32_t stripe)
+        : mStripes(stripes), mStripe(stripe)
+    {
+        mStripes->Lock(mStripe);
+    }
+
+    ~ScopedStripeLock()
+    {
+        mStripes->Unlock(mStripe);
+    }
+
+private:
+    Stripes* mStripes;
+    uint32_t mStripe;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedStripeLock);
+};
+
+/** Hold up to kMaxStripes stripes for the scope, taken in order. */
+template <typename Stripes>
+class ScopedMultiStripeLock
+{
+public:
+    enum
+    {
+        kMaxStripes = 16,
+    };
+
+    ScopedMultiStripeLock(Stripes* stripes, const uint32_t* indexes, size_t count)
+        : mStripes(stripes)
+    {
+        ASSERT(count <= kMaxStripes);
+        std::copy(indexes, indexes + count, mIndexes);
+        mCount = mStripes->LockMany(mIndexes, count);
+    }
+
+    ~ScopedMultiStripeLock()
+    {
+        mStripes->UnlockMany(mIndexes, mCount);
+    }
+
+private:
+    Stripes* mStripes;
+    uint32_t mIndexes[kMaxStripes];
+    size_t mCount;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedMultiStripeLock);
+};
+
+inline PaddedLockArray::PaddedLockArray(uint32_t size) : mSize(size), mLocks(NULL)
+{
+    void* memory = NULL;
+    int ret = posix_memalign(&memory, sizeof(PaddedLock), size * sizeof(PaddedLock));
+    ASSERT(ret == 0);
+    mLocks = static_cast<PaddedLock*>(memory);
+    for (uint32_t i = 0; i < size; ++i)
+    {
+        ::new (&mLocks[i].lock) MicroLock;
+    }
+}
+
+inline PaddedLockArray::~PaddedLockArray()
+{
+    for (uint32_t i = 0; i < mSize; ++i)
+    {
+        mLocks[i].lock.~MicroLock();
+    }
+    free(mLocks);
+}
+
+template <typename LockArray>
+size_t LockStripes<LockArray>::LockMany(uint32_t* stripes, size_t count)
+{
+    std::sort(stripes, stripes + count);
+    count = std::unique(stripes, stripes + count) - stripes;
+    for (size_t i = 0; i < count; ++i)
+    {
+        Lock(stripes[i]);
+    }
+    return count;
+}
+
+template <typename LockArray>
+void LockStripes<LockArray>::UnlockMany(const uint32_t* stripes, size_t count)
+{
+    for (size_t i = count; i > 0; --i)
+    {
+        Unlock(stripes[i - 1]);
+    }
+}
+
+#endif  // _SRC_SYNC_LOCK_STRIPES_H
@@ -9,11 +9,23 @@
 #include "src/common/assert.h"
 #include "src/common/macros.h"
 #include "src/sync/atomic.h"
+#include "src/sync/futex.h"
+#include "src/sync/lock_profiler.h"
 #include "src/sync/scoped_lock.h"
 #include "src/thread/this_thread.h"
 #include "src/thread/thread_check.h"
 
-/** Non-fair light-weighted lock */
+/**
+ * Non-fair light-weighted lock.
+ *
+ * The 64-bit lock word holds the owner's thread id in the high half and
+ * the flags in the low half.  A contended locker spins for a while, then
+ * sets the waiters flag and sleeps on the low half with a futex; Unlock()
+ * only makes a system call when that flag is set.  The spin limit follows
+ * how long recent acquisitions had to spin, so short critical sections
+ * are waited out and long ones park at once.  To keep the lock 8 bytes,
+ * that estimate lives in a small table hashed by the lock's address.
+ */
 class MicroLock
 {
 public:
@@ -33,9 +45,20 @@ public:
 
 private:
     uint64_t getSignature() const;
+    bool lockSlow(uint64_t signature, int64_t timeoutInUs);
+    volatile int32_t* spinEstimate() const;
+
+    /** The flags half of the lock word, the futex (little endian). */
+    volatile int32_t* flags()
+    {
+        return reinterpret_cast<volatile int32_t*>(&mLock);
+    }
 
     static const uint64_t kLockOn = 1;
     static const uint64_t kLockOff = 0;
+    static const uint64_t kWaiters = 2;
+    static const int32_t kMaxSpins = 1000;
+    static const uint32_t kSpinEstimateSlots = 64;
     uint64_t mLock;
 
     DISALLOW_COPY_AND_ASSIGN(MicroLock);
@@ -151,29 +174,39 @@ FORCE_INLINE void Sleeper::Pause()
     }
 }
 
-inline void MicroLock::Lock()
+inline LOCK_PROFILE_NOINLINE void MicroLock::Lock()
 {
+    LOCK_PROFILE_BEGIN();
     uint64_t signature = getSignature();
-    Sleeper sleeper;
-    do
+    bool contended = !AtomicCompareExchange(&mLock, signature, kLockOff,
+                                            std::memory_order_acquire);
+    if (UNLIKELY(contended))
     {
-        while (IsLocked())
-        {
-            sleeper.Pause();
-        }
+        lockSlow(signature, -1);
     }
-    while (!AtomicCompareExchange(&mLock, signature, kLockOff));
+    LOCK_PROFILE_ACQUIRED(this, "MicroLock", contended);
 }
 
-inline bool MicroLock::TryLock()
+inline LOCK_PROFILE_NOINLINE bool MicroLock::TryLock()
 {
+    LOCK_PROFILE_BEGIN();
     uint64_t signature = getSignature();
-    return AtomicCompareExchange(&mLock, signature, kLockOff);
+    bool locked = AtomicCompareExchange(&mLock, signature, kLockOff, std::memory_order_acquire);
+    if (locked)
+    {
+        LOCK_PROFILE_ACQUIRED(this, "MicroLock", false);
+    }
+    return locked;
 }
 
 inline void MicroLock::Unlock()
 {
-    AtomicSet(&mLock, kLockOff);
+    LOCK_PROFILE_RELEASED(this);
+    uint64_t value = AtomicExchange(&mLock, kLockOff, std::memory_order_release);
+    if (UNLIKELY(value & kWaiters))
+    {
+        FutexWake(flags(), 1);
+    }
 }
 
 inline bool MicroLock::IsLocked() const
@@ -181,25 +214,72 @@ inline bool MicroLock::IsLocked() const
     return AtomicGet(&mLock) != kLockOff;
 }
 
-inline bool MicroLock::TimedLock(uint64_t timeoutInUs)
+inline LOCK_PROFILE_NOINLINE bool MicroLock::TimedLock(uint64_t timeoutInUs)
 {
-    uint64_t begin = GetCurrentTimeInUs();
+    LOCK_PROFILE_BEGIN();
     uint64_t signature = getSignature();
-    Sleeper sleeper;
-    do
+    bool contended = !AtomicCompareExchange(&mLock, signature, kLockOff,
+                                            std::memory_order_acquire);
+    if (contended && !lockSlow(signature, timeoutInUs))
     {
-        while (IsLocked())
+        return false;
+    }
+    LOCK_PROFILE_ACQUIRED(this, "MicroLock", contended);
+    return true;
+}
+
+inline bool MicroLock::lockSlow(uint64_t signature, int64_t timeoutInUs)
+{
+    uint64_t begin = GetCurrentTimeInUs();
+
+    // Spin up to twice the recent average, like glibc's adaptive mutex.
+    volatile int32_t* estimate = spinEstimate();
+    int32_t spins = AtomicGet(estimate);
+    int32_t maxSpins = MIN(spins * 2 + 10, kMaxSpins);
+    for (int32_t i = 0; i < maxSpins; ++i)
+    {
+        if (AtomicGet(&mLock) == kLockOff
+            && AtomicCompareExchange(&mLock, signature, kLockOff,
+                                     std::memory_order_acquire))
+        {
+            AtomicSet(estimate, spins + (i - spins) / 8);
+            return true;
+        }
+        asm volatile("pause");
+    }
+    AtomicSet(estimate, spins + (maxSpins - spins) / 8);
+
+    // Park.  Whoever is woken up takes the lock with the waiters flag, as
+    // other threads may still sleep.
+    while (true)
+    {
+        uint64_t value = AtomicGet(&mLock);
+        if (value == kLockOff)
+        {
+            if (AtomicCompareExchange(&mLock, signature | kWaiters, value,
+                                      std::memory_order_acquire))
+            {
+                return true;
+            }
+            continue;
+        }
+        if (!(value & kWaiters)
+            && !AtomicCompareExchange(&mLock, value | kWaiters, value))
+        {
+            continue;
+        }
+        int64_t left = -1;
+        if (timeoutInUs >= 0)
         {
-            sleeper.Pause();
             uint64_t now = GetCurrentTimeInUs();
-            if (now >= begin && now - begin >= timeoutInUs)
+            if (now >= begin && now - begin >= static_cast<uint64_t>(timeoutInUs))
             {
                 return false;
             }
+            left = timeoutInUs - (now - begin);
         }
+        FutexWait(flags(), kLockOn | kWaiters, left);
     }
-    while (!AtomicCompareExchange(&mLock, signature, kLockOff));
-    return true;
 }
 
 inline int MicroLock::Owner() const
@@ -208,6 +288,14 @@ inline int MicroLock::Owner() const
             (AtomicGet(&mLock) & 0XFFFFFFFF00000000) >> 32);
 }
 
+inline volatile int32_t* MicroLock::spinEstimate() const
+{
+    // One cache line per slot; moving averages of spins to acquire.
+    static volatile int32_t sEstimates[kSpinEstimateSlots][16];
+    uint64_t hash = reinterpret_cast<uint64_t>(this) * 0x9E3779B97F4A7C15ULL;
+    return sEstimates[hash >> 58];
+}
+
 FORCE_INLINE uint64_t MicroLock::getSignature() const
 {
     int tid = ThisThread::GetId();
@@ -226,7 +314,7 @@ inline void MicroRWLock::ReadLock()
 
 inline void MicroRWLock::ReadUnlock()
 {
-    uint64_t bits = AtomicDec(&mLock);
+    uint64_t bits = AtomicDec(&mLock, std::memory_order_release);
     assert((bits & kWriterMask) == 0);
 }
 
@@ -249,7 +337,8 @@ inline void MicroRWLock::WriteLock()
 inline void MicroRWLock::WriteUnlock()
 {
     uint64_t value = AtomicGet(&mLock);
-    while (!AtomicCompareExchange(&mLock, value & kReaderMask, value))
+    while (!AtomicCompareExchange(&mLock, value & kReaderMask, value,
+                                  std::memory_order_release))
     {
         value = AtomicGet(&mLock);
     }
@@ -365,7 +454,7 @@ inline void MicroRWLockPreferWrite::ReadLock()
 
 inline void MicroRWLockPreferWrite::ReadUnlock()
 {
-    AtomicDec(&mLock);
+    AtomicDec(&mLock, std::memory_order_release);
 }
 
 inline void MicroRWLockPreferWrite::WriteLock()
@@ -534,8 +623,14 @@ inline int MicroRWLockPreferWrite::GetWriteLockOwner() const
     return static_cast<int>(AtomicGet(&mLock) >> 32);
 }
 
-#if 0
-
+/**
+ * An array of spin locks, one bit each, 32 to a word.
+ *
+ * For lock striping where memory matters more than contention: a million
+ * locks take 128KB.  Locks in the same word share a cache line, so keep
+ * critical sections short, or use one MicroLock per cache line instead
+ * (see LockStripes).
+ */
 class MicroLockVector
 {
 public:
@@ -549,126 +644,85 @@ public:
 
     bool IsLocked(uint32_t index) const;
 
+    bool TimedLock(uint32_t index, uint64_t timeoutInUs);
+
+    uint32_t Size() const { return mSize; }
+
 private:
-    uint32_t mask(uint32_t index) const
+    static uint32_t mask(uint32_t index)
     {
-        return 1UL << (index & 0x1f);
+        return 1U << (index & 0x1f);
     }
 
+    volatile uint32_t* word(uint32_t index)
+    {
+        ASSERT_DEBUG(index < mSize);
+        return &mLock[index >> 5];
+    }
+
+    const volatile uint32_t* word(uint32_t index) const
+    {
+        ASSERT_DEBUG(index < mSize);
+        return &mLock[index >> 5];
+    }
+
+    uint32_t mSize;
     std::vector<uint32_t> mLock;
 
     DISALLOW_COPY_AND_ASSIGN(MicroLockVector);
 };
 
-MicroLockVector::MicroLockVector(uint32_t size)
+inline MicroLockVector::MicroLockVector(uint32_t size)
+    : mSize(size), mLock((size + 31) >> 5, 0U)
 {
-    mLock.assign(((size + 31) >> 5), 0UL);
 }
 
 inline void MicroLockVector::Lock(uint32_t index)
 {
-    const uint32_t _mask = mask(index);
+    const uint32_t bit = mask(index);
     Sleeper sleeper;
-    do
+    while (!TryLock(index))
     {
-        while ((AtomicGet(&mLock[index >> 5]) & _mask) != 0)
+        while ((AtomicGet(word(index)) & bit) != 0)
         {
             sleeper.Pause();
         }
     }
-    while (!TryLock(index));
 }
 
 inline bool MicroLockVector::TryLock(uint32_t index)
 {
-    const uint32_t _mask = mask(index);
-    const uint32_t value = AtomicGet(&mLock[index >> 5]);
-    return AtomicCompareExchange(
-            &(mLock[index >> 5]), value | _mask, value & ~_mask);
+    // Fails only if this bit is taken, whatever happens to its neighbours.
+    const uint32_t bit = mask(index);
+    return (AtomicExchangeOr(word(index), bit) & bit) == 0;
 }
 
 inline void MicroLockVector::Unlock(uint32_t index)
 {
-    const uint32_t _mask = mask(index);
-    uint32_t value = AtomicGet(&mLock[index >> 5]);
-    Sleeper sleeper;
-    while ((value & _mask) != 0 &&
-            !AtomicCompareExchange(
-                &mLock[index >> 5], value & ~_mask, value))
-    {
-        sleeper.Pause();
-        value = AtomicGet(&mLock[index >> 5]);
-    }
+    const uint32_t bit = mask(index);
+    ASSERT_DEBUG((AtomicGet(word(index)) & bit) != 0);
+    AtomicExchangeAnd(word(index), ~bit);
 }
 
 inline bool MicroLockVector::IsLocked(uint32_t index) const
 {
-    return (AtomicGet(&mLock[index >> 5]) & mask(index)) != 0;
+    return (AtomicGet(word(index)) & mask(index)) != 0;
 }
 
-class MicroRWLockRefCounted :
-    public MicroRWLock,
-    public RefCounted<MicroRWLockRefCounted>
-{
-public:
-    explicit MicroRWLockRefCounted(LockType type);
-
-    ~MicroRWLockRefCounted() {}
-
-    void ReadLock();
-
-    void ReadUnlock();
-
-    void WriteLock();
-
-    void WriteUnlock();
-
-private:
-    enum LockType { READ_LOCK, WRITE_LOCK,  RELEASE = 2 };
-
-    DISALLOW_COPY_AND_ASSIGN(MicroRWLockRefCounted);
-};
-
-MicroRWLockRefCounted::MicroRWLockRefCounted(LockType type)
+inline bool MicroLockVector::TimedLock(uint32_t index, uint64_t timeoutInUs)
 {
-    AddRef();
-    switch (type)
+    uint64_t begin = GetCurrentTimeInUs();
+    Sleeper sleeper;
+    while (!TryLock(index))
     {
-        case READ_LOCK:
-            ReadLock();
-            break;
-        case WRITE_LOCK:
-            WriteLock();
-            break;
-        case RELEASE:
-            abort();
+        uint64_t now = GetCurrentTimeInUs();
+        if (now >= begin && now - begin >= timeoutInUs)
+        {
+            return false;
+        }
+        sleeper.Pause();
     }
+    return true;
 }
 
-inline void MicroRWLockRefCounted::ReadLock()
-{
-    AddRef();
-    MicroRWLock::ReadLock();
-}
-
-inline void MicroRWLockRefCounted::ReadUnlock()
-{
-    MicroRWLock::ReadUnlock();
-    RefCounted<MicroRWLockRefCounted>::Release();
-}
-
-inline void MicroRWLockRefCounted::WriteLock()
-{
-    AddRef();
-    MicroRWLock::WriteLock();
-}
-
-inline void MicroRWLockRefCounted::WriteUnlock()
-{
-    MicroRWLock::WriteUnlock();
-    RefCounted<MicroRWLockRefCounted>::Release();
-}
-
-#endif // if 0
-
 #endif  // _SRC_SYNC_MICRO_LOCK_H
@@ -0,0 +1,157 @@
+#ifndef _SRC_SYNC_MPSC_QUEUE_H
+#define _SRC_SYNC_MPSC_QUEUE_H
+
+#include <stddef.h>
+
+#include "src/base/atomic_pointer.h"
+#include "src/common/common.h"
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+
+class MpscQueueNode
+{
+public:
+    MpscQueueNode() : mNext(NULL) {}
+
+private:
+    template <typename T, MpscQueueNode T::*M>
+    friend class IntrusiveMpscQueue;
+
+    MpscQueueNode* volatile mNext;
+
+    DISALLOW_COPY_AND_ASSIGN(MpscQueueNode);
+};
+
+/**
+ * An intrusive lock-free multi-producer single-consumer FIFO queue, after
+ * Dmitry Vyukov's non-intrusive MPSC node-based queue.
+ *
+ * Producers link objects at the head with a single atomic exchange, and
+ * never wait for each other or the consumer.  The consumer pops from the
+ * tail without any atomic read-modify-write.  A stub node keeps the list
+ * non-empty, so no object has to stay in the queue after being popped.
+ *
+ * A producer preempted between the exchange and linking its node leaves
+ * the queue broken for a moment: Pop() returns NULL until the link is done,
+ * even though objects pushed later are in the queue.  The consumer should
+ * retry (or wait for a wakeup) rather than treat NULL as "empty forever".
+ *
+ * Push() may be called from any thread, Pop(), Drain() and Empty() only from
+ * one consumer thread at a time.  As with other intrusive containers, the
+ * user manages life-cycle of objects, and an object must not be pushed
+ * again before it's popped.
+ *
+ * Usage:
+ *   struct Task
+ *   {
+ *       MpscQueueNode node;
+ *       ...
+ *   };
+ *
+ *   IntrusiveMpscQueue<Task, &Task::node> queue;
+ *   queue.Push(task);               // any thread
+ *   while ((task = queue.Pop()) != NULL) { ... }    // consumer thread
+ */
+template <typename T, MpscQueueNode T::*M>
+class IntrusiveMpscQueue
+{
+public:
+    IntrusiveMpscQueue() : mHead(&mStub), mTail(&mStub) {}
+
+    /**
+     * Append 'obj', return true if the queue was empty before, which is a
+     * hint for waking the consumer up.
+     */
+    bool Push(T* obj)
+    {
+        MpscQueueNode* node = &(obj->*M);
+        node->mNext = NULL;
+        return push(node) == &mStub;
+    }
+
+    /**
+     * Remove and return the oldest object, or NULL if the queue is empty or
+     * a producer has not finished linking.
+     */
+    T* Pop()
+    {
+        MpscQueueNode* tail = mTail;
+        MpscQueueNode* next = AtomicGet(&tail->mNext);
+        if (tail == &mStub)
+        {
+            if (next == NULL)
+            {
+                return NULL;
+            }
+            // Skip the stub.
+            mTail = next;
+            tail = next;
+            next = AtomicGet(&next->mNext);
+        }
+        if (next != NULL)
+        {
+            mTail = next;
+            return MemberToObject(tail, M);
+        }
+        // 'tail' is the last linked node.  Unless a producer is in the
+        // middle of a push, put the stub behind it so it can be taken.
+        if (tail != AtomicGet(&mHead))
+        {
+            return NULL;
+        }
+        mStub.mNext = NULL;
+        push(&mStub);
+        next = AtomicGet(&tail->mNext);
+        if (next != NULL)
+        {
+            mTail = next;
+            return MemberToObject(tail, M);
+        }
+        return NULL;
+    }
+
+    /**
+     * Pop up to 'maxCount' objects and call handler(T*) on each, in order.
+     * The handler may push the object again.  Return the number of popped
+     * objects.
+     */
+    template <typename Handler>
+    size_t Drain(Handler handler, size_t maxCount = static_cast<size_t>(-1))
+    {
+        size_t count = 0;
+        T* obj = NULL;
+        while (count < maxCount && (obj = Pop()) != NULL)
+        {
+            ++count;
+            handler(obj);
+        }
+        return count;
+    }
+
+    /** Whether there is no object to pop, from the consumer's view. */
+    bool Empty() const
+    {
+        return mTail == &mStub && AtomicGet(&mStub.mNext) == NULL;
+    }
+
+private:
+    // Return the previous head.
+    MpscQueueNode* push(MpscQueueNode* node)
+    {
+        MpscQueueNode* prev = AtomicExchange(&mHead, node);
+        MemoryBarrier();
+        AtomicSet(&prev->mNext, node);
+        return prev;
+    }
+
+    // Written by producers and the consumer respectively, pad them to
+    // separate cache lines.
+    MpscQueueNode* volatile mHead;
+    char mHeadPadding[64 - sizeof(MpscQueueNode*)];  // NOLINT(runtime/sizeof)
+    MpscQueueNode* mTail;
+    MpscQueueNode mStub;
+
+    DISALLOW_COPY_AND_ASSIGN(IntrusiveMpscQueue);
+};
+
+#endif  // _SRC_SYNC_MPSC_QUEUE_H
@@ -6,6 +6,7 @@
 #include "src/base/gettime.h"
 #include "src/common/macros.h"
 #include "src/sync/atomic.h"
+#include "src/sync/lock_profiler.h"
 #include "src/sync/scoped_lock.h"
 #include "src/thread/this_thread.h"
 #include "src/thread/thread_check.h"
@@ -182,20 +183,35 @@ inline MutexBase::~MutexBase()
     CheckPthreadError(::pthread_mutex_destroy(&mMutex));
 }
 
-inline void MutexBase::Lock()
+inline LOCK_PROFILE_NOINLINE void MutexBase::Lock()
 {
+    LOCK_PROFILE_BEGIN();
+    // When profiling, try first to tell contended acquisitions apart.
+    if (LOCK_PROFILE_ENABLED && ::pthread_mutex_trylock(&mMutex) == 0)
+    {
+        LOCK_PROFILE_ACQUIRED(this, "MutexBase", false);
+        return;
+    }
     CheckPthreadError(::pthread_mutex_lock(&mMutex));
+    LOCK_PROFILE_ACQUIRED(this, "MutexBase", true);
 }
 
 inline void MutexBase::Unlock()
 {
+    LOCK_PROFILE_RELEASED(this);
     CheckPthreadError(::pthread_mutex_unlock(&mMutex));
 }
 
-inline bool MutexBase::TryLock()
+inline LOCK_PROFILE_NOINLINE bool MutexBase::TryLock()
 {
-    return CheckPthreadTryLockError(
+    LOCK_PROFILE_BEGIN();
+    bool locked = CheckPthreadTryLockError(
             ::pthread_mutex_trylock(&mMutex));
+    if (locked)
+    {
+        LOCK_PROFILE_ACQUIRED(this, "MutexBase", false);
+    }
+    return locked;
 }
 
 inline bool MutexBase::IsLocked() const
@@ -0,0 +1,550 @@
+#ifndef _SRC_SYNC_RING_BUFFER_H
+#define _SRC_SYNC_RING_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "src/base/atomic_pointer.h"
+#include "src/base/gettime.h"
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+#include "src/sync/cond.h"
+#include "src/sync/micro_lock.h"
+
+namespace detail
+{
+
+inline size_t RingBufferCapacity(size_t capacity)
+{
+    ASSERT(capacity > 0);
+    size_t result = 1;
+    while (result < capacity)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+
+inline void RingBufferPause()
+{
+    asm volatile("pause");
+}
+
+}  // namespace detail
+
+/**
+ * A bounded lock-free single-producer single-consumer ring buffer.
+ *
+ * The producer and the consumer own one index each, on separate cache lines.
+ * Each side also keeps a cached copy of the other side's index, and reloads
+ * it only when the ring looks full (or empty), so most operations touch no
+ * shared cache line but the slot itself.
+ *
+ * Push*() may be called from one producer thread, Pop*() from one consumer
+ * thread.  The capacity is rounded up to a power of 2.
+ */
+template <typename T>
+class SpscRingBuffer
+{
+public:
+    typedef T value_type;
+
+    explicit SpscRingBuffer(size_t capacity)
+        : mCapacity(detail::RingBufferCapacity(capacity)),
+          mMask(mCapacity - 1),
+          mBuffer(new T[mCapacity]),
+          mTail(0),
+          mCachedHead(0),
+          mHead(0),
+          mCachedTail(0)
+    {
+    }
+
+    ~SpscRingBuffer() { delete[] mBuffer; }
+
+    /** Return false if the ring is full. */
+    bool Push(const T& value)
+    {
+        return PushBatch(&value, 1) == 1;
+    }
+
+    /** Return false if the ring is empty. */
+    bool Pop(T* value)
+    {
+        return PopBatch(value, 1) == 1;
+    }
+
+    /**
+     * Push as many of 'values' as there is room for, return the number of
+     * pushed ones.  They are published to the consumer at once.
+     */
+    size_t PushBatch(const T* values, size_t count)
+    {
+        uint64_t tail = mTail;
+        if (count > mCapacity - (tail - mCachedHead))
+        {
+            mCachedHead = AtomicGet(&mHead);
+            MemoryBarrier();
+            count = MIN(count, mCapacity - (tail - mCachedHead));
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            mBuffer[(tail + i) & mMask] = values[i];
+        }
+        MemoryBarrier();
+        AtomicSet(&mTail, tail + count);
+        return count;
+    }
+
+    /**
+     * Pop up to 'count' values into 'values', return the number of popped
+     * ones.
+     */
+    size_t PopBatch(T* values, size_t count)
+    {
+        uint64_t head = mHead;
+        if (count > mCachedTail - head)
+        {
+            mCachedTail = AtomicGet(&mTail);
+            MemoryBarrier();
+            count = MIN(count, mCachedTail - head);
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            values[i] = mBuffer[(head + i) & mMask];
+        }
+        MemoryBarrier();
+        AtomicSet(&mHead, head + count);
+        return count;
+    }
+
+    /** The number of values, exact only when both sides are quiet. */
+    size_t Size() const { return AtomicGet(&mTail) - AtomicGet(&mHead); }
+
+    bool Empty() const { return Size() == 0; }
+
+    size_t Capacity() const { return mCapacity; }
+
+private:
+    const size_t mCapacity;
+    const uint64_t mMask;
+    T* const mBuffer;
+    char mBufferPadding[64 - 3 * sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+    // Owned by the producer
+    volatile uint64_t mTail;
+    uint64_t mCachedHead;
+    char mTailPadding[64 - 2 * sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+    // Owned by the consumer
+    volatile uint64_t mHead;
+    uint64_t mCachedTail;
+    char mHeadPadding[64 - 2 * sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+    DISALLOW_COPY_AND_ASSIGN(SpscRingBuffer);
+};
+
+/**
+ * A bounded lock-free multi-producer multi-consumer ring buffer, after Dmitry
+ * Vyukov's bounded MPMC queue.
+ *
+ * Every slot carries a sequence number telling whether it's ready for the
+ * producer or the consumer of a position, so producers (and consumers)
+ * contend on one CAS of their index only, and never on each other's slots.
+ *
+ * PushBatch() and PopBatch() claim several positions with a single CAS.  A
+ * claimed slot might still be in the hands of a consumer (or producer) of
+ * the previous round, which is waited for; it has claimed the slot already,
+ * so it's a matter of a copy unless the thread is preempted.
+ *
+ * The capacity is rounded up to a power of 2.
+ */
+template <typename T>
+class MpmcRingBuffer
+{
+public:
+    typedef T value_type;
+
+    explicit MpmcRingBuffer(size_t capacity)
+        : mCapacity(detail::RingBufferCapacity(capacity)),
+          mMask(mCapacity - 1),
+          mCells(new Cell[mCapacity]),
+          mEnqueuePos(0),
+          mDequeuePos(0)
+    {
+        for (size_t i = 0; i < mCapacity; ++i)
+        {
+            mCells[i].sequence = i;
+        }
+    }
+
+    ~MpmcRingBuffer() { delete[] mCells; }
+
+    /** Return false if the ring is full. */
+    bool Push(const T& value)
+    {
+        uint64_t pos = AtomicGet(&mEnqueuePos);
+        Cell* cell = NULL;
+        while (true)
+        {
+            cell = &mCells[pos & mMask];
+            int64_t diff = static_cast<int64_t>(AtomicGet(&cell->sequence) - pos);
+            if (diff == 0)
+            {
+                if (AtomicCompareExchange(&mEnqueuePos, pos + 1, pos))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            pos = AtomicGet(&mEnqueuePos);
+        }
+        MemoryBarrier();
+        cell->value = value;
+        MemoryBarrier();
+        AtomicSet(&cell->sequence, pos + 1);
+        return true;
+    }
+
+    /** Return false if the ring is empty. */
+    bool Pop(T* value)
+    {
+        uint64_t pos = AtomicGet(&mDequeuePos);
+        Cell* cell = NULL;
+        while (true)
+        {
+            cell = &mCells[pos & mMask];
+            int64_t diff = static_cast<int64_t>(AtomicGet(&cell->sequence) - (pos + 1));
+            if (diff == 0)
+            {
+                if (AtomicCompareExchange(&mDequeuePos, pos + 1, pos))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            pos = AtomicGet(&mDequeuePos);
+        }
+        MemoryBarrier();
+        *value = cell->value;
+        MemoryBarrier();
+        AtomicSet(&cell->sequence, pos + mCapacity);
+        return true;
+    }
+
+    /**
+     * Push as many of 'values' as there is room for, return the number of
+     * pushed ones.
+     */
+    size_t PushBatch(const T* values, size_t count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        uint64_t pos = 0;
+        while (true)
+        {
+            pos = AtomicGet(&mEnqueuePos);
+            // A stale dequeue position only underestimates the room.
+            uint64_t used = pos - AtomicGet(&mDequeuePos);
+            if (static_cast<int64_t>(used) < 0 || used >= mCapacity)
+            {
+                return Push(values[0]) ? 1 : 0;
+            }
+            count = MIN(count, mCapacity - used);
+            if (AtomicCompareExchange(&mEnqueuePos, pos + count, pos))
+            {
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            Cell* cell = &mCells[(pos + i) & mMask];
+            Sleeper sleeper;
+            while (AtomicGet(&cell->sequence) != pos + i)
+            {
+                sleeper.Pause();
+            }
+            MemoryBarrier();
+            cell->value = values[i];
+            MemoryBarrier();
+            AtomicSet(&cell->sequence, pos + i + 1);
+        }
+        return count;
+    }
+
+    /**
+     * Pop up to 'count' values into 'values', return the number of popped
+     * ones.
+     */
+    size_t PopBatch(T* values, size_t count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        uint64_t pos = 0;
+        while (true)
+        {
+            pos = AtomicGet(&mDequeuePos);
+            // Positions below the enqueue position are claimed by producers.
+            uint64_t claimed = AtomicGet(&mEnqueuePos) - pos;
+            if (static_cast<int64_t>(claimed) <= 0)
+            {
+                return 0;
+            }
+            count = MIN(count, claimed);
+            if (AtomicCompareExchange(&mDequeuePos, pos + count, pos))
+            {
+                break;
+            }
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            Cell* cell = &mCells[(pos + i) & mMask];
+            Sleeper sleeper;
+            while (AtomicGet(&cell->sequence) != pos + i + 1)
+            {
+                sleeper.Pause();
+            }
+            MemoryBarrier();
+            values[i] = cell->value;
+            MemoryBarrier();
+            AtomicSet(&cell->sequence, pos + i + mCapacity);
+        }
+        return count;
+    }
+
+    /** The number of values, exact only when all threads are quiet. */
+    size_t Size() const
+    {
+        int64_t size = AtomicGet(&mEnqueuePos) - AtomicGet(&mDequeuePos);
+        return size < 0 ? 0 : size;
+    }
+
+    bool Empty() const { return Size() == 0; }
+
+    size_t Capacity() const { return mCapacity; }
+
+private:
+    struct Cell
+    {
+        volatile uint64_t sequence;
+        T value;
+    };
+
+    const size_t mCapacity;
+    const uint64_t mMask;
+    Cell* const mCells;
+    char mCellsPadding[64 - 3 * sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+    volatile uint64_t mEnqueuePos;
+    char mEnqueuePadding[64 - sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+    volatile uint64_t mDequeuePos;
+    char mDequeuePadding[64 - sizeof(uint64_t)];  // NOLINT(runtime/sizeof)
+
+    DISALLOW_COPY_AND_ASSIGN(MpmcRingBuffer);
+};
+
+/**
+ * Blocking wrapper of SpscRingBuffer or MpmcRingBuffer.
+ *
+ * A blocked side spins for a while first, like Sleeper, and then parks on a
+ * ConditionVariable.  The other side only takes the lock to wake it up when
+ * somebody is parked, so there is no system call as long as neither side
+ * parks.  The Try*() routines don't block.
+ *
+ * Usage:
+ *   BlockingRingBuffer<MpmcRingBuffer<Request*> > ring(1024);
+ *   ring.Push(request);         // I/O threads
+ *   ring.Pop(&request);         // worker threads
+ */
+template <typename Ring>
+class BlockingRingBuffer
+{
+public:
+    typedef typename Ring::value_type value_type;
+
+    explicit BlockingRingBuffer(size_t capacity)
+        : mRing(capacity),
+          mPushWaiters(0),
+          mPopWaiters(0)
+    {
+    }
+
+    bool TryPush(const value_type& value)
+    {
+        if (!mRing.Push(value))
+        {
+            return false;
+        }
+        wakeUp(&mPopWaiters, &mNotEmpty);
+        return true;
+    }
+
+    bool TryPop(value_type* value)
+    {
+        if (!mRing.Pop(value))
+        {
+            return false;
+        }
+        wakeUp(&mPushWaiters, &mNotFull);
+        return true;
+    }
+
+    /** Block until 'value' is pushed. */
+    void Push(const value_type& value)
+    {
+        for (int i = 0; i < kMaxSpins; ++i)
+        {
+            if (TryPush(value))
+            {
+                return;
+            }
+            detail::RingBufferPause();
+        }
+        mNotFull.Lock();
+        AtomicInc(&mPushWaiters);
+        while (!mRing.Push(value))
+        {
+            mNotFull.Wait();
+        }
+        AtomicDec(&mPushWaiters);
+        mNotFull.Unlock();
+        wakeUp(&mPopWaiters, &mNotEmpty);
+    }
+
+    /** Block until a value is popped. */
+    void Pop(value_type* value)
+    {
+        TimedPop(value, -1);
+    }
+
+    /**
+     * Block until a value is popped, or 'timeoutInUs' passes (never if
+     * negative).  Return false on timeout.
+     */
+    bool TimedPop(value_type* value, int64_t timeoutInUs)
+    {
+        for (int i = 0; i < kMaxSpins; ++i)
+        {
+            if (TryPop(value))
+            {
+                return true;
+            }
+            detail::RingBufferPause();
+        }
+        uint64_t deadline = GetCurrentTimeInUs() + timeoutInUs;
+        bool popped = true;
+        mNotEmpty.Lock();
+        AtomicInc(&mPopWaiters);
+        while (!mRing.Pop(value))
+        {
+            if (timeoutInUs < 0)
+            {
+                mNotEmpty.Wait();
+                continue;
+            }
+            int64_t remain = deadline - GetCurrentTimeInUs();
+            if (remain <= 0)
+            {
+                popped = false;
+                break;
+            }
+            mNotEmpty.TimedWait(remain);
+        }
+        AtomicDec(&mPopWaiters);
+        mNotEmpty.Unlock();
+        if (popped)
+        {
+            wakeUp(&mPushWaiters, &mNotFull);
+        }
+        return popped;
+    }
+
+    /** Push all of 'values', block while the ring is full.  Return 'count'. */
+    size_t PushBatch(const value_type* values, size_t count)
+    {
+        size_t total = count;
+        while (count > 0)
+        {
+            size_t pushed = mRing.PushBatch(values, count);
+            if (pushed == 0)
+            {
+                Push(values[0]);
+                pushed = 1;
+            }
+            else
+            {
+                wakeUp(&mPopWaiters, &mNotEmpty);
+            }
+            values += pushed;
+            count -= pushed;
+        }
+        return total;
+    }
+
+    /**
+     * Pop up to 'count' values, block until there is at least one.  Return
+     * the number of popped values.
+     */
+    size_t PopBatch(value_type* values, size_t count)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        size_t popped = mRing.PopBatch(values, count);
+        if (popped == 0)
+        {
+            Pop(values);
+            popped = 1 + mRing.PopBatch(values + 1, count - 1);
+        }
+        wakeUp(&mPushWaiters, &mNotFull);
+        return popped;
+    }
+
+    size_t Size() const { return mRing.Size(); }
+
+    bool Empty() const { return mRing.Empty(); }
+
+    size_t Capacity() const { return mRing.Capacity(); }
+
+private:
+    enum
+    {
+        kMaxSpins = 1000,
+    };
+
+    void wakeUp(volatile uint32_t* waiters, ConditionVariable* cond)
+    {
+        // Order the ring update before reading the waiters, which is paired
+        // with the waiter's increment before its last try.
+        __sync_synchronize();
+        if (AtomicGet(waiters) != 0)
+        {
+            cond->Lock();
+            cond->Broadcast();
+            cond->Unlock();
+        }
+    }
+
+    Ring mRing;
+    volatile uint32_t mPushWaiters;
+    volatile uint32_t mPopWaiters;
+    ConditionVariable mNotFull;
+    ConditionVariable mNotEmpty;
+
+    DISALLOW_COPY_AND_ASSIGN(BlockingRingBuffer);
+};
+
+#endif  // _SRC_SYNC_RING_BUFFER_H
@@ -118,6 +118,58 @@ inline void ScopedRWLock<T>::doUnlock()
     }
 }
 
+/**
+ * Hold the read side of 'T' in a scope: anything with ReadLock() and
+ * ReadUnlock(), e.g. RW locks, or the read section of a Snapshot.
+ */
+template <typename T>
+class ScopedReaderLocker
+{
+public:
+    typedef T LockType;
+
+    explicit ScopedReaderLocker(T* lock) : mLock(lock)
+    {
+        mLock->ReadLock();
+    }
+
+    ~ScopedReaderLocker()
+    {
+        mLock->ReadUnlock();
+    }
+
+private:
+    T* mLock;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedReaderLocker);
+};
+
+/**
+ * Hold the write side of 'T' in a scope: anything with WriteLock() and
+ * WriteUnlock(), e.g. RW locks, or a SeqLock updated in place.
+ */
+template <typename T>
+class ScopedWriterLocker
+{
+public:
+    typedef T LockType;
+
+    explicit ScopedWriterLocker(T* lock) : mLock(lock)
+    {
+        mLock->WriteLock();
+    }
+
+    ~ScopedWriterLocker()
+    {
+        mLock->WriteUnlock();
+    }
+
+private:
+    T* mLock;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedWriterLocker);
+};
+
 #ifndef NO_STONE_SCOPED_LOCK_MACRO
 
 template<typename Lock>
@@ -139,13 +191,13 @@ struct ScopedLockerHelper
         if (true) \
 
 #define STONE_SCOPED_LOCK(lock) \
-        STONE_SCOPED_LOCK_X(lock, ScopedLocker<typeof(lock)>)
+        STONE_SCOPED_LOCK_X(lock, ScopedLocker<__typeof__(lock)>)
 
 #define STONE_SCOPED_RLOCK(lock) \
-        STONE_SCOPED_LOCK_X(lock, ScopedReaderLocker<typeof(lock)>)
+        STONE_SCOPED_LOCK_X(lock, ScopedReaderLocker<__typeof__(lock)>)
 
 #define STONE_SCOPED_WLOCK(lock) \
-        STONE_SCOPED_LOCK_X(lock, ScopedWriterLocker<typeof(lock)>)
+        STONE_SCOPED_LOCK_X(lock, ScopedWriterLocker<__typeof__(lock)>)
 
 #endif // NO_STONE_SCOPED_LOCK_MACRO
 
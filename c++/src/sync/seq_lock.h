@@ -0,0 +1,131 @@
+#ifndef _SRC_SYNC_SEQ_LOCK_H
+#define _SRC_SYNC_SEQ_LOCK_H
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+#include "src/sync/micro_lock.h"
+
+/**
+ * Sequence lock around a small trivially copyable value, e.g. a clock or
+ * a pair of counters.
+ *
+ * Readers copy the value optimistically and retry if a writer was active
+ * meanwhile; they never write shared memory, so reads scale with the
+ * number of cores.  Writers are serialized by a MicroLock and bump the
+ * sequence to odd before and to even after the update.  A reader may
+ * spin as long as writers keep writing, so it fits values read far more
+ * often than written.
+ *
+ * Usage:
+ *   SeqLock<Config> config;
+ *   Config current = config.Read();
+ *   config.Write(newConfig);
+ *   // or, to update in place:
+ *   {
+ *       ScopedWriterLocker<SeqLock<Config> > locker(&config);
+ *       config.MutableValue()->version++;
+ *   }
+ */
+template <typename T>
+class SeqLock
+{
+public:
+    SeqLock() : mSequence(0), mValue() {}
+
+    explicit SeqLock(const T& value) : mSequence(0), mValue(value) {}
+
+    /** Return a consistent copy of the value. */
+    T Read() const;
+
+    void Write(const T& value);
+
+    /**
+     * Lower-level read protocol, for reading part of the value:
+     *   uint32_t seq;
+     *   do { seq = lock.ReadBegin(); x = lock.Value().x; } while (lock.ReadRetry(seq));
+     * What is read between may be torn, only use it after ReadRetry().
+     */
+    uint32_t ReadBegin() const;
+    bool ReadRetry(uint32_t sequence) const;
+    const T& Value() const { return mValue; }
+
+    /** Write side, to update in place through MutableValue(). */
+    void WriteLock();
+    void WriteUnlock();
+    T* MutableValue() { return &mValue; }
+
+private:
+    volatile uint32_t mSequence;
+    MicroLock mWriteLock;
+    T mValue;
+
+    DISALLOW_COPY_AND_ASSIGN(SeqLock);
+};
+
+template <typename T>
+inline uint32_t SeqLock<T>::ReadBegin() const
+{
+    uint32_t sequence;
+    // Acquire: the value is read after the sequence.
+    while ((sequence = AtomicGet(&mSequence, std::memory_order_acquire)) & 1)
+    {
+        asm volatile("pause");
+    }
+    return sequence;
+}
+
+template <typename T>
+inline bool SeqLock<T>::ReadRetry(uint32_t sequence) const
+{
+    // The value is read before the sequence again.
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return AtomicGet(&mSequence, std::memory_order_relaxed) != sequence;
+}
+
+template <typename T>
+inline T SeqLock<T>::Read() const
+{
+    STATIC_ASSERT(std::is_trivially_copyable<T>::value);
+    // Copy bytewise: a torn T may not be a valid one.
+    char buffer[sizeof(T)] __attribute__((aligned(__alignof__(T))));
+    uint32_t sequence;
+    do
+    {
+        sequence = ReadBegin();
+        memcpy(buffer, &mValue, sizeof(T));
+    }
+    while (ReadRetry(sequence));
+    return *reinterpret_cast<T*>(buffer);
+}
+
+template <typename T>
+inline void SeqLock<T>::WriteLock()
+{
+    mWriteLock.Lock();
+    AtomicSet(&mSequence, mSequence + 1, std::memory_order_relaxed);
+    // The value is written after the odd sequence.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+template <typename T>
+inline void SeqLock<T>::WriteUnlock()
+{
+    // Release: the value is written before the even sequence.
+    AtomicSet(&mSequence, mSequence + 1, std::memory_order_release);
+    mWriteLock.Unlock();
+}
+
+template <typename T>
+inline void SeqLock<T>::Write(const T& value)
+{
+    WriteLock();
+    mValue = value;
+    WriteUnlock();
+}
+
+#endif  // _SRC_SYNC_SEQ_LOCK_H
@@ -0,0 +1,254 @@
+#include "src/sync/snapshot.h"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <vector>
+
+#ifdef __NR_membarrier
+#include <linux/membarrier.h>
+#endif
+
+#include "src/sync/cond.h"
+#include "src/sync/posix_lock.h"
+#include "src/sync/scoped_lock.h"
+#include "src/thread/this_thread.h"
+
+namespace
+{
+
+struct RetiredObject
+{
+    void* object;
+    void (*deleter)(void*);
+    uint64_t epoch;
+};
+
+bool registerMembarrier()
+{
+#ifdef __NR_membarrier
+    return ::syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+#else
+    return false;
+#endif
+}
+
+}  // anonymous namespace
+
+/** Everything but the read fast path, under one mutex: writers are rare. */
+struct EpochReclaimer::State
+{
+    State() : records(NULL), reclaimerRunning(false), reclaimerStopping(false),
+              reclaimerIntervalInMs(0), reclaimer(0)
+    {
+        CheckPthreadError(pthread_key_create(&recordKey, &EpochReclaimer::unregisterThread));
+    }
+
+    SimpleMutex mutex;
+    ThreadRecord* records;
+    std::vector<RetiredObject> retired;
+    pthread_key_t recordKey;
+
+    bool reclaimerRunning;
+    bool reclaimerStopping;
+    uint32_t reclaimerIntervalInMs;
+    pthread_t reclaimer;
+    ConditionVariable reclaimerCond;
+};
+
+__thread EpochReclaimer::ThreadRecord* EpochReclaimer::tRecord = NULL;
+volatile uint64_t EpochReclaimer::sEpoch = 1;
+bool EpochReclaimer::sUseMembarrier = registerMembarrier();
+
+EpochReclaimer::State* EpochReclaimer::getState()
+{
+    // Never freed, so readers may run during static destruction.
+    static State* sState = new State;
+    return sState;
+}
+
+EpochReclaimer::ThreadRecord* EpochReclaimer::registerThread()
+{
+    State* state = getState();
+    ScopedLock<SimpleMutex> lock(state->mutex);
+    ThreadRecord* record = state->records;
+    while (record != NULL && record->inUse)
+    {
+        record = record->next;
+    }
+    if (record == NULL)
+    {
+        record = new ThreadRecord;
+        record->next = state->records;
+        state->records = record;
+    }
+    record->epoch = 0;
+    record->nesting = 0;
+    record->inUse = 1;
+    CheckPthreadError(pthread_setspecific(state->recordKey, record));
+    tRecord = record;
+    return record;
+}
+
+void EpochReclaimer::unregisterThread(void* arg)
+{
+    ThreadRecord* record = static_cast<ThreadRecord*>(arg);
+    State* state = getState();
+    ScopedLock<SimpleMutex> lock(state->mutex);
+    ASSERT(record->nesting == 0);
+    record->epoch = 0;
+    record->inUse = 0;
+}
+
+void EpochReclaimer::Retire(void* object, void (*deleter)(void*))
+{
+    State* state = getState();
+    bool background = false;
+    {
+        ScopedLock<SimpleMutex> lock(state->mutex);
+        // Readers entering from now on announce a later epoch.
+        RetiredObject retired = { object, deleter, AtomicExchangeAdd(&sEpoch, 1UL) };
+        state->retired.push_back(retired);
+        background = state->reclaimerRunning;
+    }
+    if (!background)
+    {
+        Reclaim();
+    }
+}
+
+size_t EpochReclaimer::Reclaim()
+{
+    State* state = getState();
+    std::vector<RetiredObject> freed;
+    {
+        ScopedLock<SimpleMutex> lock(state->mutex);
+        if (state->retired.empty())
+        {
+            return 0;
+        }
+        // Make the epochs announced by running readers visible.
+#ifdef __NR_membarrier
+        if (sUseMembarrier)
+        {
+            ::syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+        }
+#endif
+        __sync_synchronize();
+        uint64_t oldest = UINT64_MAX;
+        for (ThreadRecord* record = state->records; record != NULL; record = record->next)
+        {
+            uint64_t epoch = AtomicGet(&record->epoch);
+            if (epoch != 0 && epoch < oldest)
+            {
+                oldest = epoch;
+            }
+        }
+        // A reader which entered at epoch 'oldest' may see objects retired
+        // at that epoch or later.
+        size_t kept = 0;
+        for (size_t i = 0; i < state->retired.size(); ++i)
+        {
+            if (state->retired[i].epoch < oldest)
+            {
+                freed.push_back(state->retired[i]);
+            }
+            else
+            {
+                state->retired[kept++] = state->retired[i];
+            }
+        }
+        state->retired.resize(kept);
+    }
+    // Out of the lock, deleters may retire more.
+    for (size_t i = 0; i < freed.size(); ++i)
+    {
+        freed[i].deleter(freed[i].object);
+    }
+    return freed.size();
+}
+
+void EpochReclaimer::Synchronize()
+{
+    State* state = getState();
+    uint64_t target = AtomicGet(&sEpoch);
+    while (true)
+    {
+        Reclaim();
+        {
+            ScopedLock<SimpleMutex> lock(state->mutex);
+            bool pending = false;
+            for (size_t i = 0; i < state->retired.size() && !pending; ++i)
+            {
+                pending = state->retired[i].epoch < target;
+            }
+            if (!pending)
+            {
+                return;
+            }
+        }
+        ThisThread::SleepInMs(1);
+    }
+}
+
+size_t EpochReclaimer::GetPendingCount()
+{
+    State* state = getState();
+    ScopedLock<SimpleMutex> lock(state->mutex);
+    return state->retired.size();
+}
+
+void EpochReclaimer::StartBackgroundReclaimer(uint32_t intervalInMs)
+{
+    State* state = getState();
+    ScopedLock<SimpleMutex> lock(state->mutex);
+    if (state->reclaimerRunning)
+    {
+        return;
+    }
+    state->reclaimerRunning = true;
+    state->reclaimerStopping = false;
+    state->reclaimerIntervalInMs = intervalInMs;
+    CheckPthreadError(pthread_create(&state->reclaimer, NULL, &reclaimerMain, state));
+}
+
+void EpochReclaimer::StopBackgroundReclaimer()
+{
+    State* state = getState();
+    {
+        ScopedLock<SimpleMutex> lock(state->mutex);
+        if (!state->reclaimerRunning)
+        {
+            return;
+        }
+    }
+    state->reclaimerCond.Lock();
+    state->reclaimerStopping = true;
+    state->reclaimerCond.Signal();
+    state->reclaimerCond.Unlock();
+    CheckPthreadError(pthread_join(state->reclaimer, NULL));
+    {
+        ScopedLock<SimpleMutex> lock(state->mutex);
+        state->reclaimerRunning = false;
+    }
+    // Retire() reclaims by itself again, catch up with what is left.
+    Reclaim();
+}
+
+void* EpochReclaimer::reclaimerMain(void* arg)
+{
+    State* state = static_cast<State*>(arg);
+    bool stopping = false;
+    while (!stopping)
+    {
+        state->reclaimerCond.Lock();
+        if (!state->reclaimerStopping)
+        {
+            state->reclaimerCond.TimedWait(state->reclaimerIntervalInMs * 1000L);
+        }
+        stopping = state->reclaimerStopping;
+        state->reclaimerCond.Unlock();
+        Reclaim();
+    }
+    return NULL;
+}
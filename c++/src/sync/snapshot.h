@@ -0,0 +1,168 @@
+#ifndef _SRC_SYNC_SNAPSHOT_H
+#define _SRC_SYNC_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "src/common/assert.h"
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+
+/**
+ * Epoch-based deferred reclamation, the process-wide domain of Snapshot.
+ *
+ * A reader announces the global epoch it entered in, in a record of its
+ * own thread, and clears it on leaving; that is two plain stores and no
+ * atomic read-modify-write.  An object retired at epoch 'e' is freed once
+ * every thread is either outside a read section or entered after 'e'.
+ *
+ * The store-load fence a reader would need between announcing and reading
+ * is moved to the reclaimer with membarrier(2), which makes all running
+ * threads of the process execute a full barrier.  Where membarrier is not
+ * available readers fall back to a real fence.
+ */
+class EpochReclaimer
+{
+public:
+    /** Enter a read section.  Nestable. */
+    static void ReadLock();
+
+    static void ReadUnlock();
+
+    /** Free 'object' with 'deleter' once no reader can still see it. */
+    static void Retire(void* object, void (*deleter)(void*));
+
+    /** Free what no reader can see any more, return the number freed. */
+    static size_t Reclaim();
+
+    /**
+     * Block until everything retired so far is freed.  Must not be called
+     * in a read section.
+     */
+    static void Synchronize();
+
+    /** Number of retired objects not freed yet. */
+    static size_t GetPendingCount();
+
+    /**
+     * Reclaim every 'intervalInMs' in a background thread, instead of in
+     * Retire().  Idempotent.
+     */
+    static void StartBackgroundReclaimer(uint32_t intervalInMs);
+
+    static void StopBackgroundReclaimer();
+
+private:
+    struct ThreadRecord
+    {
+        volatile uint64_t epoch;    // 0 if not in a read section
+        uint32_t nesting;
+        volatile int32_t inUse;     // Records of exited threads are reused
+        ThreadRecord* next;
+        char padding[64 - 2 * sizeof(uint64_t) - sizeof(ThreadRecord*)];  // NOLINT
+    };
+
+    struct State;
+
+    static State* getState();
+    static ThreadRecord* registerThread();
+    static void unregisterThread(void* record);
+    static void* reclaimerMain(void* arg);
+
+    static __thread ThreadRecord* tRecord;
+    static volatile uint64_t sEpoch;
+    static bool sUseMembarrier;
+
+    EpochReclaimer();
+};
+
+/**
+ * An RCU-like pointer to an immutable value.
+ *
+ * Readers get the current value inside a read section, which costs no
+ * atomic read-modify-write and never blocks.  Update() publishes a new
+ * value at once and retires the old one to the EpochReclaimer, which
+ * deletes it after the readers that may still use it are gone.  Concurrent
+ * Update()s are fine, but a read-modify-write of the value needs a lock
+ * around it.
+ *
+ * Usage:
+ *   Snapshot<RouteTable> routes(new RouteTable(...));
+ *   {
+ *       ScopedReaderLocker<Snapshot<RouteTable> > locker(&routes);
+ *       routes.Get()->Lookup(address);
+ *   }
+ *   routes.Update(new RouteTable(...));
+ */
+template <typename T>
+class Snapshot
+{
+public:
+    explicit Snapshot(T* value = NULL) : mValue(value) {}
+
+    /** Delete the current value, no reader may use it any more. */
+    ~Snapshot() { delete mValue; }
+
+    /** Read section, shared by all Snapshots (see EpochReclaimer). */
+    void ReadLock() const { EpochReclaimer::ReadLock(); }
+    void ReadUnlock() const { EpochReclaimer::ReadUnlock(); }
+
+    /** The current value, valid until the end of the read section. */
+    const T* Get() const
+    {
+        return AtomicGet(&mValue, std::memory_order_acquire);
+    }
+
+    /** Publish 'value', and retire the old one. */
+    void Update(T* value)
+    {
+        T* old = AtomicExchange(&mValue, value);
+        if (old != NULL)
+        {
+            EpochReclaimer::Retire(old, &deleteValue);
+        }
+    }
+
+private:
+    static void deleteValue(void* value) { delete static_cast<T*>(value); }
+
+    T* volatile mValue;
+
+    DISALLOW_COPY_AND_ASSIGN(Snapshot);
+};
+
+inline void EpochReclaimer::ReadLock()
+{
+    ThreadRecord* record = tRecord;
+    if (UNLIKELY(record == NULL))
+    {
+        record = registerThread();
+    }
+    if (record->nesting++ == 0)
+    {
+        AtomicSet(&record->epoch, AtomicGet(&sEpoch), std::memory_order_relaxed);
+        if (LIKELY(sUseMembarrier))
+        {
+            // The reclaimer's membarrier() fences this thread, only keep
+            // the compiler from reordering.
+            __atomic_signal_fence(__ATOMIC_SEQ_CST);
+        }
+        else
+        {
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        }
+    }
+}
+
+inline void EpochReclaimer::ReadUnlock()
+{
+    ThreadRecord* record = tRecord;
+    ASSERT_DEBUG(record != NULL && record->nesting > 0);
+    if (--record->nesting == 0)
+    {
+        // Release, so the reads of the section complete before leaving it.
+        AtomicSet(&record->epoch, static_cast<uint64_t>(0), std::memory_order_release);
+    }
+}
+
+#endif  // _SRC_SYNC_SNAPSHOT_H
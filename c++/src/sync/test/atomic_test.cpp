@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+
+TEST(Atomic, Basic)
+{
+    volatile uint32_t value = 10;
+    EXPECT_EQ(10U, AtomicGet(&value));
+    EXPECT_EQ(10U, AtomicGet(&value, std::memory_order_relaxed));
+    AtomicSet(&value, 20U);
+    EXPECT_EQ(20U, value);
+    AtomicSet(&value, 21U, std::memory_order_seq_cst);
+    EXPECT_EQ(22U, AtomicInc(&value));
+    EXPECT_EQ(21U, AtomicDec(&value, std::memory_order_relaxed));
+    EXPECT_EQ(21U, AtomicExchangeAdd(&value, 4U));
+    EXPECT_EQ(25U, AtomicExchangeSub(&value, 5U, std::memory_order_acq_rel));
+    EXPECT_EQ(23U, AtomicAdd(&value, 3U));
+    EXPECT_EQ(20U, AtomicSub(&value, 3U));
+    EXPECT_EQ(20U, AtomicExchange(&value, 0x0FU, std::memory_order_acquire));
+    EXPECT_EQ(0x0FU, AtomicExchangeOr(&value, 0xF0U));
+    EXPECT_EQ(0xFFU, AtomicExchangeAnd(&value, 0x3CU, std::memory_order_release));
+    EXPECT_EQ(0x3CU, value);
+
+    EXPECT_FALSE(AtomicCompareExchange(&value, 1U, 0U));
+    EXPECT_TRUE(AtomicCompareExchange(&value, 1U, 0x3CU));
+    // A release CAS fails with a relaxed load.
+    EXPECT_FALSE(AtomicCompareExchange(&value, 2U, 0U, std::memory_order_release));
+    EXPECT_TRUE(AtomicCompareExchange(&value, 2U, 1U, std::memory_order_acq_rel));
+    EXPECT_EQ(2U, value);
+
+    const volatile uint64_t constant = 7;
+    EXPECT_EQ(7UL, AtomicGet(&constant));
+
+    volatile bool flag = false;
+    AtomicSet(&flag, true);
+    EXPECT_TRUE(AtomicGet(&flag));
+
+    int array[2];
+    int* volatile pointer = &array[0];
+    EXPECT_EQ(&array[0], AtomicExchange(&pointer, &array[1]));
+    EXPECT_TRUE(AtomicCompareExchange(&pointer, static_cast<int*>(NULL), &array[1]));
+    EXPECT_TRUE(pointer == NULL);
+}
+
+struct TaggedPointer
+{
+    void* pointer;
+    uint64_t tag;
+} __attribute__((aligned(16)));
+
+TEST(Atomic, DoubleWordCAS)
+{
+    int object;
+    volatile TaggedPointer value = { NULL, 0 };
+    TaggedPointer compare = { NULL, 1 };
+    TaggedPointer exchange = { &object, 2 };
+    EXPECT_FALSE(DoubleWordCAS(&value, exchange, compare));
+    EXPECT_TRUE(value.pointer == NULL);
+    compare.tag = 0;
+    EXPECT_TRUE(DoubleWordCAS(&value, exchange, compare));
+    EXPECT_TRUE(value.pointer == &object);
+    EXPECT_EQ(2UL, value.tag);
+    EXPECT_TRUE(AtomicCompareExchange(&value, compare, exchange));
+    EXPECT_EQ(0UL, value.tag);
+}
+
+struct AtomicTestArgs
+{
+    volatile uint64_t counter;
+    volatile TaggedPointer tagged;
+};
+
+static void* incrementAtomics(void* arg)
+{
+    AtomicTestArgs* args = static_cast<AtomicTestArgs*>(arg);
+    for (int i = 0; i < 100000; ++i)
+    {
+        AtomicInc(&args->counter, std::memory_order_relaxed);
+        while (true)
+        {
+            TaggedPointer old = { args->tagged.pointer, args->tagged.tag };
+            TaggedPointer next = { old.pointer, old.tag + 1 };
+            if (DoubleWordCAS(&args->tagged, next, old))
+            {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+TEST(Atomic, MultiThread)
+{
+    AtomicTestArgs args;
+    args.counter = 0;
+    args.tagged.pointer = &args;
+    args.tagged.tag = 0;
+    pthread_t threads[4];
+    for (size_t i = 0; i < COUNT_OF(threads); ++i)
+    {
+        pthread_create(&threads[i], NULL, incrementAtomics, &args);
+    }
+    for (size_t i = 0; i < COUNT_OF(threads); ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    EXPECT_EQ(400000UL, args.counter);
+    EXPECT_EQ(400000UL, args.tagged.tag);
+    EXPECT_TRUE(args.tagged.pointer == &args);
+}
@@ -0,0 +1,185 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/sync/atomic.h"
+#include "src/sync/cond.h"
+#include "src/sync/count_down_latch.h"
+
+TEST(CountDownLatch, Basic)
+{
+    CountDownLatch latch(2);
+    EXPECT_EQ(2, latch.GetCount());
+    uint64_t start = GetCurrentTimeInUs();
+    EXPECT_FALSE(latch.TimedWait(10000));
+    EXPECT_GE(GetCurrentTimeInUs() - start, 10000UL);
+    latch.CountDown();
+    EXPECT_FALSE(latch.TimedWait(0));
+    latch.CountDown();
+    EXPECT_EQ(0, latch.GetCount());
+    EXPECT_TRUE(latch.TimedWait(0));
+    latch.Wait();
+
+    CountDownLatch zero(0);
+    zero.Wait();
+
+    // Extra count downs don't go below zero.
+    latch.CountDown();
+    EXPECT_EQ(0, latch.GetCount());
+    EXPECT_TRUE(latch.TimedWait(0));
+    zero.CountDown();
+    zero.Wait();
+}
+
+struct LatchTestArgs
+{
+    CountDownLatch* start;
+    CountDownLatch* done;
+    volatile int32_t* counter;
+};
+
+static void* startAndCountDown(void* arg)
+{
+    LatchTestArgs* args = static_cast<LatchTestArgs*>(arg);
+    args->start->Wait();
+    AtomicInc(args->counter);
+    args->done->CountDown();
+    return NULL;
+}
+
+TEST(CountDownLatch, MultiThread)
+{
+    const int threadNum = 8;
+    CountDownLatch start(1);
+    CountDownLatch done(threadNum);
+    volatile int32_t counter = 0;
+    LatchTestArgs args = { &start, &done, &counter };
+    std::vector<pthread_t> threads(threadNum);
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_create(&threads[i], NULL, startAndCountDown, &args);
+    }
+    EXPECT_EQ(0, AtomicGet(&counter));
+    start.CountDown();
+    done.Wait();
+    EXPECT_EQ(threadNum, AtomicGet(&counter));
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/** The ConditionVariable-based barrier Barrier replaces. */
+class CondBarrier
+{
+public:
+    explicit CondBarrier(int count) : mCount(count), mRemaining(count), mPhase(0) {}
+
+    bool Wait()
+    {
+        mCond.Lock();
+        int phase = mPhase;
+        bool last = --mRemaining == 0;
+        if (last)
+        {
+            mRemaining = mCount;
+            ++mPhase;
+            mCond.Broadcast();
+        }
+        while (phase == mPhase)
+        {
+            mCond.Wait();
+        }
+        mCond.Unlock();
+        return last;
+    }
+
+private:
+    ConditionVariable mCond;
+    const int mCount;
+    int mRemaining;
+    int mPhase;
+};
+
+template <typename BarrierType>
+struct BarrierTestArgs
+{
+    BarrierType* barrier;
+    int threadNum;
+    int phases;
+    std::vector<int>* arrivals;     // per phase
+    std::vector<int>* leaders;      // per phase
+};
+
+// In every phase, check all threads arrived at the previous one.
+template <typename BarrierType>
+static void* runPhases(void* arg)
+{
+    BarrierTestArgs<BarrierType>* args = static_cast<BarrierTestArgs<BarrierType>*>(arg);
+    for (int phase = 0; phase < args->phases; ++phase)
+    {
+        AtomicInc(&(*args->arrivals)[phase]);
+        if (args->barrier->Wait())
+        {
+            AtomicInc(&(*args->leaders)[phase]);
+        }
+        EXPECT_EQ(args->threadNum, AtomicGet(&(*args->arrivals)[phase]));
+    }
+    return NULL;
+}
+
+// Return the elapsed time in us.
+template <typename BarrierType>
+static uint64_t runBarrier(int threadNum, int phases)
+{
+    BarrierType barrier(threadNum);
+    std::vector<int> arrivals(phases, 0);
+    std::vector<int> leaders(phases, 0);
+    BarrierTestArgs<BarrierType> args = { &barrier, threadNum, phases, &arrivals, &leaders };
+    std::vector<pthread_t> threads(threadNum);
+    uint64_t start = GetCurrentTimeInUs();
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_create(&threads[i], NULL, runPhases<BarrierType>, &args);
+    }
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = GetCurrentTimeInUs() - start;
+    for (int phase = 0; phase < phases; ++phase)
+    {
+        EXPECT_EQ(1, leaders[phase]);
+    }
+    return elapsed;
+}
+
+TEST(Barrier, Basic)
+{
+    Barrier single(1);
+    EXPECT_TRUE(single.Wait());
+    EXPECT_TRUE(single.Wait());
+}
+
+TEST(Barrier, MultiThread)
+{
+    runBarrier<Barrier>(2, 1000);
+    runBarrier<Barrier>(7, 1000);
+}
+
+TEST(Barrier, Benchmark)
+{
+    const int phases = 10000;
+    for (int threadNum = 2; threadNum <= 8; threadNum *= 2)
+    {
+        uint64_t barrierTime = runBarrier<Barrier>(threadNum, phases);
+        uint64_t condTime = runBarrier<CondBarrier>(threadNum, phases);
+        fprintf(stderr, ">>> %d threads: Barrier %lu phases/ms, "
+                "ConditionVariable barrier %lu phases/ms\n",
+                threadNum, phases * 1000UL / (barrierTime + 1),
+                phases * 1000UL / (condTime + 1));
+    }
+}
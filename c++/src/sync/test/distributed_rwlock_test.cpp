@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+
+#include "src/sync/distributed_rwlock.h"
+#include "src/sync/test/lock_common_test.h"
+
+class DistributedRWLockTestFixture : public LockTestFixture
+{
+public:
+    DistributedRWLockTestFixture() {}
+};
+
+TEST_F(DistributedRWLockTestFixture, RWLock)
+{
+    testRWLock<DistributedRWLock>();
+}
+
+TEST_F(DistributedRWLockTestFixture, Timeout)
+{
+    testRWLockTimeout<DistributedRWLock>();
+}
+
+TEST_F(DistributedRWLockTestFixture, Owner)
+{
+    testRWLockOwner<DistributedRWLock>();
+}
+
+TEST_F(DistributedRWLockTestFixture, Benchmark)
+{
+    const int readsPerWrites[] = { 1000, 20 };
+    for (size_t i = 0; i < COUNT_OF(readsPerWrites); ++i)
+    {
+        for (int threadNum = 1; threadNum <= 16; threadNum *= 4)
+        {
+            int readsPerWrite = readsPerWrites[i];
+            benchmarkRWLock<DistributedRWLock>("DistributedRWLock", threadNum, 200, readsPerWrite);
+            benchmarkRWLock<MicroRWLock>("MicroRWLock", threadNum, 200, readsPerWrite);
+            benchmarkRWLock<RWLock>("RWLock", threadNum, 200, readsPerWrite);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+
+#include "src/sync/fair_lock.h"
+#include "src/sync/test/lock_common_test.h"
+
+class FairLockTestFixture : public LockTestFixture
+{
+public:
+    FairLockTestFixture() {}
+};
+
+TEST_F(FairLockTestFixture, Lock)
+{
+    testLock<TicketLock>();
+    testLock<McsLock>();
+}
+
+TEST_F(FairLockTestFixture, Timeout)
+{
+    testLockTimeout<TicketLock>();
+    testLockTimeout<McsLock>();
+}
+
+TEST_F(FairLockTestFixture, Nested)
+{
+    McsLock locks[3];
+    locks[0].Lock();
+    EXPECT_TRUE(locks[1].TryLock());
+    locks[2].Lock();
+    // Released out of order, nodes are reused by the next ones.
+    locks[0].Unlock();
+    EXPECT_TRUE(locks[0].TryLock());
+    locks[2].Unlock();
+    locks[1].Unlock();
+    locks[0].Unlock();
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_FALSE(locks[i].IsLocked());
+    }
+}
+
+TEST_F(FairLockTestFixture, Benchmark)
+{
+    for (int threadNum = 1; threadNum <= 16; threadNum *= 4)
+    {
+        benchmarkLock<TicketLock>("TicketLock", threadNum, 200);
+        benchmarkLock<McsLock>("McsLock", threadNum, 200);
+        benchmarkLock<MicroLock>("MicroLock", threadNum, 200);
+        benchmarkLock<SpinLock>("SpinLock", threadNum, 200);
+        benchmarkLock<AdaptiveMutex>("AdaptiveMutex", threadNum, 200);
+    }
+}
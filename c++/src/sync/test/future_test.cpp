@@ -0,0 +1,293 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "src/base/closure.h"
+#include "src/base/gettime.h"
+#include "src/sync/cond.h"
+#include "src/sync/future.h"
+#include "src/thread/thread_pool.h"
+
+static int twice(int value)
+{
+    return value * 2;
+}
+
+static std::string toString(int value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "<%d>", value);
+    return buffer;
+}
+
+struct AddTo
+{
+    explicit AddTo(int d) : delta(d) {}
+    int operator()(int value) const { return value + delta; }
+    int delta;
+};
+
+TEST(Future, Basic)
+{
+    Future<int> invalid;
+    EXPECT_FALSE(invalid.IsValid());
+
+    Promise<int> promise;
+    Future<int> future = promise.GetFuture();
+    Future<int> copy = future;
+    EXPECT_TRUE(future.IsValid());
+    EXPECT_FALSE(future.IsReady());
+    EXPECT_FALSE(future.TimedWait(1000));
+    promise.SetValue(42);
+    EXPECT_TRUE(copy.IsReady());
+    EXPECT_TRUE(future.TimedWait(0));
+    EXPECT_EQ(42, future.Get());
+    EXPECT_EQ(42, copy.Get());
+
+    EXPECT_EQ(std::string("x"), MakeReadyFuture(std::string("x")).Get());
+}
+
+TEST(Future, ThenInline)
+{
+    // Attached before the value: runs in SetValue().
+    Promise<int> promise;
+    Future<std::string> chained =
+        promise.GetFuture().Then(&twice).Then(AddTo(1)).Then(&toString);
+    EXPECT_FALSE(chained.IsReady());
+    promise.SetValue(20);
+    ASSERT_TRUE(chained.IsReady());
+    EXPECT_EQ("<41>", chained.Get());
+
+    // Attached after the value: runs at once.
+    Future<int> ready = MakeReadyFuture(5).Then(AddTo(10));
+    ASSERT_TRUE(ready.IsReady());
+    EXPECT_EQ(15, ready.Get());
+}
+
+TEST(Future, Void)
+{
+    // A chain ending in a side effect.
+    int seen = 0;
+    Promise<int> promise;
+    Future<void> done = promise.GetFuture().Then([&seen](int value) { seen = value; });
+    EXPECT_FALSE(done.IsReady());
+    promise.SetValue(7);
+    ASSERT_TRUE(done.IsReady());
+    done.Get();
+    EXPECT_EQ(7, seen);
+
+    // And going on from one.
+    Future<int> next = done.Then([&seen]() { return seen + 1; });
+    EXPECT_EQ(8, next.Get());
+
+    Promise<void> signal;
+    int runs = 0;
+    Future<void> counted = signal.GetFuture().Then([&runs]() { ++runs; });
+    EXPECT_FALSE(counted.TimedWait(1000));
+    signal.SetValue();
+    EXPECT_TRUE(counted.IsReady());
+    EXPECT_EQ(1, runs);
+
+    MakeReadyFuture().Then([&runs]() { ++runs; }).Wait();
+    EXPECT_EQ(2, runs);
+}
+
+TEST(Future, ThenOnExecutor)
+{
+    ThreadPool pool(2);
+    pool.Start();
+    std::vector<Promise<int> > promises(100);
+    std::vector<Future<int> > futures;
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        futures.push_back(promises[i].GetFuture().Then(&pool, &twice).Then(&pool, AddTo(1)));
+    }
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        promises[i].SetValue(i);
+    }
+    for (size_t i = 0; i < futures.size(); ++i)
+    {
+        EXPECT_EQ(static_cast<int>(i * 2 + 1), futures[i].Get());
+    }
+    pool.Stop();
+}
+
+TEST(Future, WhenAll)
+{
+    EXPECT_TRUE(WhenAll(std::vector<Future<int> >()).Get().empty());
+
+    std::vector<Promise<int> > promises(5);
+    std::vector<Future<int> > futures;
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        futures.push_back(promises[i].GetFuture());
+    }
+    promises[3].SetValue(3);
+    Future<std::vector<int> > all = WhenAll(futures);
+    for (int i = 4; i >= 0; --i)
+    {
+        EXPECT_FALSE(all.IsReady());
+        if (i != 3)
+        {
+            promises[i].SetValue(i);
+        }
+    }
+    ASSERT_TRUE(all.IsReady());
+    ASSERT_EQ(5UL, all.Get().size());
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(i, all.Get()[i]);
+    }
+}
+
+TEST(Future, WhenAny)
+{
+    std::vector<Promise<std::string> > promises(3);
+    std::vector<Future<std::string> > futures;
+    for (size_t i = 0; i < promises.size(); ++i)
+    {
+        futures.push_back(promises[i].GetFuture());
+    }
+    Future<std::pair<size_t, std::string> > any = WhenAny(futures);
+    EXPECT_FALSE(any.IsReady());
+    promises[2].SetValue("two");
+    ASSERT_TRUE(any.IsReady());
+    EXPECT_EQ(2UL, any.Get().first);
+    EXPECT_EQ("two", any.Get().second);
+    promises[0].SetValue("zero");
+    promises[1].SetValue("one");
+    EXPECT_EQ(2UL, any.Get().first);
+}
+
+struct FutureTestArgs
+{
+    std::vector<Promise<int> >* requests;
+    std::vector<Promise<int> >* responses;
+};
+
+// Answer every request with its value plus one.
+static void* answerRequests(void* arg)
+{
+    FutureTestArgs* args = static_cast<FutureTestArgs*>(arg);
+    for (size_t i = 0; i < args->requests->size(); ++i)
+    {
+        int value = (*args->requests)[i].GetFuture().Get();
+        (*args->responses)[i].SetValue(value + 1);
+    }
+    return NULL;
+}
+
+// Ping-pong 'count' values between two threads through futures, return the
+// elapsed time in us.
+static uint64_t runFuturePingPong(size_t count)
+{
+    std::vector<Promise<int> > requests(count);
+    std::vector<Promise<int> > responses(count);
+    FutureTestArgs args = { &requests, &responses };
+    pthread_t thread;
+    uint64_t start = GetCurrentTimeInUs();
+    pthread_create(&thread, NULL, answerRequests, &args);
+    for (size_t i = 0; i < count; ++i)
+    {
+        requests[i].SetValue(i);
+        EXPECT_EQ(static_cast<int>(i + 1), responses[i].GetFuture().Get());
+    }
+    pthread_join(thread, NULL);
+    return GetCurrentTimeInUs() - start;
+}
+
+/** The hand-rolled one-shot event the futures replace. */
+struct CondEvent
+{
+    CondEvent() : ready(false), value(0) {}
+
+    void Set(int v)
+    {
+        cond.Lock();
+        value = v;
+        ready = true;
+        cond.Signal();
+        cond.Unlock();
+    }
+
+    int Get()
+    {
+        cond.Lock();
+        while (!ready)
+        {
+            cond.Wait();
+        }
+        cond.Unlock();
+        return value;
+    }
+
+    ConditionVariable cond;
+    bool ready;
+    int value;
+};
+
+struct CondTestArgs
+{
+    std::vector<CondEvent>* requests;
+    std::vector<CondEvent>* responses;
+};
+
+static void* answerCondRequests(void* arg)
+{
+    CondTestArgs* args = static_cast<CondTestArgs*>(arg);
+    for (size_t i = 0; i < args->requests->size(); ++i)
+    {
+        (*args->responses)[i].Set((*args->requests)[i].Get() + 1);
+    }
+    return NULL;
+}
+
+static uint64_t runCondPingPong(size_t count)
+{
+    std::vector<CondEvent> requests(count);
+    std::vector<CondEvent> responses(count);
+    CondTestArgs args = { &requests, &responses };
+    pthread_t thread;
+    uint64_t start = GetCurrentTimeInUs();
+    pthread_create(&thread, NULL, answerCondRequests, &args);
+    for (size_t i = 0; i < count; ++i)
+    {
+        requests[i].Set(i);
+        EXPECT_EQ(static_cast<int>(i + 1), responses[i].Get());
+    }
+    pthread_join(thread, NULL);
+    return GetCurrentTimeInUs() - start;
+}
+
+TEST(Future, MultiThread)
+{
+    runFuturePingPong(10000);
+}
+
+TEST(Future, Benchmark)
+{
+    const size_t count = 100000;
+    uint64_t futureTime = runFuturePingPong(count);
+    uint64_t condTime = runCondPingPong(count);
+    fprintf(stderr, ">>> cross-thread ping-pong: Future %lu ops/ms, "
+            "ConditionVariable %lu ops/ms\n",
+            count * 1000 / (futureTime + 1), count * 1000 / (condTime + 1));
+
+    // Promise + inline Then + Get in one thread: the cost of the machinery.
+    uint64_t start = GetCurrentTimeInUs();
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        Promise<int> promise;
+        Future<int> future = promise.GetFuture().Then(&twice);
+        promise.SetValue(i);
+        sum += future.Get();
+    }
+    uint64_t elapsed = GetCurrentTimeInUs() - start;
+    EXPECT_EQ(static_cast<int64_t>(count * (count - 1)), sum);
+    fprintf(stderr, ">>> Promise + Then + Get: %lu ops/ms\n", count * 1000 / (elapsed + 1));
+}
@@ -3,8 +3,11 @@
 
 #include <gtest/gtest.h>
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <typeinfo>
+#include <vector>
 
 #include "src/sync/micro_lock.h"
 #include "src/sync/posix_lock.h"
@@ -49,6 +52,24 @@ public:
         doTestRWLockOwner<LockType>();
     }
 
+    /**
+     * Let 'threadNum' threads take the lock for 'durationInMs', print the
+     * throughput and the fairness, i.e. the least / most acquisitions of
+     * one thread.
+     */
+    template <typename LockType>
+    void benchmarkLock(const char* name, int threadNum, int durationInMs)
+    {
+        doBenchmarkLock<LockType>(name, threadNum, durationInMs);
+    }
+
+    /** Like benchmarkLock(), one write lock in 'readsPerWrite' locks. */
+    template <typename RWLockType>
+    void benchmarkRWLock(const char* name, int threadNum, int durationInMs, int readsPerWrite)
+    {
+        doBenchmarkRWLock<RWLockType>(name, threadNum, durationInMs, readsPerWrite);
+    }
+
 private:
     template <typename LockType>
     struct LockInfo
@@ -56,9 +77,32 @@ private:
         LockType* lock;
     };
 
+    template <typename LockType>
+    struct BenchmarkInfo
+    {
+        LockType* lock;
+        volatile bool* stop;
+        uint64_t* shared;
+        uint64_t count;
+        int readsPerWrite;
+    };
+
     template <typename LockType>
     static void* processLock(void* args);
 
+    template <typename LockType>
+    static void* benchmarkLockThread(void* args);
+
+    template <typename LockType>
+    void doBenchmarkLock(const char* name, int threadNum, int durationInMs);
+
+    template <typename RWLockType>
+    static void* benchmarkRWLockThread(void* args);
+
+    template <typename RWLockType>
+    void doBenchmarkRWLock(const char* name, int threadNum, int durationInMs,
+                           int readsPerWrite);
+
     template <typename RWLockType>
     static void* processRWLock(void* args);
 
@@ -374,6 +418,106 @@ void LockTestFixture::doTestRWLockOwner()
     EXPECT_EQ(lock.GetWriteLockOwner(), 0);
 }
 
+template <typename LockType>
+void* LockTestFixture::benchmarkLockThread(void* args)
+{
+    BenchmarkInfo<LockType>* info = static_cast<BenchmarkInfo<LockType>*>(args);
+    while (!AtomicGet(info->stop))
+    {
+        info->lock->Lock();
+        ++*info->shared;
+        info->lock->Unlock();
+        ++info->count;
+    }
+    return NULL;
+}
+
+template <typename LockType>
+void LockTestFixture::doBenchmarkLock(const char* name, int threadNum, int durationInMs)
+{
+    LockType lock;
+    volatile bool stop = false;
+    uint64_t shared = 0;
+    std::vector<BenchmarkInfo<LockType> > infos(threadNum);
+    std::vector<pthread_t> tids(threadNum);
+    for (int i = 0; i < threadNum; ++i)
+    {
+        BenchmarkInfo<LockType> info = { &lock, &stop, &shared, 0, 0 };
+        infos[i] = info;
+        pthread_create(&tids[i], NULL, benchmarkLockThread<LockType>, &infos[i]);
+    }
+    ThisThread::SleepInMs(durationInMs);
+    AtomicSet(&stop, true);
+    uint64_t total = 0;
+    uint64_t least = UINT64_MAX;
+    uint64_t most = 0;
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        total += infos[i].count;
+        least = MIN(least, infos[i].count);
+        most = MAX(most, infos[i].count);
+    }
+    EXPECT_EQ(total, shared);
+    fprintf(stderr, ">>> %-13s %2d threads: %6lu ops/ms, fairness %.3f\n",
+            name, threadNum, total / durationInMs,
+            static_cast<double>(least) / (most + 1));
+}
+
+template <typename RWLockType>
+void* LockTestFixture::benchmarkRWLockThread(void* args)
+{
+    BenchmarkInfo<RWLockType>* info = static_cast<BenchmarkInfo<RWLockType>*>(args);
+    uint64_t sum = 0;
+    while (!AtomicGet(info->stop))
+    {
+        if (info->count % info->readsPerWrite == 0)
+        {
+            info->lock->WriteLock();
+            ++*info->shared;
+            info->lock->WriteUnlock();
+        }
+        else
+        {
+            info->lock->ReadLock();
+            sum += *info->shared;
+            info->lock->ReadUnlock();
+        }
+        ++info->count;
+    }
+    return reinterpret_cast<void*>(sum);
+}
+
+template <typename RWLockType>
+void LockTestFixture::doBenchmarkRWLock(const char* name, int threadNum, int durationInMs,
+                                        int readsPerWrite)
+{
+    RWLockType lock;
+    volatile bool stop = false;
+    uint64_t shared = 0;
+    std::vector<BenchmarkInfo<RWLockType> > infos(threadNum);
+    std::vector<pthread_t> tids(threadNum);
+    for (int i = 0; i < threadNum; ++i)
+    {
+        BenchmarkInfo<RWLockType> info = { &lock, &stop, &shared, 1, readsPerWrite };
+        infos[i] = info;
+        pthread_create(&tids[i], NULL, benchmarkRWLockThread<RWLockType>, &infos[i]);
+    }
+    ThisThread::SleepInMs(durationInMs);
+    AtomicSet(&stop, true);
+    uint64_t total = 0;
+    uint64_t writes = 0;
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_join(tids[i], NULL);
+        total += infos[i].count - 1;
+        writes += (infos[i].count - 1) / readsPerWrite;
+    }
+    EXPECT_EQ(writes, shared);
+    fprintf(stderr, ">>> %-17s %2d threads, 1 write per %d: %6lu ops/ms\n",
+            name, threadNum, readsPerWrite, total / durationInMs);
+}
+
 template <typename LockType>
 void LockTestFixture::criticalSectionOp(
         LockType* lock, int i)
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+#include "src/cpu/cpu.h"
+#include "src/sync/lock_profiler.h"
+#include "src/sync/micro_lock.h"
+#include "src/sync/posix_lock.h"
+#include "src/thread/this_thread.h"
+
+static const LockProfiler::LockStats* findLockStats(
+        const std::vector<LockProfiler::LockStats>& stats, const void* lock)
+{
+    for (size_t i = 0; i < stats.size(); ++i)
+    {
+        if (stats[i].lock == lock)
+        {
+            return &stats[i];
+        }
+    }
+    return NULL;
+}
+
+TEST(LockProfiler, Record)
+{
+    LockProfiler::Reset();
+    int fastLock;
+    int slowLock;
+    int outer;
+    for (int i = 0; i < 10; ++i)
+    {
+        LockProfiler::OnAcquire(&fastLock, "Fast", 20, false, NULL);
+        LockProfiler::OnRelease(&fastLock);
+    }
+    LockProfiler::OnAcquire(&outer, "Outer", 0, false, NULL);
+    LockProfiler::OnAcquire(&slowLock, "Slow", 1000, true, &fastLock);
+    LockProfiler::OnAcquire(&slowLock, "Slow", 5000, true, &slowLock);
+    ThisThread::SleepInMs(1);
+    LockProfiler::OnRelease(&slowLock);
+    LockProfiler::OnRelease(&slowLock);
+    LockProfiler::OnRelease(&outer);
+    // Not held: ignored.
+    LockProfiler::OnRelease(&fastLock);
+
+    std::vector<LockProfiler::LockStats> stats;
+    LockProfiler::GetStats(&stats);
+    const LockProfiler::LockStats* slow = findLockStats(stats, &slowLock);
+    const LockProfiler::LockStats* fast = findLockStats(stats, &fastLock);
+    const LockProfiler::LockStats* out = findLockStats(stats, &outer);
+    ASSERT_TRUE(slow != NULL && fast != NULL && out != NULL);
+    EXPECT_EQ(&slowLock, stats[0].lock);
+
+    EXPECT_STREQ("Slow", slow->type);
+    EXPECT_EQ(2UL, slow->acquisitions);
+    EXPECT_EQ(2UL, slow->contentions);
+    EXPECT_EQ(6000UL, slow->waitCycles);
+    EXPECT_EQ(5000UL, slow->maxWaitCycles);
+    EXPECT_EQ(1UL, slow->waitHistogram[9]);     // 1000 in [512, 1024)
+    EXPECT_EQ(1UL, slow->waitHistogram[12]);    // 5000 in [4096, 8192)
+    EXPECT_EQ(&slowLock, slow->slowest[0].address);
+    EXPECT_EQ(5000UL, slow->slowest[0].waitCycles);
+    EXPECT_EQ(&fastLock, slow->slowest[1].address);
+    EXPECT_EQ(1000UL, slow->slowest[1].waitCycles);
+    EXPECT_GT(slow->maxHoldCycles, GetCpuMHz() * 1000 / 2);
+    EXPECT_GE(out->holdCycles, slow->maxHoldCycles);
+
+    EXPECT_EQ(10UL, fast->acquisitions);
+    EXPECT_EQ(0UL, fast->contentions);
+    EXPECT_EQ(0UL, fast->waitCycles);
+    EXPECT_EQ(10UL, fast->waitHistogram[4]);    // 20 in [16, 32)
+    EXPECT_TRUE(fast->slowest[0].address == NULL);
+
+    LockProfiler::Dump(stderr, 3);
+    LockProfiler::Reset();
+    LockProfiler::GetStats(&stats);
+    EXPECT_TRUE(findLockStats(stats, &slowLock) == NULL);
+}
+
+TEST(LockProfiler, ManyLocks)
+{
+    LockProfiler::Reset();
+    std::vector<char> locks(LockProfiler::kMaxLocks + 100);
+    for (size_t i = 0; i < locks.size(); ++i)
+    {
+        LockProfiler::OnAcquire(&locks[i], "Many", 1, false, NULL);
+        LockProfiler::OnRelease(&locks[i]);
+    }
+    std::vector<LockProfiler::LockStats> stats;
+    LockProfiler::GetStats(&stats);
+    EXPECT_LE(stats.size(), static_cast<size_t>(LockProfiler::kMaxLocks));
+    EXPECT_EQ(locks.size(), stats.size() + LockProfiler::GetDroppedLocks());
+    LockProfiler::Reset();
+}
+
+#if LOCK_PROFILE_ENABLED
+
+struct ProfiledLocks
+{
+    MicroLock microLock;
+    SimpleMutex mutex;
+};
+
+static void* contendProfiledLocks(void* arg)
+{
+    ProfiledLocks* locks = static_cast<ProfiledLocks*>(arg);
+    for (int i = 0; i < 1000; ++i)
+    {
+        ScopedLock<MicroLock> microLock(locks->microLock);
+        ScopedLock<SimpleMutex> mutex(locks->mutex);
+        sched_yield();
+    }
+    return NULL;
+}
+
+TEST(LockProfiler, Hooks)
+{
+    LockProfiler::Reset();
+    ProfiledLocks locks;
+    pthread_t threads[4];
+    for (size_t i = 0; i < COUNT_OF(threads); ++i)
+    {
+        pthread_create(&threads[i], NULL, contendProfiledLocks, &locks);
+    }
+    for (size_t i = 0; i < COUNT_OF(threads); ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    std::vector<LockProfiler::LockStats> stats;
+    LockProfiler::GetStats(&stats);
+    const LockProfiler::LockStats* microLock = findLockStats(stats, &locks.microLock);
+    const LockProfiler::LockStats* mutex = findLockStats(stats, &locks.mutex);
+    ASSERT_TRUE(microLock != NULL && mutex != NULL);
+    EXPECT_EQ(4000UL, microLock->acquisitions);
+    EXPECT_EQ(4000UL, mutex->acquisitions);
+    EXPECT_GT(microLock->contentions, 0UL);
+    EXPECT_GT(microLock->holdCycles, mutex->holdCycles);
+    EXPECT_TRUE(microLock->slowest[0].address != NULL);
+    LockProfiler::Dump(stderr, 2);
+}
+
+#endif
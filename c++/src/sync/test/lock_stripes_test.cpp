@@ -0,0 +1,175 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/sync/atomic.h"
+#include "src/sync/lock_stripes.h"
+
+TEST(MicroLockVector, Basic)
+{
+    MicroLockVector locks(100);
+    EXPECT_EQ(100U, locks.Size());
+    locks.Lock(31);
+    EXPECT_TRUE(locks.IsLocked(31));
+    EXPECT_FALSE(locks.IsLocked(30));
+    EXPECT_FALSE(locks.IsLocked(32));
+
+    // Neighbours in the same word are independent.
+    EXPECT_TRUE(locks.TryLock(30));
+    EXPECT_FALSE(locks.TryLock(31));
+    locks.Unlock(30);
+    EXPECT_TRUE(locks.IsLocked(31));
+
+    uint64_t begin = GetCurrentTimeInUs();
+    EXPECT_FALSE(locks.TimedLock(31, 10000));
+    EXPECT_GE(GetCurrentTimeInUs() - begin, 10000UL);
+    locks.Unlock(31);
+    EXPECT_TRUE(locks.TimedLock(31, 10000));
+    locks.Unlock(31);
+
+    locks.Lock(99);
+    EXPECT_TRUE(locks.IsLocked(99));
+    locks.Unlock(99);
+    for (uint32_t i = 0; i < locks.Size(); ++i)
+    {
+        EXPECT_FALSE(locks.IsLocked(i));
+    }
+}
+
+TEST(LockStripes, Stripe)
+{
+    LockStripes<> stripes(50);
+    EXPECT_EQ(64U, stripes.GetStripeNum());
+
+    // Consecutive integers cover every stripe.
+    std::vector<int> hits(stripes.GetStripeNum(), 0);
+    for (int key = 0; key < 6400; ++key)
+    {
+        uint32_t stripe = stripes.GetStripeOf(key);
+        ASSERT_LT(stripe, stripes.GetStripeNum());
+        EXPECT_EQ(stripe, stripes.GetStripeOf(key));
+        ++hits[stripe];
+    }
+    for (size_t i = 0; i < hits.size(); ++i)
+    {
+        EXPECT_GT(hits[i], 50);
+        EXPECT_LT(hits[i], 150);
+    }
+
+    uint32_t indexes[] = { 7, 3, 7, 1, 3 };
+    EXPECT_EQ(3U, stripes.LockMany(indexes, COUNT_OF(indexes)));
+    EXPECT_EQ(1U, indexes[0]);
+    EXPECT_EQ(3U, indexes[1]);
+    EXPECT_EQ(7U, indexes[2]);
+    EXPECT_TRUE(stripes.IsLocked(3));
+    EXPECT_FALSE(stripes.TryLock(7));
+    stripes.UnlockMany(indexes, 3);
+    EXPECT_FALSE(stripes.IsLocked(1));
+    EXPECT_FALSE(stripes.IsLocked(7));
+    {
+        ScopedStripeLock<LockStripes<> > lock(&stripes, 5);
+        EXPECT_TRUE(stripes.IsLocked(5));
+    }
+    EXPECT_FALSE(stripes.IsLocked(5));
+}
+
+template <typename Stripes>
+struct StripedAccounts
+{
+    StripedAccounts(uint32_t stripeNum, size_t accountNum)
+        : stripes(stripeNum), balances(accountNum, 100), stop(false), count(0)
+    {
+    }
+
+    Stripes stripes;
+    std::vector<int64_t> balances;
+    volatile bool stop;
+    volatile uint64_t count;
+};
+
+// Move money between random pairs of accounts, locking both stripes.
+template <typename Stripes>
+static void* transfer(void* arg)
+{
+    StripedAccounts<Stripes>* accounts = static_cast<StripedAccounts<Stripes>*>(arg);
+    uint64_t random = reinterpret_cast<uint64_t>(&random);
+    uint64_t count = 0;
+    while (!AtomicGet(&accounts->stop))
+    {
+        random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t from = (random >> 33) % accounts->balances.size();
+        size_t to = (random >> 13) % accounts->balances.size();
+        uint32_t indexes[] = {
+            accounts->stripes.GetStripeOf(from),
+            accounts->stripes.GetStripeOf(to),
+        };
+        ScopedMultiStripeLock<Stripes> lock(&accounts->stripes, indexes, COUNT_OF(indexes));
+        accounts->balances[from] -= 7;
+        accounts->balances[to] += 7;
+        ++count;
+    }
+    AtomicAdd(&accounts->count, count);
+    return NULL;
+}
+
+// Return the transfers per ms of 'threadNum' threads.
+template <typename Stripes>
+static uint64_t runTransfers(uint32_t stripeNum, size_t accountNum, int threadNum,
+                             int durationInMs)
+{
+    StripedAccounts<Stripes> accounts(stripeNum, accountNum);
+    std::vector<pthread_t> threads(threadNum);
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_create(&threads[i], NULL, transfer<Stripes>, &accounts);
+    }
+    usleep(durationInMs * 1000);
+    AtomicSet(&accounts.stop, true);
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    int64_t total = 0;
+    for (size_t i = 0; i < accounts.balances.size(); ++i)
+    {
+        total += accounts.balances[i];
+    }
+    EXPECT_EQ(static_cast<int64_t>(accountNum) * 100, total);
+    for (uint32_t i = 0; i < accounts.stripes.GetStripeNum(); ++i)
+    {
+        EXPECT_FALSE(accounts.stripes.IsLocked(i));
+    }
+    return accounts.count / durationInMs;
+}
+
+TEST(LockStripes, MultiThread)
+{
+    EXPECT_GT(runTransfers<LockStripes<PaddedLockArray> >(16, 1000, 8, 100), 0UL);
+    EXPECT_GT(runTransfers<LockStripes<PackedLockArray> >(16, 1000, 8, 100), 0UL);
+    // Collisions on few stripes, and stripes shared by the pair.
+    EXPECT_GT(runTransfers<LockStripes<PackedLockArray> >(2, 1000, 8, 100), 0UL);
+}
+
+TEST(LockStripes, Benchmark)
+{
+    const uint32_t stripeNums[] = { 1, 64, 4096 };
+    for (size_t i = 0; i < COUNT_OF(stripeNums); ++i)
+    {
+        for (int threadNum = 1; threadNum <= 16; threadNum *= 4)
+        {
+            uint32_t stripeNum = stripeNums[i];
+            uint64_t padded = runTransfers<LockStripes<PaddedLockArray> >(
+                    stripeNum, 100000, threadNum, 200);
+            uint64_t packed = runTransfers<LockStripes<PackedLockArray> >(
+                    stripeNum, 100000, threadNum, 200);
+            fprintf(stderr, ">>> %u stripes, %d threads: padded %lu transfers/ms "
+                    "(%u bytes), packed %lu transfers/ms (%u bytes)\n",
+                    stripeNum, threadNum, padded, stripeNum * 64, packed,
+                    (stripeNum + 31) / 32 * 4);
+        }
+    }
+}
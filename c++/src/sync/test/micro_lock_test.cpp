@@ -1,5 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <pthread.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/cpu/cpu.h"
 #include "src/sync/test/lock_common_test.h"
 
 class MicroLockTestFixture : public LockTestFixture
@@ -31,3 +38,96 @@ TEST_F(MicroLockTestFixture, Owner)
     testRWLockOwner<MicroRWLock>();
     testRWLockOwner<MicroRWLockPreferWrite>();
 }
+
+TEST_F(MicroLockTestFixture, ScopedReaderWriter)
+{
+    MicroRWLock lock;
+    {
+        ScopedReaderLocker<MicroRWLock> reader(&lock);
+        EXPECT_TRUE(lock.IsReadLocked());
+        EXPECT_FALSE(lock.TryWriteLock());
+    }
+    STONE_SCOPED_RLOCK(lock)
+    {
+        EXPECT_TRUE(lock.IsReadLocked());
+    }
+    STONE_SCOPED_WLOCK(lock)
+    {
+        EXPECT_TRUE(lock.IsWriteLocked());
+    }
+    EXPECT_FALSE(lock.IsLocked());
+}
+
+template <typename LockType>
+struct LatencyTestArgs
+{
+    LockType* lock;
+    int rounds;
+    volatile uint64_t* counter;
+    std::vector<uint64_t> cycles;   // to acquire, per round
+};
+
+template <typename LockType>
+static void* lockForLatency(void* arg)
+{
+    LatencyTestArgs<LockType>* args = static_cast<LatencyTestArgs<LockType>*>(arg);
+    args->cycles.reserve(args->rounds);
+    for (int i = 0; i < args->rounds; ++i)
+    {
+        uint64_t start = GetCpuCycles();
+        args->lock->Lock();
+        args->cycles.push_back(GetCpuCycles() - start);
+        // A short critical section
+        for (int j = 0; j < 20; ++j)
+        {
+            ++*args->counter;
+        }
+        args->lock->Unlock();
+    }
+    return NULL;
+}
+
+// Print the percentiles of the time to acquire 'lock' with 'threadNum'
+// threads contending.
+template <typename LockType>
+static void printLockLatency(const char* name, int threadNum, int totalRounds)
+{
+    LockType lock;
+    volatile uint64_t counter = 0;
+    std::vector<LatencyTestArgs<LockType> > args(threadNum);
+    std::vector<pthread_t> threads(threadNum);
+    uint64_t start = GetCurrentTimeInUs();
+    for (int i = 0; i < threadNum; ++i)
+    {
+        args[i].lock = &lock;
+        args[i].rounds = totalRounds / threadNum;
+        args[i].counter = &counter;
+        pthread_create(&threads[i], NULL, lockForLatency<LockType>, &args[i]);
+    }
+    std::vector<uint64_t> cycles;
+    for (int i = 0; i < threadNum; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        cycles.insert(cycles.end(), args[i].cycles.begin(), args[i].cycles.end());
+    }
+    uint64_t elapsed = GetCurrentTimeInUs() - start;
+    EXPECT_EQ(cycles.size() * 20, counter);
+    std::sort(cycles.begin(), cycles.end());
+    double cyclesPerUs = GetCpuMHz();
+    size_t n = cycles.size();
+    fprintf(stderr, ">>> %-11s %2d threads: %6lu ops/ms, latency us p50 %.2f p99 %.2f "
+            "p99.9 %.2f max %.2f\n",
+            name, threadNum, n * 1000 / (elapsed + 1),
+            cycles[n / 2] / cyclesPerUs, cycles[n * 99 / 100] / cyclesPerUs,
+            cycles[n * 999 / 1000] / cyclesPerUs, cycles[n - 1] / cyclesPerUs);
+}
+
+TEST_F(MicroLockTestFixture, LatencyBenchmark)
+{
+    const int totalRounds = 200000;
+    for (int threadNum = 2; threadNum <= 64; threadNum *= 2)
+    {
+        printLockLatency<MicroLock>("MicroLock", threadNum, totalRounds);
+        printLockLatency<SimpleMutex>("SimpleMutex", threadNum, totalRounds);
+    }
+}
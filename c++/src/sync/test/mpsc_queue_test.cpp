@@ -0,0 +1,177 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/base/intrusive_list.h"
+#include "src/sync/mpsc_queue.h"
+#include "src/sync/posix_lock.h"
+#include "src/sync/scoped_lock.h"
+
+struct QueueItem
+{
+    int producer;
+    int sequence;
+    MpscQueueNode node;
+    LinkNode link;
+
+    QueueItem() : producer(0), sequence(0) {}
+};
+
+typedef IntrusiveMpscQueue<QueueItem, &QueueItem::node> ItemQueue;
+
+struct CollectItem
+{
+    explicit CollectItem(std::vector<QueueItem*>* o) : out(o) {}
+    void operator()(QueueItem* item) { out->push_back(item); }
+    std::vector<QueueItem*>* out;
+};
+
+TEST(IntrusiveMpscQueue, Basic)
+{
+    ItemQueue queue;
+    EXPECT_TRUE(queue.Empty());
+    EXPECT_TRUE(queue.Pop() == NULL);
+
+    std::vector<QueueItem> items(10);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        items[i].sequence = i;
+        EXPECT_EQ(i == 0, queue.Push(&items[i]));
+    }
+    EXPECT_FALSE(queue.Empty());
+    EXPECT_EQ(&items[0], queue.Pop());
+    EXPECT_EQ(&items[1], queue.Pop());
+
+    // Batch drain, in order and bounded
+    std::vector<QueueItem*> drained;
+    EXPECT_EQ(3UL, queue.Drain(CollectItem(&drained), 3));
+    EXPECT_EQ(5UL, queue.Drain(CollectItem(&drained)));
+    ASSERT_EQ(8UL, drained.size());
+    for (size_t i = 0; i < drained.size(); ++i)
+    {
+        EXPECT_EQ(&items[i + 2], drained[i]);
+    }
+    EXPECT_TRUE(queue.Empty());
+    EXPECT_TRUE(queue.Pop() == NULL);
+
+    // Reuse popped objects, and interleave with pops.
+    EXPECT_TRUE(queue.Push(&items[0]));
+    EXPECT_EQ(&items[0], queue.Pop());
+    EXPECT_TRUE(queue.Push(&items[0]));
+    EXPECT_FALSE(queue.Push(&items[1]));
+    EXPECT_EQ(&items[0], queue.Pop());
+    EXPECT_FALSE(queue.Push(&items[2]));
+    EXPECT_EQ(&items[1], queue.Pop());
+    EXPECT_EQ(&items[2], queue.Pop());
+    EXPECT_TRUE(queue.Pop() == NULL);
+}
+
+struct ProducerArgs
+{
+    ItemQueue* queue;
+    SimpleMutex* mutex;
+    IntrusiveList<QueueItem, &QueueItem::link>* list;
+    QueueItem* items;
+    int count;
+};
+
+static void* produceToQueue(void* arg)
+{
+    ProducerArgs* args = static_cast<ProducerArgs*>(arg);
+    for (int i = 0; i < args->count; ++i)
+    {
+        args->queue->Push(&args->items[i]);
+    }
+    return NULL;
+}
+
+static void* produceToList(void* arg)
+{
+    ProducerArgs* args = static_cast<ProducerArgs*>(arg);
+    for (int i = 0; i < args->count; ++i)
+    {
+        ScopedLock<SimpleMutex> lock(*args->mutex);
+        args->list->push_back(&args->items[i]);
+    }
+    return NULL;
+}
+
+// Push from 'producerNum' threads and pop from this one, return the elapsed
+// time in us.
+static uint64_t runQueue(int producerNum, int countPerProducer, bool useQueue)
+{
+    ItemQueue queue;
+    SimpleMutex mutex;
+    IntrusiveList<QueueItem, &QueueItem::link> list;
+    std::vector<QueueItem> items(producerNum * countPerProducer);
+    std::vector<ProducerArgs> args(producerNum);
+    std::vector<pthread_t> threads(producerNum);
+    uint64_t start = GetCurrentTimeInUs();
+    for (int p = 0; p < producerNum; ++p)
+    {
+        QueueItem* begin = &items[p * countPerProducer];
+        for (int i = 0; i < countPerProducer; ++i)
+        {
+            begin[i].producer = p;
+            begin[i].sequence = i;
+        }
+        ProducerArgs a = { &queue, &mutex, &list, begin, countPerProducer };
+        args[p] = a;
+        pthread_create(&threads[p], NULL, useQueue ? produceToQueue : produceToList, &args[p]);
+    }
+
+    // Objects of each producer come out in order.
+    std::vector<int> expected(producerNum, 0);
+    int popped = 0;
+    while (popped < producerNum * countPerProducer)
+    {
+        QueueItem* item = NULL;
+        if (useQueue)
+        {
+            item = queue.Pop();
+        }
+        else
+        {
+            ScopedLock<SimpleMutex> lock(mutex);
+            item = list.empty() ? NULL : list.pop_front();
+        }
+        if (item == NULL)
+        {
+            asm volatile("pause");
+            continue;
+        }
+        EXPECT_EQ(expected[item->producer], item->sequence);
+        expected[item->producer] = item->sequence + 1;
+        ++popped;
+    }
+    uint64_t elapsed = GetCurrentTimeInUs() - start;
+    for (int p = 0; p < producerNum; ++p)
+    {
+        pthread_join(threads[p], NULL);
+    }
+    EXPECT_TRUE(queue.Empty());
+    return elapsed;
+}
+
+TEST(IntrusiveMpscQueue, MultiProducer)
+{
+    runQueue(4, 100000, true);
+}
+
+TEST(IntrusiveMpscQueue, Benchmark)
+{
+    const int count = 1000000;
+    for (int producerNum = 1; producerNum <= 8; producerNum *= 2)
+    {
+        int countPerProducer = count / producerNum;
+        uint64_t queueTime = runQueue(producerNum, countPerProducer, true);
+        uint64_t listTime = runQueue(producerNum, countPerProducer, false);
+        fprintf(stderr, ">>> %d producers: IntrusiveMpscQueue %lu ops/ms, "
+                "SimpleMutex + IntrusiveList %lu ops/ms\n",
+                producerNum,
+                count * 1000UL / (queueTime + 1), count * 1000UL / (listTime + 1));
+    }
+}
@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/sync/ring_buffer.h"
+
+template <typename Ring>
+static void testBasic()
+{
+    Ring ring(6);
+    EXPECT_EQ(8UL, ring.Capacity());
+    EXPECT_TRUE(ring.Empty());
+    uint64_t value = 0;
+    EXPECT_FALSE(ring.Pop(&value));
+
+    // Wrap around a few times.
+    uint64_t next = 0;
+    uint64_t expected = 0;
+    for (int round = 0; round < 10; ++round)
+    {
+        while (ring.Push(next))
+        {
+            ++next;
+        }
+        EXPECT_EQ(8UL, ring.Size());
+        for (int i = 0; i < 5; ++i)
+        {
+            ASSERT_TRUE(ring.Pop(&value));
+            EXPECT_EQ(expected++, value);
+        }
+    }
+
+    // Batches are cut at the capacity.
+    uint64_t values[16];
+    EXPECT_EQ(3UL, ring.PopBatch(values, 16));
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(expected++, values[i]);
+    }
+    EXPECT_TRUE(ring.Empty());
+    for (int i = 0; i < 16; ++i)
+    {
+        values[i] = 100 + i;
+    }
+    EXPECT_EQ(8UL, ring.PushBatch(values, 16));
+    EXPECT_EQ(0UL, ring.PushBatch(values, 16));
+    EXPECT_EQ(2UL, ring.PopBatch(values, 2));
+    EXPECT_EQ(100UL, values[0]);
+    EXPECT_EQ(101UL, values[1]);
+    EXPECT_EQ(6UL, ring.Size());
+}
+
+TEST(RingBuffer, Basic)
+{
+    testBasic<SpscRingBuffer<uint64_t> >();
+    testBasic<MpmcRingBuffer<uint64_t> >();
+}
+
+template <typename Ring>
+struct RingTestArgs
+{
+    Ring* ring;
+    int id;
+    uint64_t count;
+    size_t batch;
+    uint64_t sum;
+};
+
+// Values are (producer id << 32 | sequence), so consumers can check the
+// order per producer.
+template <typename Ring>
+static void* produceToRing(void* arg)
+{
+    RingTestArgs<Ring>* args = static_cast<RingTestArgs<Ring>*>(arg);
+    std::vector<uint64_t> values(args->batch);
+    uint64_t sent = 0;
+    while (sent < args->count)
+    {
+        size_t n = 0;
+        for (; n < args->batch && sent + n < args->count; ++n)
+        {
+            values[n] = (static_cast<uint64_t>(args->id) << 32) | (sent + n);
+        }
+        const uint64_t* p = &values[0];
+        while (n > 0)
+        {
+            size_t pushed = args->ring->PushBatch(p, n);
+            if (pushed == 0)
+            {
+                sched_yield();
+            }
+            p += pushed;
+            n -= pushed;
+            sent += pushed;
+        }
+    }
+    return NULL;
+}
+
+template <typename Ring>
+static void* consumeFromRing(void* arg)
+{
+    RingTestArgs<Ring>* args = static_cast<RingTestArgs<Ring>*>(arg);
+    std::vector<uint64_t> values(args->batch);
+    std::vector<uint64_t> lastSequence(64, 0);
+    uint64_t received = 0;
+    while (received < args->count)
+    {
+        size_t n = args->ring->PopBatch(&values[0], MIN(args->batch, args->count - received));
+        if (n == 0)
+        {
+            sched_yield();
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            uint64_t producer = values[i] >> 32;
+            uint64_t sequence = values[i] & 0xFFFFFFFF;
+            // Order per producer holds within one consumer.
+            EXPECT_LT(lastSequence[producer], sequence + 1);
+            lastSequence[producer] = sequence + 1;
+            args->sum += sequence;
+        }
+        received += n;
+    }
+    return NULL;
+}
+
+// Run 'producerNum' producers and 'consumerNum' consumers over a ring, check
+// every value arrives once, and return the elapsed time in us.
+template <typename Ring>
+static uint64_t runRing(int producerNum, int consumerNum, uint64_t countPerProducer,
+                        size_t batch)
+{
+    Ring ring(1024);
+    uint64_t total = countPerProducer * producerNum;
+    std::vector<RingTestArgs<Ring> > producers(producerNum);
+    std::vector<RingTestArgs<Ring> > consumers(consumerNum);
+    std::vector<pthread_t> threads(producerNum + consumerNum);
+    uint64_t start = GetCurrentTimeInUs();
+    for (int i = 0; i < consumerNum; ++i)
+    {
+        RingTestArgs<Ring> args = { &ring, i, total / consumerNum, batch, 0 };
+        if (i == 0)
+        {
+            args.count += total % consumerNum;
+        }
+        consumers[i] = args;
+        pthread_create(&threads[i], NULL, consumeFromRing<Ring>, &consumers[i]);
+    }
+    for (int i = 0; i < producerNum; ++i)
+    {
+        RingTestArgs<Ring> args = { &ring, i, countPerProducer, batch, 0 };
+        producers[i] = args;
+        pthread_create(&threads[consumerNum + i], NULL, produceToRing<Ring>, &producers[i]);
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = GetCurrentTimeInUs() - start;
+    uint64_t sum = 0;
+    for (int i = 0; i < consumerNum; ++i)
+    {
+        sum += consumers[i].sum;
+    }
+    EXPECT_EQ(producerNum * (countPerProducer * (countPerProducer - 1) / 2), sum);
+    EXPECT_TRUE(ring.Empty());
+    return elapsed;
+}
+
+TEST(RingBuffer, MultiThread)
+{
+    runRing<SpscRingBuffer<uint64_t> >(1, 1, 1000000, 1);
+    runRing<SpscRingBuffer<uint64_t> >(1, 1, 1000000, 7);
+    runRing<MpmcRingBuffer<uint64_t> >(4, 4, 200000, 1);
+    runRing<MpmcRingBuffer<uint64_t> >(4, 4, 200000, 7);
+    // The blocking ones park when full or empty.
+    runRing<BlockingRingBuffer<SpscRingBuffer<uint64_t> > >(1, 1, 1000000, 16);
+    runRing<BlockingRingBuffer<MpmcRingBuffer<uint64_t> > >(4, 2, 200000, 1);
+    runRing<BlockingRingBuffer<MpmcRingBuffer<uint64_t> > >(2, 4, 200000, 5);
+}
+
+TEST(RingBuffer, BlockingTimeout)
+{
+    BlockingRingBuffer<MpmcRingBuffer<int> > ring(4);
+    int value = 0;
+    uint64_t start = GetCurrentTimeInUs();
+    EXPECT_FALSE(ring.TimedPop(&value, 20000));
+    EXPECT_GE(GetCurrentTimeInUs() - start, 20000UL);
+    ring.Push(3);
+    EXPECT_TRUE(ring.TimedPop(&value, 20000));
+    EXPECT_EQ(3, value);
+    EXPECT_TRUE(ring.TryPush(4));
+    EXPECT_TRUE(ring.TryPop(&value));
+    EXPECT_FALSE(ring.TryPop(&value));
+}
+
+template <typename Ring>
+static void testZeroCountBatch()
+{
+    Ring ring(4);
+    uint64_t values[2] = { 7, 8 };
+    ring.PushBatch(values, 2);
+    // Neither blocks nor touches 'values'.
+    EXPECT_EQ(0UL, ring.PopBatch(values + 2, 0));
+    EXPECT_EQ(0UL, ring.PushBatch(values, 0));
+    EXPECT_EQ(2UL, ring.Size());
+    EXPECT_EQ(2UL, ring.PopBatch(values, 2));
+    EXPECT_EQ(7UL, values[0]);
+    EXPECT_EQ(8UL, values[1]);
+    EXPECT_EQ(0UL, ring.PopBatch(values + 2, 0));
+}
+
+TEST(RingBuffer, ZeroCountBatch)
+{
+    testZeroCountBatch<SpscRingBuffer<uint64_t> >();
+    testZeroCountBatch<MpmcRingBuffer<uint64_t> >();
+    testZeroCountBatch<BlockingRingBuffer<SpscRingBuffer<uint64_t> > >();
+    testZeroCountBatch<BlockingRingBuffer<MpmcRingBuffer<uint64_t> > >();
+}
+
+TEST(RingBuffer, Benchmark)
+{
+    const uint64_t count = 4000000;
+    const size_t batches[] = { 1, 16 };
+    for (size_t b = 0; b < COUNT_OF(batches); ++b)
+    {
+        size_t batch = batches[b];
+        uint64_t spsc = runRing<SpscRingBuffer<uint64_t> >(1, 1, count, batch);
+        uint64_t mpmc = runRing<MpmcRingBuffer<uint64_t> >(1, 1, count, batch);
+        uint64_t mpmc4 = runRing<MpmcRingBuffer<uint64_t> >(4, 4, count / 4, batch);
+        uint64_t blocking = runRing<BlockingRingBuffer<MpmcRingBuffer<uint64_t> > >(
+                4, 4, count / 4, batch);
+        fprintf(stderr, ">>> batch %lu: SPSC %lu ops/ms, MPMC 1:1 %lu ops/ms, "
+                "MPMC 4:4 %lu ops/ms, blocking MPMC 4:4 %lu ops/ms\n",
+                batch, count * 1000 / (spsc + 1), count * 1000 / (mpmc + 1),
+                count * 1000 / (mpmc4 + 1), count * 1000 / (blocking + 1));
+    }
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <vector>
+
+#include "src/base/gettime.h"
+#include "src/sync/atomic.h"
+#include "src/sync/micro_lock.h"
+#include "src/sync/scoped_lock.h"
+#include "src/sync/seq_lock.h"
+
+// Consistent when all fields are equal.
+struct SeqLockValue
+{
+    uint64_t fields[8];
+};
+
+static SeqLockValue makeSeqLockValue(uint64_t v)
+{
+    SeqLockValue value;
+    for (size_t i = 0; i < COUNT_OF(value.fields); ++i)
+    {
+        value.fields[i] = v;
+    }
+    return value;
+}
+
+static bool isConsistent(const SeqLockValue& value)
+{
+    for (size_t i = 1; i < COUNT_OF(value.fields); ++i)
+    {
+        if (value.fields[i] != value.fields[0])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(SeqLock, Basic)
+{
+    SeqLock<SeqLockValue> lock(makeSeqLockValue(3));
+    EXPECT_EQ(3UL, lock.Read().fields[7]);
+    lock.Write(makeSeqLockValue(5));
+    EXPECT_EQ(5UL, lock.Read().fields[0]);
+
+    {
+        ScopedWriterLocker<SeqLock<SeqLockValue> > locker(&lock);
+        for (size_t i = 0; i < 8; ++i)
+        {
+            ++lock.MutableValue()->fields[i];
+        }
+    }
+    EXPECT_TRUE(isConsistent(lock.Read()));
+    EXPECT_EQ(6UL, lock.Read().fields[3]);
+
+    uint32_t sequence;
+    uint64_t first;
+    do
+    {
+        sequence = lock.ReadBegin();
+        first = lock.Value().fields[0];
+    }
+    while (lock.ReadRetry(sequence));
+    EXPECT_EQ(6UL, first);
+}
+
+struct SeqLockTestArgs
+{
+    SeqLock<SeqLockValue>* seqLock;
+    MicroRWLock* rwLock;
+    SeqLockValue* rwValue;
+    volatile bool* stop;
+    uint64_t reads;
+};
+
+static void* readSeqLock(void* arg)
+{
+    SeqLockTestArgs* args = static_cast<SeqLockTestArgs*>(arg);
+    while (!AtomicGet(args->stop))
+    {
+        SeqLockValue value = args->seqLock->Read();
+        EXPECT_TRUE(isConsistent(value));
+        ++args->reads;
+    }
+    return NULL;
+}
+
+static void* readRWLock(void* arg)
+{
+    SeqLockTestArgs* args = static_cast<SeqLockTestArgs*>(arg);
+    while (!AtomicGet(args->stop))
+    {
+        args->rwLock->ReadLock();
+        SeqLockValue value = *args->rwValue;
+        args->rwLock->ReadUnlock();
+        EXPECT_TRUE(isConsistent(value));
+        ++args->reads;
+    }
+    return NULL;
+}
+
+// Read with 'readerNum' threads while this one writes every
+// 'writeIntervalInUs', return the reads per ms.
+static uint64_t runReaders(bool useSeqLock, int readerNum, int durationInMs,
+                           uint64_t writeIntervalInUs)
+{
+    SeqLock<SeqLockValue> seqLock(makeSeqLockValue(0));
+    MicroRWLock rwLock;
+    SeqLockValue rwValue = makeSeqLockValue(0);
+    volatile bool stop = false;
+    std::vector<SeqLockTestArgs> args(readerNum);
+    std::vector<pthread_t> threads(readerNum);
+    for (int i = 0; i < readerNum; ++i)
+    {
+        SeqLockTestArgs a = { &seqLock, &rwLock, &rwValue, &stop, 0 };
+        args[i] = a;
+        pthread_create(&threads[i], NULL, useSeqLock ? readSeqLock : readRWLock, &args[i]);
+    }
+    uint64_t start = GetCurrentTimeInUs();
+    uint64_t next = start;
+    for (uint64_t v = 1; GetCurrentTimeInUs() - start < durationInMs * 1000UL; ++v)
+    {
+        if (useSeqLock)
+        {
+            seqLock.Write(makeSeqLockValue(v));
+        }
+        else
+        {
+            rwLock.WriteLock();
+            rwValue = makeSeqLockValue(v);
+            rwLock.WriteUnlock();
+        }
+        next += writeIntervalInUs;
+        while (GetCurrentTimeInUs() < next)
+        {
+            sched_yield();
+        }
+    }
+    AtomicSet(&stop, true);
+    uint64_t reads = 0;
+    for (int i = 0; i < readerNum; ++i)
+    {
+        pthread_join(threads[i], NULL);
+        reads += args[i].reads;
+    }
+    return reads / durationInMs;
+}
+
+TEST(SeqLock, MultiThread)
+{
+    runReaders(true, 4, 100, 0);
+}
+
+TEST(SeqLock, Benchmark)
+{
+    for (int readerNum = 1; readerNum <= 8; readerNum *= 2)
+    {
+        uint64_t seqLock = runReaders(true, readerNum, 200, 100);
+        uint64_t rwLock = runReaders(false, readerNum, 200, 100);
+        fprintf(stderr, ">>> %d readers, a write per 100us: SeqLock %lu reads/ms, "
+                "MicroRWLock %lu reads/ms\n", readerNum, seqLock, rwLock);
+    }
+}
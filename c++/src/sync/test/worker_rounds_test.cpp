@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+
+#include "src/base/gettime.h"
+#include "src/sync/atomic.h"
+#include "src/sync/worker_rounds.h"
+
+struct RoundsTestArgs
+{
+    WorkerRounds rounds;
+    volatile int64_t handed;
+    volatile int64_t processed;
+    volatile int32_t stop;
+};
+
+static void* drainInRounds(void* arg)
+{
+    RoundsTestArgs* args = static_cast<RoundsTestArgs*>(arg);
+    while (AtomicGet(&args->stop) == 0)
+    {
+        args->rounds.BeginRound();
+        int64_t handed = AtomicGet(&args->handed);
+        bool idle = handed == AtomicGet(&args->processed);
+        AtomicSet(&args->processed, handed);
+        args->rounds.EndRound(idle, 1000 * 1000);
+    }
+    return NULL;
+}
+
+TEST(WorkerRounds, WaitForRound)
+{
+    RoundsTestArgs args;
+    args.handed = 0;
+    args.processed = 0;
+    args.stop = 0;
+    pthread_t worker;
+    ASSERT_EQ(0, pthread_create(&worker, NULL, drainInRounds, &args));
+
+    // The worker sleeps for a second when idle, WaitForRound wakes it up.
+    uint64_t start = GetCurrentTimeInUs();
+    for (int64_t i = 1; i <= 1000; ++i)
+    {
+        AtomicSet(&args.handed, i);
+        if (i % 2 == 0)
+        {
+            args.rounds.WakeUp();
+        }
+        args.rounds.WaitForRound(1000 * 1000);
+        ASSERT_EQ(i, AtomicGet(&args.processed));
+    }
+    EXPECT_LT(GetCurrentTimeInUs() - start, 10 * 1000 * 1000UL);
+
+    AtomicSet(&args.stop, 1);
+    args.rounds.WakeUp();
+    ASSERT_EQ(0, pthread_join(worker, NULL));
+}
@@ -0,0 +1,114 @@
+#ifndef _SRC_SYNC_WORKER_ROUNDS_H
+#define _SRC_SYNC_WORKER_ROUNDS_H
+
+#include <limits.h>
+#include <stdint.h>
+
+#include "src/common/macros.h"
+#include "src/sync/atomic.h"
+#include "src/sync/futex.h"
+
+/**
+ * The handshake between a background thread which works in rounds, e.g.
+ * draining per-thread buffers, and the threads feeding or waiting for it.
+ *
+ * The worker brackets each round with BeginRound() and EndRound(), and
+ * after a round with nothing to do sleeps in EndRound() until WakeUp() or
+ * the interval passes.  WaitForRound() returns once a whole round has run
+ * after it was called, so everything handed over before is processed.
+ * All words are futexes; WakeUp() makes a system call only if the worker
+ * is asleep, EndRound() only if somebody waits.
+ *
+ * Usage:
+ *   // worker
+ *   while (true) { rounds.BeginRound(); bool idle = Drain(); rounds.EndRound(idle, kIntervalUs); }
+ *   // producers
+ *   Hand(record); rounds.WakeUp();
+ *   // flush
+ *   rounds.WaitForRound(kIntervalUs);
+ */
+class WorkerRounds
+{
+public:
+    WorkerRounds()
+        : mRounds(0), mWakeups(0), mSleeping(0), mRoundWaiters(0), mBeginWakeups(0)
+    {
+    }
+
+    /** By the worker, before looking for work. */
+    void BeginRound() { mBeginWakeups = AtomicGet(&mWakeups); }
+
+    /**
+     * By the worker, after a round.  If 'idle', sleep until woken up or
+     * 'sleepUs' passes; a WakeUp() since BeginRound() returns at once.
+     */
+    void EndRound(bool idle, int64_t sleepUs);
+
+    /** Wake up the worker if it sleeps. */
+    void WakeUp()
+    {
+        if (AtomicGet(&mSleeping) != 0)
+        {
+            AtomicInc(&mWakeups);
+            FutexWake(&mWakeups, 1);
+        }
+    }
+
+    /** A hint, to skip WakeUp() while the worker is busy anyway. */
+    bool IsSleeping() const { return AtomicGet(&mSleeping, std::memory_order_relaxed) != 0; }
+
+    /**
+     * Block until a round which began after the call has ended, waking up
+     * the worker every 'pollUs' meanwhile.  Must not be called by the worker.
+     */
+    void WaitForRound(int64_t pollUs);
+
+private:
+    volatile int32_t mRounds;       // Bumped after each round
+    volatile int32_t mWakeups;      // The worker sleeps on
+    volatile int32_t mSleeping;
+    volatile int32_t mRoundWaiters;
+    int32_t mBeginWakeups;          // Owned by the worker
+
+    DISALLOW_COPY_AND_ASSIGN(WorkerRounds);
+};
+
+inline void WorkerRounds::EndRound(bool idle, int64_t sleepUs)
+{
+    AtomicInc(&mRounds);
+    if (AtomicGet(&mRoundWaiters) != 0)
+    {
+        FutexWake(&mRounds, INT_MAX);
+    }
+    if (idle)
+    {
+        AtomicSet(&mSleeping, 1);
+        // Producers hand work over before reading mSleeping, the worker
+        // sets mSleeping before its futex re-reads mWakeups.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        FutexWait(&mWakeups, mBeginWakeups, sleepUs);
+        AtomicSet(&mSleeping, 0);
+    }
+}
+
+inline void WorkerRounds::WaitForRound(int64_t pollUs)
+{
+    // The round in progress may have passed what the caller handed over,
+    // so wait for the one after it too.
+    uint32_t target = AtomicGet(&mRounds) + 2;
+    AtomicInc(&mRoundWaiters);
+    while (true)
+    {
+        int32_t rounds = AtomicGet(&mRounds);
+        if (static_cast<int32_t>(rounds - target) >= 0)
+        {
+            break;
+        }
+        AtomicInc(&mWakeups);
+        FutexWake(&mWakeups, 1);
+        FutexWait(&mRounds, rounds, pollUs);
+    }
+    AtomicDec(&mRoundWaiters);
+}
+
+#endif  // _SRC_SYNC_WORKER_ROUNDS_H
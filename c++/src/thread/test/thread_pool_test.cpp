@@ -0,0 +1,337 @@
+#include <gtest/gtest.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <deque>
+#include <set>
+#include <vector>
+
+#include "src/base/closure.h"
+#include "src/base/gettime.h"
+#include "src/sync/atomic.h"
+#include "src/sync/cond.h"
+#include "src/thread/thread_pool.h"
+
+static void increase(volatile uint64_t* counter)
+{
+    AtomicInc(counter);
+}
+
+TEST(WorkStealingDeque, Basic)
+{
+    detail::WorkStealingDeque deque(4);
+    stone::Closure<void>* tasks[5];
+    for (int i = 0; i < 5; ++i)
+    {
+        tasks[i] = stone::NewPermanentClosure(&increase, static_cast<volatile uint64_t*>(NULL));
+    }
+    EXPECT_TRUE(deque.Pop() == NULL);
+    EXPECT_TRUE(deque.Steal() == NULL);
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_TRUE(deque.Push(tasks[i]));
+    }
+    EXPECT_FALSE(deque.Push(tasks[4]));
+    EXPECT_EQ(4UL, deque.Size());
+    // The owner takes the newest, thieves the oldest.
+    EXPECT_EQ(tasks[3], deque.Pop());
+    EXPECT_EQ(tasks[0], deque.Steal());
+    EXPECT_EQ(tasks[1], deque.Steal());
+    EXPECT_EQ(tasks[2], deque.Pop());
+    EXPECT_TRUE(deque.Pop() == NULL);
+    EXPECT_EQ(0UL, deque.Size());
+    for (int i = 0; i < 5; ++i)
+    {
+        delete tasks[i];
+    }
+}
+
+struct StealArgs
+{
+    detail::WorkStealingDeque* deque;
+    volatile bool* stop;
+    std::vector<google::protobuf::Closure*> stolen;
+};
+
+static void* stealFromDeque(void* arg)
+{
+    StealArgs* args = static_cast<StealArgs*>(arg);
+    while (!AtomicGet(args->stop) || args->deque->Size() != 0)
+    {
+        google::protobuf::Closure* task = args->deque->Steal();
+        if (task != NULL)
+        {
+            args->stolen.push_back(task);
+        }
+    }
+    return NULL;
+}
+
+TEST(WorkStealingDeque, Concurrent)
+{
+    const int count = 200000;
+    detail::WorkStealingDeque deque(256);
+    // Tasks are only used as distinct pointers here.
+    std::vector<char> storage(count);
+    volatile bool stop = false;
+    StealArgs args[3];
+    pthread_t threads[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        args[i].deque = &deque;
+        args[i].stop = &stop;
+        pthread_create(&threads[i], NULL, stealFromDeque, &args[i]);
+    }
+    std::vector<google::protobuf::Closure*> popped;
+    for (int i = 0; i < count; ++i)
+    {
+        google::protobuf::Closure* task =
+            reinterpret_cast<google::protobuf::Closure*>(&storage[i]);
+        while (!deque.Push(task))
+        {
+            sched_yield();
+        }
+        if (i % 3 == 0)
+        {
+            google::protobuf::Closure* p = deque.Pop();
+            if (p != NULL)
+            {
+                popped.push_back(p);
+            }
+        }
+    }
+    AtomicSet(&stop, true);
+    for (int i = 0; i < 3; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Every task is taken exactly once.
+    std::set<google::protobuf::Closure*> taken(popped.begin(), popped.end());
+    size_t total = popped.size();
+    for (int i = 0; i < 3; ++i)
+    {
+        taken.insert(args[i].stolen.begin(), args[i].stolen.end());
+        total += args[i].stolen.size();
+    }
+    EXPECT_EQ(static_cast<size_t>(count), total);
+    EXPECT_EQ(static_cast<size_t>(count), taken.size());
+}
+
+TEST(ThreadPool, Submit)
+{
+    ThreadPool pool(4);
+    pool.Start();
+    volatile uint64_t counter = 0;
+    for (int i = 0; i < 100000; ++i)
+    {
+        pool.Submit(stone::NewClosure(&increase, &counter));
+    }
+    // Stop() runs everything queued.
+    pool.Stop();
+    EXPECT_EQ(100000UL, counter);
+
+    // Restart, with pinned workers.
+    ThreadPool pinned(2, true);
+    pinned.Start();
+    EXPECT_EQ(-1, pinned.GetCurrentWorkerIndex());
+    for (int i = 0; i < 1000; ++i)
+    {
+        pinned.Submit(stone::NewClosure(&increase, &counter));
+    }
+    pinned.Stop();
+    EXPECT_EQ(101000UL, counter);
+}
+
+static const size_t kSumGrain = 1024;
+
+static uint64_t parallelSum(ThreadPool* pool, const uint64_t* data, size_t begin, size_t end);
+
+// Sum of a range as a forked subtask.
+struct SumTask : public google::protobuf::Closure
+{
+    SumTask(ThreadPool* p, const uint64_t* d, size_t b, size_t e)
+        : pool(p), data(d), begin(b), end(e), result(0), done(false) {}
+
+    virtual void Run()
+    {
+        result = parallelSum(pool, data, begin, end);
+        MemoryBarrier();
+        AtomicSet(&done, true);
+    }
+
+    void Join()
+    {
+        // Help running tasks rather than blocking the worker.
+        while (!AtomicGet(&done))
+        {
+            if (!pool->RunPendingTask())
+            {
+                sched_yield();
+            }
+        }
+        MemoryBarrier();
+    }
+
+    ThreadPool* pool;
+    const uint64_t* data;
+    size_t begin;
+    size_t end;
+    uint64_t result;
+    volatile bool done;
+};
+
+static uint64_t parallelSum(ThreadPool* pool, const uint64_t* data, size_t begin, size_t end)
+{
+    if (end - begin <= kSumGrain)
+    {
+        uint64_t sum = 0;
+        for (size_t i = begin; i < end; ++i)
+        {
+            sum += data[i];
+        }
+        return sum;
+    }
+    size_t mid = begin + (end - begin) / 2;
+    SumTask left(pool, data, begin, mid);
+    pool->Submit(&left);
+    uint64_t right = parallelSum(pool, data, mid, end);
+    left.Join();
+    return left.result + right;
+}
+
+static uint64_t runForkJoin(ThreadPool* pool, const std::vector<uint64_t>& data)
+{
+    SumTask root(pool, &data[0], 0, data.size());
+    pool->Submit(&root);
+    root.Join();
+    return root.result;
+}
+
+TEST(ThreadPool, ForkJoin)
+{
+    std::vector<uint64_t> data(1 << 20);
+    uint64_t expected = 0;
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = i * 3;
+        expected += data[i];
+    }
+    ThreadPool pool(4);
+    pool.Start();
+    for (int round = 0; round < 5; ++round)
+    {
+        EXPECT_EQ(expected, runForkJoin(&pool, data));
+    }
+    pool.Stop();
+}
+
+// A single queue under one lock, the baseline of the benchmark.
+class MutexQueuePool
+{
+public:
+    explicit MutexQueuePool(int threadNum) : mThreads(threadNum), mStopping(false)
+    {
+        for (int i = 0; i < threadNum; ++i)
+        {
+            pthread_create(&mThreads[i], NULL, workerMain, this);
+        }
+    }
+
+    ~MutexQueuePool()
+    {
+        mCond.Lock();
+        mStopping = true;
+        mCond.Broadcast();
+        mCond.Unlock();
+        for (size_t i = 0; i < mThreads.size(); ++i)
+        {
+            pthread_join(mThreads[i], NULL);
+        }
+    }
+
+    void Submit(google::protobuf::Closure* task)
+    {
+        mCond.Lock();
+        mTasks.push_back(task);
+        mCond.Signal();
+        mCond.Unlock();
+    }
+
+private:
+    static void* workerMain(void* arg)
+    {
+        MutexQueuePool* pool = static_cast<MutexQueuePool*>(arg);
+        while (true)
+        {
+            pool->mCond.Lock();
+            while (pool->mTasks.empty() && !pool->mStopping)
+            {
+                pool->mCond.Wait();
+            }
+            if (pool->mTasks.empty())
+            {
+                pool->mCond.Unlock();
+                return NULL;
+            }
+            google::protobuf::Closure* task = pool->mTasks.front();
+            pool->mTasks.pop_front();
+            pool->mCond.Unlock();
+            task->Run();
+        }
+    }
+
+    std::vector<pthread_t> mThreads;
+    std::deque<google::protobuf::Closure*> mTasks;
+    bool mStopping;
+    ConditionVariable mCond;
+};
+
+TEST(ThreadPool, Benchmark)
+{
+    const int count = 1000000;
+    stone::Closure<void>* task = NULL;
+    volatile uint64_t counter = 0;
+    task = stone::NewPermanentClosure(&increase, &counter);
+    for (int threadNum = 1; threadNum <= 8; threadNum *= 2)
+    {
+        // Fine-grained tasks submitted from outside
+        uint64_t start = GetCurrentTimeInUs();
+        {
+            ThreadPool pool(threadNum);
+            pool.Start();
+            for (int i = 0; i < count; ++i)
+            {
+                pool.Submit(task);
+            }
+            pool.Stop();
+        }
+        uint64_t stealing = GetCurrentTimeInUs() - start;
+        start = GetCurrentTimeInUs();
+        {
+            MutexQueuePool pool(threadNum);
+            for (int i = 0; i < count; ++i)
+            {
+                pool.Submit(task);
+            }
+        }
+        uint64_t locked = GetCurrentTimeInUs() - start;
+
+        // Fork/join over 2^24 numbers, with 2^14 leaf tasks
+        std::vector<uint64_t> data(1 << 24, 1);
+        ThreadPool pool(threadNum);
+        pool.Start();
+        start = GetCurrentTimeInUs();
+        EXPECT_EQ(data.size(), runForkJoin(&pool, data));
+        uint64_t forkJoin = GetCurrentTimeInUs() - start;
+        pool.Stop();
+
+        fprintf(stderr, ">>> %d threads: ThreadPool %lu tasks/ms, MutexQueuePool %lu tasks/ms, "
+                "fork/join sum %luus\n",
+                threadNum, count * 1000UL / (stealing + 1), count * 1000UL / (locked + 1),
+                forkJoin);
+    }
+    EXPECT_EQ(8UL * count, counter);
+    delete task;
+}
@@ -0,0 +1,291 @@
+#include "src/thread/thread_pool.h"
+
+#include <limits.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "src/base/atomic_pointer.h"
+#include "src/common/assert.h"
+#include "src/sync/atomic.h"
+#include "src/sync/futex.h"
+
+namespace detail
+{
+
+WorkStealingDeque::WorkStealingDeque(size_t capacity)
+    : mMask(RingBufferCapacity(capacity) - 1),
+      mBuffer(new Task*[mMask + 1]),
+      mTop(0),
+      mBottom(0)
+{
+}
+
+WorkStealingDeque::~WorkStealingDeque()
+{
+    delete[] mBuffer;
+}
+
+bool WorkStealingDeque::Push(Task* task)
+{
+    int64_t bottom = mBottom;
+    // A stale top only underestimates the room.
+    if (bottom - AtomicGet(&mTop) > mMask)
+    {
+        return false;
+    }
+    mBuffer[bottom & mMask] = task;
+    MemoryBarrier();
+    AtomicSet(&mBottom, bottom + 1);
+    return true;
+}
+
+WorkStealingDeque::Task* WorkStealingDeque::Pop()
+{
+    int64_t bottom = mBottom - 1;
+    AtomicSet(&mBottom, bottom);
+    // The store above must be visible before reading top, or a thief and
+    // the owner might both take the last task.
+    __sync_synchronize();
+    int64_t top = AtomicGet(&mTop);
+    if (top > bottom)
+    {
+        AtomicSet(&mBottom, bottom + 1);
+        return NULL;
+    }
+    Task* task = mBuffer[bottom & mMask];
+    if (top == bottom)
+    {
+        // The last one, race with thieves for it.
+        if (!AtomicCompareExchange(&mTop, top + 1, top))
+        {
+            task = NULL;
+        }
+        AtomicSet(&mBottom, bottom + 1);
+    }
+    return task;
+}
+
+WorkStealingDeque::Task* WorkStealingDeque::Steal()
+{
+    int64_t top = AtomicGet(&mTop);
+    __sync_synchronize();
+    int64_t bottom = AtomicGet(&mBottom);
+    if (top >= bottom)
+    {
+        return NULL;
+    }
+    Task* task = mBuffer[top & mMask];
+    if (!AtomicCompareExchange(&mTop, top + 1, top))
+    {
+        return NULL;
+    }
+    return task;
+}
+
+size_t WorkStealingDeque::Size() const
+{
+    int64_t size = AtomicGet(&mBottom) - AtomicGet(&mTop);
+    return size < 0 ? 0 : size;
+}
+
+}  // namespace detail
+
+static __thread ThreadPool* tCurrentPool = NULL;
+static __thread int tCurrentWorkerIndex = -1;
+
+ThreadPool::ThreadPool(int threadNum, bool pinToCpu, size_t queueCapacity)
+    : mThreadNum(threadNum),
+      mPinToCpu(pinToCpu),
+      mStarted(false),
+      mStopping(false),
+      mInjection(queueCapacity),
+      mSleepers(0),
+      mWaking(0),
+      mWakeSequence(0)
+{
+    ASSERT(threadNum > 0);
+    for (int i = 0; i < threadNum; ++i)
+    {
+        mWorkers.push_back(new Worker(this, i));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    if (mStarted)
+    {
+        Stop();
+    }
+    for (size_t i = 0; i < mWorkers.size(); ++i)
+    {
+        delete mWorkers[i];
+    }
+}
+
+void ThreadPool::Start()
+{
+    ASSERT(!mStarted);
+    mStarted = true;
+    mStopping = false;
+    long cpuNum = sysconf(_SC_NPROCESSORS_ONLN);  // NOLINT(runtime/int)
+    for (int i = 0; i < mThreadNum; ++i)
+    {
+        Worker* worker = mWorkers[i];
+        CheckPthreadError(pthread_create(&worker->thread, NULL, workerMain, worker));
+        if (mPinToCpu && cpuNum > 0)
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(i % cpuNum, &cpuSet);
+            CheckPthreadError(pthread_setaffinity_np(worker->thread, sizeof(cpuSet), &cpuSet));
+        }
+    }
+}
+
+void ThreadPool::Stop()
+{
+    ASSERT(mStarted);
+    AtomicSet(&mStopping, true);
+    __sync_synchronize();
+    AtomicInc(&mWakeSequence);
+    FutexWake(&mWakeSequence, INT_MAX);
+    for (int i = 0; i < mThreadNum; ++i)
+    {
+        CheckPthreadError(pthread_join(mWorkers[i]->thread, NULL));
+    }
+    mStarted = false;
+}
+
+void ThreadPool::Submit(Task* task)
+{
+    while (!TrySubmit(task))
+    {
+        sched_yield();
+    }
+}
+
+bool ThreadPool::TrySubmit(Task* task)
+{
+    ASSERT_DEBUG(mStarted);
+    int index = GetCurrentWorkerIndex();
+    if (!(index >= 0 && mWorkers[index]->deque.Push(task)) && !mInjection.Push(task))
+    {
+        return false;
+    }
+    signal();
+    return true;
+}
+
+bool ThreadPool::RunPendingTask()
+{
+    int index = GetCurrentWorkerIndex();
+    Task* task = findTask(index >= 0 ? mWorkers[index] : NULL);
+    if (task == NULL)
+    {
+        return false;
+    }
+    task->Run();
+    return true;
+}
+
+int ThreadPool::GetCurrentWorkerIndex() const
+{
+    return tCurrentPool == this ? tCurrentWorkerIndex : -1;
+}
+
+void* ThreadPool::workerMain(void* arg)
+{
+    Worker* worker = static_cast<Worker*>(arg);
+    tCurrentPool = worker->pool;
+    tCurrentWorkerIndex = worker->index;
+    worker->pool->run(worker);
+    return NULL;
+}
+
+void ThreadPool::run(Worker* worker)
+{
+    int idleRounds = 0;
+    bool woken = false;
+    while (true)
+    {
+        Task* task = findTask(worker);
+        if (task != NULL)
+        {
+            if (woken)
+            {
+                // There might be more, pass the wakeup on.
+                signal();
+                woken = false;
+            }
+            task->Run();
+            idleRounds = 0;
+            continue;
+        }
+        if (++idleRounds < kSpinRounds)
+        {
+            asm volatile("pause");
+            continue;
+        }
+
+        // Register as a sleeper before the last look, see signal().
+        int32_t sequence = AtomicGet(&mWakeSequence);
+        AtomicInc(&mSleepers);
+        task = findTask(worker);
+        if (task == NULL)
+        {
+            if (AtomicGet(&mStopping))
+            {
+                AtomicDec(&mSleepers);
+                break;
+            }
+            FutexWait(&mWakeSequence, sequence);
+            woken = true;
+        }
+        AtomicDec(&mSleepers);
+        AtomicSet(&mWaking, 0U);
+        if (task != NULL)
+        {
+            task->Run();
+        }
+        idleRounds = 0;
+    }
+}
+
+ThreadPool::Task* ThreadPool::findTask(Worker* worker)
+{
+    Task* task = NULL;
+    if (worker != NULL && (task = worker->deque.Pop()) != NULL)
+    {
+        return task;
+    }
+    if (mInjection.Pop(&task))
+    {
+        return task;
+    }
+    // Steal, starting from a random victim to spread thieves.
+    int start = worker != NULL ? rand_r(&worker->randomSeed) % mThreadNum : 0;
+    for (int i = 0; i < mThreadNum; ++i)
+    {
+        Worker* victim = mWorkers[(start + i) % mThreadNum];
+        if (victim != worker && (task = victim->deque.Steal()) != NULL)
+        {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+void ThreadPool::signal()
+{
+    // Order the queue update before reading mSleepers, which is paired with
+    // the increment of a parking worker before its last findTask().  Only
+    // one wakeup is in flight at a time: until the woken worker is up, it
+    // will find the new tasks itself.
+    __sync_synchronize();
+    if (AtomicGet(&mSleepers) != 0 && AtomicCompareExchange(&mWaking, 1U, 0U))
+    {
+        AtomicInc(&mWakeSequence);
+        FutexWake(&mWakeSequence, 1);
+    }
+}
@@ -0,0 +1,158 @@
+#ifndef _SRC_THREAD_THREAD_POOL_H
+#define _SRC_THREAD_THREAD_POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <google/protobuf/stubs/callback.h>
+
+#include "src/common/macros.h"
+#include "src/sync/ring_buffer.h"
+
+namespace detail
+{
+
+/**
+ * Chase-Lev work-stealing deque of fixed capacity.  The owner pushes and
+ * pops at the bottom, any other thread steals from the top.
+ */
+class WorkStealingDeque
+{
+public:
+    typedef google::protobuf::Closure Task;
+
+    explicit WorkStealingDeque(size_t capacity);
+    ~WorkStealingDeque();
+
+    /** Owner only.  Return false if full. */
+    bool Push(Task* task);
+
+    /** Owner only.  Return the newest task, or NULL if empty. */
+    Task* Pop();
+
+    /** Any thread.  Return the oldest task, or NULL if empty or lost a race. */
+    Task* Steal();
+
+    size_t Size() const;
+
+private:
+    const int64_t mMask;
+    Task** const mBuffer;
+    char mBufferPadding[64 - 2 * sizeof(int64_t)];  // NOLINT(runtime/sizeof)
+    volatile int64_t mTop;
+    char mTopPadding[64 - sizeof(int64_t)];  // NOLINT(runtime/sizeof)
+    volatile int64_t mBottom;
+    char mBottomPadding[64 - sizeof(int64_t)];  // NOLINT(runtime/sizeof)
+
+    DISALLOW_COPY_AND_ASSIGN(WorkStealingDeque);
+};
+
+}  // namespace detail
+
+/**
+ * A work-stealing thread pool.
+ *
+ * Every worker owns a Chase-Lev deque.  Tasks submitted by a worker go to
+ * its own deque and are run newest first, which keeps fork/join workloads
+ * cache-friendly; tasks submitted by other threads go to a global bounded
+ * injection queue.  An idle worker looks at its own deque, the injection
+ * queue, and then steals the oldest task of the other workers.  When there
+ * is nothing to run it spins for a while and parks on a futex; submitters
+ * only make a system call when some worker is parked.
+ *
+ * Tasks are google::protobuf::Closure, so stone::Closure<void> created by
+ * NewClosure() (self-deleting) or NewPermanentClosure() can be submitted.
+ *
+ * Usage:
+ *   ThreadPool pool(8);
+ *   pool.Start();
+ *   pool.Submit(stone::NewClosure(&handler, &Handler::Process, request));
+ *   ...
+ *   pool.Stop();        // runs what is queued, then joins the workers
+ */
+class ThreadPool
+{
+public:
+    typedef google::protobuf::Closure Task;
+
+    /**
+     * @param threadNum       number of workers
+     * @param pinToCpu        pin worker 'i' to CPU 'i % number of CPUs'
+     * @param queueCapacity   capacity of the injection queue
+     */
+    explicit ThreadPool(int threadNum, bool pinToCpu = false, size_t queueCapacity = 65536);
+
+    /** Stop() if not yet. */
+    ~ThreadPool();
+
+    void Start();
+
+    /** Wait until all submitted tasks are run, and join the workers. */
+    void Stop();
+
+    /**
+     * Queue 'task' to run on some worker.  Block (yielding) while the
+     * injection queue is full.
+     */
+    void Submit(Task* task);
+
+    /** Like Submit(), but return false instead of blocking. */
+    bool TrySubmit(Task* task);
+
+    /**
+     * Run one queued task in the calling thread, return false if there was
+     * none.  A worker waiting for subtasks (fork/join) calls this rather
+     * than blocking, so it helps instead of starving the pool.
+     */
+    bool RunPendingTask();
+
+    int GetThreadNum() const { return mThreadNum; }
+
+    /** The index of the calling worker of this pool, or -1. */
+    int GetCurrentWorkerIndex() const;
+
+private:
+    enum
+    {
+        kDequeCapacity = 4096,      // Overflows into the injection queue
+        kSpinRounds = 64,           // Rounds of findTask() before parking
+    };
+
+    struct Worker
+    {
+        Worker(ThreadPool* p, int i)
+            : pool(p), index(i), deque(kDequeCapacity), thread(0), randomSeed(i + 1) {}
+
+        ThreadPool* pool;
+        int index;
+        detail::WorkStealingDeque deque;
+        pthread_t thread;
+        uint32_t randomSeed;
+    };
+
+    static void* workerMain(void* arg);
+    void run(Worker* worker);
+    Task* findTask(Worker* worker);
+    void signal();
+
+    const int mThreadNum;
+    const bool mPinToCpu;
+    bool mStarted;
+    volatile bool mStopping;
+    std::vector<Worker*> mWorkers;
+    MpmcRingBuffer<Task*> mInjection;
+
+    // Parking: a worker reads mWakeSequence, registers in mSleepers, checks
+    // queues again, and sleeps on mWakeSequence which submitters bump.
+    // mWaking is set while a woken worker is not up yet.
+    char mParkingPadding[64];
+    volatile uint32_t mSleepers;
+    volatile uint32_t mWaking;
+    volatile int32_t mWakeSequence;
+
+    DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+#endif  // _SRC_THREAD_THREAD_POOL_H